@@ -0,0 +1,225 @@
+#include "http/SocketPoll.h"
+#include "http/SocketServer.h"
+
+#include <math.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * accept load balancing among forked workers.
+ *
+ * usage: accept_bh [shared|exclusive|reuseport] [workers] [connections] [port]
+ *
+ * every worker watches its listen socket with SocketPoll the way SocketServer does,
+ * and counts the connections it accepts and how many times it is woken up.
+ */
+
+enum BenchStrategy
+{
+    BS_SHARED,
+    BS_EXCLUSIVE,
+    BS_REUSEPORT,
+};
+
+struct WorkerStat
+{
+    int pid;
+    long accepts;
+    long wakeups;
+    long spurious; // woken up but nothing to accept
+};
+
+static volatile sig_atomic_t gs_stop = 0;
+
+static void OnStop(int)
+{
+    gs_stop = 1;
+}
+
+static void RunWorker(int listen_fd, BenchStrategy strategy, const char* host, int port, int report, int ready)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnStop;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    if (strategy == BS_REUSEPORT) listen_fd = ListenTo(host, port, true);
+
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "worker %d failed to listen\n", getpid());
+        _exit(1);
+    }
+
+    SocketPoll poll;
+    SocketPoll::SetSocketNonBlocking(listen_fd);
+    poll.AddListenSocket(listen_fd, &listen_fd, strategy == BS_EXCLUSIVE);
+
+    char c = 1;
+    write(ready, &c, 1);
+
+    WorkerStat stat;
+    memset(&stat, 0, sizeof(stat));
+    stat.pid = getpid();
+
+    PollEvent events[64];
+
+    while (!gs_stop)
+    {
+        int n = poll.WaitAll(events, 64);
+        if (n <= 0) continue;
+
+        ++stat.wakeups;
+
+        int accepted = 0;
+        while (1)
+        {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd < 0) break;
+
+            close(fd);
+            ++accepted;
+        }
+
+        if (accepted == 0) ++stat.spurious;
+
+        stat.accepts += accepted;
+    }
+
+    write(report, &stat, sizeof(stat));
+    _exit(0);
+}
+
+static int ConnectTo(const char* host, int port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &addr.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* host = "127.0.0.1";
+
+    BenchStrategy strategy = BS_SHARED;
+    int workers = 4;
+    int conns = 20000;
+    int port = 19527;
+
+    if (argc >= 2)
+    {
+        if (strcmp(argv[1], "exclusive") == 0) strategy = BS_EXCLUSIVE;
+        else if (strcmp(argv[1], "reuseport") == 0) strategy = BS_REUSEPORT;
+    }
+
+    if (argc >= 3) workers = atoi(argv[2]);
+    if (argc >= 4) conns = atoi(argv[3]);
+    if (argc >= 5) port = atoi(argv[4]);
+
+    static const char* names[] = { "shared", "exclusive", "reuseport" };
+
+    int listen_fd = -1;
+    if (strategy != BS_REUSEPORT)
+    {
+        listen_fd = ListenTo(host, port);
+        if (listen_fd < 0)
+        {
+            fprintf(stderr, "failed to listen to %s:%d\n", host, port);
+            return 1;
+        }
+    }
+
+    int report[2], ready[2];
+    if (pipe(report) != 0 || pipe(ready) != 0) return 1;
+
+    int* pids = new int[workers];
+    for (int i = 0; i < workers; ++i)
+    {
+        pids[i] = fork();
+        if (pids[i] == 0) RunWorker(listen_fd, strategy, host, port, report[1], ready[1]);
+    }
+
+    for (int i = 0; i < workers; ++i)
+    {
+        char c;
+        read(ready[0], &c, 1);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < conns; ++i)
+    {
+        int fd = ConnectTo(host, port);
+        if (fd < 0)
+        {
+            ++failed;
+            continue;
+        }
+
+        close(fd);
+    }
+
+    // let workers drain their backlog.
+    usleep(500*1000);
+
+    for (int i = 0; i < workers; ++i) kill(pids[i], SIGUSR1);
+
+    WorkerStat* stats = new WorkerStat[workers];
+    for (int i = 0; i < workers; ++i)
+    {
+        read(report[0], &stats[i], sizeof(WorkerStat));
+        waitpid(pids[i], NULL, 0);
+    }
+
+    long total = 0, wakeups = 0, spurious = 0;
+    long min = conns, max = 0;
+    double sum_sq = 0;
+
+    printf("strategy:%s, workers:%d, connections:%d, failed:%d\n", names[strategy], workers, conns, failed);
+    printf("%8s %10s %10s %10s\n", "pid", "accepts", "wakeups", "spurious");
+
+    for (int i = 0; i < workers; ++i)
+    {
+        printf("%8d %10ld %10ld %10ld\n", stats[i].pid, stats[i].accepts, stats[i].wakeups, stats[i].spurious);
+
+        total    += stats[i].accepts;
+        wakeups  += stats[i].wakeups;
+        spurious += stats[i].spurious;
+        sum_sq   += (double)stats[i].accepts * stats[i].accepts;
+
+        if (stats[i].accepts < min) min = stats[i].accepts;
+        if (stats[i].accepts > max) max = stats[i].accepts;
+    }
+
+    // jain's fairness index, 1.0 means perfectly even.
+    double fairness = sum_sq > 0? (double)total * total / (workers * sum_sq) : 0;
+
+    printf("accepted:%ld, min:%ld, max:%ld, fairness:%.4f\n", total, min, max, fairness);
+    printf("wakeups per connection:%.3f, spurious wakeups:%ld\n",
+            total? (double)wakeups / total : 0, spurious);
+
+    delete[] stats;
+    delete[] pids;
+
+    return 0;
+}
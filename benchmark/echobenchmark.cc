@@ -0,0 +1,369 @@
+#include "http/SocketServer.h"
+#include "sys/Clock.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+ * echo over tcp loopback vs unix domain socket, served by epoll or io_uring backend,
+ * and by epoll with busy polling, which reports how long it spun against slept.
+ *
+ * usage: echo_bh [round trips] [megabytes] [message size]
+ *
+ * a forked process echoes with SocketServer, the client measures
+ * round trip latency of small messages on one connection, then
+ * throughput of streaming data through the echo.
+ */
+
+static void RunEchoServer(int listen_fd, SocketBackend backend, int spin, int report)
+{
+    SocketServer server(backend);
+    server.SetBusyPoll(spin);
+    server.SetWatchAcceptedSock(true);
+    server.WatchRawSocket(listen_fd, true);
+
+    std::map<SocketConnection*, std::string> pending;
+    std::vector<char> buf(64*1024);
+    int handled = 0;
+
+    while (true)
+    {
+        SocketEvent evt;
+        server.RunPoll(&evt);
+
+        if (evt.code != SC_READ && evt.code != SC_WRITE) continue;
+
+        SocketConnection* conn = evt.conn;
+        std::string& out = pending[conn];
+
+        if (spin > 0 && report >= 0 && (++handled & 255) == 0)
+        {
+            PollStats stats = server.GetPollStats();
+            write(report, &stats, sizeof(stats));
+        }
+
+        if (!out.empty())
+        {
+            int n = conn->SendBuffer(out.c_str(), out.size());
+            if (n < 0)
+            {
+                pending.erase(conn);
+                conn->CloseConnection();
+                continue;
+            }
+
+            out.erase(0, n);
+
+            // stop reading until the peer takes what is echoed.
+            if (!out.empty())
+            {
+                conn->WatchEvent(false, true);
+                continue;
+            }
+        }
+
+        int n = conn->ReadBuffer(&buf[0], buf.size());
+        if (n < 0)
+        {
+            pending.erase(conn);
+            conn->CloseConnection();
+            continue;
+        }
+
+        if (n == 0) continue;
+
+        int sent = conn->SendBuffer(&buf[0], n);
+        if (sent < 0)
+        {
+            pending.erase(conn);
+            conn->CloseConnection();
+            continue;
+        }
+
+        if (sent < n)
+        {
+            out.assign(&buf[sent], n - sent);
+            conn->WatchEvent(false, true);
+        }
+    }
+}
+
+static int ConnectBlocking(const char* host, int port)
+{
+    int fd = -1;
+
+    if (strncmp(host, "unix:", 5) == 0)
+    {
+        const char* name = host + 5;
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, name, sizeof(addr.sun_path) - 1);
+
+        socklen_t len = sizeof(addr);
+        if (name[0] == '@')
+        {
+            addr.sun_path[0] = '\0';
+            len = offsetof(struct sockaddr_un, sun_path) + strlen(name);
+        }
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, len) == 0) return fd;
+    }
+    else
+    {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, host, &addr.sin_addr);
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+    }
+
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+static bool ReadFull(int fd, char* buf, size_t sz)
+{
+    while (sz > 0)
+    {
+        int n = read(fd, buf, sz);
+        if (n <= 0) return false;
+
+        buf += n;
+        sz -= n;
+    }
+
+    return true;
+}
+
+static bool WriteFull(int fd, const char* buf, size_t sz)
+{
+    while (sz > 0)
+    {
+        int n = write(fd, buf, sz);
+        if (n <= 0) return false;
+
+        buf += n;
+        sz -= n;
+    }
+
+    return true;
+}
+
+struct StreamArg
+{
+    int fd;
+    size_t total;
+};
+
+static void* StreamWriter(void* arg)
+{
+    StreamArg* stream = (StreamArg*)arg;
+
+    std::vector<char> buf(64*1024, 'x');
+    size_t left = stream->total;
+
+    while (left > 0)
+    {
+        size_t sz = std::min(left, buf.size());
+        if (!WriteFull(stream->fd, &buf[0], sz)) break;
+
+        left -= sz;
+    }
+
+    return NULL;
+}
+
+static void RunClient(const char* name, const char* host, int port, int rounds, int megabytes, int msg_size, int report)
+{
+    int fd = ConnectBlocking(host, port);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: failed to connect\n", name);
+        return;
+    }
+
+    std::vector<char> msg(msg_size, 'm');
+    std::vector<int64_t> rtt;
+    rtt.reserve(rounds);
+
+    for (int i = 0; i < rounds; ++i)
+    {
+        int64_t start = MonotonicMicroSec();
+
+        if (!WriteFull(fd, &msg[0], msg.size()) || !ReadFull(fd, &msg[0], msg.size()))
+        {
+            fprintf(stderr, "%s: echo failed\n", name);
+            close(fd);
+            return;
+        }
+
+        rtt.push_back(MonotonicMicroSec() - start);
+    }
+
+    std::sort(rtt.begin(), rtt.end());
+
+    double sum = 0;
+    for (size_t i = 0; i < rtt.size(); ++i) sum += rtt[i];
+
+    StreamArg stream = { fd, (size_t)megabytes * 1024 * 1024 };
+
+    int64_t start = MonotonicMicroSec();
+
+    pthread_t writer;
+    pthread_create(&writer, NULL, StreamWriter, &stream);
+
+    std::vector<char> buf(64*1024);
+    size_t received = 0;
+
+    while (received < stream.total)
+    {
+        int n = read(fd, &buf[0], buf.size());
+        if (n <= 0) break;
+
+        received += n;
+    }
+
+    pthread_join(writer, NULL);
+
+    double sec = (MonotonicMicroSec() - start) / 1e6;
+
+    printf("%-12s rtt avg:%7.2fus p50:%5ldus p99:%5ldus  throughput:%9.2f MB/s",
+            name, rtt.empty()? 0 : sum / rtt.size(),
+            rtt.empty()? 0L : (long)rtt[rtt.size() / 2],
+            rtt.empty()? 0L : (long)rtt[rtt.size() * 99 / 100],
+            received / (1024.0 * 1024.0) / sec);
+
+    // latest stats of the server, it keeps writing them without blocking.
+    PollStats stats;
+    bool got = false;
+    while (report >= 0 && read(report, &stats, sizeof(stats)) == (int)sizeof(stats)) got = true;
+
+    if (got)
+    {
+        printf("  spin hits:%lu sleeps:%lu spin/sleep time:%.2f",
+                (unsigned long)stats.spinHits, (unsigned long)stats.sleeps,
+                stats.sleepTime? (double)stats.spinTime / stats.sleepTime : 0.0);
+    }
+
+    printf("\n");
+
+    close(fd);
+}
+
+static void Bench(const char* name, const char* host, int port, SocketBackend backend,
+        int spin, int rounds, int megabytes, int msg_size)
+{
+    if (backend == SB_IO_URING)
+    {
+        SocketServer probe(backend);
+        if (probe.GetBackend() != backend)
+        {
+            fprintf(stderr, "%s: io_uring is not supported\n", name);
+            return;
+        }
+    }
+
+    int listen_fd = ListenTo(host, port);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "%s: failed to listen to %s\n", name, host);
+        return;
+    }
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    // port is picked by system for tcp.
+    if (strncmp(host, "unix:", 5) != 0 && getsockname(listen_fd, (struct sockaddr*)&addr, &len) == 0)
+    {
+        port = ntohs(addr.sin_port);
+    }
+
+    // stats of busy polling are passed back by a pipe, dropped when it is full.
+    int report[2] = { -1, -1 };
+    if (spin > 0 && pipe(report) == 0)
+    {
+        fcntl(report[0], F_SETFL, O_NONBLOCK);
+        fcntl(report[1], F_SETFL, O_NONBLOCK);
+    }
+
+    int pid = fork();
+    if (pid == 0)
+    {
+        RunEchoServer(listen_fd, backend, spin, report[1]);
+        _exit(0);
+    }
+
+    close(listen_fd);
+    if (report[1] >= 0) close(report[1]);
+
+    RunClient(name, host, port, rounds, megabytes, msg_size, report[0]);
+
+    if (report[0] >= 0) close(report[0]);
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = 100000;
+    int megabytes = 1024;
+    int msg_size = 64;
+
+    if (argc >= 2) rounds = atoi(argv[1]);
+    if (argc >= 3) megabytes = atoi(argv[2]);
+    if (argc >= 4) msg_size = atoi(argv[3]);
+
+    if (rounds <= 0 || megabytes <= 0 || msg_size <= 0)
+    {
+        fprintf(stderr, "usage: echo_bh [round trips] [megabytes] [message size]\n");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("round trips:%d, message size:%d, streamed:%dMB\n", rounds, msg_size, megabytes);
+
+    char unix_addr[64];
+    snprintf(unix_addr, sizeof(unix_addr), "unix:@echo_bh_%d", (int)getpid());
+
+    Bench("tcp", "127.0.0.1", 0, SB_EPOLL, 0, rounds, megabytes, msg_size);
+    Bench("unix", unix_addr, 0, SB_EPOLL, 0, rounds, megabytes, msg_size);
+    Bench("tcp/uring", "127.0.0.1", 0, SB_IO_URING, 0, rounds, megabytes, msg_size);
+    Bench("unix/uring", unix_addr, 0, SB_IO_URING, 0, rounds, megabytes, msg_size);
+    Bench("tcp/spin", "127.0.0.1", 0, SB_EPOLL, 50, rounds, megabytes, msg_size);
+    Bench("unix/spin", unix_addr, 0, SB_EPOLL, 50, rounds, megabytes, msg_size);
+
+    return 0;
+}
+
@@ -0,0 +1,299 @@
+#include "http/RpcChannel.h"
+#include "http/SocketServer.h"
+#include "sys/Clock.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * framed rpc over tcp loopback and unix domain socket, served by epoll or io_uring backend.
+ *
+ * usage: rpc_bh [calls] [window] [message size]
+ *
+ * a forked process echoes requests by RpcChannel, the client measures latency of
+ * calls made one at a time, then messages/sec and latency of calls pipelined with
+ * window of them in flight, which are batched into a write per event by both ends.
+ */
+
+static void EchoRequest(void* arg, RpcChannel* channel, const RpcMessage& msg)
+{
+    (void)arg;
+
+    if (msg.type_ == RMT_REQUEST) channel->Reply(msg.id_, msg.data_, msg.size_);
+}
+
+static void RunRpcServer(int listen_fd, SocketBackend backend)
+{
+    SocketServer server(backend);
+    server.SetWatchAcceptedSock(true);
+    server.WatchRawSocket(listen_fd, true);
+
+    std::map<SocketConnection*, RpcChannel*> channels;
+
+    while (true)
+    {
+        SocketEvent evt;
+        server.RunPoll(&evt);
+
+        if (evt.code == SC_ACCEPTED)
+        {
+            RpcChannel* channel = new RpcChannel(evt.conn);
+            channel->SetRequestHandler(&EchoRequest, NULL);
+
+            channels[evt.conn] = channel;
+            continue;
+        }
+
+        if (evt.code != SC_READ && evt.code != SC_WRITE) continue;
+
+        std::map<SocketConnection*, RpcChannel*>::iterator it = channels.find(evt.conn);
+        if (it == channels.end()) continue;
+
+        if (it->second->ProcessEvent(evt) < 0)
+        {
+            delete it->second;
+            channels.erase(it);
+        }
+    }
+}
+
+struct CallState
+{
+    RpcChannel* channel;
+    std::string msg;
+
+    int total;
+    int window;
+    int issued;
+    int done;
+    bool failed;
+
+    // start time of calls by id, and latency of calls done.
+    std::vector<int64_t> start;
+    std::vector<int64_t> latency;
+};
+
+static void IssueCalls(CallState* st);
+
+static void OnReply(void* arg, int status, const RpcMessage& reply)
+{
+    CallState* st = (CallState*)arg;
+
+    if (status != RS_OK)
+    {
+        st->failed = true;
+        return;
+    }
+
+    st->latency.push_back(MonotonicMicroSec() - st->start[reply.id_]);
+    ++st->done;
+
+    // window is kept full, calls made here go out by the flush of this event.
+    IssueCalls(st);
+}
+
+static void IssueCalls(CallState* st)
+{
+    while (st->issued < st->total && st->issued - st->done < st->window)
+    {
+        uint64_t id = st->channel->Call(st->msg.data(), st->msg.size(), &OnReply, st);
+        if (id == 0)
+        {
+            st->failed = true;
+            return;
+        }
+
+        if (st->start.size() <= id) st->start.resize(id * 2 + 1);
+
+        st->start[id] = MonotonicMicroSec();
+        ++st->issued;
+    }
+}
+
+static bool RunCalls(SocketServer& server, RpcChannel& channel, CallState* st)
+{
+    IssueCalls(st);
+    channel.Flush();
+
+    while (st->done < st->total && !st->failed)
+    {
+        SocketEvent evt;
+        server.RunPoll(&evt);
+
+        if (evt.code != SC_READ && evt.code != SC_WRITE) continue;
+        if (channel.ProcessEvent(evt) < 0) return false;
+    }
+
+    return !st->failed;
+}
+
+static int64_t Percentile(const std::vector<int64_t>& sorted, int permille)
+{
+    if (sorted.empty()) return 0;
+
+    return sorted[std::min(sorted.size() - 1, sorted.size() * permille / 1000)];
+}
+
+static void RunClient(const char* name, const char* host, int port, SocketBackend backend,
+        int calls, int window, int msg_size)
+{
+    SocketServer server(backend);
+
+    SocketConnection* conn = server.ConnectTo(host, port);
+    if (conn == NULL)
+    {
+        fprintf(stderr, "%s: failed to connect\n", name);
+        return;
+    }
+
+    while (!conn->IsConnected())
+    {
+        SocketEvent evt;
+        server.RunPoll(&evt);
+
+        if (evt.code == SC_FAIL_CONN)
+        {
+            fprintf(stderr, "%s: failed to connect\n", name);
+            return;
+        }
+    }
+
+    RpcChannel channel(conn);
+
+    // one at a time, round trip latency.
+    CallState serial;
+    serial.channel = &channel;
+    serial.msg.assign(msg_size, 'm');
+    serial.total = std::max(calls / 10, 1);
+    serial.window = 1;
+    serial.issued = 0;
+    serial.done = 0;
+    serial.failed = false;
+
+    if (!RunCalls(server, channel, &serial))
+    {
+        fprintf(stderr, "%s: calls failed\n", name);
+        return;
+    }
+
+    RpcStats before = channel.GetStats();
+
+    CallState pipelined = serial;
+    pipelined.total = calls;
+    pipelined.window = window;
+    pipelined.issued = 0;
+    pipelined.done = 0;
+    pipelined.latency.clear();
+    pipelined.latency.reserve(calls);
+
+    int64_t start = MonotonicMicroSec();
+
+    if (!RunCalls(server, channel, &pipelined))
+    {
+        fprintf(stderr, "%s: calls failed\n", name);
+        return;
+    }
+
+    double sec = (MonotonicMicroSec() - start) / 1e6;
+
+    RpcStats stats = channel.GetStats();
+    int64_t writes = stats.writes - before.writes;
+
+    std::sort(serial.latency.begin(), serial.latency.end());
+    std::sort(pipelined.latency.begin(), pipelined.latency.end());
+
+    printf("%-11s serial p50:%4ldus p99:%5ldus | pipelined %9.0f msg/s p50:%5ldus p99:%5ldus p999:%6ldus calls/write:%.1f\n",
+            name, (long)Percentile(serial.latency, 500), (long)Percentile(serial.latency, 990),
+            calls / sec, (long)Percentile(pipelined.latency, 500), (long)Percentile(pipelined.latency, 990),
+            (long)Percentile(pipelined.latency, 999),
+            writes? (double)(stats.sent - before.sent) / writes : 0.0);
+
+    channel.Close();
+}
+
+static void Bench(const char* name, const char* host, SocketBackend backend, int calls, int window, int msg_size)
+{
+    if (backend == SB_IO_URING)
+    {
+        SocketServer probe(backend);
+        if (probe.GetBackend() != backend)
+        {
+            fprintf(stderr, "%s: io_uring is not supported\n", name);
+            return;
+        }
+    }
+
+    int listen_fd = ListenTo(host, 0);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "%s: failed to listen to %s\n", name, host);
+        return;
+    }
+
+    int port = 0;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    // port is picked by system for tcp.
+    if (strncmp(host, "unix:", 5) != 0 && getsockname(listen_fd, (struct sockaddr*)&addr, &len) == 0)
+    {
+        port = ntohs(addr.sin_port);
+    }
+
+    int pid = fork();
+    if (pid == 0)
+    {
+        RunRpcServer(listen_fd, backend);
+        _exit(0);
+    }
+
+    close(listen_fd);
+
+    RunClient(name, host, port, backend, calls, window, msg_size);
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char* argv[])
+{
+    int calls = 1000000;
+    int window = 128;
+    int msg_size = 64;
+
+    if (argc >= 2) calls = atoi(argv[1]);
+    if (argc >= 3) window = atoi(argv[2]);
+    if (argc >= 4) msg_size = atoi(argv[3]);
+
+    if (calls <= 0 || window <= 0 || msg_size < 0)
+    {
+        fprintf(stderr, "usage: rpc_bh [calls] [window] [message size]\n");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("calls:%d, window:%d, message size:%d\n", calls, window, msg_size);
+
+    char unix_addr[64];
+    snprintf(unix_addr, sizeof(unix_addr), "unix:@rpc_bh_%d", (int)getpid());
+
+    Bench("tcp", "127.0.0.1", SB_EPOLL, calls, window, msg_size);
+    Bench("unix", unix_addr, SB_EPOLL, calls, window, msg_size);
+    Bench("tcp/uring", "127.0.0.1", SB_IO_URING, calls, window, msg_size);
+    Bench("unix/uring", unix_addr, SB_IO_URING, calls, window, msg_size);
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "http/SocketServer.h"
+#include "sys/Clock.h"
+
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * udp datagrams over loopback, read in batches by SocketServer.
+ *
+ * usage: udp_bh [rounds] [datagram size]
+ *
+ * each round sends a burst of datagrams that fits in the receive buffer of
+ * the server, then times the server reading all of it, for each batch size.
+ * only the receiving side is timed, so that it doesn't matter how many cpus
+ * are there for sender and receiver.
+ */
+
+static void SendBurst(int fd, int num, int size)
+{
+    std::vector<char> data(size, 'u');
+    struct mmsghdr msgs[64];
+    struct iovec iov[64];
+
+    for (int i = 0; i < 64; ++i)
+    {
+        iov[i].iov_base = &data[0];
+        iov[i].iov_len  = size;
+
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (num > 0)
+    {
+        int n = sendmmsg(fd, msgs, num < 64? num : 64, 0);
+        if (n <= 0) break;
+
+        num -= n;
+    }
+}
+
+static void Bench(int batch, int rounds, int size)
+{
+    SocketServer server;
+    server.SetDatagramBatch(batch, size);
+
+    int fd = server.BindUdp("127.0.0.1", 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "failed to bind udp socket\n");
+        return;
+    }
+
+    int rcvbuf = 4 * 1024 * 1024;
+    socklen_t len = sizeof(rcvbuf);
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len);
+
+    // kernel charges about 1KB on top of each datagram, leave half of buffer spare.
+    int burst = rcvbuf / (size + 1024) / 2;
+    if (burst > 4096) burst = 4096;
+
+    struct sockaddr_in addr;
+    len = sizeof(addr);
+    getsockname(fd, (struct sockaddr*)&addr, &len);
+
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    if (burst <= 0 || sender < 0 || connect(sender, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "failed to set up sender\n");
+        if (sender >= 0) close(sender);
+        return;
+    }
+
+    int64_t datagrams = 0;
+    int64_t events = 0;
+    int64_t elapsed = 0;
+
+    for (int i = 0; i < rounds; ++i)
+    {
+        SendBurst(sender, burst, size);
+
+        int received = 0;
+        int64_t start = MonotonicMicroSec();
+
+        while (received < burst)
+        {
+            SocketEvent evt;
+            server.RunPoll(&evt);
+
+            if (evt.code != SC_DATAGRAM) continue;
+
+            received += evt.count;
+            ++events;
+        }
+
+        elapsed += MonotonicMicroSec() - start;
+        datagrams += received;
+    }
+
+    close(sender);
+
+    double sec = elapsed / 1e6;
+
+    printf("batch:%4d  burst:%5d  datagrams/s:%10.0f  MB/s:%8.2f  datagrams per read:%7.2f\n",
+            batch, burst, datagrams / sec, datagrams * (double)size / (1024 * 1024) / sec,
+            events? (double)datagrams / events : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = 200;
+    int size = 64;
+
+    if (argc >= 2) rounds = atoi(argv[1]);
+    if (argc >= 3) size = atoi(argv[2]);
+
+    if (rounds <= 0 || size <= 0 || size > 65507)
+    {
+        fprintf(stderr, "usage: udp_bh [rounds] [datagram size]\n");
+        return 1;
+    }
+
+    printf("rounds:%d, datagram size:%d\n", rounds, size);
+
+    const int batches[] = {1, 4, 16, 64, 256};
+
+    for (size_t i = 0; i < sizeof(batches)/sizeof(batches[0]); ++i)
+    {
+        Bench(batches[i], rounds, size);
+    }
+
+    return 0;
+}
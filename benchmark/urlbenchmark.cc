@@ -0,0 +1,157 @@
+#include "http/HttpUrl.h"
+#include "http/HttpArena.h"
+#include "sys/Clock.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * splitting request target and reading its query parameters.
+ *
+ * usage: url_bh [rounds]
+ *
+ * "split" is what HttpClient used to do: path and query copied to std::string,
+ * a handler wanting parameters then splits and decodes the query into a map.
+ * "view" parses the target in place by HttpUrl and decodes into an arena that is
+ * reset per request, as HttpClient does now.
+ * both look up the same parameters of the same targets.
+ */
+
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+    return -1;
+}
+
+static std::string DecodeString(const std::string& str)
+{
+    std::string out;
+
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        if (str[i] == '+')
+        {
+            out.push_back(' ');
+        }
+        else if (str[i] == '%' && i + 2 < str.size())
+        {
+            out.push_back((char)(HexValue(str[i + 1]) << 4 | HexValue(str[i + 2])));
+            i += 2;
+        }
+        else
+        {
+            out.push_back(str[i]);
+        }
+    }
+
+    return out;
+}
+
+static size_t SplitTarget(const std::string& target, const char* key)
+{
+    size_t q = target.find('?');
+
+    std::string url = target.substr(0, q);
+    std::string data = q == std::string::npos? "" : target.substr(q + 1);
+
+    std::map<std::string, std::string> params;
+
+    size_t start = 0;
+    while (start < data.size())
+    {
+        size_t amp = data.find('&', start);
+        if (amp == std::string::npos) amp = data.size();
+
+        std::string pair = data.substr(start, amp - start);
+        size_t eq = pair.find('=');
+
+        if (eq == std::string::npos) params[DecodeString(pair)] = "";
+        else params[DecodeString(pair.substr(0, eq))] = DecodeString(pair.substr(eq + 1));
+
+        start = amp + 1;
+    }
+
+    std::map<std::string, std::string>::const_iterator it = params.find(key);
+
+    return url.size() + (it == params.end()? 0 : it->second.size());
+}
+
+static size_t ViewTarget(const std::string& target, const char* key, HttpArena* arena)
+{
+    HttpUrl url;
+    if (!url.Parse(target.data(), target.size())) return 0;
+
+    HttpStrRef raw, value;
+    if (url.FindParam(key, &raw)) HttpUrl::Decode(arena, raw, true, &value);
+
+    size_t sz = url.GetPath().len_ + value.len_;
+
+    arena->Reset();
+
+    return sz;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = 200000;
+
+    if (argc >= 2) rounds = atoi(argv[1]);
+
+    if (rounds <= 0)
+    {
+        fprintf(stderr, "usage: url_bh [rounds]\n");
+        return 1;
+    }
+
+    std::vector<std::string> targets;
+    targets.push_back("/index.html");
+    targets.push_back("/api/v1/users/12345/profile?fields=name,email&lang=en");
+    targets.push_back("/search?q=hello+world%21&page=3&size=20&sort=relevance&safe=on&ref=home");
+    targets.push_back("/static/js/vendor/app.3f9a2b7c1d.min.js?v=20240101");
+    targets.push_back("/track?uid=a1b2c3d4e5&evt=click&ts=1700000000000&url=https%3A%2F%2Fexample.com%2Fa%2Fb&x=1&y=2");
+
+    printf("rounds:%d, targets:%d\n", rounds, (int)targets.size());
+
+    HttpArena arena;
+
+    const char* keys[] = { "q", "url", "none" };
+
+    for (size_t k = 0; k < sizeof(keys)/sizeof(keys[0]); ++k)
+    {
+        size_t check[2] = {0, 0};
+        int64_t elapsed[2] = {0, 0};
+
+        int64_t start = MonotonicMicroSec();
+        for (int i = 0; i < rounds; ++i)
+        {
+            check[0] += SplitTarget(targets[i % targets.size()], keys[k]);
+        }
+
+        elapsed[0] = MonotonicMicroSec() - start;
+
+        start = MonotonicMicroSec();
+        for (int i = 0; i < rounds; ++i)
+        {
+            check[1] += ViewTarget(targets[i % targets.size()], keys[k], &arena);
+        }
+
+        elapsed[1] = MonotonicMicroSec() - start;
+
+        const char* names[] = { "split", "view" };
+        for (int m = 0; m < 2; ++m)
+        {
+            printf("key:%-5s %-6s ns/target:%8.1f  targets/s:%12.0f  check:%zu\n", keys[k], names[m],
+                    elapsed[m] * 1000.0 / rounds, elapsed[m]? rounds * 1e6 / elapsed[m] : 0.0, check[m]);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include "DnsResolver.h"
+
+#include "sys/Log.h"
+#include "sys/Clock.h"
+#include "sys/AtomicOps.h"
+#include "thread/Thread.h"
+
+#include <netdb.h>
+#include <string.h>
+#include <netinet/in.h>
+
+const int DnsResolver::max_cache_size = 4096;
+
+class DnsResolver::ResolveThread: public ThreadBase
+{
+    public:
+
+        explicit ResolveThread(DnsResolver* resolver): resolver_(resolver) {}
+
+    protected:
+
+        virtual void Run() { resolver_->RunResolver(); }
+
+    private:
+
+        DnsResolver* resolver_;
+};
+
+DnsResolver::DnsResolver(int threads, int ttl, int negativeTtl)
+    :ttl_(ttl)
+    ,negativeTtl_(negativeTtl)
+    ,stop_(false)
+    ,lookups_(0)
+{
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&cond_, NULL);
+
+    if (threads <= 0) threads = 1;
+
+    for (int i = 0; i < threads; ++i)
+    {
+        ThreadBase* thread = new ResolveThread(this);
+
+        if (!thread->Start())
+        {
+            slog(LOG_ERROR, "dns: failed to start resolver thread");
+            delete thread;
+            continue;
+        }
+
+        threads_.push_back(thread);
+    }
+}
+
+DnsResolver::~DnsResolver()
+{
+    pthread_mutex_lock(&lock_);
+    stop_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+
+    for (size_t i = 0; i < threads_.size(); ++i)
+    {
+        threads_[i]->Join();
+        delete threads_[i];
+    }
+
+    std::vector<DnsAddress> none;
+    std::map<std::string, std::vector<DnsQuery*> >::iterator it;
+
+    for (it = waiting_.begin(); it != waiting_.end(); ++it)
+    {
+        Finish(it->second, EAI_SYSTEM, none);
+    }
+
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&lock_);
+}
+
+int DnsResolver::Lookup(const std::string& host, std::vector<DnsAddress>& addrs, int* error)
+{
+    int64_t now = MonotonicMicroSec();
+
+    pthread_mutex_lock(&lock_);
+
+    int ret = 0;
+    std::map<std::string, CacheEntry>::iterator it = cache_.find(host);
+
+    if (it != cache_.end())
+    {
+        if (it->second.expire_ <= now)
+        {
+            cache_.erase(it);
+        }
+        else
+        {
+            ret = it->second.error_? -1 : 1;
+
+            if (error) *error = it->second.error_;
+            addrs = it->second.addrs_;
+        }
+    }
+
+    pthread_mutex_unlock(&lock_);
+
+    return ret;
+}
+
+void DnsResolver::Resolve(DnsQuery* query)
+{
+    query->error_ = 0;
+    query->addrs_.clear();
+
+    if (Lookup(query->host_, query->addrs_, &query->error_))
+    {
+        query->done_(query);
+        return;
+    }
+
+    pthread_mutex_lock(&lock_);
+
+    if (stop_ || threads_.empty())
+    {
+        pthread_mutex_unlock(&lock_);
+
+        query->error_ = EAI_SYSTEM;
+        query->done_(query);
+        return;
+    }
+
+    std::vector<DnsQuery*>& waiters = waiting_[query->host_];
+
+    // the first query of a host starts the lookup, the others wait for it.
+    if (waiters.empty())
+    {
+        jobs_.push_back(query->host_);
+        pthread_cond_signal(&cond_);
+    }
+
+    waiters.push_back(query);
+
+    pthread_mutex_unlock(&lock_);
+}
+
+void DnsResolver::Clear()
+{
+    pthread_mutex_lock(&lock_);
+    cache_.clear();
+    pthread_mutex_unlock(&lock_);
+}
+
+int DnsResolver::GetCacheSize() const
+{
+    pthread_mutex_lock(&lock_);
+    int size = cache_.size();
+    pthread_mutex_unlock(&lock_);
+
+    return size;
+}
+
+void DnsResolver::RunResolver()
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    while (true)
+    {
+        pthread_mutex_lock(&lock_);
+
+        while (jobs_.empty() && !stop_) pthread_cond_wait(&cond_, &lock_);
+
+        if (stop_)
+        {
+            pthread_mutex_unlock(&lock_);
+            break;
+        }
+
+        std::string host = jobs_.front();
+        jobs_.pop_front();
+
+        pthread_mutex_unlock(&lock_);
+
+        atomic_increment(&lookups_);
+
+        struct addrinfo* list = NULL;
+        int error = getaddrinfo(host.c_str(), NULL, &hints, &list);
+
+        std::vector<DnsAddress> addrs;
+
+        for (struct addrinfo* ai = list; error == 0 && ai != NULL; ai = ai->ai_next)
+        {
+            if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+
+            DnsAddress addr;
+            memset(&addr, 0, sizeof(addr));
+
+            addr.family_ = ai->ai_family;
+            addr.len_ = ai->ai_addrlen;
+            memcpy(&addr.addr_, ai->ai_addr, ai->ai_addrlen);
+
+            addrs.push_back(addr);
+        }
+
+        if (list) freeaddrinfo(list);
+
+        if (error == 0 && addrs.empty()) error = EAI_NONAME;
+
+        if (error) slog(LOG_WARN, "dns: failed to resolve %s, error:%s", host.c_str(), gai_strerror(error));
+
+        std::vector<DnsQuery*> waiters;
+
+        pthread_mutex_lock(&lock_);
+
+        Store(host, error, addrs);
+
+        std::map<std::string, std::vector<DnsQuery*> >::iterator it = waiting_.find(host);
+        if (it != waiting_.end())
+        {
+            waiters.swap(it->second);
+            waiting_.erase(it);
+        }
+
+        pthread_mutex_unlock(&lock_);
+
+        Finish(waiters, error, addrs);
+    }
+}
+
+// lock must be held.
+void DnsResolver::Store(const std::string& host, int error, const std::vector<DnsAddress>& addrs)
+{
+    int64_t now = MonotonicMicroSec();
+
+    if (cache_.size() >= (size_t)max_cache_size)
+    {
+        std::map<std::string, CacheEntry>::iterator it = cache_.begin();
+
+        while (it != cache_.end())
+        {
+            if (it->second.expire_ <= now) cache_.erase(it++);
+            else ++it;
+        }
+
+        // nothing is expired, make room anyway.
+        if (cache_.size() >= (size_t)max_cache_size) cache_.erase(cache_.begin());
+    }
+
+    CacheEntry& entry = cache_[host];
+
+    entry.error_ = error;
+    entry.expire_ = now + (int64_t)(error? negativeTtl_ : ttl_) * 1000000;
+    entry.addrs_ = addrs;
+}
+
+void DnsResolver::Finish(std::vector<DnsQuery*>& waiters, int error, const std::vector<DnsAddress>& addrs)
+{
+    for (size_t i = 0; i < waiters.size(); ++i)
+    {
+        DnsQuery* query = waiters[i];
+
+        query->error_ = error;
+        query->addrs_ = addrs;
+        query->done_(query);
+    }
+}
+
@@ -0,0 +1,115 @@
+#ifndef __DNS_RESOLVER_H__
+#define __DNS_RESOLVER_H__
+
+#include "misc/MpscQueue.h"
+#include "misc/NonCopyable.h"
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+class ThreadBase;
+
+struct DnsAddress
+{
+    int family_;
+    socklen_t len_;
+    struct sockaddr_storage addr_;
+};
+
+// a lookup handed to DnsResolver::Resolve(), owned by the caller.
+struct DnsQuery
+{
+    DnsQuery(): error_(0), done_(NULL), arg_(NULL) {}
+    virtual ~DnsQuery() {}
+
+    std::string host_;
+
+    // 0 on success, otherwise error code of getaddrinfo().
+    int error_;
+    std::vector<DnsAddress> addrs_;
+
+    // called in resolver thread when the lookup is done.
+    void (*done_)(DnsQuery*);
+    void* arg_;
+
+    // free for the caller, to pass the query back to its own thread.
+    MpscNode node_;
+};
+
+/*
+ * resolves host names by getaddrinfo() in a pool of threads, so that a slow
+ * name server never blocks the polling thread.
+ *
+ * a) results are cached for a fixed time, getaddrinfo() doesn't tell the ttl of
+ *    the records. failures are cached for a shorter time.
+ * b) queries for a host already being resolved wait for that lookup instead of
+ *    starting another one.
+ * c) all functions are thread safe, one resolver can be shared by many servers.
+ */
+class DnsResolver: public noncopyable
+{
+    public:
+
+        // ttl and negative ttl are in seconds.
+        explicit DnsResolver(int threads = 2, int ttl = 60, int negativeTtl = 5);
+
+        // queries not resolved yet are done with EAI_SYSTEM.
+        ~DnsResolver();
+
+        // return 1 if cached addresses are copied to addrs, -1 if a failure is cached,
+        // in which case error is set to the error of the lookup, 0 if not cached.
+        int Lookup(const std::string& host, std::vector<DnsAddress>& addrs, int* error = NULL);
+
+        // query->done_ is called in resolver thread, or in calling thread if result is cached.
+        void Resolve(DnsQuery* query);
+
+        // drop cached results.
+        void Clear();
+
+        int GetCacheSize() const;
+
+        // lookups run by getaddrinfo(), cached results and coalesced queries don't count.
+        int64_t GetLookups() const { return lookups_; }
+
+        static const int max_cache_size;
+
+    private:
+
+        struct CacheEntry
+        {
+            int error_;
+            int64_t expire_; // monotonic micro seconds
+            std::vector<DnsAddress> addrs_;
+        };
+
+        class ResolveThread;
+        friend class ResolveThread;
+
+        void RunResolver();
+        void Store(const std::string& host, int error, const std::vector<DnsAddress>& addrs);
+        void Finish(std::vector<DnsQuery*>& waiters, int error, const std::vector<DnsAddress>& addrs);
+
+        const int ttl_;
+        const int negativeTtl_;
+
+        bool stop_;
+        volatile int64_t lookups_;
+
+        mutable pthread_mutex_t lock_;
+        pthread_cond_t cond_;
+
+        // hosts to be resolved, queries waiting for each host.
+        std::deque<std::string> jobs_;
+        std::map<std::string, std::vector<DnsQuery*> > waiting_;
+
+        std::map<std::string, CacheEntry> cache_;
+        std::vector<ThreadBase*> threads_;
+};
+
+#endif
+
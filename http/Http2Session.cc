@@ -0,0 +1,930 @@
+#include "Http2Session.h"
+#include "HttpArena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char HTTP2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const int HTTP2_PREFACE_LEN = sizeof(HTTP2_PREFACE) - 1;
+
+#define HTTP2_FRAME_HEAD (9)
+
+// defaults of rfc 7540, neither is changed by settings of server.
+#define HTTP2_FRAME_SIZE (16384)
+#define HTTP2_WINDOW (65535)
+#define HTTP2_WINDOW_MAX (0x7fffffff)
+#define HTTP2_FRAME_SIZE_MAX (16777215)
+
+// concurrent streams allowed to client, the ones beyond are refused.
+#define HTTP2_MAX_STREAMS (128)
+
+// compressed header block of HEADERS and CONTINUATION.
+#define HTTP2_MAX_HEADER_BLOCK (64*1024)
+
+// decoded header list, each field counts its name, value and 32 bytes, rfc 7540, 6.5.2.
+// a small block can refer to a large table entry many times.
+#define HTTP2_MAX_HEADER_LIST (64*1024)
+
+struct Http2Session::Stream
+{
+    Stream(uint32_t id, int window)
+        :id_(id)
+        ,remoteEnd_(false)
+        ,localEnd_(false)
+        ,sendWindow_(window)
+        ,recvWindow_(HTTP2_WINDOW)
+        ,contentLength_(-1)
+        ,sent_(0)
+    {
+    }
+
+    uint32_t id_;
+
+    bool remoteEnd_; // END_STREAM received, request is dispatched
+    bool localEnd_;  // END_STREAM framed
+
+    int64_t sendWindow_;
+    int64_t recvWindow_;
+    int64_t contentLength_;
+
+    HttpRequest request_;
+
+    // target of request refers to it.
+    std::string target_;
+    std::string body_;
+
+    // body of response held back, sent_ bytes of it are framed.
+    std::string pending_;
+    size_t sent_;
+};
+
+static inline uint32_t ReadUint32(const char* data)
+{
+    const unsigned char* p = (const unsigned char*)data;
+
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void WriteUint32(char* data, uint32_t val)
+{
+    data[0] = (char)(val >> 24);
+    data[1] = (char)(val >> 16);
+    data[2] = (char)(val >> 8);
+    data[3] = (char)val;
+}
+
+// strip padding of DATA and HEADERS, return false if it is longer than the frame.
+static bool StripPadding(uint8_t flags, const char** data, int* len)
+{
+    if ((flags & Http2Session::H2FL_PADDED) == 0) return true;
+    if (*len < 1) return false;
+
+    int pad = (unsigned char)**data;
+    if (pad >= *len) return false;
+
+    *data += 1;
+    *len -= pad + 1;
+
+    return true;
+}
+
+// "content-type" to "Content-Type".
+static void CanonicalName(const std::string& name, std::string* out)
+{
+    out->assign(name);
+
+    bool upper = true;
+    for (size_t i = 0; i < out->size(); ++i)
+    {
+        char& c = (*out)[i];
+
+        if (upper && c >= 'a' && c <= 'z') c -= 'a' - 'A';
+
+        upper = (c == '-');
+    }
+}
+
+// headers of http/1 connection, not allowed in http/2.
+static bool IsConnectionHeader(const std::string& name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+// values unique to a response are not worth a slot in table, credentials never take one.
+static bool IsIndexable(const std::string& name)
+{
+    return name != "content-length" && name != "date" && name != "etag" && name != "last-modified"
+        && name != "content-range" && name != "set-cookie" && name != "authorization";
+}
+
+Http2Session::Http2Session(RequestHandler handler, void* arg, HttpArena* arena)
+    :handler_(handler)
+    ,arg_(arg)
+    ,arena_(arena)
+    ,preface_(true)
+    ,settings_(true)
+    ,goaway_(false)
+    ,lastStreamId_(0)
+    ,peerFrameSize_(HTTP2_FRAME_SIZE)
+    ,peerWindow_(HTTP2_WINDOW)
+    ,sendWindow_(HTTP2_WINDOW)
+    ,recvWindow_(HTTP2_WINDOW)
+    ,headerStream_(0)
+    ,headerEnd_(false)
+    ,fieldsSize_(0)
+{
+}
+
+Http2Session::~Http2Session()
+{
+    for (std::map<uint32_t, Stream*>::iterator it = streams_.begin(); it != streams_.end(); ++it)
+    {
+        delete it->second;
+    }
+}
+
+int Http2Session::MatchPreface(const char* data, int len)
+{
+    int n = len < HTTP2_PREFACE_LEN? len : HTTP2_PREFACE_LEN;
+
+    if (memcmp(data, HTTP2_PREFACE, n) != 0) return -1;
+
+    return n == HTTP2_PREFACE_LEN? 1 : 0;
+}
+
+bool Http2Session::DecodeBase64Url(const std::string& str, std::string* out)
+{
+    uint32_t acc = 0;
+    int bits = 0;
+
+    out->clear();
+
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        char c = str[i];
+        int val = -1;
+
+        if (c >= 'A' && c <= 'Z') val = c - 'A';
+        else if (c >= 'a' && c <= 'z') val = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') val = c - '0' + 52;
+        else if (c == '-') val = 62;
+        else if (c == '_') val = 63;
+        else if (c == '=') return str.find_first_not_of('=', i) == std::string::npos;
+
+        if (val < 0) return false;
+
+        acc = (acc << 6) | val;
+        bits += 6;
+
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out->push_back((char)(acc >> bits));
+        }
+    }
+
+    return true;
+}
+
+void Http2Session::Start()
+{
+    char settings[12];
+
+    settings[0] = 0;
+    settings[1] = H2S_MAX_CONCURRENT_STREAMS;
+    WriteUint32(settings + 2, HTTP2_MAX_STREAMS);
+
+    settings[6] = 0;
+    settings[7] = H2S_MAX_HEADER_LIST_SIZE;
+    WriteUint32(settings + 8, HTTP2_MAX_HEADER_LIST);
+
+    AppendFrame(H2F_SETTINGS, 0, 0, settings, sizeof(settings));
+}
+
+bool Http2Session::StartUpgrade(const std::string& settings, HttpRequest& request)
+{
+    std::string payload;
+    if (!DecodeBase64Url(settings, &payload) || payload.size() % 6 != 0) return false;
+
+    // settings of upgrade are acknowledged by 101 response.
+    if (ApplySettings(payload.data(), payload.size()) != H2E_NO_ERROR) return false;
+
+    Start();
+
+    Stream* stream = new Stream(1, peerWindow_);
+    stream->remoteEnd_ = true;
+
+    lastStreamId_ = 1;
+    streams_[1] = stream;
+
+    Dispatch(stream, request);
+    return true;
+}
+
+bool Http2Session::IsClosed() const
+{
+    return goaway_ && streams_.empty() && output_.empty();
+}
+
+int Http2Session::Process(const char* data, int len)
+{
+    int consumed = 0;
+
+    if (preface_)
+    {
+        int ret = MatchPreface(data, len);
+        if (ret < 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+        if (ret == 0) return 0;
+
+        preface_ = false;
+        consumed = HTTP2_PREFACE_LEN;
+    }
+
+    while (len - consumed >= HTTP2_FRAME_HEAD)
+    {
+        const unsigned char* head = (const unsigned char*)data + consumed;
+
+        int size = head[0] << 16 | head[1] << 8 | head[2];
+        uint8_t type = head[3];
+        uint8_t flags = head[4];
+        uint32_t id = ReadUint32((const char*)head + 5) & 0x7fffffff;
+
+        if (size > HTTP2_FRAME_SIZE) return ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+        // whole frame is parsed at once.
+        if (len - consumed - HTTP2_FRAME_HEAD < size) break;
+
+        if (settings_ && (type != H2F_SETTINGS || (flags & H2FL_ACK))) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+        if (ProcessFrame(type, flags, id, data + consumed + HTTP2_FRAME_HEAD, size) < 0) return -1;
+
+        consumed += HTTP2_FRAME_HEAD + size;
+    }
+
+    return consumed;
+}
+
+int Http2Session::ProcessFrame(uint8_t type, uint8_t flags, uint32_t id, const char* data, int len)
+{
+    // header block must not be interleaved by any other frame.
+    if (headerStream_ && type != H2F_CONTINUATION) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    switch (type)
+    {
+        case H2F_DATA:
+            return OnData(flags, id, data, len);
+        case H2F_HEADERS:
+            return OnHeaders(flags, id, data, len);
+        case H2F_CONTINUATION:
+            return OnContinuation(flags, id, data, len);
+        case H2F_RST_STREAM:
+            return OnRstStream(id, len);
+        case H2F_SETTINGS:
+            return OnSettings(flags, id, data, len);
+        case H2F_PING:
+            return OnPing(flags, id, data, len);
+        case H2F_GOAWAY:
+            return OnGoaway(id, len);
+        case H2F_WINDOW_UPDATE:
+            return OnWindowUpdate(id, data, len);
+        case H2F_PRIORITY:
+            {
+                if (id == 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+                if (len != 5) ResetStream(id, H2E_FRAME_SIZE_ERROR);
+            }
+            break;
+        case H2F_PUSH_PROMISE:
+            return ConnectionError(H2E_PROTOCOL_ERROR);
+        default:
+            // unknown frame is ignored.
+            break;
+    }
+
+    return 0;
+}
+
+int Http2Session::OnData(uint8_t flags, uint32_t id, const char* data, int len)
+{
+    if (id == 0 || id > lastStreamId_) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    // padding counts in flow control, as the whole frame does.
+    int size = len;
+
+    recvWindow_ -= size;
+    if (recvWindow_ < 0) return ConnectionError(H2E_FLOW_CONTROL_ERROR);
+
+    // data is buffered or dropped at once, window is opened again as it is consumed.
+    if (recvWindow_ <= HTTP2_WINDOW / 2)
+    {
+        AppendWindowUpdate(0, HTTP2_WINDOW - recvWindow_);
+        recvWindow_ = HTTP2_WINDOW;
+    }
+
+    if (!StripPadding(flags, &data, &len)) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    // frames in flight of stream reset are ignored.
+    Stream* stream = FindStream(id);
+    if (stream == NULL) return 0;
+
+    if (stream->remoteEnd_)
+    {
+        ResetStream(id, H2E_STREAM_CLOSED);
+        return 0;
+    }
+
+    stream->recvWindow_ -= size;
+    if (stream->recvWindow_ < 0)
+    {
+        ResetStream(id, H2E_FLOW_CONTROL_ERROR);
+        return 0;
+    }
+
+    // stream is dropped, as http/1 drops the connection.
+    if (stream->body_.size() + len >= HttpRequest::MaxBodyLength)
+    {
+        ResetStream(id, H2E_CANCEL);
+        return 0;
+    }
+
+    stream->body_.append(data, len);
+
+    if (flags & H2FL_END_STREAM)
+    {
+        EndStream(stream);
+        return 0;
+    }
+
+    if (stream->recvWindow_ <= HTTP2_WINDOW / 2)
+    {
+        AppendWindowUpdate(id, HTTP2_WINDOW - stream->recvWindow_);
+        stream->recvWindow_ = HTTP2_WINDOW;
+    }
+
+    return 0;
+}
+
+int Http2Session::OnHeaders(uint8_t flags, uint32_t id, const char* data, int len)
+{
+    if (id == 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+    if (!StripPadding(flags, &data, &len)) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    // priority is not supported, dependency and weight are skipped.
+    if (flags & H2FL_PRIORITY)
+    {
+        if (len < 5) return ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+        data += 5;
+        len -= 5;
+    }
+
+    headerStream_ = id;
+    headerEnd_ = (flags & H2FL_END_STREAM) != 0;
+    headerBlock_.assign(data, len);
+
+    if ((flags & H2FL_END_HEADERS) == 0) return 0;
+
+    return FinishHeaders();
+}
+
+int Http2Session::OnContinuation(uint8_t flags, uint32_t id, const char* data, int len)
+{
+    if (headerStream_ == 0 || id != headerStream_) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    if (headerBlock_.size() + len > HTTP2_MAX_HEADER_BLOCK) return ConnectionError(H2E_ENHANCE_YOUR_CALM);
+
+    headerBlock_.append(data, len);
+
+    if ((flags & H2FL_END_HEADERS) == 0) return 0;
+
+    return FinishHeaders();
+}
+
+void Http2Session::OnHeader(void* arg, const std::string& name, const std::string& value)
+{
+    Http2Session* session = (Http2Session*)arg;
+
+    // fields beyond the limit are decoded to keep table in sync, but not kept.
+    session->fieldsSize_ += name.size() + value.size() + 32;
+    if (session->fieldsSize_ > HTTP2_MAX_HEADER_LIST) return;
+
+    session->fields_.push_back(HpackHeader(name, value));
+}
+
+int Http2Session::FinishHeaders()
+{
+    uint32_t id = headerStream_;
+    headerStream_ = 0;
+
+    // block is decoded even if the stream is gone, to keep table in sync with peer.
+    fields_.clear();
+    fieldsSize_ = 0;
+
+    if (!decoder_.Decode(headerBlock_.data(), headerBlock_.size(), &OnHeader, this))
+    {
+        return ConnectionError(H2E_COMPRESSION_ERROR);
+    }
+
+    bool oversize = (fieldsSize_ > HTTP2_MAX_HEADER_LIST);
+    Stream* stream = FindStream(id);
+
+    if (stream)
+    {
+        // trailers, fields are dropped.
+        if (stream->remoteEnd_) ResetStream(id, H2E_STREAM_CLOSED);
+        else if (!headerEnd_) ResetStream(id, H2E_PROTOCOL_ERROR);
+        else if (oversize) ResetStream(id, H2E_ENHANCE_YOUR_CALM);
+        else EndStream(stream);
+
+        return 0;
+    }
+
+    // stream closed already.
+    if (id <= lastStreamId_) return 0;
+
+    // streams of client are odd.
+    if ((id & 1) == 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    lastStreamId_ = id;
+
+    if (streams_.size() >= HTTP2_MAX_STREAMS)
+    {
+        ResetStream(id, H2E_REFUSED_STREAM);
+        return 0;
+    }
+
+    if (oversize)
+    {
+        ResetStream(id, H2E_ENHANCE_YOUR_CALM);
+        return 0;
+    }
+
+    stream = new Stream(id, peerWindow_);
+    streams_[id] = stream;
+
+    if (!BuildRequest(stream)) ResetStream(id, H2E_PROTOCOL_ERROR);
+    else if (headerEnd_) EndStream(stream);
+
+    return 0;
+}
+
+// a malformed request is a stream error, rfc 7540, 8.1.2.
+bool Http2Session::BuildRequest(Stream* stream)
+{
+    HttpRequest& req = stream->request_;
+
+    req.SetArena(arena_);
+
+    std::string method;
+    std::string name;
+    bool scheme = false;
+    bool regular = false;
+
+    for (size_t i = 0; i < fields_.size(); ++i)
+    {
+        const std::string& key = fields_[i].first;
+        const std::string& value = fields_[i].second;
+
+        if (key.empty() || value.find_first_of(std::string("\0\r\n", 3)) != std::string::npos) return false;
+
+        if (key[0] == ':')
+        {
+            // pseudo headers come first, once each.
+            if (regular) return false;
+
+            if (key == ":method")
+            {
+                if (!method.empty() || value.empty()) return false;
+                method = value;
+            }
+            else if (key == ":path")
+            {
+                if (!stream->target_.empty() || value.empty()) return false;
+                stream->target_ = value;
+            }
+            else if (key == ":scheme")
+            {
+                if (scheme) return false;
+                scheme = true;
+            }
+            else if (key == ":authority")
+            {
+                req.AddHeader("Host", value.c_str());
+            }
+            else
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        regular = true;
+
+        for (size_t j = 0; j < key.size(); ++j)
+        {
+            if (key[j] >= 'A' && key[j] <= 'Z') return false;
+        }
+
+        if (IsConnectionHeader(key)) return false;
+        if (key == "te" && value != "trailers") return false;
+
+        if (key == "content-length")
+        {
+            if (value.find_first_not_of("0123456789") != std::string::npos) return false;
+
+            stream->contentLength_ = strtoll(value.c_str(), NULL, 10);
+        }
+
+        CanonicalName(key, &name);
+
+        // fields of the same name are joined, cookie may be split into many.
+        const std::map<std::string, std::string>& headers = req.GetHeader();
+        std::map<std::string, std::string>::const_iterator it = headers.find(name);
+
+        if (it == headers.end())
+        {
+            req.AddHeader(name.c_str(), value.c_str());
+        }
+        else
+        {
+            std::string joined = it->second + (key == "cookie"? "; " : ", ") + value;
+            req.AddHeader(name.c_str(), joined.c_str());
+        }
+    }
+
+    if (method.empty() || stream->target_.empty() || !scheme) return false;
+
+    // methods unknown to http/1 are refused the same way.
+    if (!req.SetHttpMethod(method)) return false;
+
+    req.SetVersion(HttpRequest::HV_20);
+
+    return req.SetTarget(stream->target_.data(), stream->target_.size());
+}
+
+void Http2Session::EndStream(Stream* stream)
+{
+    stream->remoteEnd_ = true;
+
+    if (stream->contentLength_ >= 0 && (size_t)stream->contentLength_ != stream->body_.size())
+    {
+        ResetStream(stream->id_, H2E_PROTOCOL_ERROR);
+        return;
+    }
+
+    if (!stream->body_.empty())
+    {
+        stream->request_.SetBody(stream->body_.data(), stream->body_.size());
+        std::string().swap(stream->body_);
+    }
+
+    Dispatch(stream, stream->request_);
+}
+
+void Http2Session::Dispatch(Stream* stream, HttpRequest& request)
+{
+    bool head = request.GetHttpMethod() == HttpRequest::HM_HEAD;
+
+    response_.CleanUp();
+    handler_(arg_, request, response_);
+
+    SendResponse(stream, response_, head);
+
+    // body is framed or copied to stream, what handler allocated goes at once.
+    response_.CleanUp();
+    request.CleanUp();
+    if (arena_) arena_->Reset();
+
+    if (stream->localEnd_) CloseStream(stream->id_);
+}
+
+void Http2Session::SendResponse(Stream* stream, const HttpResponse& response, bool head)
+{
+    int status = response.GetStatusCode();
+    if (status < 100 || status > 999) status = HttpResponse::HSC_500;
+
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", status);
+
+    block_.clear();
+    encoder_.Encode(":status", buf, &block_);
+
+    std::string name;
+
+    const std::map<std::string, std::string>& headers = response.GetHeader();
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+    {
+        name = it->first;
+        for (size_t i = 0; i < name.size(); ++i)
+        {
+            if (name[i] >= 'A' && name[i] <= 'Z') name[i] += 'a' - 'A';
+        }
+
+        if (IsConnectionHeader(name)) continue;
+
+        encoder_.Encode(name, it->second, &block_, IsIndexable(name));
+    }
+
+    int body = head? 0 : response.GetBodySize();
+
+    // block larger than a frame goes on by CONTINUATION.
+    int total = block_.size();
+    int off = total < peerFrameSize_? total : peerFrameSize_;
+
+    uint8_t flags = (body == 0? H2FL_END_STREAM : 0) | (off == total? H2FL_END_HEADERS : 0);
+    AppendFrame(H2F_HEADERS, flags, stream->id_, block_.data(), off);
+
+    while (off < total)
+    {
+        int n = total - off < peerFrameSize_? total - off : peerFrameSize_;
+
+        AppendFrame(H2F_CONTINUATION, off + n == total? H2FL_END_HEADERS : 0, stream->id_, block_.data() + off, n);
+        off += n;
+    }
+
+    if (body == 0)
+    {
+        stream->localEnd_ = true;
+        return;
+    }
+
+    const char* data = response.GetBody();
+    int sent = SendData(stream, data, body);
+
+    if (sent < body)
+    {
+        stream->pending_.assign(data + sent, body - sent);
+        stream->sent_ = 0;
+    }
+}
+
+int Http2Session::SendData(Stream* stream, const char* data, int len)
+{
+    int sent = 0;
+
+    while (sent < len)
+    {
+        int64_t window = sendWindow_ < stream->sendWindow_? sendWindow_ : stream->sendWindow_;
+        if (window <= 0 || (int)output_.size() >= MaxOutput) break;
+
+        int n = len - sent;
+        if (n > peerFrameSize_) n = peerFrameSize_;
+        if (n > window) n = window;
+
+        bool last = (sent + n == len);
+
+        AppendFrame(H2F_DATA, last? H2FL_END_STREAM : 0, stream->id_, data + sent, n);
+
+        sendWindow_ -= n;
+        stream->sendWindow_ -= n;
+        sent += n;
+
+        if (last) stream->localEnd_ = true;
+    }
+
+    return sent;
+}
+
+// return true if stream is done.
+bool Http2Session::FlushStream(Stream* stream)
+{
+    if (stream->sent_ < stream->pending_.size())
+    {
+        stream->sent_ += SendData(stream, stream->pending_.data() + stream->sent_, stream->pending_.size() - stream->sent_);
+    }
+
+    return stream->localEnd_ && stream->remoteEnd_;
+}
+
+void Http2Session::Flush()
+{
+    // lower streams first, they are the older ones.
+    std::map<uint32_t, Stream*>::iterator it = streams_.begin();
+
+    while (it != streams_.end() && sendWindow_ > 0 && (int)output_.size() < MaxOutput)
+    {
+        Stream* stream = it->second;
+
+        if (!stream->pending_.empty() && FlushStream(stream))
+        {
+            delete stream;
+            streams_.erase(it++);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+// error code of the stream reset is not looked at, the stream is gone either way.
+int Http2Session::OnRstStream(uint32_t id, int len)
+{
+    if (id == 0 || id > lastStreamId_) return ConnectionError(H2E_PROTOCOL_ERROR);
+    if (len != 4) return ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+    CloseStream(id);
+    return 0;
+}
+
+int Http2Session::OnSettings(uint8_t flags, uint32_t id, const char* data, int len)
+{
+    if (id != 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    if (flags & H2FL_ACK) return len == 0? 0 : ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+    if (len % 6 != 0) return ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+    ErrorCode code = ApplySettings(data, len);
+    if (code != H2E_NO_ERROR) return ConnectionError(code);
+
+    settings_ = false;
+    AppendFrame(H2F_SETTINGS, H2FL_ACK, 0, NULL, 0);
+
+    // windows may be opened by new initial size.
+    Flush();
+    return 0;
+}
+
+Http2Session::ErrorCode Http2Session::ApplySettings(const char* data, int len)
+{
+    for (int off = 0; off + 6 <= len; off += 6)
+    {
+        int id = (unsigned char)data[off] << 8 | (unsigned char)data[off + 1];
+        uint32_t value = ReadUint32(data + off + 2);
+
+        switch (id)
+        {
+            case H2S_HEADER_TABLE_SIZE:
+                {
+                    encoder_.SetMaxTableSize(value);
+                }
+                break;
+            case H2S_ENABLE_PUSH:
+                {
+                    if (value > 1) return H2E_PROTOCOL_ERROR;
+                }
+                break;
+            case H2S_INITIAL_WINDOW_SIZE:
+                {
+                    if (value > HTTP2_WINDOW_MAX) return H2E_FLOW_CONTROL_ERROR;
+
+                    // windows of open streams change by the difference.
+                    int64_t delta = (int64_t)value - peerWindow_;
+
+                    std::map<uint32_t, Stream*>::iterator it = streams_.begin();
+                    for (; it != streams_.end(); ++it)
+                    {
+                        it->second->sendWindow_ += delta;
+                        if (it->second->sendWindow_ > HTTP2_WINDOW_MAX) return H2E_FLOW_CONTROL_ERROR;
+                    }
+
+                    peerWindow_ = value;
+                }
+                break;
+            case H2S_MAX_FRAME_SIZE:
+                {
+                    if (value < HTTP2_FRAME_SIZE || value > HTTP2_FRAME_SIZE_MAX) return H2E_PROTOCOL_ERROR;
+
+                    peerFrameSize_ = value;
+                }
+                break;
+            default:
+                // the ones not listed are ignored.
+                break;
+        }
+    }
+
+    return H2E_NO_ERROR;
+}
+
+int Http2Session::OnPing(uint8_t flags, uint32_t id, const char* data, int len)
+{
+    if (id != 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+    if (len != 8) return ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+    if ((flags & H2FL_ACK) == 0) AppendFrame(H2F_PING, H2FL_ACK, 0, data, len);
+
+    return 0;
+}
+
+// last stream id tells of streams pushed by server, none is.
+int Http2Session::OnGoaway(uint32_t id, int len)
+{
+    if (id != 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+    if (len < 8) return ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+    // streams open are finished, no new one comes.
+    goaway_ = true;
+    return 0;
+}
+
+int Http2Session::OnWindowUpdate(uint32_t id, const char* data, int len)
+{
+    if (len != 4) return ConnectionError(H2E_FRAME_SIZE_ERROR);
+
+    uint32_t increment = ReadUint32(data) & 0x7fffffff;
+
+    if (id == 0)
+    {
+        if (increment == 0) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+        sendWindow_ += increment;
+        if (sendWindow_ > HTTP2_WINDOW_MAX) return ConnectionError(H2E_FLOW_CONTROL_ERROR);
+
+        Flush();
+        return 0;
+    }
+
+    if (id > lastStreamId_) return ConnectionError(H2E_PROTOCOL_ERROR);
+
+    Stream* stream = FindStream(id);
+    if (stream == NULL) return 0;
+
+    if (increment == 0)
+    {
+        ResetStream(id, H2E_PROTOCOL_ERROR);
+        return 0;
+    }
+
+    stream->sendWindow_ += increment;
+    if (stream->sendWindow_ > HTTP2_WINDOW_MAX)
+    {
+        ResetStream(id, H2E_FLOW_CONTROL_ERROR);
+        return 0;
+    }
+
+    if (!stream->pending_.empty() && FlushStream(stream)) CloseStream(id);
+
+    return 0;
+}
+
+Http2Session::Stream* Http2Session::FindStream(uint32_t id) const
+{
+    std::map<uint32_t, Stream*>::const_iterator it = streams_.find(id);
+
+    return it == streams_.end()? NULL : it->second;
+}
+
+int Http2Session::ConnectionError(ErrorCode code)
+{
+    if (!goaway_)
+    {
+        char payload[8];
+        WriteUint32(payload, lastStreamId_);
+        WriteUint32(payload + 4, code);
+
+        AppendFrame(H2F_GOAWAY, 0, 0, payload, sizeof(payload));
+    }
+
+    goaway_ = true;
+    return -1;
+}
+
+void Http2Session::ResetStream(uint32_t id, ErrorCode code)
+{
+    char payload[4];
+    WriteUint32(payload, code);
+
+    AppendFrame(H2F_RST_STREAM, 0, id, payload, sizeof(payload));
+    CloseStream(id);
+}
+
+void Http2Session::CloseStream(uint32_t id)
+{
+    std::map<uint32_t, Stream*>::iterator it = streams_.find(id);
+    if (it == streams_.end()) return;
+
+    delete it->second;
+    streams_.erase(it);
+}
+
+void Http2Session::AppendFrameHead(int len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    char head[HTTP2_FRAME_HEAD];
+
+    head[0] = (char)(len >> 16);
+    head[1] = (char)(len >> 8);
+    head[2] = (char)len;
+    head[3] = (char)type;
+    head[4] = (char)flags;
+    WriteUint32(head + 5, id);
+
+    output_.append(head, sizeof(head));
+}
+
+void Http2Session::AppendFrame(uint8_t type, uint8_t flags, uint32_t id, const char* data, int len)
+{
+    AppendFrameHead(len, type, flags, id);
+
+    if (len > 0) output_.append(data, len);
+}
+
+void Http2Session::AppendWindowUpdate(uint32_t id, uint32_t increment)
+{
+    char payload[4];
+    WriteUint32(payload, increment);
+
+    AppendFrame(H2F_WINDOW_UPDATE, 0, id, payload, sizeof(payload));
+}
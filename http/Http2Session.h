@@ -0,0 +1,197 @@
+#ifndef __HTTP2_SESSION_H__
+#define __HTTP2_SESSION_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "HttpHpack.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "misc/NonCopyable.h"
+
+class HttpArena;
+
+/*
+ * server side of a http/2 connection in clear text(h2c, rfc 7540), started by prior
+ * knowledge or upgraded from http/1.1 by "Upgrade: h2c".
+ *
+ * a) frames are parsed from data read, Process() returns bytes consumed as other parsers
+ *    do, frames to send are appended to an output buffer, taken by the caller to send.
+ * b) request of a stream is dispatched to handler when END_STREAM of it arrives, handler
+ *    runs synchronously as it does for http/1, response is framed at once. body held back
+ *    by flow control is kept by the stream, and sent as peer opens windows.
+ * c) header names are turned into the case http/1 clients send("content-type" to
+ *    "Content-Type", ":authority" to "Host"), handlers look them up the same way.
+ * d) connection error queues GOAWAY and Process() returns -1, stream error resets the stream.
+ * e) body of a request is limited by HttpRequest::MaxBodyLength as it is for http/1,
+ *    push and priority are not supported, event stream ends with its header.
+ */
+class Http2Session: public noncopyable
+{
+    public:
+
+        enum FrameType
+        {
+            H2F_DATA          = 0x0,
+            H2F_HEADERS       = 0x1,
+            H2F_PRIORITY      = 0x2,
+            H2F_RST_STREAM    = 0x3,
+            H2F_SETTINGS      = 0x4,
+            H2F_PUSH_PROMISE  = 0x5,
+            H2F_PING          = 0x6,
+            H2F_GOAWAY        = 0x7,
+            H2F_WINDOW_UPDATE = 0x8,
+            H2F_CONTINUATION  = 0x9,
+        };
+
+        enum FrameFlag
+        {
+            H2FL_END_STREAM  = 0x1,
+            H2FL_ACK         = 0x1,
+            H2FL_END_HEADERS = 0x4,
+            H2FL_PADDED      = 0x8,
+            H2FL_PRIORITY    = 0x20,
+        };
+
+        enum SettingId
+        {
+            H2S_HEADER_TABLE_SIZE      = 0x1,
+            H2S_ENABLE_PUSH            = 0x2,
+            H2S_MAX_CONCURRENT_STREAMS = 0x3,
+            H2S_INITIAL_WINDOW_SIZE    = 0x4,
+            H2S_MAX_FRAME_SIZE         = 0x5,
+            H2S_MAX_HEADER_LIST_SIZE   = 0x6,
+        };
+
+        enum ErrorCode
+        {
+            H2E_NO_ERROR            = 0x0,
+            H2E_PROTOCOL_ERROR      = 0x1,
+            H2E_INTERNAL_ERROR      = 0x2,
+            H2E_FLOW_CONTROL_ERROR  = 0x3,
+            H2E_SETTINGS_TIMEOUT    = 0x4,
+            H2E_STREAM_CLOSED       = 0x5,
+            H2E_FRAME_SIZE_ERROR    = 0x6,
+            H2E_REFUSED_STREAM      = 0x7,
+            H2E_CANCEL              = 0x8,
+            H2E_COMPRESSION_ERROR   = 0x9,
+            H2E_CONNECT_ERROR       = 0xa,
+            H2E_ENHANCE_YOUR_CALM   = 0xb,
+        };
+
+        // handler fills response of request, as HttpClient::HttpHandler does.
+        typedef void (* RequestHandler)(void* arg, const HttpRequest& req, HttpResponse& response);
+
+        // arena is given to requests, and reset once a response is framed.
+        Http2Session(RequestHandler handler, void* arg, HttpArena* arena);
+        ~Http2Session();
+
+        // prior knowledge, server preface is queued, client preface is expected.
+        void Start();
+
+        // upgraded from http/1.1, settings is value of HTTP2-Settings, request is the one
+        // carrying the upgrade, it is answered on stream 1. caller sends "101 Switching
+        // Protocols" ahead of the output. return false if settings is malformed,
+        // nothing is done then.
+        bool StartUpgrade(const std::string& settings, HttpRequest& request);
+
+        // return bytes consumed, -1 on connection error, GOAWAY is queued then.
+        int Process(const char* data, int len);
+
+        // frame body held back by flow control, or by output buffer full.
+        void Flush();
+
+        std::string& GetOutput() { return output_; }
+
+        // GOAWAY is sent or received, and nothing is left to send.
+        bool IsClosed() const;
+
+        int GetStreamNum() const { return streams_.size(); }
+        int GetSendWindow() const { return sendWindow_; }
+
+        // max bytes of frames buffered, body beyond waits in streams.
+        static const int MaxOutput = 256*1024;
+
+        // "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", return 1 if data starts with it, 0 if data
+        // is a prefix of it, -1 if not.
+        static int MatchPreface(const char* data, int len);
+
+        static bool DecodeBase64Url(const std::string& str, std::string* out);
+
+    private:
+
+        struct Stream;
+
+        int ProcessFrame(uint8_t type, uint8_t flags, uint32_t id, const char* data, int len);
+
+        int OnData(uint8_t flags, uint32_t id, const char* data, int len);
+        int OnHeaders(uint8_t flags, uint32_t id, const char* data, int len);
+        int OnContinuation(uint8_t flags, uint32_t id, const char* data, int len);
+        int OnRstStream(uint32_t id, int len);
+        int OnSettings(uint8_t flags, uint32_t id, const char* data, int len);
+        int OnPing(uint8_t flags, uint32_t id, const char* data, int len);
+        int OnGoaway(uint32_t id, int len);
+        int OnWindowUpdate(uint32_t id, const char* data, int len);
+
+        int FinishHeaders();
+        ErrorCode ApplySettings(const char* data, int len);
+        bool BuildRequest(Stream* stream);
+
+        static void OnHeader(void* arg, const std::string& name, const std::string& value);
+
+        void EndStream(Stream* stream);
+        void Dispatch(Stream* stream, HttpRequest& request);
+        void SendResponse(Stream* stream, const HttpResponse& response, bool head);
+        int  SendData(Stream* stream, const char* data, int len);
+        bool FlushStream(Stream* stream);
+
+        Stream* FindStream(uint32_t id) const;
+
+        int  ConnectionError(ErrorCode code);
+        void ResetStream(uint32_t id, ErrorCode code);
+        void CloseStream(uint32_t id);
+
+        void AppendFrame(uint8_t type, uint8_t flags, uint32_t id, const char* data, int len);
+        void AppendFrameHead(int len, uint8_t type, uint8_t flags, uint32_t id);
+        void AppendWindowUpdate(uint32_t id, uint32_t increment);
+
+        RequestHandler handler_;
+        void* arg_;
+        HttpArena* arena_;
+
+        bool preface_;   // client preface is expected
+        bool settings_;  // SETTINGS is expected, it must follow the preface
+        bool goaway_;    // GOAWAY is sent or received
+
+        uint32_t lastStreamId_;
+
+        // settings of peer.
+        int peerFrameSize_;
+        int peerWindow_;
+
+        // windows of connection.
+        int64_t sendWindow_;
+        int64_t recvWindow_;
+
+        // header block being received by HEADERS and CONTINUATION.
+        uint32_t headerStream_;
+        bool headerEnd_;
+        std::string headerBlock_;
+
+        HpackDecoder decoder_;
+        HpackEncoder encoder_;
+
+        // fields of the header block being decoded, and their size as rfc 7540 counts.
+        std::vector<HpackHeader> fields_;
+        size_t fieldsSize_;
+
+        std::map<uint32_t, Stream*> streams_;
+
+        HttpResponse response_;
+        std::string block_;
+        std::string output_;
+};
+
+#endif // __HTTP2_SESSION_H__
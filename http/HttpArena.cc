@@ -0,0 +1,150 @@
+#include "HttpArena.h"
+
+#include "misc/PerThreadMemory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// chunks are pooled per thread, a thread takes memory of all of them on first use.
+#define HTTP_ARENA_CHUNK_SIZE (4096)
+#define HTTP_ARENA_CHUNK_NUM  (256)
+
+struct HttpArena::Chunk
+{
+    Chunk* next_;
+    size_t size_;
+    bool pooled_;
+
+    char* Data() { return (char*)(this + 1); }
+};
+
+HttpArena::HttpArena()
+    :head_(NULL)
+    ,cur_(NULL)
+    ,ptr_(NULL)
+    ,end_(NULL)
+    ,large_(NULL)
+    ,used_(0)
+    ,chunkNum_(0)
+{
+}
+
+HttpArena::~HttpArena()
+{
+    Clear();
+}
+
+PerThreadMemoryAlloc* HttpArena::GetPool()
+{
+    // never destroyed, chunks may be released by any thread any time.
+    static PerThreadMemoryAlloc* pool = new PerThreadMemoryAlloc(HTTP_ARENA_CHUNK_SIZE, HTTP_ARENA_CHUNK_NUM);
+
+    return pool;
+}
+
+size_t HttpArena::GetChunkSize()
+{
+    return HTTP_ARENA_CHUNK_SIZE - sizeof(Chunk);
+}
+
+void* HttpArena::AllocSlow(size_t sz)
+{
+    if (sz > GetChunkSize())
+    {
+        Chunk* chunk = (Chunk*)malloc(sizeof(Chunk) + sz);
+        if (chunk == NULL) return NULL;
+
+        chunk->size_ = sz;
+        chunk->pooled_ = false;
+        chunk->next_ = large_;
+        large_ = chunk;
+
+        used_ += sz;
+
+        return chunk->Data();
+    }
+
+    Chunk* next = cur_? cur_->next_ : head_;
+
+    if (next == NULL)
+    {
+        next = (Chunk*)GetPool()->AllocBuffer();
+
+        if (next)
+        {
+            next->pooled_ = true;
+        }
+        else
+        {
+            next = (Chunk*)malloc(HTTP_ARENA_CHUNK_SIZE);
+            if (next == NULL) return NULL;
+
+            next->pooled_ = false;
+        }
+
+        next->size_ = GetChunkSize();
+        next->next_ = NULL;
+
+        if (cur_) cur_->next_ = next;
+        else head_ = next;
+
+        ++chunkNum_;
+    }
+
+    cur_ = next;
+    ptr_ = next->Data();
+    end_ = ptr_ + next->size_;
+
+    return Alloc(sz);
+}
+
+char* HttpArena::Strdup(const char* str, size_t len)
+{
+    char* mem = (char*)Alloc(len + 1);
+    if (mem == NULL) return NULL;
+
+    memcpy(mem, str, len);
+    mem[len] = '\0';
+
+    return mem;
+}
+
+void HttpArena::FreeLarge()
+{
+    while (large_)
+    {
+        Chunk* next = large_->next_;
+        free(large_);
+        large_ = next;
+    }
+}
+
+void HttpArena::Reset()
+{
+    if (large_) FreeLarge();
+
+    cur_ = head_;
+    ptr_ = head_? head_->Data() : NULL;
+    end_ = head_? ptr_ + head_->size_ : NULL;
+    used_ = 0;
+}
+
+void HttpArena::Clear()
+{
+    FreeLarge();
+
+    while (head_)
+    {
+        Chunk* next = head_->next_;
+
+        if (head_->pooled_) GetPool()->ReleaseBuffer(head_);
+        else free(head_);
+
+        head_ = next;
+    }
+
+    cur_ = NULL;
+    ptr_ = end_ = NULL;
+    used_ = 0;
+    chunkNum_ = 0;
+}
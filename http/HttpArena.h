@@ -0,0 +1,148 @@
+#ifndef __HTTP_ARENA_H__
+#define __HTTP_ARENA_H__
+
+#include <new>
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+#include "misc/NonCopyable.h"
+
+class PerThreadMemoryAlloc;
+
+/*
+ * bump allocator for memory that lives as long as a request, eg, what handler builds
+ * the response with.
+ *
+ * a) memory is carved from chunks taken from a per thread pool, chunk is malloc-ed if
+ *    the pool of current thread runs out, allocation larger than a chunk is malloc-ed alone.
+ * b) nothing is freed one by one, Reset() rewinds to the first chunk in O(1), chunks
+ *    are kept for next request, Clear() gives them back to the pool.
+ * c) not thread safe.
+ */
+class HttpArena: public noncopyable
+{
+    public:
+
+        HttpArena();
+        ~HttpArena();
+
+        // aligned to pointer size, return NULL if out of memory.
+        void* Alloc(size_t sz);
+
+        // copy of str, terminated by '\0'.
+        char* Strdup(const char* str, size_t len);
+
+        void Reset();
+        void Clear();
+
+        // bytes allocated since last reset, and chunks held.
+        size_t GetUsed() const { return used_; }
+        size_t GetChunkNum() const { return chunkNum_; }
+
+        static size_t GetChunkSize();
+
+    private:
+
+        struct Chunk;
+
+        void* AllocSlow(size_t sz);
+        void  FreeLarge();
+
+        static PerThreadMemoryAlloc* GetPool();
+
+        // chunks in use are from head_ to cur_, the ones behind cur_ are spare.
+        Chunk* head_;
+        Chunk* cur_;
+
+        char* ptr_;
+        char* end_;
+
+        Chunk* large_;
+
+        size_t used_;
+        size_t chunkNum_;
+};
+
+inline void* HttpArena::Alloc(size_t sz)
+{
+    sz = (sz + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    if ((size_t)(end_ - ptr_) < sz) return AllocSlow(sz);
+
+    void* mem = ptr_;
+
+    ptr_  += sz;
+    used_ += sz;
+
+    return mem;
+}
+
+// stl allocator on top of HttpArena, deallocation is a no-op.
+template<class Type>
+class HttpArenaAllocator
+{
+    public:
+
+        typedef Type value_type;
+        typedef Type* pointer;
+        typedef const Type* const_pointer;
+        typedef Type& reference;
+        typedef const Type& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<class Other>
+        struct rebind
+        {
+            typedef HttpArenaAllocator<Other> other;
+        };
+
+        explicit HttpArenaAllocator(HttpArena* arena): arena_(arena) {}
+
+        template<class Other>
+        HttpArenaAllocator(const HttpArenaAllocator<Other>& other): arena_(other.GetArena()) {}
+
+        pointer allocate(size_type n, const void* = 0)
+        {
+            void* mem = arena_->Alloc(n * sizeof(Type));
+            if (mem == NULL) throw std::bad_alloc();
+
+            return (pointer)mem;
+        }
+
+        void deallocate(pointer, size_type) {}
+
+        size_type max_size() const { return ((size_type)-1) / sizeof(Type); }
+
+        void construct(pointer p, const Type& val) { new ((void*)p) Type(val); }
+        void destroy(pointer p) { p->~Type(); }
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+
+        HttpArena* GetArena() const { return arena_; }
+
+        template<class Other>
+        bool operator==(const HttpArenaAllocator<Other>& other) const { return arena_ == other.GetArena(); }
+
+        template<class Other>
+        bool operator!=(const HttpArenaAllocator<Other>& other) const { return arena_ != other.GetArena(); }
+
+    private:
+
+        HttpArena* arena_;
+};
+
+// containers allocating from arena, eg:
+// HttpArenaString body((HttpArenaAllocator<char>(arena)));
+// HttpArenaVector<int>::Type ids((HttpArenaAllocator<int>(arena)));
+typedef std::basic_string<char, std::char_traits<char>, HttpArenaAllocator<char> > HttpArenaString;
+
+template<class Elem>
+struct HttpArenaVector
+{
+    typedef std::vector<Elem, HttpArenaAllocator<Elem> > Type;
+};
+
+#endif
@@ -0,0 +1,759 @@
+#include "HttpAsyncClient.h"
+
+#include "sys/Log.h"
+
+#include <deque>
+#include <algorithm>
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+// size of buffer holding output, the largest HttpWriteBuffer hands out by default.
+#define CLIENT_WRITE_SIZE (8*1024)
+
+static const char HTTP_CRLF[] = "\r\n";
+
+struct ClientCall
+{
+    explicit ClientCall(const HttpResponseHandler& handler)
+        :handler_(handler)
+        ,idempotent_(false)
+        ,head_(false)
+        ,retried_(false)
+    {
+    }
+
+    HttpResponseHandler handler_;
+
+    // serialized request, kept for retrying.
+    std::string request_;
+
+    bool idempotent_;
+    bool head_;
+    bool retried_;
+
+    HttpClientResponse response_;
+};
+
+struct ClientHost
+{
+    std::string host_;
+    int port_;
+
+    // most recently used connection is at the back.
+    std::vector<ClientConn*> conns_;
+    std::deque<ClientCall*> pending_;
+};
+
+struct ClientConn
+{
+    ClientConn(SocketConnection* conn, ClientHost* host)
+        :conn_(conn)
+        ,handle_(conn->GetHandle())
+        ,host_(host)
+        ,parser_(HttpMessageParser::HPT_RESPONSE)
+        ,readBuffer_()
+        ,outSize_(0)
+        ,error_(HCE_CLOSED)
+        ,connected_(false)
+        ,eof_(false)
+        ,shut_(false)
+        ,dead_(false)
+        ,dirty_(false)
+        ,started_(false)
+    {
+    }
+
+    SocketConnection* conn_;
+
+    // slot of conn_ is reused by later connections, events are matched by handle.
+    const ConnHandle handle_;
+
+    ClientHost* host_;
+
+    // requests sent or queued to be sent, front one is being responded.
+    std::deque<ClientCall*> inflight_;
+
+    HttpMessageParser parser_;
+    HttpReadBuffer readBuffer_;
+
+    HttpBufferList output_;
+    int outSize_;
+
+    // reported to requests in flight when connection dies.
+    int error_;
+
+    bool connected_;
+    bool eof_;     // closed by remote
+    bool shut_;    // fail to send, only responses sent already are read
+    bool dead_;    // close now
+    bool dirty_;   // in the list to be settled
+    bool started_; // response to the front request has begun
+};
+
+static void AppendBody(void* arg, const char* data, int len)
+{
+    ((std::string*)arg)->append(data, len);
+}
+
+static bool IsIdempotent(const std::string& method)
+{
+    static const char* methods[] = { "GET", "HEAD", "PUT", "DELETE", "OPTIONS", "TRACE" };
+
+    for (size_t i = 0; i < sizeof(methods)/sizeof(methods[0]); ++i)
+    {
+        if (method == methods[i]) return true;
+    }
+
+    return false;
+}
+
+// headers framing the message are generated by client.
+static bool IsReservedHeader(const std::string& name)
+{
+    return strcasecmp(name.c_str(), "Host") == 0
+        || strcasecmp(name.c_str(), "Content-Length") == 0
+        || strcasecmp(name.c_str(), "Transfer-Encoding") == 0
+        || strcasecmp(name.c_str(), "Connection") == 0;
+}
+
+const std::string* HttpClientResponse::GetHeader(const char* name) const
+{
+    return HttpMessageParser::FindHeader(headers_, name);
+}
+
+HttpAsyncClient::HttpAsyncClient(SocketServer& server)
+    :handling_(false)
+    ,maxConn_(8)
+    ,maxIdle_(8)
+    ,maxPipeline_(1)
+    ,outstanding_(0)
+    ,connNum_(0)
+    ,connects_(0)
+    ,writeBuffer_()
+    ,tcpServer_(server)
+    ,conn_(SocketServer::max_conn_id)
+{
+}
+
+HttpAsyncClient::~HttpAsyncClient()
+{
+    std::map<std::string, ClientHost*>::iterator it;
+
+    for (it = host_.begin(); it != host_.end(); ++it)
+    {
+        ClientHost* host = it->second;
+
+        for (size_t i = 0; i < host->conns_.size(); ++i)
+        {
+            ClientConn* conn = host->conns_[i];
+
+            HttpBuffer* buf;
+            while ((buf = conn->output_.PopFront()) != NULL)
+            {
+                writeBuffer_.ReleaseWriteBuffer(buf);
+            }
+
+            for (size_t j = 0; j < conn->inflight_.size(); ++j) delete conn->inflight_[j];
+
+            conn->conn_->CloseConnection();
+            delete conn;
+        }
+
+        for (size_t i = 0; i < host->pending_.size(); ++i) delete host->pending_[i];
+
+        delete host;
+    }
+
+    for (size_t i = 0; i < done_.size(); ++i) delete done_[i];
+}
+
+ClientHost* HttpAsyncClient::GetHost(const std::string& host, int port)
+{
+    char key[16];
+    snprintf(key, sizeof(key), ":%d", port);
+
+    ClientHost*& entry = host_[host + key];
+
+    if (entry == NULL)
+    {
+        entry = new ClientHost();
+        entry->host_ = host;
+        entry->port_ = port;
+    }
+
+    return entry;
+}
+
+bool HttpAsyncClient::Request(const HttpClientRequest& req, const HttpResponseHandler& handler)
+{
+    if (req.host_.empty() || req.method_.empty() || req.url_.empty() || req.port_ <= 0) return false;
+
+    ClientCall* call = new ClientCall(handler);
+
+    call->idempotent_ = IsIdempotent(req.method_);
+    call->head_ = (req.method_ == "HEAD");
+
+    std::string& head = call->request_;
+    head.reserve(256 + req.body_.size());
+
+    head += req.method_;
+    head += " ";
+    head += req.url_;
+    head += " HTTP/1.1\r\n";
+
+    head += "Host: " + req.host_;
+    if (req.port_ != 80)
+    {
+        char port[16];
+        snprintf(port, sizeof(port), ":%d", req.port_);
+        head += port;
+    }
+    head += HTTP_CRLF;
+
+    for (size_t i = 0; i < req.headers_.size(); ++i)
+    {
+        if (IsReservedHeader(req.headers_[i].first)) continue;
+
+        head += req.headers_[i].first;
+        head += ": ";
+        head += req.headers_[i].second;
+        head += HTTP_CRLF;
+    }
+
+    if (!req.body_.empty() || req.method_ == "POST" || req.method_ == "PUT" || req.method_ == "PATCH")
+    {
+        char len[64];
+        snprintf(len, sizeof(len), "Content-Length: %d\r\n", (int)req.body_.size());
+        head += len;
+    }
+
+    head += "Connection: keep-alive\r\n";
+    head += HTTP_CRLF;
+    head += req.body_;
+
+    ClientHost* host = GetHost(req.host_, req.port_);
+
+    host->pending_.push_back(call);
+    ++outstanding_;
+
+    Dispatch(host);
+
+    // requests issued from handler are settled by the caller of handler.
+    if (!handling_) Settle();
+
+    return true;
+}
+
+bool HttpAsyncClient::ProcessEvent(SocketEvent evt)
+{
+    if (evt.conn->GetOpaqueValue() != GetOpaqueValue()) return false;
+
+    ClientConn** slot = conn_.Get(evt.conn->GetConnectionId());
+    if (slot == NULL || *slot == NULL || (*slot)->handle_ != evt.conn->GetHandle()) return true;
+
+    ClientConn* conn = *slot;
+
+    switch (evt.code)
+    {
+        case SC_READ:
+        case SC_WRITE:
+            {
+                HandleEvent(conn);
+            }
+            break;
+        case SC_CONNECTED:
+            {
+                conn->connected_ = true;
+                MarkDirty(conn);
+            }
+            break;
+        case SC_FAIL_CONN:
+            {
+                slog(LOG_WARN, "client: failed to connect to %s:%d",
+                        conn->host_->host_.c_str(), conn->host_->port_);
+
+                conn->error_ = HCE_CONNECT;
+                conn->dead_ = true;
+                MarkDirty(conn);
+            }
+            break;
+        default:
+            {
+            }
+            break;
+    }
+
+    Settle();
+    return true;
+}
+
+void HttpAsyncClient::HandleEvent(ClientConn* conn)
+{
+    if (conn->connected_ && conn->outSize_ > 0) FlushConn(conn);
+
+    // responses are taken in full, keep reading until socket is drained.
+    while (!conn->dead_ && !conn->eof_)
+    {
+        int size = 0;
+        conn->readBuffer_.GetFreeBuffer(size);
+
+        if (size <= 0) break;
+
+        int n = ReadConn(conn);
+        if (n < 0) conn->eof_ = true;
+
+        ProcessConn(conn);
+
+        if (n < size) break;
+    }
+
+    MarkDirty(conn);
+
+    // connection may be able to take queued requests now.
+    Dispatch(conn->host_);
+}
+
+void HttpAsyncClient::Dispatch(ClientHost* host)
+{
+    while (!host->pending_.empty())
+    {
+        ClientCall* call = host->pending_.front();
+
+        // a new connection is preferred to pipelining, responses on it don't wait for others.
+        ClientConn* conn = PickIdle(host);
+
+        if (conn == NULL && (int)host->conns_.size() < maxConn_)
+        {
+            conn = OpenConn(host);
+
+            if (conn == NULL)
+            {
+                host->pending_.pop_front();
+                Complete(call, HCE_CONNECT);
+                continue;
+            }
+        }
+
+        if (conn == NULL) conn = PickPipeline(host, call);
+
+        // requests are sent in order, the rest wait for the front one.
+        if (conn == NULL) return;
+
+        host->pending_.pop_front();
+        AssignCall(conn, call);
+    }
+}
+
+ClientConn* HttpAsyncClient::PickIdle(ClientHost* host)
+{
+    for (size_t i = host->conns_.size(); i > 0; --i)
+    {
+        ClientConn* conn = host->conns_[i - 1];
+
+        if (!conn->dead_ && !conn->shut_ && conn->inflight_.empty()) return conn;
+    }
+
+    return NULL;
+}
+
+// connection with the fewest requests in flight, all of which must be idempotent.
+ClientConn* HttpAsyncClient::PickPipeline(ClientHost* host, const ClientCall* call)
+{
+    if (!call->idempotent_) return NULL;
+
+    ClientConn* best = NULL;
+
+    for (size_t i = 0; i < host->conns_.size(); ++i)
+    {
+        ClientConn* conn = host->conns_[i];
+
+        if (conn->dead_ || conn->shut_ || (int)conn->inflight_.size() >= maxPipeline_) continue;
+
+        // non-idempotent request is only sent on idle connection, it is always the front one.
+        if (!conn->inflight_.front()->idempotent_) continue;
+
+        if (best == NULL || conn->inflight_.size() < best->inflight_.size()) best = conn;
+    }
+
+    return best;
+}
+
+ClientConn* HttpAsyncClient::OpenConn(ClientHost* host)
+{
+    SocketConnection* sock = tcpServer_.ConnectToAsync(host->host_.c_str(), host->port_, GetOpaqueValue());
+    if (sock == NULL)
+    {
+        slog(LOG_WARN, "client: failed to connect to %s:%d", host->host_.c_str(), host->port_);
+        return NULL;
+    }
+
+    ClientConn** slot = conn_.Alloc(sock->GetConnectionId());
+    if (slot == NULL)
+    {
+        sock->CloseConnection();
+        return NULL;
+    }
+
+    delete *slot;
+
+    ClientConn* conn = new ClientConn(sock, host);
+    conn->connected_ = sock->IsConnected();
+
+    *slot = conn;
+    host->conns_.push_back(conn);
+
+    ++connNum_;
+    ++connects_;
+
+    MarkDirty(conn);
+
+    return conn;
+}
+
+void HttpAsyncClient::AssignCall(ClientConn* conn, ClientCall* call)
+{
+    conn->inflight_.push_back(call);
+
+    AppendOutput(conn, call->request_.c_str(), call->request_.size());
+
+    if (conn->inflight_.size() == 1) StartResponse(conn);
+}
+
+void HttpAsyncClient::StartResponse(ClientConn* conn)
+{
+    ClientCall* call = conn->inflight_.front();
+
+    conn->parser_.Reset();
+    conn->parser_.SetHeadRequest(call->head_);
+    conn->parser_.SetBodyHandler(&AppendBody, &call->response_.body_);
+
+    conn->started_ = false;
+}
+
+int HttpAsyncClient::ReadConn(ClientConn* conn)
+{
+    int size = 0;
+    char* buf = conn->readBuffer_.GetFreeBuffer(size);
+
+    if (size <= 0) return 0;
+
+    int n = conn->conn_->ReadBuffer(buf, size);
+    if (n > 0) conn->readBuffer_.IncreaseContentRange(n);
+
+    return n;
+}
+
+int HttpAsyncClient::FlushConn(ClientConn* conn)
+{
+    HttpBuffer* buf;
+
+    while ((buf = conn->output_.GetFront()) != NULL)
+    {
+        // buffers queued behind are coalesced into the same segments.
+        int sz = conn->conn_->SendBuffer(buf->curPtr_, buf->curSize_, buf != conn->output_.GetTail());
+        if (sz < 0)
+        {
+            // server may have closed after responding, eg, to "Connection: close",
+            // responses already sent are still read, requests behind are retried on eof.
+            while ((buf = conn->output_.PopFront()) != NULL)
+            {
+                writeBuffer_.ReleaseWriteBuffer(buf);
+            }
+
+            conn->outSize_ = 0;
+            conn->shut_ = true;
+            return -1;
+        }
+
+        conn->outSize_ -= sz;
+
+        if (sz < buf->curSize_)
+        {
+            buf->curPtr_ += sz;
+            buf->curSize_ -= sz;
+            break;
+        }
+
+        conn->output_.PopFront();
+        writeBuffer_.ReleaseWriteBuffer(buf);
+    }
+
+    return 0;
+}
+
+bool HttpAsyncClient::AppendOutput(ClientConn* conn, const char* data, int len)
+{
+    HttpBuffer* tail = conn->output_.GetTail();
+
+    MarkDirty(conn);
+
+    while (len > 0)
+    {
+        int room = 0;
+        if (tail) room = tail->memory_ + tail->size_ - (tail->curPtr_ + tail->curSize_);
+
+        if (room == 0)
+        {
+            tail = writeBuffer_.AllocWriteBuffer(CLIENT_WRITE_SIZE);
+            if (tail == NULL)
+            {
+                conn->dead_ = true;
+                return false;
+            }
+
+            conn->output_.PushBack(tail);
+            room = tail->size_;
+        }
+
+        int sz = room < len? room : len;
+
+        memcpy(tail->curPtr_ + tail->curSize_, data, sz);
+
+        tail->curSize_ += sz;
+        conn->outSize_ += sz;
+
+        data += sz;
+        len  -= sz;
+    }
+
+    return true;
+}
+
+void HttpAsyncClient::ProcessConn(ClientConn* conn)
+{
+    HttpReadBuffer& buffer = conn->readBuffer_;
+    HttpMessageParser& parser = conn->parser_;
+
+    while (!conn->dead_)
+    {
+        const char* data = buffer.GetContentStart();
+        int len = buffer.GetContenLen();
+
+        if (conn->inflight_.empty())
+        {
+            // idle connection is closed by server, or sends garbage, or can't send any more.
+            if (len > 0 || conn->eof_ || conn->shut_) conn->dead_ = true;
+            return;
+        }
+
+        if (len > 0) conn->started_ = true;
+
+        bool head = parser.GetState() == HttpMessageParser::HPS_HEAD;
+
+        int n = 0;
+        if (len > 0) n = parser.Parse(data, len);
+
+        if (n < 0)
+        {
+            conn->error_ = HCE_MALFORMED;
+            conn->dead_ = true;
+            return;
+        }
+
+        if (n == 0)
+        {
+            if (!conn->eof_) return;
+
+            if (parser.FinishOnClose()) FinishCall(conn);
+            else conn->dead_ = true;
+
+            return;
+        }
+
+        buffer.ConsumeBuffer(n);
+
+        if (head)
+        {
+            ClientCall* call = conn->inflight_.front();
+
+            // interim response, the final one follows.
+            if (parser.GetStatusCode() < 200)
+            {
+                parser.Reset();
+                parser.SetHeadRequest(call->head_);
+                continue;
+            }
+
+            HttpClientResponse& resp = call->response_;
+
+            resp.status_ = parser.GetStatusCode();
+            resp.reason_ = parser.GetReason();
+            resp.headers_ = parser.GetHeaders();
+        }
+
+        if (parser.IsMessageComplete()) FinishCall(conn);
+    }
+}
+
+void HttpAsyncClient::FinishCall(ClientConn* conn)
+{
+    ClientCall* call = conn->inflight_.front();
+
+    conn->inflight_.pop_front();
+
+    Complete(call, HCE_OK);
+
+    // requests pipelined behind are sent again on another connection.
+    if (!conn->parser_.IsKeepAlive())
+    {
+        conn->started_ = false;
+        conn->dead_ = true;
+        return;
+    }
+
+    if (!conn->inflight_.empty())
+    {
+        StartResponse(conn);
+        return;
+    }
+
+    ClientHost* host = conn->host_;
+    std::vector<ClientConn*>& conns = host->conns_;
+
+    std::vector<ClientConn*>::iterator it = std::find(conns.begin(), conns.end(), conn);
+    conns.erase(it);
+    conns.push_back(conn);
+
+    int idle = 0;
+    for (size_t i = 0; i < conns.size(); ++i)
+    {
+        if (conns[i]->inflight_.empty()) ++idle;
+    }
+
+    if (idle > maxIdle_) conn->dead_ = true;
+}
+
+void HttpAsyncClient::MarkDirty(ClientConn* conn)
+{
+    if (conn->dirty_) return;
+
+    conn->dirty_ = true;
+    dirty_.push_back(conn);
+}
+
+// flush, re-arm or close the connections touched by current event.
+// closing a connection may dispatch its requests to others, the list grows while walking it.
+void HttpAsyncClient::SettleDirty()
+{
+    for (size_t i = 0; i < dirty_.size(); ++i)
+    {
+        ClientConn* conn = dirty_[i];
+
+        conn->dirty_ = false;
+
+        if (!conn->dead_ && conn->connected_ && conn->outSize_ > 0) FlushConn(conn);
+
+        if (conn->dead_)
+        {
+            ClientHost* host = conn->host_;
+
+            CloseConn(conn);
+            Dispatch(host);
+            continue;
+        }
+
+        bool write = conn->outSize_ > 0 || !conn->connected_;
+
+        conn->conn_->WatchEvent(true, write);
+    }
+
+    dirty_.clear();
+}
+
+// requests in flight are either failed or queued again to be retried.
+void HttpAsyncClient::FailConn(ClientConn* conn)
+{
+    ClientHost* host = conn->host_;
+
+    while (!conn->inflight_.empty())
+    {
+        ClientCall* call = conn->inflight_.back();
+        conn->inflight_.pop_back();
+
+        bool front = conn->inflight_.empty();
+
+        bool retry = conn->error_ == HCE_CLOSED && call->idempotent_
+            && !call->retried_ && !(front && conn->started_);
+
+        if (retry)
+        {
+            call->retried_ = true;
+            call->response_ = HttpClientResponse();
+
+            host->pending_.push_front(call);
+            continue;
+        }
+
+        Complete(call, (front || conn->error_ == HCE_CONNECT)? conn->error_ : HCE_CLOSED);
+    }
+}
+
+void HttpAsyncClient::CloseConn(ClientConn* conn)
+{
+    std::vector<ClientConn*>& conns = conn->host_->conns_;
+
+    std::vector<ClientConn*>::iterator it = std::find(conns.begin(), conns.end(), conn);
+    if (it != conns.end()) conns.erase(it);
+
+    FailConn(conn);
+
+    HttpBuffer* buf;
+    while ((buf = conn->output_.PopFront()) != NULL)
+    {
+        writeBuffer_.ReleaseWriteBuffer(buf);
+    }
+
+    int id = conn->conn_->GetConnectionId();
+
+    conn->conn_->CloseConnection();
+
+    ClientConn** slot = conn_.Get(id);
+    if (slot && *slot == conn) *slot = NULL;
+
+    --connNum_;
+
+    delete conn;
+}
+
+void HttpAsyncClient::Complete(ClientCall* call, int error)
+{
+    call->response_.error_ = error;
+    done_.push_back(call);
+}
+
+void HttpAsyncClient::DeliverDone()
+{
+    std::vector<ClientCall*> done;
+    done.swap(done_);
+
+    for (size_t i = 0; i < done.size(); ++i)
+    {
+        ClientCall* call = done[i];
+
+        --outstanding_;
+
+        call->handler_(&call->response_);
+
+        delete call;
+    }
+}
+
+// handlers run after connections are settled, requests they issue are settled in turn.
+void HttpAsyncClient::Settle()
+{
+    handling_ = true;
+
+    while (true)
+    {
+        SettleDirty();
+
+        if (done_.empty()) break;
+
+        DeliverDone();
+    }
+
+    handling_ = false;
+}
+
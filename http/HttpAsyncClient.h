@@ -0,0 +1,165 @@
+#ifndef __HTTP_ASYNC_CLIENT_H__
+#define __HTTP_ASYNC_CLIENT_H__
+
+#include "HttpBuffer.h"
+#include "HttpMessageParser.h"
+#include "SocketServer.h"
+#include "misc/functor.h"
+#include "misc/NonCopyable.h"
+#include "misc/PagedTable.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+struct ClientCall;
+struct ClientConn;
+struct ClientHost;
+
+enum HttpClientError
+{
+    HCE_OK,
+    HCE_CONNECT,   // fail to resolve or connect to host
+    HCE_CLOSED,    // connection is closed before response is complete
+    HCE_MALFORMED, // response can't be parsed
+};
+
+typedef HttpMessageParser::Header HttpClientHeader;
+
+struct HttpClientRequest
+{
+    HttpClientRequest(): method_("GET"), port_(80), url_("/") {}
+
+    void AddHeader(const std::string& name, const std::string& value)
+    {
+        headers_.push_back(HttpClientHeader(name, value));
+    }
+
+    std::string method_;
+    std::string host_;
+    int port_;
+    std::string url_;
+
+    // Host, Content-Length and Connection are filled by client.
+    std::vector<HttpClientHeader> headers_;
+    std::string body_;
+};
+
+struct HttpClientResponse
+{
+    HttpClientResponse(): error_(HCE_OK), status_(0) {}
+
+    // case insensitive, return NULL if not found.
+    const std::string* GetHeader(const char* name) const;
+
+    int error_;
+    int status_;
+    std::string reason_;
+    std::vector<HttpClientHeader> headers_;
+    std::string body_;
+};
+
+// called in polling thread when the request is done or fails,
+// response is owned by client and only valid during the call.
+typedef misc::function<void, HttpClientResponse*> HttpResponseHandler;
+
+/*
+ * non-blocking http/1.1 client, one instance per polling thread, no locking involved.
+ *
+ * a) connections are kept alive and pooled per host:port, at most
+ *    SetMaxConnPerHost() of them are opened, requests beyond wait in a queue.
+ * b) idempotent requests can be pipelined on one connection, up to
+ *    SetMaxPipeline() in flight, responses are delivered in order.
+ * c) an idempotent request is retried once on a new connection if the one
+ *    it is sent on is closed before any of the response arrives, which is
+ *    what happens when a pooled connection is timed out by the server.
+ * d) connections are opened on the SocketServer of the caller, which keeps polling
+ *    it and passes every event to ProcessEvent(), so that requests fan out from the
+ *    same event loop as the rest of the work, without threads of their own.
+ * e) responses are framed by HttpMessageParser, the parser HttpProxy uses, headers
+ *    share syntax and helpers with requests parsed by HttpClient.
+ * f) functions must be called in the polling thread, from handlers, or
+ *    before polling starts.
+ */
+class HttpAsyncClient: public noncopyable
+{
+    public:
+
+        explicit HttpAsyncClient(SocketServer& server);
+
+        // requests in flight are dropped without calling handler.
+        ~HttpAsyncClient();
+
+        void SetMaxConnPerHost(int num) { maxConn_ = num; }
+        void SetMaxIdlePerHost(int num) { maxIdle_ = num; }
+
+        // 1 disables pipelining.
+        void SetMaxPipeline(int depth) { maxPipeline_ = depth; }
+
+        // return false if request is invalid, otherwise handler is always called.
+        bool Request(const HttpClientRequest& req, const HttpResponseHandler& handler);
+
+        // handle event of the server, return false if it is not of a connection of this
+        // client, which carries GetOpaqueValue() as opaque value, the caller handles it then.
+        bool ProcessEvent(SocketEvent evt);
+
+        uintptr_t GetOpaqueValue() const { return (uintptr_t)this; }
+
+        // requests not done yet.
+        int GetOutstanding() const { return outstanding_; }
+
+        int GetConnNumber() const { return connNum_; }
+        int64_t GetConnects() const { return connects_; }
+
+    private:
+
+        ClientHost* GetHost(const std::string& host, int port);
+
+        void HandleEvent(ClientConn* conn);
+
+        // dispatch queued requests of host to connections that can take them.
+        void Dispatch(ClientHost* host);
+        ClientConn* PickIdle(ClientHost* host);
+        ClientConn* PickPipeline(ClientHost* host, const ClientCall* call);
+        ClientConn* OpenConn(ClientHost* host);
+        void AssignCall(ClientConn* conn, ClientCall* call);
+
+        int  ReadConn(ClientConn* conn);
+        int  FlushConn(ClientConn* conn);
+        bool AppendOutput(ClientConn* conn, const char* data, int len);
+        void ProcessConn(ClientConn* conn);
+        void StartResponse(ClientConn* conn);
+        void FinishCall(ClientConn* conn);
+
+        void MarkDirty(ClientConn* conn);
+        void SettleDirty();
+        void FailConn(ClientConn* conn);
+        void CloseConn(ClientConn* conn);
+
+        void Complete(ClientCall* call, int error);
+        void DeliverDone();
+        void Settle();
+
+        bool handling_;
+
+        int maxConn_;
+        int maxIdle_;
+        int maxPipeline_;
+
+        int outstanding_;
+        int connNum_;
+        int64_t connects_;
+
+        std::map<std::string, ClientHost*> host_;
+        std::vector<ClientConn*> dirty_;
+        std::vector<ClientCall*> done_;
+
+        HttpWriteBuffer writeBuffer_;
+        SocketServer& tcpServer_;
+        PagedTable<ClientConn*> conn_;
+};
+
+#endif
+
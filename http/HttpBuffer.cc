@@ -1,8 +1,17 @@
 #include "HttpBuffer.h"
 
+#include "sys/Log.h"
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+// mirrored regions freed are kept by each thread for reuse, as a new one costs a memfd,
+// a reserve and two fixed mappings, and connections come and go with the same sizes.
+#define MIRROR_POOL_NUM (8)
 
 static HttpBuffer* AllocHttpBuffer(int sz)
 {
@@ -13,6 +22,7 @@ static HttpBuffer* AllocHttpBuffer(int sz)
     buff->curPtr_ = buff->memory_;
     buff->curSize_ = 0;
     buff->next_ = NULL;
+    buff->ref_ = 1;
 
     return buff;
 }
@@ -22,6 +32,18 @@ static inline void FreeHttpBuffer(HttpBuffer* buf)
     free(buf);
 }
 
+void RetainHttpBuffer(HttpBuffer* buf)
+{
+    ++buf->ref_;
+}
+
+void ReleaseHttpBuffer(void* buf)
+{
+    HttpBuffer* entity = (HttpBuffer*)buf;
+
+    if (--entity->ref_ == 0) FreeHttpBuffer(entity);
+}
+
 HttpBufferList::HttpBufferList()
     :head_(NULL), tail_(NULL)
 {
@@ -64,11 +86,14 @@ void HttpBufferList::PushBack(HttpBuffer* node)
 }
 
 // HttpReadBuffer
-HttpReadBuffer::HttpReadBuffer(int size)
-    : readBuff_(NULL)
-    , size_(size)
+HttpReadBuffer::HttpReadBuffer(int size, bool mirror)
+    : size_(size)
+    , mirror_(mirror)
+    , capacity_(0)
+    , head_(0)
+    , len_(0)
+    , memory_(NULL)
 {
-    InitBuffer();
 }
 
 HttpReadBuffer::~HttpReadBuffer()
@@ -76,86 +101,311 @@ HttpReadBuffer::~HttpReadBuffer()
     FreeBuffer();
 }
 
+// map a memfd twice back to back, so that data wrapping around the end is
+// still contiguous in memory.
+static char* MapMirror(int size)
+{
+    int fd = memfd_create("http_read_buffer", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    char* addr = NULL;
+
+    if (ftruncate(fd, size) == 0)
+    {
+        // reserve the range first, then put both views into it.
+        void* base = mmap(NULL, 2 * (size_t)size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (base != MAP_FAILED)
+        {
+            addr = (char*)base;
+
+            if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+                    || mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+            {
+                munmap(addr, 2 * (size_t)size);
+                addr = NULL;
+            }
+        }
+    }
+
+    // mappings keep the memory alive.
+    close(fd);
+
+    return addr;
+}
+
+struct MirrorPool
+{
+    int num_;
+    int size_[MIRROR_POOL_NUM];
+    char* addr_[MIRROR_POOL_NUM];
+};
+
+static pthread_key_t gs_mirror_key;
+static pthread_once_t gs_mirror_once = PTHREAD_ONCE_INIT;
+
+static void ReleaseMirrorPool(void* arg)
+{
+    MirrorPool* pool = (MirrorPool*)arg;
+
+    for (int i = 0; i < pool->num_; ++i)
+    {
+        munmap(pool->addr_[i], 2 * (size_t)pool->size_[i]);
+    }
+
+    free(pool);
+}
+
+static void InitMirrorKey()
+{
+    pthread_key_create(&gs_mirror_key, &ReleaseMirrorPool);
+}
+
+static MirrorPool* GetMirrorPool()
+{
+    pthread_once(&gs_mirror_once, &InitMirrorKey);
+
+    MirrorPool* pool = (MirrorPool*)pthread_getspecific(gs_mirror_key);
+    if (pool) return pool;
+
+    pool = (MirrorPool*)calloc(1, sizeof(MirrorPool));
+    if (pool && pthread_setspecific(gs_mirror_key, pool) != 0)
+    {
+        free(pool);
+        pool = NULL;
+    }
+
+    return pool;
+}
+
+static char* AllocMirror(int size)
+{
+    MirrorPool* pool = GetMirrorPool();
+
+    // most recently freed first, it is likely still in cache.
+    for (int i = pool? pool->num_ - 1 : -1; i >= 0; --i)
+    {
+        if (pool->size_[i] != size) continue;
+
+        char* addr = pool->addr_[i];
+
+        --pool->num_;
+        memmove(pool->size_ + i, pool->size_ + i + 1, (pool->num_ - i) * sizeof(int));
+        memmove(pool->addr_ + i, pool->addr_ + i + 1, (pool->num_ - i) * sizeof(char*));
+
+        return addr;
+    }
+
+    return MapMirror(size);
+}
+
+static void FreeMirror(char* addr, int size)
+{
+    MirrorPool* pool = GetMirrorPool();
+    if (pool == NULL)
+    {
+        munmap(addr, 2 * (size_t)size);
+        return;
+    }
+
+    // the one freed longest ago goes when pool is full.
+    if (pool->num_ == MIRROR_POOL_NUM)
+    {
+        munmap(pool->addr_[0], 2 * (size_t)pool->size_[0]);
+
+        --pool->num_;
+        memmove(pool->size_, pool->size_ + 1, pool->num_ * sizeof(int));
+        memmove(pool->addr_, pool->addr_ + 1, pool->num_ * sizeof(char*));
+    }
+
+    pool->size_[pool->num_] = size;
+    pool->addr_[pool->num_] = addr;
+    ++pool->num_;
+}
+
 void HttpReadBuffer::InitBuffer()
 {
-    readBuff_ = AllocHttpBuffer(size_);
+    head_ = 0;
+    len_  = 0;
+
+    if (mirror_)
+    {
+        int page = (int)sysconf(_SC_PAGESIZE);
+        int size = (size_ + page - 1) / page * page;
+
+        memory_ = AllocMirror(size);
+        if (memory_)
+        {
+            capacity_ = size;
+            return;
+        }
+
+        // out of mappings(vm.max_map_count) or fds, the buffer goes on with plain memory.
+        static bool warned = false;
+        if (!warned)
+        {
+            warned = true;
+            slog(LOG_WARN, "read buffer: mirrored mapping failed, plain memory is used");
+        }
+
+        mirror_ = false;
+    }
+
+    memory_ = (char*)malloc(size_);
+    capacity_ = memory_? size_ : 0;
+}
+
+static void FreeMemory(char* memory, int capacity, bool mirror)
+{
+    if (mirror)
+    {
+        FreeMirror(memory, capacity);
+    }
+    else
+    {
+        free(memory);
+    }
 }
 
 void HttpReadBuffer::FreeBuffer()
 {
-    FreeHttpBuffer(readBuff_);
+    if (memory_ == NULL) return;
+
+    FreeMemory(memory_, capacity_, mirror_);
+
+    memory_ = NULL;
+    capacity_ = 0;
+    head_ = 0;
+    len_  = 0;
+}
+
+void HttpReadBuffer::ReleaseBuffer()
+{
+    if (len_ == 0) FreeBuffer();
+}
+
+bool HttpReadBuffer::Resize(int size)
+{
+    if (size <= 0 || size < len_) return false;
+    if (size == size_ || memory_ == NULL)
+    {
+        size_ = size;
+        return true;
+    }
+
+    char* memory = memory_;
+    int capacity = capacity_;
+    bool mirror = mirror_;
+    int head = head_;
+    int len = len_;
+    int old = size_;
+
+    size_ = size;
+    InitBuffer();
+
+    if (memory_ == NULL)
+    {
+        memory_ = memory;
+        capacity_ = capacity;
+        mirror_ = mirror;
+        head_ = head;
+        len_ = len;
+        size_ = old;
+        return false;
+    }
+
+    // mirrored memory has content contiguous even if it wraps around.
+    memcpy(memory_, memory + head, len);
+    len_ = len;
+
+    FreeMemory(memory, capacity, mirror);
+
+    return true;
 }
 
 void HttpReadBuffer::ResetBuffer()
 {
-    readBuff_->curPtr_ = readBuff_->memory_;
-    readBuff_->curSize_ = 0;
+    head_ = 0;
+    len_  = 0;
 }
 
 void HttpReadBuffer::ConsumeBuffer(int sz)
 {
-    if (sz > readBuff_->curSize_) sz = readBuff_->curSize_;
+    if (sz > len_) sz = len_;
 
-    if (sz == readBuff_->curSize_)
+    head_ += sz;
+    len_  -= sz;
+
+    if (len_ == 0)
     {
-        readBuff_->curPtr_ = readBuff_->memory_;
+        head_ = 0;
     }
-    else
+    else if (head_ >= capacity_)
     {
-        readBuff_->curPtr_ += sz;
+        // only mirrored buffer gets here, the same bytes are seen from the first view.
+        head_ -= capacity_;
     }
-
-    readBuff_->curSize_ -= sz;
 }
 
 const char* HttpReadBuffer::GetContentPoint(int off) const
 {
-    if (off >= readBuff_->curSize_) return NULL;
+    if (off >= len_) return NULL;
 
-    return readBuff_->curPtr_ + off;
+    return memory_ + head_ + off;
 }
 
 const char* HttpReadBuffer::GetContentStart() const
 {
-    return readBuff_->curPtr_;
+    return memory_? memory_ + head_ : NULL;
 }
 
 const char* HttpReadBuffer::GetContentEnd() const
 {
-    return readBuff_->curPtr_ + readBuff_->curSize_;
+    return memory_? memory_ + head_ + len_ : NULL;
 }
 
-short HttpReadBuffer::MoveDataToFront(HttpBuffer* node) const
+void HttpReadBuffer::MoveDataToFront()
 {
-    memmove(node->memory_, node->curPtr_, node->curSize_);
-    node->curPtr_ = node->memory_;
-    return node->curSize_;
+    memmove(memory_, memory_ + head_, len_);
+    head_ = 0;
 }
 
 void HttpReadBuffer::IncreaseContentRange(int sz)
 {
-    readBuff_->curSize_ += sz;
-    assert(readBuff_->curPtr_ + readBuff_->curSize_ <= readBuff_->memory_ + readBuff_->size_);
+    len_ += sz;
+    assert(len_ <= capacity_);
+    assert(mirror_ || head_ + len_ <= capacity_);
 }
 
 #define MINI_SOCKET_READ_SIZE (64)
 
 char* HttpReadBuffer::GetFreeBuffer(int& size)
 {
-    int left = readBuff_->size_ - (readBuff_->curPtr_ - readBuff_->memory_) - readBuff_->curSize_;
+    if (memory_ == NULL) InitBuffer();
 
-    if (left < MINI_SOCKET_READ_SIZE) MoveDataToFront(readBuff_);
+    if (memory_ == NULL)
+    {
+        size = 0;
+        return NULL;
+    }
 
-    char* buffer = readBuff_->curPtr_ + readBuff_->curSize_;
+    // free space of mirrored buffer is always contiguous, right behind the content.
+    if (mirror_)
+    {
+        size = capacity_ - len_;
+        return memory_ + head_ + len_;
+    }
 
-    size   = readBuff_->memory_ + readBuff_->size_ - (readBuff_->curPtr_ + readBuff_->curSize_);
+    if (capacity_ - head_ - len_ < MINI_SOCKET_READ_SIZE) MoveDataToFront();
 
-    return buffer;
+    size = capacity_ - head_ - len_;
+
+    return memory_ + head_ + len_;
 }
 
 int HttpReadBuffer::GetContenLen() const
 {
-    return readBuff_->curSize_;
+    return len_;
 }
 
 // HttpWriteBuffer
@@ -192,6 +442,12 @@ bool HttpWriteBuffer::InitBuffer()
 }
 
 void HttpWriteBuffer::DestroyBuffer()
+{
+    ReleaseFreeBuffer();
+    free(freeBuffer_);
+}
+
+void HttpWriteBuffer::ReleaseFreeBuffer()
 {
     int i = 0;
     while (i < num_slot_)
@@ -209,13 +465,12 @@ void HttpWriteBuffer::DestroyBuffer()
         freeBuffer_[i] = NULL;
         ++i;
     }
-
-    free(freeBuffer_);
 }
 
 HttpBuffer* HttpWriteBuffer::AllocWriteBuffer(int sz)
 {
-    if (sz <= 0 || sz > num_slot_*size_) return NULL;
+    if (sz <= 0) return NULL;
+    if (sz > num_slot_*size_) return AllocHttpBuffer(sz);
 
     int mod = sz%size_;
 
@@ -243,6 +498,12 @@ HttpBuffer* HttpWriteBuffer::AllocWriteBuffer(int sz)
 
 void HttpWriteBuffer::ReleaseWriteBuffer(HttpBuffer* buf)
 {
+    if (!IsPooled(buf))
+    {
+        ReleaseHttpBuffer(buf);
+        return;
+    }
+
     int mod = buf->size_%size_;
 
     mod = mod > 0? size_ - mod : 0;
@@ -11,9 +11,17 @@ struct HttpBuffer
     char* curPtr_;
     HttpBuffer* next_;
 
+    // references held, counted for buffers not pooled by HttpWriteBuffer only.
+    int ref_;
+
     char memory_[1];
 };
 
+// buffer not pooled is freed when the last reference is released, so that it can be
+// sent by SocketConnection::SendZeroCopy(), which takes ReleaseHttpBuffer() as callback.
+void RetainHttpBuffer(HttpBuffer* buf);
+void ReleaseHttpBuffer(void* buf);
+
 class HttpBufferList
 {
     public:
@@ -33,11 +41,19 @@ class HttpBufferList
         HttpBuffer* tail_;
 };
 
+/*
+ * circular buffer of data read, mapped twice back to back from a memfd, so that content
+ * and free space are always contiguous, and nothing is moved no matter how data comes in.
+ * size is rounded up to page size then. each mapping takes 2 entries of vm.max_map_count,
+ * and a few freed ones are pooled by each thread. if mirror is not set, or mapping fails,
+ * plain memory is used from then on, where content is moved to front when free space left
+ * gets small, which is slower for large messages but works the same.
+ */
 class HttpReadBuffer: public noncopyable
 {
     public:
 
-        explicit HttpReadBuffer(int size = 8*1024);
+        explicit HttpReadBuffer(int size = 8*1024, bool mirror = true);
         ~HttpReadBuffer();
 
         int GetContenLen() const;
@@ -48,6 +64,16 @@ class HttpReadBuffer: public noncopyable
         void ResetBuffer();
         void ConsumeBuffer(int sz);
 
+        // memory is allocated on first GetFreeBuffer(), and given back by ReleaseBuffer()
+        // if no content is left, so that an idle connection holds none.
+        void ReleaseBuffer();
+        bool HasBuffer() const { return memory_ != NULL; }
+
+        // change size, content is kept, return false if it doesn't fit in the new size.
+        bool Resize(int size);
+        int  GetSize() const { return size_; }
+        bool IsMirrored() const { return memory_ != NULL && mirror_; }
+
         void IncreaseContentRange(int sz);
 
         char* GetFreeBuffer(int& size);
@@ -56,10 +82,18 @@ class HttpReadBuffer: public noncopyable
 
         void  FreeBuffer();
         void  InitBuffer();
-        short MoveDataToFront(HttpBuffer*) const;
+        void  MoveDataToFront();
 
-        const int size_;
-        HttpBuffer* readBuff_;
+        int size_;
+
+        bool mirror_;
+        int capacity_;
+
+        // offset of content, and length of it.
+        int head_;
+        int len_;
+
+        char* memory_;
 };
 
 class HttpWriteBuffer: public noncopyable
@@ -69,9 +103,16 @@ class HttpWriteBuffer: public noncopyable
         explicit HttpWriteBuffer(int granularity = 1024, int total = 8);
         ~HttpWriteBuffer();
 
+        // sz larger than the largest pooled buffer is allocated alone, with a reference
+        // released by ReleaseWriteBuffer().
         HttpBuffer* AllocWriteBuffer(int sz);
         void ReleaseWriteBuffer(HttpBuffer* entity);
 
+        // free buffers pooled, they are allocated again on demand.
+        void ReleaseFreeBuffer();
+
+        bool IsPooled(const HttpBuffer* buf) const { return buf->size_ <= num_slot_*size_; }
+
     private:
 
         bool  InitBuffer();
@@ -1,22 +1,73 @@
 #include "HttpClient.h"
+#include "HttpMessageParser.h"
+
+#include "sys/Clock.h"
 
 #include <algorithm>
 
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// bytes read from a connection in one event.
+#define HTTP_READ_BUDGET (256*1024)
+
+// read buffer grows up to max when reads fill it, and shrinks back to min when
+// an event reads less than a quarter of it.
+#define HTTP_READ_BUFFER_MIN (8*1024)
+#define HTTP_READ_BUFFER_MAX (256*1024)
+
+// events in a row reading little before the buffer shrinks.
+#define HTTP_READ_SHRINK_EVENTS (4)
+
+// request line or header line longer than this is rejected, rather than waited for.
+#define HTTP_LINE_MAX (8*1024)
+
+// frames buffered by idle http/2 session are given back beyond this.
+#define HTTP2_OUTPUT_KEEP (16*1024)
+
 static const char HTTP_CTRL[] = "\r\n";
-static const char HTTP_HEADER_DELIM[] = ": ";
 
 static const int HTTP_CTRL_LEN = sizeof(HTTP_CTRL) - 1;
-static const int HTTP_HEADER_DELIM_LEN = sizeof(HTTP_HEADER_DELIM) - 1;
+
+static const char HTTP_BAD_REQUEST_RESPONSE[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char HTTP2_UPGRADE_RESPONSE[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: h2c\r\n"
+    "\r\n";
 
 HttpClient::HttpClient(HttpHandler handler)
     :keepalive_(false)
+    ,drained_(false)
+    ,armed_(false)
+    ,budget_(0)
+    ,quietEvents_(0)
+    ,readBudget_(HTTP_READ_BUDGET)
+    ,pendingSize_(0)
+    ,handled_(0)
+    ,handlerLatency_(0)
+    ,bodyLeft_(0)
+    ,h2_(NULL)
     ,evtHandler_(&HttpClient::ProcessRequestLine)
     ,cgi_(handler)
+    ,partHandler_(NULL)
+    ,entities_(NULL)
 {
+    memset(&readStats_, 0, sizeof(readStats_));
+
+    request_.SetArena(&arena_);
+    multipart_.SetPartHandler(&HttpClient::OnPartEvent, this);
 }
 
 HttpClient::~HttpClient()
 {
+    delete h2_;
 }
 
 void HttpClient::SetConnection(SocketConnection* conn)
@@ -42,6 +93,17 @@ void HttpClient::ResetClient(SocketConnection* conn)
         buf = pendingWrite_.PopFront();
     }
 
+    pendingSize_ = 0;
+    streamTopic_.clear();
+
+    bodyLeft_ = 0;
+    multipart_.Reset();
+
+    delete h2_;
+    h2_ = NULL;
+
+    // idle client holds no chunk.
+    arena_.Clear();
     conn_ = conn;
     evtHandler_ = &HttpClient::ProcessRequestLine;
 }
@@ -57,6 +119,12 @@ int HttpClient::ProcessEvent(SocketEvent evt)
     int ret = 0;
     int len = 0;
 
+    drained_ = false;
+    armed_ = false;
+    budget_ = readBudget_;
+
+    int64_t bytes = readStats_.bytes;
+
     do
     {
         len = (this->*evtHandler_)(evt);
@@ -70,21 +138,95 @@ int HttpClient::ProcessEvent(SocketEvent evt)
 
     } while (len > 0);
 
+    if (evt.code == SC_READ && !IsStreaming())
+    {
+        ++readStats_.events;
+
+        if (drained_) ++readStats_.drained;
+        else if (budget_ <= 0) ++readStats_.budgetHits;
+
+        AdaptReadBuffer(readStats_.bytes - bytes);
+    }
+
     return ret;
 }
 
 int HttpClient::ReadHttpData()
 {
-    int sz = readBuffer_.GetContenLen();
-    if (sz) return 0;
+    int total = 0;
+    bool unarmed = false;
+
+    while (!drained_ && budget_ > 0)
+    {
+        int free = 0;
+        char* buf = readBuffer_.GetFreeBuffer(free);
 
-    char* buf = readBuffer_.GetFreeBuffer(sz);
+        // buffer is full, it grows if it can, or parser makes room before more is read.
+        if (free <= 0)
+        {
+            int size = std::min(readBuffer_.GetSize() * 2, HTTP_READ_BUFFER_MAX);
+            if (size <= readBuffer_.GetSize() || !readBuffer_.Resize(size)) break;
 
-    if (sz) sz = conn_->ReadBuffer(buf, sz);
+            ++readStats_.grows;
+            continue;
+        }
 
-    if (sz > 0) readBuffer_.IncreaseContentRange(sz);
+        int sz = std::min(free, budget_);
+        int n = conn_->ReadBuffer(buf, sz, false);
+        unarmed = true;
 
-    return sz;
+        ++readStats_.reads;
+
+        if (n < 0) return n;
+
+        // a short read tells socket is drained, without a call that fails with EAGAIN.
+        if (n < sz) drained_ = true;
+        if (n == 0) break;
+
+        readBuffer_.IncreaseContentRange(n);
+        readStats_.bytes += n;
+        budget_ -= n;
+        total += n;
+
+        // reads fill the buffer up, it is too small for the traffic.
+        if (n == free && readBuffer_.GetSize() < HTTP_READ_BUFFER_MAX)
+        {
+            int size = std::min(readBuffer_.GetSize() * 2, HTTP_READ_BUFFER_MAX);
+            if (readBuffer_.Resize(size)) ++readStats_.grows;
+        }
+    }
+
+    // armed once for all the reads above, event that reads nothing arms it as well.
+    if (unarmed || !armed_) conn_->FinishRead();
+
+    armed_ = true;
+
+    return total;
+}
+
+void HttpClient::AdaptReadBuffer(int bytes)
+{
+    int size = readBuffer_.GetSize();
+
+    if (size <= HTTP_READ_BUFFER_MIN || bytes >= size / 4)
+    {
+        quietEvents_ = 0;
+        return;
+    }
+
+    // a lull between bursts keeps the buffer, a run of small events gives it back.
+    if (++quietEvents_ < HTTP_READ_SHRINK_EVENTS) return;
+
+    // sizes stay powers of 2 of min, which mirrored regions pooled are reused by.
+    int target = HTTP_READ_BUFFER_MIN;
+    while (target < bytes * 4) target *= 2;
+
+    // fails if content left doesn't fit, tried again by next event.
+    if (readBuffer_.Resize(target))
+    {
+        ++readStats_.shrinks;
+        quietEvents_ = 0;
+    }
 }
 
 int HttpClient::ProcessRequestLine(SocketEvent evt)
@@ -126,6 +268,15 @@ int HttpClient::ParseRequestLine()
     const char* start = readBuffer_.GetContentStart();
     const char* end   = readBuffer_.GetContentEnd();
 
+    // nothing is consumed until the whole line is in.
+    if (std::search(start, end, HTTP_CTRL, HTTP_CTRL + HTTP_CTRL_LEN) == end)
+    {
+        return end - start < HTTP_LINE_MAX? 0 : -1;
+    }
+
+    // http/2 by prior knowledge, connection starts with its preface instead.
+    if (end - start >= 3 && memcmp(start, "PRI", 3) == 0) return StartHttp2();
+
     const char* delim = std::find(start, end, ' ');
 
     int len = 0;
@@ -144,21 +295,9 @@ int HttpClient::ParseRequestLine()
         // short of data
         if (delim == end) return len;
 
-        const char* question_mark = std::find(start, end, '?');
-
-        if (question_mark != end)
-        {
-            std::string url(start, question_mark);
-            request_.SetUrl(url);
-
-            std::string data(question_mark + 1, delim);
-            request_.SetUrlData(data);
-        }
-        else
-        {
-            std::string url(start, delim);
-            request_.SetUrl(url);
-        }
+        // target is kept in arena till the response is sent, split in place.
+        char* target = arena_.Strdup(start, delim - start);
+        if (target == NULL || !request_.SetTarget(target, delim - start)) return -1;
 
         len += delim - start + 1;
         readBuffer_.ConsumeBuffer(delim - start + 1);
@@ -203,32 +342,32 @@ int HttpClient::ParseHeader()
     static const size_t ctrl_len = HTTP_CTRL_LEN;
     static const char* end_of_ctrl = ctrl + ctrl_len;
 
-    static const char* header_delim = HTTP_HEADER_DELIM;
-    static const size_t header_delim_len = HTTP_HEADER_DELIM_LEN;
-    static const char* end_of_header_delim = header_delim + header_delim_len;
+    HttpMessageParser::Header header;
 
     while (1)
     {
         const char* line_end = std::search(start, end, ctrl, end_of_ctrl);
-        if (line_end == end) return true;
+        if (line_end == end) return end - start < HTTP_LINE_MAX? len : -1;
 
-        const char* colon = std::search(start, line_end, header_delim, end_of_header_delim);
-        if (colon == line_end)
+        if (line_end == start)
         {
             // end of headers.
-            len += line_end - start + ctrl_len;
-            readBuffer_.ConsumeBuffer(line_end - start + ctrl_len);
+            len += ctrl_len;
+            readBuffer_.ConsumeBuffer(ctrl_len);
             break;
         }
 
-        std::string key(start, colon);
-        std::string value(colon + 2, line_end);
+        // header syntax is the same as of messages parsed by HttpMessageParser.
+        if (!HttpMessageParser::ParseHeaderLine(start, line_end, &header)) return -1;
 
-        request_.AddHeader(key.c_str(), value.c_str());
+        request_.AddHeader(header.first.c_str(), header.second.c_str());
 
         len += line_end - start + ctrl_len;
         readBuffer_.ConsumeBuffer(line_end - start + ctrl_len);
+
+        // buffer drained is rewound to the front.
         start = readBuffer_.GetContentStart();
+        end   = readBuffer_.GetContentEnd();
     }
 
     std::string connection = request_.GetHeaderValue("Connection");
@@ -244,24 +383,42 @@ int HttpClient::ParseBody()
     const char* start = readBuffer_.GetContentStart();
     const char* end   = readBuffer_.GetContentEnd();
 
+    // no body is expected, bytes behind belong to requests pipelined.
     if (request_.GetHttpMethod() != HttpRequest::HM_POST)
     {
-        len += end - start;
-        readBuffer_.ConsumeBuffer(end - start);
         FinishParsingBody();
         return 1;
     }
 
+    if (multipart_.IsActive()) return ParseMultipart();
+
     size_t contentLen = request_.GetBodyLength();
     if (contentLen == 0)
     {
         std::string clen = request_.GetHeaderValue("Content-Length");
         if (clen.empty()) return len; // no body
 
-        contentLen = atoi(clen.c_str());
+        char* stop = NULL;
+        int64_t bodyLen = strtoll(clen.c_str(), &stop, 10);
 
-        if (contentLen == 0) return len;
-        else if (contentLen >= HttpRequest::MaxBodyLength) return -1;
+        if (*stop != '\0' || bodyLen < 0) return RejectRequest();
+
+        // empty body, request is complete with its header.
+        if (bodyLen == 0)
+        {
+            FinishParsingBody();
+            return 1;
+        }
+
+        if (partHandler_ && multipart_.Init(request_.GetHeaderValue("Content-Type")))
+        {
+            bodyLeft_ = bodyLen;
+            return ParseMultipart();
+        }
+
+        contentLen = bodyLen;
+
+        if (contentLen >= HttpRequest::MaxBodyLength) return -1;
 
         request_.SetBodySize(contentLen);
     }
@@ -282,34 +439,141 @@ int HttpClient::ParseBody()
     return len;
 }
 
+// malformed request is answered by 400, connection is closed then.
+int HttpClient::RejectRequest()
+{
+    conn_->SendBuffer(HTTP_BAD_REQUEST_RESPONSE, sizeof(HTTP_BAD_REQUEST_RESPONSE) - 1);
+    return -1;
+}
+
+// body is parsed in place, at most a boundary or a part head is left in read buffer.
+int HttpClient::ParseMultipart()
+{
+    int avail = readBuffer_.GetContenLen();
+    if (avail > bodyLeft_) avail = bodyLeft_;
+
+    int n = multipart_.Parse(readBuffer_.GetContentStart(), avail);
+    if (n < 0) return -1;
+
+    readBuffer_.ConsumeBuffer(n);
+    bodyLeft_ -= n;
+
+    if (bodyLeft_ == 0)
+    {
+        // body ends before the close delimiter.
+        if (!multipart_.IsComplete()) return -1;
+
+        multipart_.Reset();
+        FinishParsingBody();
+        return 1;
+    }
+
+    // the rest of body is all there, but can't be parsed.
+    if (n == 0 && avail == bodyLeft_) return -1;
+
+    return n;
+}
+
+void HttpClient::OnPartEvent(void* arg, HttpMultipartParser::PartEvent evt, const char* data, int len)
+{
+    HttpClient* client = (HttpClient*)arg;
+
+    client->partHandler_(client->request_, client->multipart_, evt, data, len);
+}
+
 int HttpClient::GenerateResponse(SocketEvent evt)
 {
-    // TODO
-    cgi_(request_, response_);
+    // request asking for h2c is answered on stream 1 of the new protocol.
+    if (UpgradeHttp2()) return 1;
+
+    Dispatch(request_, response_);
 
     int sz = response_.GetResponseSize();
 
     HttpBuffer* buf = writeBuffer_.AllocWriteBuffer(sz);
     buf->curSize_ = response_.GenerateResponse(buf->curPtr_, buf->size_);
 
+    pendingSize_ += buf->curSize_;
     pendingWrite_.PushBack(buf);
+
+    if (response_.IsEventStream()) streamTopic_ = response_.GetStreamTopic();
+
     response_.CleanUp();
 
     FinishGenerateResponse();
     return 1;
 }
 
+void HttpClient::Dispatch(const HttpRequest& req, HttpResponse& response)
+{
+    int64_t start = MonotonicMicroSec();
+
+    const HttpEntity* entity = FindEntity(req);
+
+    if (entity) entity->Respond(req, response);
+    else cgi_(req, response);
+
+    handlerLatency_ = MonotonicMicroSec() - start;
+    ++handled_;
+}
+
+const HttpEntity* HttpClient::FindEntity(const HttpRequest& req)
+{
+    if (entities_ == NULL || entities_->empty()) return NULL;
+
+    HttpRequest::HttpMethod method = req.GetHttpMethod();
+    if (method != HttpRequest::HM_GET && method != HttpRequest::HM_HEAD) return NULL;
+
+    // path of target in place, decoded and normalized in arena only if it has to be.
+    HttpStrRef path;
+    if (!req.GetTarget().GetNormalizedPath(req.GetArena(), &path)) return NULL;
+
+    // key is reused, lookup allocates nothing once it has grown to the paths asked for.
+    entityKey_.assign(path.data_, path.len_);
+
+    HttpEntityMap::const_iterator it = entities_->find(entityKey_);
+
+    return it == entities_->end()? NULL : it->second;
+}
+
 int HttpClient::SendResponse(SocketEvent evt)
+{
+    int len = SendPending();
+    if (len < 0) return -1;
+
+    if (pendingWrite_.GetFront() == NULL) FinishSendResponse();
+
+    return len;
+}
+
+int HttpClient::SendPending()
 {
     int len = 0;
     HttpBuffer* buf = pendingWrite_.GetFront();
 
     while (buf)
     {
-        int sz = conn_->SendBuffer(buf->curPtr_, buf->curSize_);
+        int sz = 0;
+
+        if (writeBuffer_.IsPooled(buf))
+        {
+            // buffers queued behind are coalesced into the same segments.
+            sz = conn_->SendBuffer(buf->curPtr_, buf->curSize_, buf != pendingWrite_.GetTail());
+        }
+        else
+        {
+            // large response is sent in place, kernel holds a reference until it is done.
+            RetainHttpBuffer(buf);
+
+            sz = conn_->SendZeroCopy(buf->curPtr_, buf->curSize_, &ReleaseHttpBuffer, buf);
+            if (sz <= 0) ReleaseHttpBuffer(buf);
+        }
+
         if (sz < 0) return -1;
 
         len += sz;
+        pendingSize_ -= sz;
+
         if (sz < buf->curSize_)
         {
             buf->curPtr_ += sz;
@@ -321,11 +585,137 @@ int HttpClient::SendResponse(SocketEvent evt)
         buf = pendingWrite_.GetFront();
     }
 
-    if (buf == NULL) FinishSendResponse();
-
     return len;
 }
 
+int HttpClient::StartHttp2()
+{
+    h2_ = new Http2Session(&HttpClient::OnHttp2Request, this, &arena_);
+    h2_->Start();
+
+    evtHandler_ = &HttpClient::ProcessHttp2;
+    return 1;
+}
+
+bool HttpClient::UpgradeHttp2()
+{
+    if (request_.GetVersion() != HttpRequest::HV_11) return false;
+
+    const std::map<std::string, std::string>& headers = request_.GetHeader();
+
+    std::map<std::string, std::string>::const_iterator upgrade = headers.find("Upgrade");
+    std::map<std::string, std::string>::const_iterator settings = headers.find("HTTP2-Settings");
+    std::map<std::string, std::string>::const_iterator connection = headers.find("Connection");
+
+    if (upgrade == headers.end() || settings == headers.end() || connection == headers.end()) return false;
+    if (!HttpMessageParser::HasToken(upgrade->second, "h2c")) return false;
+
+    // both are connection options, or a proxy on the way may have passed them on(rfc 7540, 3.2).
+    if (!HttpMessageParser::HasToken(connection->second, "Upgrade")
+            || !HttpMessageParser::HasToken(connection->second, "HTTP2-Settings")) return false;
+
+    // 101 goes ahead of the frames.
+    int sz = sizeof(HTTP2_UPGRADE_RESPONSE) - 1;
+
+    HttpBuffer* buf = writeBuffer_.AllocWriteBuffer(sz);
+    if (buf == NULL) return false;
+
+    h2_ = new Http2Session(&HttpClient::OnHttp2Request, this, &arena_);
+
+    // malformed settings, request is answered by http/1.
+    if (!h2_->StartUpgrade(settings->second, request_))
+    {
+        delete h2_;
+        h2_ = NULL;
+
+        writeBuffer_.ReleaseWriteBuffer(buf);
+        return false;
+    }
+
+    memcpy(buf->curPtr_, HTTP2_UPGRADE_RESPONSE, sz);
+    buf->curSize_ = sz;
+
+    pendingSize_ += sz;
+    pendingWrite_.PushBack(buf);
+
+    // frames not queued for want of memory are tried again by ProcessHttp2() right after.
+    QueueHttp2Output();
+
+    evtHandler_ = &HttpClient::ProcessHttp2;
+    return true;
+}
+
+void HttpClient::OnHttp2Request(void* arg, const HttpRequest& req, HttpResponse& response)
+{
+    HttpClient* client = (HttpClient*)arg;
+
+    client->Dispatch(req, response);
+}
+
+bool HttpClient::QueueHttp2Output()
+{
+    std::string& out = h2_->GetOutput();
+    if (out.empty()) return true;
+
+    // output is kept by session.
+    HttpBuffer* buf = writeBuffer_.AllocWriteBuffer(out.size());
+    if (buf == NULL) return false;
+
+    memcpy(buf->curPtr_, out.data(), out.size());
+    buf->curSize_ = out.size();
+
+    pendingSize_ += buf->curSize_;
+    pendingWrite_.PushBack(buf);
+
+    out.clear();
+    if (out.capacity() > HTTP2_OUTPUT_KEEP) std::string().swap(out);
+
+    return true;
+}
+
+int HttpClient::ProcessHttp2(SocketEvent evt)
+{
+    // responses peer doesn't read hold back the requests behind.
+    bool blocked = pendingSize_ >= Http2Session::MaxOutput;
+
+    if (evt.code == SC_READ && !blocked)
+    {
+        int ret = ReadHttpData();
+        if (ret < 0) return ret;
+    }
+
+    int len = h2_->Process(readBuffer_.GetContentStart(), readBuffer_.GetContenLen());
+    if (len > 0) readBuffer_.ConsumeBuffer(len);
+
+    // body left by output buffer full goes on as what is queued gets sent.
+    if (len >= 0 && !blocked) h2_->Flush();
+
+    if (!QueueHttp2Output()) return -1;
+
+    int sent = SendPending();
+
+    // GOAWAY is sent as far as socket takes it.
+    if (sent < 0 || len < 0) return -1;
+
+    if (h2_->IsClosed() && pendingWrite_.GetFront() == NULL) return -1;
+
+    // not reported readable until responses are sent.
+    if (pendingSize_ >= Http2Session::MaxOutput) conn_->WatchEvent(false, true);
+
+    return len + sent;
+}
+
+int HttpClient::ProcessStream(SocketEvent evt)
+{
+    if (evt.code != SC_READ) return 0;
+
+    // nothing is expected from peer, read only to tell when it is gone.
+    char buf[64];
+    int sz = conn_->ReadBuffer(buf, sizeof(buf));
+
+    return sz < 0? sz : 0;
+}
+
 void HttpClient::FinishParsingRequestLine()
 {
     evtHandler_ = &HttpClient::ProcessHeader;
@@ -349,5 +739,18 @@ void HttpClient::FinishGenerateResponse()
 void HttpClient::FinishSendResponse()
 {
     evtHandler_ = &HttpClient::ProcessRequestLine;
+
+    // everything handler allocated goes at once, request refers to it.
+    request_.CleanUp();
+    arena_.Reset();
+
+    if (streamTopic_.empty()) return;
+
+    // requests pipelined behind are dropped, stream is the last response.
+    readBuffer_.ResetBuffer();
+    readBuffer_.ReleaseBuffer();
+    writeBuffer_.ReleaseFreeBuffer();
+
+    evtHandler_ = &HttpClient::ProcessStream;
 }
 
@@ -1,19 +1,39 @@
 #ifndef __HTTP_CLIENT_H__
 #define __HTTP_CLIENT_H__
 
+#include "Http2Session.h"
+#include "HttpArena.h"
 #include "HttpBuffer.h"
+#include "HttpEntity.h"
+#include "HttpMultipartParser.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 
 #include "SocketServer.h"
 #include "misc/NonCopyable.h"
 
+// counters of reading requests, accumulated over connections served by the client.
+struct HttpReadStats
+{
+    int64_t events;     // read events handled
+    int64_t reads;      // read calls made
+    int64_t bytes;      // bytes read
+    int64_t drained;    // events read until nothing was left in socket
+    int64_t budgetHits; // events stopped by the budget, socket is left to next round
+    int64_t grows;      // read buffer grown as reads fill it up
+    int64_t shrinks;    // read buffer shrunk as connection goes quiet
+};
+
 class HttpClient: public noncopyable
 {
     public:
 
         typedef void (* HttpHandler)(const HttpRequest&, HttpResponse&);
 
+        // called for each part event of a multipart body, data is only valid during the call.
+        typedef void (* PartHandler)(HttpRequest&, const HttpMultipartParser&,
+                HttpMultipartParser::PartEvent, const char* data, int len);
+
         explicit HttpClient(HttpHandler handler = NULL);
         ~HttpClient();
 
@@ -25,6 +45,36 @@ class HttpClient: public noncopyable
 
         void RegisterHttpHandler(HttpHandler handler);
 
+        // multipart body is streamed to part handler as it is read, instead of being buffered
+        // in request, so it is not limited by HttpRequest::MaxBodyLength.
+        // http handler is called once the body is done.
+        void RegisterPartHandler(PartHandler handler) { partHandler_ = handler; }
+
+        // GET/HEAD of a path in entities is answered by the entity, handler is not run.
+        void SetEntities(const HttpEntityMap* entities) { entities_ = entities; }
+
+        // bytes of response waiting to be sent.
+        int GetPendingWriteSize() const { return pendingSize_; }
+
+        // number of requests handled, and time(micro seconds) spent in handler for the last one.
+        int64_t GetHandledNum() const { return handled_; }
+        int64_t GetLastHandlerLatency() const { return handlerLatency_; }
+
+        // socket is read until drained in one event, as long as it is within budget(bytes),
+        // so that one busy connection doesn't starve the others.
+        void SetReadBudget(int budget) { readBudget_ = budget; }
+        const HttpReadStats& GetReadStats() const { return readStats_; }
+        int GetReadBufferSize() const { return readBuffer_.GetSize(); }
+
+        // response set as event stream is sent, the connection carries events of the topic
+        // from now on, by SocketServer::Send(), holding no buffer while idle.
+        bool IsStreaming() const { return evtHandler_ == &HttpClient::ProcessStream; }
+        const std::string& GetStreamTopic() const { return streamTopic_; }
+
+        // connection speaks http/2, started by prior knowledge or by "Upgrade: h2c",
+        // requests of all its streams go to the same handler.
+        bool IsHttp2() const { return h2_ != NULL; }
+
     private:
 
         typedef int (HttpClient::*EventHandler)(SocketEvent);
@@ -34,10 +84,25 @@ class HttpClient: public noncopyable
         int ProcessBody(SocketEvent);
         int GenerateResponse(SocketEvent);
         int SendResponse(SocketEvent);
+        int ProcessStream(SocketEvent);
+        int ProcessHttp2(SocketEvent);
 
         int ParseRequestLine();
         int ParseHeader();
         int ParseBody();
+        int ParseMultipart();
+        int RejectRequest();
+
+        int  SendPending();
+        void Dispatch(const HttpRequest& req, HttpResponse& response);
+        const HttpEntity* FindEntity(const HttpRequest& req);
+
+        int  StartHttp2();
+        bool UpgradeHttp2();
+        bool QueueHttp2Output();
+
+        static void OnPartEvent(void* arg, HttpMultipartParser::PartEvent evt, const char* data, int len);
+        static void OnHttp2Request(void* arg, const HttpRequest& req, HttpResponse& response);
 
         inline void FinishParsingRequestLine();
         inline void FinishParsingHeader();
@@ -46,21 +111,50 @@ class HttpClient: public noncopyable
         inline void FinishSendResponse();
 
         int ReadHttpData();
+        void AdaptReadBuffer(int bytes);
         void CloseConnection();
 
     private:
 
         bool keepalive_;
+
+        // state of reading in current event.
+        bool drained_;
+        bool armed_;
+        int  budget_;
+
+        // events in a row reading less than a quarter of the buffer.
+        int quietEvents_;
+
+        int readBudget_;
+        HttpReadStats readStats_;
+        int pendingSize_;
+        int64_t handled_;
+        int64_t handlerLatency_;
+
         HttpReadBuffer readBuffer_;
         HttpWriteBuffer writeBuffer_;
 
         HttpBufferList pendingWrite_;
 
+        std::string streamTopic_;
+
+        HttpArena arena_;
         HttpRequest request_;
         HttpResponse response_;
 
+        // body bytes not yet parsed by multipart_.
+        int64_t bodyLeft_;
+        HttpMultipartParser multipart_;
+
+        // created when connection turns to http/2.
+        Http2Session* h2_;
+
         EventHandler evtHandler_;
         HttpHandler cgi_;
+        PartHandler partHandler_;
+        const HttpEntityMap* entities_;
+        std::string entityKey_;
         SocketConnection* conn_;
 };
 
@@ -0,0 +1,389 @@
+#include "HttpEntity.h"
+#include "HttpArena.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// rfc 7231, IMF-fixdate.
+static const char HTTP_DATE_FORMAT[] = "%a, %d %b %Y %H:%M:%S GMT";
+
+static inline const char* SkipSpace(const char* start, const char* end)
+{
+    while (start < end && (*start == ' ' || *start == '\t')) ++start;
+
+    return start;
+}
+
+static inline const char* TrimSpace(const char* start, const char* end)
+{
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) --end;
+
+    return end;
+}
+
+// fnv-1a, 64 bits.
+static uint64_t HashContent(const char* data, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// digits only, return false if empty or overflow.
+static bool ParseNumber(const char* start, const char* end, int64_t* val)
+{
+    if (start == end) return false;
+
+    int64_t num = 0;
+    for (const char* cur = start; cur < end; ++cur)
+    {
+        if (*cur < '0' || *cur > '9') return false;
+        if (num > (INT64_MAX - 9) / 10) return false;
+
+        num = num * 10 + (*cur - '0');
+    }
+
+    *val = num;
+    return true;
+}
+
+HttpEntity::HttpEntity(const char* data, size_t len, const char* contentType, time_t lastModified)
+    :content_(data, len)
+    ,contentType_(contentType)
+    ,modified_(lastModified)
+{
+    uint64_t hash = HashContent(data, len);
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%016llx-%llx\"", (unsigned long long)hash, (unsigned long long)len);
+    etag_ = buf;
+
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)len);
+    contentLength_ = buf;
+
+    lastModified_ = FormatHttpDate(modified_);
+}
+
+HttpEntity::~HttpEntity()
+{
+}
+
+HttpEntity* HttpEntity::LoadFile(const char* path, const char* contentType)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    std::string data(st.st_size, '\0');
+
+    size_t off = 0;
+    while (off < data.size())
+    {
+        ssize_t n = read(fd, &data[off], data.size() - off);
+        if (n <= 0) break;
+
+        off += n;
+    }
+
+    close(fd);
+
+    if (off != data.size()) return NULL;
+
+    return new HttpEntity(data.data(), data.size(), contentType, st.st_mtime);
+}
+
+std::string HttpEntity::FormatHttpDate(time_t tm)
+{
+    struct tm gm;
+    gmtime_r(&tm, &gm);
+
+    char buf[64];
+    strftime(buf, sizeof(buf), HTTP_DATE_FORMAT, &gm);
+
+    return buf;
+}
+
+bool HttpEntity::ParseHttpDate(const std::string& str, time_t* tm)
+{
+    struct tm gm;
+    memset(&gm, 0, sizeof(gm));
+
+    const char* end = strptime(str.c_str(), HTTP_DATE_FORMAT, &gm);
+    if (end == NULL || *end != '\0') return false;
+
+    *tm = timegm(&gm);
+    return true;
+}
+
+int HttpEntity::ParseRange(const std::string& value, int64_t size, ByteRange* ranges, int max)
+{
+    static const char unit[] = "bytes=";
+    static const size_t unit_len = sizeof(unit) - 1;
+
+    if (strncasecmp(value.c_str(), unit, unit_len) != 0) return -1;
+
+    const char* cur = value.c_str() + unit_len;
+    const char* end = value.c_str() + value.size();
+
+    int num = 0;
+    int specs = 0;
+
+    while (cur < end)
+    {
+        const char* comma = (const char*)memchr(cur, ',', end - cur);
+        if (comma == NULL) comma = end;
+
+        const char* start = SkipSpace(cur, comma);
+        const char* stop = TrimSpace(start, comma);
+
+        cur = comma + 1;
+
+        // empty elements are allowed in list.
+        if (start == stop) continue;
+
+        if (++specs > max) return -1;
+
+        const char* dash = (const char*)memchr(start, '-', stop - start);
+        if (dash == NULL) return -1;
+
+        int64_t first = 0;
+        int64_t last = size - 1;
+
+        if (dash == start)
+        {
+            // suffix, the last n bytes.
+            int64_t n = 0;
+            if (!ParseNumber(dash + 1, stop, &n)) return -1;
+
+            if (n == 0 || size == 0) continue;
+
+            first = n < size? size - n : 0;
+        }
+        else
+        {
+            if (!ParseNumber(start, dash, &first)) return -1;
+
+            if (dash + 1 < stop)
+            {
+                if (!ParseNumber(dash + 1, stop, &last) || last < first) return -1;
+                if (last >= size) last = size - 1;
+            }
+
+            if (first >= size) continue;
+        }
+
+        ranges[num].first_ = first;
+        ranges[num].last_ = last;
+        ++num;
+    }
+
+    return specs > 0? num : -1;
+}
+
+// weak comparison of If-None-Match, "*" matches any.
+bool HttpEntity::IsNotModified(const HttpRequest& req) const
+{
+    const std::map<std::string, std::string>& headers = req.GetHeader();
+
+    std::map<std::string, std::string>::const_iterator it = headers.find("If-None-Match");
+    if (it != headers.end())
+    {
+        const char* cur = it->second.c_str();
+        const char* end = cur + it->second.size();
+
+        while (cur < end)
+        {
+            const char* comma = (const char*)memchr(cur, ',', end - cur);
+            if (comma == NULL) comma = end;
+
+            const char* start = SkipSpace(cur, comma);
+            const char* stop = TrimSpace(start, comma);
+
+            cur = comma + 1;
+
+            if (stop - start == 1 && *start == '*') return true;
+            if (stop - start > 2 && start[0] == 'W' && start[1] == '/') start += 2;
+
+            if (size_t(stop - start) == etag_.size() && memcmp(start, etag_.data(), etag_.size()) == 0) return true;
+        }
+
+        // If-Modified-Since is ignored when If-None-Match is there.
+        return false;
+    }
+
+    it = headers.find("If-Modified-Since");
+    if (it == headers.end()) return false;
+
+    time_t since = 0;
+    if (!ParseHttpDate(it->second, &since)) return false;
+
+    return modified_ <= since;
+}
+
+// strong comparison for etag, exact match for date.
+bool HttpEntity::MatchIfRange(const std::string& value) const
+{
+    if (!value.empty() && (value[0] == '"' || value[0] == 'W')) return value == etag_;
+
+    time_t date = 0;
+    if (!ParseHttpDate(value, &date)) return false;
+
+    return date == modified_;
+}
+
+void HttpEntity::SetValidators(HttpResponse& response) const
+{
+    response.AddHeader("ETag", etag_.c_str());
+    response.AddHeader("Last-Modified", lastModified_.c_str());
+}
+
+int HttpEntity::Respond(const HttpRequest& req, HttpResponse& response) const
+{
+    HttpRequest::HttpMethod method = req.GetHttpMethod();
+
+    bool head = method == HttpRequest::HM_HEAD;
+    bool get = method == HttpRequest::HM_GET || head;
+
+    response.SetShouldResponse(true);
+
+    if (get && IsNotModified(req))
+    {
+        response.SetStatusCode(HttpResponse::HSC_304);
+        response.SetStatusMessage("Not Modified");
+        SetValidators(response);
+        return HttpResponse::HSC_304;
+    }
+
+    std::string range = get? req.GetHeaderValue("Range") : "";
+    std::string ifRange = range.empty()? "" : req.GetHeaderValue("If-Range");
+
+    // representation changed, the whole of it is sent instead.
+    if (!range.empty() && (ifRange.empty() || MatchIfRange(ifRange)))
+    {
+        ByteRange ranges[MaxRanges];
+        int num = ParseRange(range, content_.size(), ranges, MaxRanges);
+
+        if (num == 0)
+        {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "bytes */%s", contentLength_.c_str());
+
+            response.SetStatusCode(HttpResponse::HSC_416);
+            response.SetStatusMessage("Range Not Satisfiable");
+            response.AddHeader("Content-Range", buf);
+            response.AddHeader("Content-Length", "0");
+            return HttpResponse::HSC_416;
+        }
+
+        // malformed Range is ignored.
+        if (num > 0 && RespondRanges(req, response, ranges, num, head)) return HttpResponse::HSC_206;
+    }
+
+    response.SetStatusCode(HttpResponse::HSC_200);
+    response.SetStatusMessage("OK");
+
+    SetValidators(response);
+    response.AddHeader("Accept-Ranges", "bytes");
+    response.AddHeader("Content-Type", contentType_.c_str());
+    response.AddHeader("Content-Length", contentLength_.c_str());
+
+    if (!head) response.SetBodyRef(content_.data(), content_.size());
+
+    return HttpResponse::HSC_200;
+}
+
+bool HttpEntity::RespondRanges(const HttpRequest& req, HttpResponse& response,
+        const ByteRange* ranges, int num, bool head) const
+{
+    char buf[128];
+
+    if (num == 1)
+    {
+        int64_t len = ranges[0].last_ - ranges[0].first_ + 1;
+
+        snprintf(buf, sizeof(buf), "bytes %lld-%lld/%s", (long long)ranges[0].first_,
+                (long long)ranges[0].last_, contentLength_.c_str());
+
+        response.AddHeader("Content-Range", buf);
+
+        snprintf(buf, sizeof(buf), "%lld", (long long)len);
+        response.AddHeader("Content-Length", buf);
+        response.AddHeader("Content-Type", contentType_.c_str());
+
+        if (!head) response.SetBodyRef(content_.data() + ranges[0].first_, len);
+    }
+    else
+    {
+        HttpArena* arena = req.GetArena();
+        if (arena == NULL) return false;
+
+        // boundary is derived from the content hash in etag, quotes excluded.
+        std::string boundary = "range_" + etag_.substr(1, 16);
+
+        // head of each part, then the close delimiter.
+        size_t total = boundary.size() + 8;
+        for (int i = 0; i < num; ++i)
+        {
+            total += snprintf(buf, sizeof(buf), "\r\n--%s\r\nContent-Type: \r\nContent-Range: bytes %lld-%lld/%s\r\n\r\n",
+                    boundary.c_str(), (long long)ranges[i].first_, (long long)ranges[i].last_, contentLength_.c_str());
+
+            total += contentType_.size() + ranges[i].last_ - ranges[i].first_ + 1;
+        }
+
+        char* body = NULL;
+        if (!head)
+        {
+            body = (char*)arena->Alloc(total + 1);
+            if (body == NULL) return false;
+
+            size_t sz = 0;
+            for (int i = 0; i < num; ++i)
+            {
+                sz += snprintf(body + sz, total + 1 - sz, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%s\r\n\r\n",
+                        boundary.c_str(), contentType_.c_str(), (long long)ranges[i].first_,
+                        (long long)ranges[i].last_, contentLength_.c_str());
+
+                int64_t len = ranges[i].last_ - ranges[i].first_ + 1;
+
+                memcpy(body + sz, content_.data() + ranges[i].first_, len);
+                sz += len;
+            }
+
+            snprintf(body + sz, total + 1 - sz, "\r\n--%s--\r\n", boundary.c_str());
+        }
+
+        std::string type = "multipart/byteranges; boundary=" + boundary;
+        response.AddHeader("Content-Type", type.c_str());
+
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)total);
+        response.AddHeader("Content-Length", buf);
+
+        if (body) response.SetBodyRef(body, total);
+    }
+
+    response.SetStatusCode(HttpResponse::HSC_206);
+    response.SetStatusMessage("Partial Content");
+    SetValidators(response);
+
+    return true;
+}
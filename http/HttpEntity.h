@@ -0,0 +1,82 @@
+#ifndef __HTTP_ENTITY_H__
+#define __HTTP_ENTITY_H__
+
+#include <map>
+#include <string>
+#include <time.h>
+#include <stdint.h>
+
+#include "misc/NonCopyable.h"
+
+class HttpRequest;
+class HttpResponse;
+
+/*
+ * representation served as it is, eg, static file or cached page.
+ *
+ * a) validators(strong etag from content hash, Last-Modified) are computed once
+ *    when entity is made, answering a request computes nothing over the content.
+ * b) Respond() evaluates If-None-Match, If-Modified-Since, If-Range and Range of GET/HEAD:
+ *    304 carries no body, single range refers to the content in place,
+ *    multiple ranges are put together in arena of request as multipart/byteranges.
+ * c) immutable once made, a new version is a new entity.
+ */
+class HttpEntity: public noncopyable
+{
+    public:
+
+        // content is copied, lastModified is in seconds since epoch.
+        HttpEntity(const char* data, size_t len, const char* contentType, time_t lastModified);
+        ~HttpEntity();
+
+        // content and modification time of file, return NULL if it can't be read.
+        static HttpEntity* LoadFile(const char* path, const char* contentType);
+
+        const std::string& GetContent() const { return content_; }
+        const std::string& GetContentType() const { return contentType_; }
+        const std::string& GetETag() const { return etag_; }
+        const std::string& GetLastModified() const { return lastModified_; }
+        time_t GetModifiedTime() const { return modified_; }
+
+        // fill response to request, return the status code.
+        int Respond(const HttpRequest& req, HttpResponse& response) const;
+
+        // max ranges served in one response, a request asking for more gets the whole entity.
+        static const int MaxRanges = 16;
+
+        // http-date(rfc 7231, IMF-fixdate only), return false if malformed.
+        static bool ParseHttpDate(const std::string& str, time_t* tm);
+        static std::string FormatHttpDate(time_t tm);
+
+        struct ByteRange
+        {
+            int64_t first_;
+            int64_t last_; // inclusive
+        };
+
+        // "bytes=..." of Range against entity of size bytes, unsatisfiable ranges are dropped.
+        // return number of ranges left, -1 if header is malformed or asks for too many.
+        static int ParseRange(const std::string& value, int64_t size, ByteRange* ranges, int max);
+
+    private:
+
+        bool IsNotModified(const HttpRequest& req) const;
+        bool MatchIfRange(const std::string& value) const;
+
+        void SetValidators(HttpResponse& response) const;
+        bool RespondRanges(const HttpRequest& req, HttpResponse& response,
+                const ByteRange* ranges, int num, bool head) const;
+
+        const std::string content_;
+        const std::string contentType_;
+        const time_t modified_;
+
+        std::string etag_;
+        std::string lastModified_;
+        std::string contentLength_;
+};
+
+// entities served by HttpServer without running the handler, keyed by path.
+typedef std::map<std::string, HttpEntity*> HttpEntityMap;
+
+#endif // __HTTP_ENTITY_H__
@@ -0,0 +1,614 @@
+#include "HttpHpack.h"
+
+#include <string.h>
+
+struct HpackStatic
+{
+    const char* name;
+    const char* value;
+};
+
+// rfc 7541, appendix A.
+static const HpackStatic HPACK_STATIC_TABLE[HpackTable::StaticNum] =
+{
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+struct HuffmanCode
+{
+    uint32_t code;
+    int bits;
+};
+
+// rfc 7541, appendix B. EOS(256) is 30 bits of ones, it never appears in encoded data.
+static const HuffmanCode HPACK_HUFFMAN_CODES[256] =
+{
+    { 0x00001ff8, 13 }, { 0x007fffd8, 23 }, { 0x0fffffe2, 28 }, { 0x0fffffe3, 28 },
+    { 0x0fffffe4, 28 }, { 0x0fffffe5, 28 }, { 0x0fffffe6, 28 }, { 0x0fffffe7, 28 },
+    { 0x0fffffe8, 28 }, { 0x00ffffea, 24 }, { 0x3ffffffc, 30 }, { 0x0fffffe9, 28 },
+    { 0x0fffffea, 28 }, { 0x3ffffffd, 30 }, { 0x0fffffeb, 28 }, { 0x0fffffec, 28 },
+    { 0x0fffffed, 28 }, { 0x0fffffee, 28 }, { 0x0fffffef, 28 }, { 0x0ffffff0, 28 },
+    { 0x0ffffff1, 28 }, { 0x0ffffff2, 28 }, { 0x3ffffffe, 30 }, { 0x0ffffff3, 28 },
+    { 0x0ffffff4, 28 }, { 0x0ffffff5, 28 }, { 0x0ffffff6, 28 }, { 0x0ffffff7, 28 },
+    { 0x0ffffff8, 28 }, { 0x0ffffff9, 28 }, { 0x0ffffffa, 28 }, { 0x0ffffffb, 28 },
+    { 0x00000014,  6 }, { 0x000003f8, 10 }, { 0x000003f9, 10 }, { 0x00000ffa, 12 },
+    { 0x00001ff9, 13 }, { 0x00000015,  6 }, { 0x000000f8,  8 }, { 0x000007fa, 11 },
+    { 0x000003fa, 10 }, { 0x000003fb, 10 }, { 0x000000f9,  8 }, { 0x000007fb, 11 },
+    { 0x000000fa,  8 }, { 0x00000016,  6 }, { 0x00000017,  6 }, { 0x00000018,  6 },
+    { 0x00000000,  5 }, { 0x00000001,  5 }, { 0x00000002,  5 }, { 0x00000019,  6 },
+    { 0x0000001a,  6 }, { 0x0000001b,  6 }, { 0x0000001c,  6 }, { 0x0000001d,  6 },
+    { 0x0000001e,  6 }, { 0x0000001f,  6 }, { 0x0000005c,  7 }, { 0x000000fb,  8 },
+    { 0x00007ffc, 15 }, { 0x00000020,  6 }, { 0x00000ffb, 12 }, { 0x000003fc, 10 },
+    { 0x00001ffa, 13 }, { 0x00000021,  6 }, { 0x0000005d,  7 }, { 0x0000005e,  7 },
+    { 0x0000005f,  7 }, { 0x00000060,  7 }, { 0x00000061,  7 }, { 0x00000062,  7 },
+    { 0x00000063,  7 }, { 0x00000064,  7 }, { 0x00000065,  7 }, { 0x00000066,  7 },
+    { 0x00000067,  7 }, { 0x00000068,  7 }, { 0x00000069,  7 }, { 0x0000006a,  7 },
+    { 0x0000006b,  7 }, { 0x0000006c,  7 }, { 0x0000006d,  7 }, { 0x0000006e,  7 },
+    { 0x0000006f,  7 }, { 0x00000070,  7 }, { 0x00000071,  7 }, { 0x00000072,  7 },
+    { 0x000000fc,  8 }, { 0x00000073,  7 }, { 0x000000fd,  8 }, { 0x00001ffb, 13 },
+    { 0x0007fff0, 19 }, { 0x00001ffc, 13 }, { 0x00003ffc, 14 }, { 0x00000022,  6 },
+    { 0x00007ffd, 15 }, { 0x00000003,  5 }, { 0x00000023,  6 }, { 0x00000004,  5 },
+    { 0x00000024,  6 }, { 0x00000005,  5 }, { 0x00000025,  6 }, { 0x00000026,  6 },
+    { 0x00000027,  6 }, { 0x00000006,  5 }, { 0x00000074,  7 }, { 0x00000075,  7 },
+    { 0x00000028,  6 }, { 0x00000029,  6 }, { 0x0000002a,  6 }, { 0x00000007,  5 },
+    { 0x0000002b,  6 }, { 0x00000076,  7 }, { 0x0000002c,  6 }, { 0x00000008,  5 },
+    { 0x00000009,  5 }, { 0x0000002d,  6 }, { 0x00000077,  7 }, { 0x00000078,  7 },
+    { 0x00000079,  7 }, { 0x0000007a,  7 }, { 0x0000007b,  7 }, { 0x00007ffe, 15 },
+    { 0x000007fc, 11 }, { 0x00003ffd, 14 }, { 0x00001ffd, 13 }, { 0x0ffffffc, 28 },
+    { 0x000fffe6, 20 }, { 0x003fffd2, 22 }, { 0x000fffe7, 20 }, { 0x000fffe8, 20 },
+    { 0x003fffd3, 22 }, { 0x003fffd4, 22 }, { 0x003fffd5, 22 }, { 0x007fffd9, 23 },
+    { 0x003fffd6, 22 }, { 0x007fffda, 23 }, { 0x007fffdb, 23 }, { 0x007fffdc, 23 },
+    { 0x007fffdd, 23 }, { 0x007fffde, 23 }, { 0x00ffffeb, 24 }, { 0x007fffdf, 23 },
+    { 0x00ffffec, 24 }, { 0x00ffffed, 24 }, { 0x003fffd7, 22 }, { 0x007fffe0, 23 },
+    { 0x00ffffee, 24 }, { 0x007fffe1, 23 }, { 0x007fffe2, 23 }, { 0x007fffe3, 23 },
+    { 0x007fffe4, 23 }, { 0x001fffdc, 21 }, { 0x003fffd8, 22 }, { 0x007fffe5, 23 },
+    { 0x003fffd9, 22 }, { 0x007fffe6, 23 }, { 0x007fffe7, 23 }, { 0x00ffffef, 24 },
+    { 0x003fffda, 22 }, { 0x001fffdd, 21 }, { 0x000fffe9, 20 }, { 0x003fffdb, 22 },
+    { 0x003fffdc, 22 }, { 0x007fffe8, 23 }, { 0x007fffe9, 23 }, { 0x001fffde, 21 },
+    { 0x007fffea, 23 }, { 0x003fffdd, 22 }, { 0x003fffde, 22 }, { 0x00fffff0, 24 },
+    { 0x001fffdf, 21 }, { 0x003fffdf, 22 }, { 0x007fffeb, 23 }, { 0x007fffec, 23 },
+    { 0x001fffe0, 21 }, { 0x001fffe1, 21 }, { 0x003fffe0, 22 }, { 0x001fffe2, 21 },
+    { 0x007fffed, 23 }, { 0x003fffe1, 22 }, { 0x007fffee, 23 }, { 0x007fffef, 23 },
+    { 0x000fffea, 20 }, { 0x003fffe2, 22 }, { 0x003fffe3, 22 }, { 0x003fffe4, 22 },
+    { 0x007ffff0, 23 }, { 0x003fffe5, 22 }, { 0x003fffe6, 22 }, { 0x007ffff1, 23 },
+    { 0x03ffffe0, 26 }, { 0x03ffffe1, 26 }, { 0x000fffeb, 20 }, { 0x0007fff1, 19 },
+    { 0x003fffe7, 22 }, { 0x007ffff2, 23 }, { 0x003fffe8, 22 }, { 0x01ffffec, 25 },
+    { 0x03ffffe2, 26 }, { 0x03ffffe3, 26 }, { 0x03ffffe4, 26 }, { 0x07ffffde, 27 },
+    { 0x07ffffdf, 27 }, { 0x03ffffe5, 26 }, { 0x00fffff1, 24 }, { 0x01ffffed, 25 },
+    { 0x0007fff2, 19 }, { 0x001fffe3, 21 }, { 0x03ffffe6, 26 }, { 0x07ffffe0, 27 },
+    { 0x07ffffe1, 27 }, { 0x03ffffe7, 26 }, { 0x07ffffe2, 27 }, { 0x00fffff2, 24 },
+    { 0x001fffe4, 21 }, { 0x001fffe5, 21 }, { 0x03ffffe8, 26 }, { 0x03ffffe9, 26 },
+    { 0x0ffffffd, 28 }, { 0x07ffffe3, 27 }, { 0x07ffffe4, 27 }, { 0x07ffffe5, 27 },
+    { 0x000fffec, 20 }, { 0x00fffff3, 24 }, { 0x000fffed, 20 }, { 0x001fffe6, 21 },
+    { 0x003fffe9, 22 }, { 0x001fffe7, 21 }, { 0x001fffe8, 21 }, { 0x007ffff3, 23 },
+    { 0x003fffea, 22 }, { 0x003fffeb, 22 }, { 0x01ffffee, 25 }, { 0x01ffffef, 25 },
+    { 0x00fffff4, 24 }, { 0x00fffff5, 24 }, { 0x03ffffea, 26 }, { 0x007ffff4, 23 },
+    { 0x03ffffeb, 26 }, { 0x07ffffe6, 27 }, { 0x03ffffec, 26 }, { 0x03ffffed, 26 },
+    { 0x07ffffe7, 27 }, { 0x07ffffe8, 27 }, { 0x07ffffe9, 27 }, { 0x07ffffea, 27 },
+    { 0x07ffffeb, 27 }, { 0x0ffffffe, 28 }, { 0x07ffffec, 27 }, { 0x07ffffed, 27 },
+    { 0x07ffffee, 27 }, { 0x07ffffef, 27 }, { 0x07fffff0, 27 }, { 0x03ffffee, 26 },
+};
+
+#define HPACK_HUFFMAN_MIN_BITS (5)
+#define HPACK_HUFFMAN_MAX_BITS (30)
+
+// canonical code: codes of the same length are consecutive and ordered by symbol,
+// code of length n that is smaller than first_[n] + count_[n] is the one.
+struct HuffmanDecodeTable
+{
+    HuffmanDecodeTable()
+    {
+        memset(first_, 0, sizeof(first_));
+        memset(count_, 0, sizeof(count_));
+        memset(offset_, 0, sizeof(offset_));
+
+        for (int sym = 0; sym < 256; ++sym) ++count_[HPACK_HUFFMAN_CODES[sym].bits];
+
+        ++count_[HPACK_HUFFMAN_MAX_BITS]; // EOS
+
+        int off = 0;
+        for (int n = 0; n <= HPACK_HUFFMAN_MAX_BITS; ++n)
+        {
+            offset_[n] = off;
+            off += count_[n];
+        }
+
+        int fill[HPACK_HUFFMAN_MAX_BITS + 1];
+        memcpy(fill, offset_, sizeof(fill));
+
+        for (int sym = 0; sym < 256; ++sym) symbols_[fill[HPACK_HUFFMAN_CODES[sym].bits]++] = sym;
+
+        symbols_[fill[HPACK_HUFFMAN_MAX_BITS]++] = 256;
+
+        uint32_t code = 0;
+        for (int n = 1; n <= HPACK_HUFFMAN_MAX_BITS; ++n)
+        {
+            code = (code + count_[n - 1]) << 1;
+            first_[n] = code;
+        }
+    }
+
+    uint32_t first_[HPACK_HUFFMAN_MAX_BITS + 1];
+    uint32_t count_[HPACK_HUFFMAN_MAX_BITS + 1];
+    int offset_[HPACK_HUFFMAN_MAX_BITS + 1];
+    int symbols_[257];
+};
+
+static const HuffmanDecodeTable HPACK_HUFFMAN_DECODE;
+
+// static table as entries of the same type as dynamic ones, built before main().
+struct HpackStaticHeaders
+{
+    HpackStaticHeaders()
+    {
+        for (size_t i = 0; i < HpackTable::StaticNum; ++i)
+        {
+            headers_[i].first = HPACK_STATIC_TABLE[i].name;
+            headers_[i].second = HPACK_STATIC_TABLE[i].value;
+        }
+    }
+
+    HpackHeader headers_[HpackTable::StaticNum];
+};
+
+static const HpackStaticHeaders HPACK_STATIC_HEADERS;
+
+HpackTable::HpackTable(size_t maxSize)
+    :maxSize_(maxSize)
+    ,size_(0)
+{
+}
+
+HpackTable::~HpackTable()
+{
+}
+
+void HpackTable::Evict(size_t size)
+{
+    while (!entries_.empty() && size_ + size > maxSize_)
+    {
+        const HpackHeader& last = entries_.back();
+
+        size_ -= EntrySize(last.first, last.second);
+        entries_.pop_back();
+    }
+}
+
+void HpackTable::SetMaxSize(size_t size)
+{
+    maxSize_ = size;
+    Evict(0);
+}
+
+const HpackHeader* HpackTable::Get(size_t index) const
+{
+    if (index == 0) return NULL;
+
+    if (index <= StaticNum) return &HPACK_STATIC_HEADERS.headers_[index - 1];
+
+    index -= StaticNum + 1;
+
+    return index < entries_.size()? &entries_[index] : NULL;
+}
+
+void HpackTable::Add(const std::string& name, const std::string& value)
+{
+    size_t size = EntrySize(name, value);
+
+    Evict(size);
+
+    if (size_ + size > maxSize_) return;
+
+    entries_.push_front(HpackHeader(name, value));
+    size_ += size;
+}
+
+size_t HpackTable::Find(const std::string& name, const std::string& value, bool* exact) const
+{
+    size_t found = 0;
+
+    *exact = false;
+
+    for (size_t i = 0; i < StaticNum; ++i)
+    {
+        if (strcmp(HPACK_STATIC_TABLE[i].name, name.c_str()) != 0) continue;
+
+        if (value == HPACK_STATIC_TABLE[i].value)
+        {
+            *exact = true;
+            return i + 1;
+        }
+
+        if (found == 0) found = i + 1;
+    }
+
+    for (size_t i = 0; i < entries_.size(); ++i)
+    {
+        if (entries_[i].first != name) continue;
+
+        if (entries_[i].second == value)
+        {
+            *exact = true;
+            return i + StaticNum + 1;
+        }
+
+        if (found == 0) found = i + StaticNum + 1;
+    }
+
+    return found;
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize)
+    :maxTableSize_(maxTableSize)
+    ,table_(maxTableSize)
+{
+}
+
+HpackDecoder::~HpackDecoder()
+{
+}
+
+void HpackDecoder::SetMaxTableSize(size_t size)
+{
+    maxTableSize_ = size;
+
+    if (table_.GetMaxSize() > size) table_.SetMaxSize(size);
+}
+
+bool HpackDecoder::DecodeString(const unsigned char** cur, const unsigned char* end, std::string* out)
+{
+    if (*cur >= end) return false;
+
+    bool huffman = (**cur & 0x80) != 0;
+
+    uint64_t len = 0;
+    int n = HpackEncoder::DecodeInteger(*cur, end - *cur, 7, &len);
+    if (n <= 0 || len > (uint64_t)(end - *cur - n)) return false;
+
+    const unsigned char* data = *cur + n;
+    *cur = data + len;
+
+    if (huffman) return HpackEncoder::HuffmanDecode(data, len, out);
+
+    out->assign((const char*)data, len);
+    return true;
+}
+
+bool HpackDecoder::Decode(const char* data, int len, HeaderHandler handler, void* arg)
+{
+    const unsigned char* cur = (const unsigned char*)data;
+    const unsigned char* end = cur + len;
+
+    // size update is only allowed ahead of the first field.
+    bool head = true;
+
+    while (cur < end)
+    {
+        unsigned char c = *cur;
+        uint64_t index = 0;
+
+        if (c & 0x80)
+        {
+            // indexed field.
+            int n = HpackEncoder::DecodeInteger(cur, end - cur, 7, &index);
+            if (n <= 0) return false;
+
+            const HpackHeader* header = table_.Get(index);
+            if (header == NULL) return false;
+
+            cur += n;
+            head = false;
+
+            handler(arg, header->first, header->second);
+            continue;
+        }
+
+        if ((c & 0xe0) == 0x20)
+        {
+            uint64_t size = 0;
+            int n = HpackEncoder::DecodeInteger(cur, end - cur, 5, &size);
+            if (n <= 0 || !head || size > maxTableSize_) return false;
+
+            table_.SetMaxSize(size);
+            cur += n;
+            continue;
+        }
+
+        // literal with incremental indexing takes 6 bits of index, without indexing and
+        // never indexed take 4 bits.
+        bool indexing = (c & 0xc0) == 0x40;
+
+        int n = HpackEncoder::DecodeInteger(cur, end - cur, indexing? 6 : 4, &index);
+        if (n <= 0) return false;
+
+        cur += n;
+        head = false;
+
+        if (index)
+        {
+            const HpackHeader* header = table_.Get(index);
+            if (header == NULL) return false;
+
+            name_ = header->first;
+        }
+        else if (!DecodeString(&cur, end, &name_))
+        {
+            return false;
+        }
+
+        if (!DecodeString(&cur, end, &value_)) return false;
+
+        handler(arg, name_, value_);
+
+        if (indexing) table_.Add(name_, value_);
+    }
+
+    return true;
+}
+
+HpackEncoder::HpackEncoder(size_t maxTableSize)
+    :limit_(maxTableSize)
+    ,update_(false)
+    ,updateMin_(0)
+    ,updateSize_(0)
+    ,table_(maxTableSize)
+{
+}
+
+HpackEncoder::~HpackEncoder()
+{
+}
+
+void HpackEncoder::SetMaxTableSize(size_t size)
+{
+    if (size > limit_) size = limit_;
+
+    if (!update_ || size < updateMin_) updateMin_ = size;
+
+    updateSize_ = size;
+    update_ = true;
+
+    table_.SetMaxSize(size);
+}
+
+void HpackEncoder::Encode(const std::string& name, const std::string& value, std::string* out, bool index)
+{
+    if (update_)
+    {
+        if (updateMin_ < updateSize_) EncodeInteger(updateMin_, 5, 0x20, out);
+
+        EncodeInteger(updateSize_, 5, 0x20, out);
+        update_ = false;
+    }
+
+    bool exact = false;
+    size_t found = table_.Find(name, value, &exact);
+
+    if (exact)
+    {
+        EncodeInteger(found, 7, 0x80, out);
+        return;
+    }
+
+    if (index) EncodeInteger(found, 6, 0x40, out);
+    else EncodeInteger(found, 4, 0x00, out);
+
+    if (found == 0) EncodeString(name.data(), name.size(), out);
+
+    EncodeString(value.data(), value.size(), out);
+
+    if (index) table_.Add(name, value);
+}
+
+void HpackEncoder::EncodeInteger(uint64_t value, int prefix, unsigned char first, std::string* out)
+{
+    uint64_t max = (1u << prefix) - 1;
+
+    if (value < max)
+    {
+        out->push_back((char)(first | value));
+        return;
+    }
+
+    out->push_back((char)(first | max));
+    value -= max;
+
+    while (value >= 0x80)
+    {
+        out->push_back((char)(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+
+    out->push_back((char)value);
+}
+
+int HpackEncoder::DecodeInteger(const unsigned char* data, int len, int prefix, uint64_t* value)
+{
+    if (len <= 0) return 0;
+
+    uint64_t max = (1u << prefix) - 1;
+    uint64_t val = data[0] & max;
+
+    if (val < max)
+    {
+        *value = val;
+        return 1;
+    }
+
+    int shift = 0;
+    for (int i = 1; i < len; ++i)
+    {
+        // nothing sent by a sane peer takes more than 32 bits.
+        if (shift > 28) return -1;
+
+        val += (uint64_t)(data[i] & 0x7f) << shift;
+        shift += 7;
+
+        if ((data[i] & 0x80) == 0)
+        {
+            *value = val;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+void HpackEncoder::EncodeString(const char* data, size_t len, std::string* out)
+{
+    size_t huffman = HuffmanLength((const unsigned char*)data, len);
+
+    if (huffman < len)
+    {
+        EncodeInteger(huffman, 7, 0x80, out);
+        HuffmanEncode((const unsigned char*)data, len, out);
+        return;
+    }
+
+    EncodeInteger(len, 7, 0x00, out);
+    out->append(data, len);
+}
+
+size_t HpackEncoder::HuffmanLength(const unsigned char* data, size_t len)
+{
+    size_t bits = 0;
+
+    for (size_t i = 0; i < len; ++i) bits += HPACK_HUFFMAN_CODES[data[i]].bits;
+
+    return (bits + 7) / 8;
+}
+
+void HpackEncoder::HuffmanEncode(const unsigned char* data, size_t len, std::string* out)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        const HuffmanCode& code = HPACK_HUFFMAN_CODES[data[i]];
+
+        acc = (acc << code.bits) | code.code;
+        bits += code.bits;
+
+        while (bits >= 8)
+        {
+            bits -= 8;
+            out->push_back((char)(acc >> bits));
+        }
+    }
+
+    // padded by the most significant bits of EOS.
+    if (bits > 0) out->push_back((char)((acc << (8 - bits)) | (0xff >> bits)));
+}
+
+bool HpackEncoder::HuffmanDecode(const unsigned char* data, size_t len, std::string* out)
+{
+    const HuffmanDecodeTable& table = HPACK_HUFFMAN_DECODE;
+
+    uint64_t acc = 0;
+    int bits = 0;
+
+    out->clear();
+    out->reserve(len * 8 / 5);
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        acc = (acc << 8) | data[i];
+        bits += 8;
+
+        while (bits >= HPACK_HUFFMAN_MIN_BITS)
+        {
+            int n = HPACK_HUFFMAN_MIN_BITS;
+            int sym = -1;
+
+            for (; n <= bits; ++n)
+            {
+                uint32_t code = (uint32_t)(acc >> (bits - n)) & ((1u << n) - 1);
+                uint32_t pos = code - table.first_[n];
+
+                if (pos < table.count_[n])
+                {
+                    sym = table.symbols_[table.offset_[n] + pos];
+                    break;
+                }
+            }
+
+            // more bits are needed.
+            if (sym < 0) break;
+
+            if (sym == 256) return false;
+
+            out->push_back((char)sym);
+            bits -= n;
+        }
+
+        // longest code has 30 bits, anything beyond is no code.
+        if (bits >= HPACK_HUFFMAN_MAX_BITS) return false;
+    }
+
+    if (bits > 7) return false;
+
+    uint32_t mask = (1u << bits) - 1;
+
+    return ((uint32_t)acc & mask) == mask;
+}
@@ -0,0 +1,137 @@
+#ifndef __HTTP_HPACK_H__
+#define __HTTP_HPACK_H__
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "misc/NonCopyable.h"
+
+/*
+ * header compression of http/2(rfc 7541).
+ *
+ * a) index space is the static table(1 to 61) followed by the dynamic table, newest first.
+ * b) dynamic table is bounded by size(name + value + 32 for each entry), entries are
+ *    evicted from the oldest as new ones come in or the bound shrinks.
+ * c) huffman code is canonical, decoded by comparing bits against the first code of
+ *    each length, no tree is walked.
+ * d) decoder and encoder each own a table, they are kept in sync with the table of peer
+ *    by decoding every header block in the order it is received, and sending them in the
+ *    order they are encoded.
+ */
+
+typedef std::pair<std::string, std::string> HpackHeader;
+
+class HpackTable: public noncopyable
+{
+    public:
+
+        explicit HpackTable(size_t maxSize = 4096);
+        ~HpackTable();
+
+        // entries are evicted until the table fits in.
+        void SetMaxSize(size_t size);
+        size_t GetMaxSize() const { return maxSize_; }
+
+        size_t GetSize() const { return size_; }
+        size_t GetEntryNum() const { return entries_.size(); }
+
+        // index is 1 based, return NULL if it is out of range.
+        const HpackHeader* Get(size_t index) const;
+
+        // entry larger than the table empties it, and is not added.
+        void Add(const std::string& name, const std::string& value);
+
+        // index of entry of the same name and value, or of the same name only when *exact
+        // is false, static entries are preferred. return 0 if none.
+        size_t Find(const std::string& name, const std::string& value, bool* exact) const;
+
+        static size_t EntrySize(const std::string& name, const std::string& value) { return name.size() + value.size() + 32; }
+
+        static const size_t StaticNum = 61;
+
+    private:
+
+        void Evict(size_t size);
+
+        size_t maxSize_;
+        size_t size_;
+
+        std::deque<HpackHeader> entries_;
+};
+
+class HpackDecoder: public noncopyable
+{
+    public:
+
+        // called for each field of a header block in order, name is in lower case as peer sent it.
+        typedef void (* HeaderHandler)(void* arg, const std::string& name, const std::string& value);
+
+        explicit HpackDecoder(size_t maxTableSize = 4096);
+        ~HpackDecoder();
+
+        // SETTINGS_HEADER_TABLE_SIZE advertised, size updates of peer can't exceed it.
+        void SetMaxTableSize(size_t size);
+        const HpackTable& GetTable() const { return table_; }
+
+        // decode a complete header block, return false on compression error,
+        // table is out of sync with peer then, connection must be closed.
+        bool Decode(const char* data, int len, HeaderHandler handler, void* arg);
+
+    private:
+
+        bool DecodeString(const unsigned char** cur, const unsigned char* end, std::string* out);
+
+        size_t maxTableSize_;
+        HpackTable table_;
+
+        std::string name_;
+        std::string value_;
+};
+
+class HpackEncoder: public noncopyable
+{
+    public:
+
+        explicit HpackEncoder(size_t maxTableSize = 4096);
+        ~HpackEncoder();
+
+        // SETTINGS_HEADER_TABLE_SIZE of peer, table is shrunk to it if it is smaller than
+        // max size given to constructor, size update is sent by next header block.
+        void SetMaxTableSize(size_t size);
+        const HpackTable& GetTable() const { return table_; }
+
+        // name must be in lower case, field is appended to out.
+        // fields not indexed are sent as literal without touching the table,
+        // values unique to a response(date, length, etag...) are not worth a slot.
+        void Encode(const std::string& name, const std::string& value, std::string* out, bool index = true);
+
+        // integer of prefix bits, first holds the bits above prefix(eg, type of representation).
+        static void EncodeInteger(uint64_t value, int prefix, unsigned char first, std::string* out);
+
+        // return bytes taken, 0 if data is short, -1 if it overflows.
+        static int DecodeInteger(const unsigned char* data, int len, int prefix, uint64_t* value);
+
+        // string literal, huffman coded if it gets shorter.
+        static void EncodeString(const char* data, size_t len, std::string* out);
+
+        // return false on invalid code, EOS, or padding other than the msb of EOS.
+        static bool HuffmanDecode(const unsigned char* data, size_t len, std::string* out);
+        static void HuffmanEncode(const unsigned char* data, size_t len, std::string* out);
+        static size_t HuffmanLength(const unsigned char* data, size_t len);
+
+    private:
+
+        size_t limit_;
+
+        // size updates to send, the smallest the table went down to comes first.
+        bool   update_;
+        size_t updateMin_;
+        size_t updateSize_;
+
+        HpackTable table_;
+};
+
+#endif // __HTTP_HPACK_H__
@@ -0,0 +1,437 @@
+#include "HttpMessageParser.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include <algorithm>
+
+static const char HTTP_CRLF[] = "\r\n";
+static const char HTTP_HEAD_END[] = "\r\n\r\n";
+
+static const int HTTP_CRLF_LEN = sizeof(HTTP_CRLF) - 1;
+static const int HTTP_HEAD_END_LEN = sizeof(HTTP_HEAD_END) - 1;
+
+// max length of chunk size line, including extensions.
+#define MAX_CHUNK_LINE (1024)
+
+static inline const char* FindCrlf(const char* start, const char* end)
+{
+    return std::search(start, end, HTTP_CRLF, HTTP_CRLF + HTTP_CRLF_LEN);
+}
+
+static inline const char* SkipSpace(const char* start, const char* end)
+{
+    while (start < end && (*start == ' ' || *start == '\t')) ++start;
+
+    return start;
+}
+
+static inline const char* TrimSpace(const char* start, const char* end)
+{
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) --end;
+
+    return end;
+}
+
+HttpMessageParser::HttpMessageParser(ParserType type, int maxHeadSize)
+    :type_(type)
+    ,maxHeadSize_(maxHeadSize)
+    ,bodyHandler_(NULL)
+    ,bodyArg_(NULL)
+{
+    Reset();
+}
+
+HttpMessageParser::~HttpMessageParser()
+{
+}
+
+void HttpMessageParser::Reset()
+{
+    state_ = HPS_HEAD;
+    bodyType_ = HBT_NONE;
+    headRequest_ = false;
+    contentLength_ = 0;
+    left_ = 0;
+    status_ = 0;
+
+    method_.clear();
+    url_.clear();
+    version_.clear();
+    reason_.clear();
+    headers_.clear();
+}
+
+const std::string* HttpMessageParser::GetHeader(const char* name) const
+{
+    return FindHeader(headers_, name);
+}
+
+bool HttpMessageParser::HasHeaderToken(const char* name, const char* token) const
+{
+    const std::string* value = GetHeader(name);
+
+    return value && HasToken(*value, token);
+}
+
+bool HttpMessageParser::IsKeepAlive() const
+{
+    if (bodyType_ == HBT_CLOSE) return false;
+
+    if (IsHttp10()) return HasHeaderToken("Connection", "keep-alive");
+
+    return !HasHeaderToken("Connection", "close");
+}
+
+bool HttpMessageParser::IsHopByHopHeader(const std::string& name)
+{
+    static const char* hop[] =
+    {
+        "Connection",
+        "Keep-Alive",
+        "Proxy-Connection",
+        "Proxy-Authenticate",
+        "Proxy-Authorization",
+        "TE",
+        "Trailer",
+        "Upgrade",
+    };
+
+    for (size_t i = 0; i < sizeof(hop)/sizeof(hop[0]); ++i)
+    {
+        if (strcasecmp(name.c_str(), hop[i]) == 0) return true;
+    }
+
+    return false;
+}
+
+bool HttpMessageParser::ParseHeaderLine(const char* start, const char* end, Header* header)
+{
+    const char* colon = std::find(start, end, ':');
+    if (colon == end || colon == start) return false;
+
+    const char* value = SkipSpace(colon + 1, end);
+    const char* value_end = TrimSpace(value, end);
+
+    header->first.assign(start, colon);
+    header->second.assign(value, value_end);
+
+    return true;
+}
+
+const std::string* HttpMessageParser::FindHeader(const std::vector<Header>& headers, const char* name)
+{
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        if (strcasecmp(headers[i].first.c_str(), name) == 0) return &headers[i].second;
+    }
+
+    return NULL;
+}
+
+bool HttpMessageParser::HasToken(const std::string& value, const char* token)
+{
+    size_t len = strlen(token);
+    const char* cur = value.c_str();
+    const char* end = cur + value.size();
+
+    while (cur < end)
+    {
+        const char* comma = std::find(cur, end, ',');
+        const char* start = SkipSpace(cur, comma);
+        const char* stop  = TrimSpace(start, comma);
+
+        if (size_t(stop - start) == len && strncasecmp(start, token, len) == 0) return true;
+
+        cur = comma + 1;
+    }
+
+    return false;
+}
+
+void HttpMessageParser::OnBody(const char* data, int len)
+{
+    if (bodyHandler_ && len > 0) bodyHandler_(bodyArg_, data, len);
+}
+
+int HttpMessageParser::Parse(const char* data, int len)
+{
+    int consumed = 0;
+
+    while (consumed < len || state_ == HPS_HEAD || state_ == HPS_DONE)
+    {
+        const char* cur = data + consumed;
+        int left = len - consumed;
+        int ret = 0;
+
+        switch (state_)
+        {
+            case HPS_HEAD:
+                {
+                    // caller acts on head before body is touched.
+                    ret = ParseHead(cur, left);
+                    return ret <= 0? ret : consumed + ret;
+                }
+            case HPS_BODY:
+                {
+                    ret = left;
+                    if (bodyType_ == HBT_LENGTH && left_ < left) ret = (int)left_;
+
+                    OnBody(cur, ret);
+
+                    if (bodyType_ == HBT_LENGTH)
+                    {
+                        left_ -= ret;
+                        if (left_ == 0) state_ = HPS_DONE;
+                    }
+                }
+                break;
+            case HPS_CHUNK_SIZE:
+                {
+                    ret = ParseChunkSize(cur, left);
+                }
+                break;
+            case HPS_CHUNK_DATA:
+                {
+                    ret = left;
+                    if (left_ < left) ret = (int)left_;
+
+                    OnBody(cur, ret);
+
+                    left_ -= ret;
+                    if (left_ == 0) state_ = HPS_CHUNK_END;
+                }
+                break;
+            case HPS_CHUNK_END:
+                {
+                    if (left < HTTP_CRLF_LEN) return consumed;
+                    if (memcmp(cur, HTTP_CRLF, HTTP_CRLF_LEN) != 0) ret = -1;
+                    else ret = HTTP_CRLF_LEN;
+
+                    state_ = HPS_CHUNK_SIZE;
+                }
+                break;
+            case HPS_TRAILER:
+                {
+                    ret = ParseTrailer(cur, left);
+                }
+                break;
+            case HPS_DONE:
+                {
+                    return consumed;
+                }
+            default:
+                {
+                    ret = -1;
+                }
+                break;
+        }
+
+        if (ret < 0)
+        {
+            state_ = HPS_ERROR;
+            return -1;
+        }
+
+        // need more data.
+        if (ret == 0) break;
+
+        consumed += ret;
+    }
+
+    return consumed;
+}
+
+bool HttpMessageParser::FinishOnClose()
+{
+    if (state_ == HPS_BODY && bodyType_ == HBT_CLOSE)
+    {
+        state_ = HPS_DONE;
+        return true;
+    }
+
+    return state_ == HPS_DONE;
+}
+
+int HttpMessageParser::ParseHead(const char* data, int len)
+{
+    const char* end = data + len;
+
+    // tolerate empty lines ahead of a message.
+    const char* start = data;
+    while (end - start >= HTTP_CRLF_LEN && memcmp(start, HTTP_CRLF, HTTP_CRLF_LEN) == 0)
+    {
+        start += HTTP_CRLF_LEN;
+    }
+
+    const char* head_end = std::search(start, end, HTTP_HEAD_END, HTTP_HEAD_END + HTTP_HEAD_END_LEN);
+
+    if (head_end == end)
+    {
+        if (len >= maxHeadSize_)
+        {
+            state_ = HPS_ERROR;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    const char* line_end = FindCrlf(start, end);
+    if (!ParseStartLine(start, line_end))
+    {
+        state_ = HPS_ERROR;
+        return -1;
+    }
+
+    const char* cur = line_end + HTTP_CRLF_LEN;
+
+    while (cur < head_end + HTTP_CRLF_LEN)
+    {
+        line_end = FindCrlf(cur, end);
+
+        headers_.push_back(Header());
+
+        if (!ParseHeaderLine(cur, line_end, &headers_.back()))
+        {
+            state_ = HPS_ERROR;
+            return -1;
+        }
+
+        cur = line_end + HTTP_CRLF_LEN;
+    }
+
+    if (!SetupBody())
+    {
+        state_ = HPS_ERROR;
+        return -1;
+    }
+
+    return head_end + HTTP_HEAD_END_LEN - data;
+}
+
+bool HttpMessageParser::ParseStartLine(const char* start, const char* end)
+{
+    const char* sp1 = std::find(start, end, ' ');
+    if (sp1 == end) return false;
+
+    const char* sp2 = std::find(sp1 + 1, end, ' ');
+
+    if (type_ == HPT_REQUEST)
+    {
+        if (sp2 == end) return false;
+
+        method_.assign(start, sp1);
+        url_.assign(sp1 + 1, sp2);
+        version_.assign(sp2 + 1, end);
+    }
+    else
+    {
+        version_.assign(start, sp1);
+
+        std::string code(sp1 + 1, sp2);
+        status_ = atoi(code.c_str());
+
+        if (status_ < 100 || status_ > 999) return false;
+
+        if (sp2 != end) reason_.assign(sp2 + 1, end);
+    }
+
+    return version_ == "HTTP/1.1" || version_ == "HTTP/1.0";
+}
+
+bool HttpMessageParser::SetupBody()
+{
+    const std::string* te = GetHeader("Transfer-Encoding");
+    const std::string* cl = GetHeader("Content-Length");
+
+    bool no_body = false;
+    if (type_ == HPT_RESPONSE)
+    {
+        no_body = headRequest_ || status_ < 200 || status_ == 204 || status_ == 304;
+    }
+
+    if (no_body)
+    {
+        bodyType_ = HBT_NONE;
+    }
+    else if (te && HasToken(*te, "chunked"))
+    {
+        bodyType_ = HBT_CHUNKED;
+    }
+    else if (cl)
+    {
+        char* stop = NULL;
+        contentLength_ = strtoll(cl->c_str(), &stop, 10);
+
+        if (cl->empty() || *stop != '\0' || contentLength_ < 0) return false;
+
+        bodyType_ = contentLength_ > 0? HBT_LENGTH : HBT_NONE;
+        left_ = contentLength_;
+    }
+    else
+    {
+        // request without length has no body.
+        bodyType_ = (type_ == HPT_REQUEST)? HBT_NONE : HBT_CLOSE;
+    }
+
+    switch (bodyType_)
+    {
+        case HBT_NONE: state_ = HPS_DONE; break;
+        case HBT_CHUNKED: state_ = HPS_CHUNK_SIZE; break;
+        default: state_ = HPS_BODY; break;
+    }
+
+    return true;
+}
+
+int HttpMessageParser::ParseChunkSize(const char* data, int len)
+{
+    const char* end = data + len;
+    const char* line_end = FindCrlf(data, end);
+
+    if (line_end == end) return len >= MAX_CHUNK_LINE? -1 : 0;
+
+    const char* cur = data;
+    int64_t size = 0;
+    int digits = 0;
+
+    while (cur < line_end)
+    {
+        char c = *cur;
+        int val;
+
+        if (c >= '0' && c <= '9') val = c - '0';
+        else if (c >= 'a' && c <= 'f') val = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') val = c - 'A' + 10;
+        else break;
+
+        // 15 hex digits at most, keep it from overflow.
+        if (++digits > 15) return -1;
+
+        size = size * 16 + val;
+        ++cur;
+    }
+
+    // chunk extensions are ignored.
+    if (digits == 0 || (cur != line_end && *cur != ';' && *cur != ' ' && *cur != '\t')) return -1;
+
+    left_ = size;
+    state_ = size? HPS_CHUNK_DATA : HPS_TRAILER;
+
+    return line_end + HTTP_CRLF_LEN - data;
+}
+
+int HttpMessageParser::ParseTrailer(const char* data, int len)
+{
+    const char* end = data + len;
+    const char* line_end = FindCrlf(data, end);
+
+    if (line_end == end) return len >= maxHeadSize_? -1 : 0;
+
+    // empty line ends the message, trailer fields are dropped.
+    if (line_end == data) state_ = HPS_DONE;
+
+    return line_end + HTTP_CRLF_LEN - data;
+}
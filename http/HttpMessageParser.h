@@ -0,0 +1,149 @@
+#ifndef __HTTP_MESSAGE_PARSER_H__
+#define __HTTP_MESSAGE_PARSER_H__
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+/*
+ * incremental parser of http/1.x request or response, used where the message
+ * has to be framed without being buffered as a whole(eg, proxy, http client).
+ *
+ * usage:
+ * a) feed data by Parse(), it returns the number of bytes consumed.
+ *    data not consumed must be presented again with more data appended:
+ *    head(and chunk size line) is only parsed when it is complete in the input.
+ * b) Parse() returns right after the head is parsed, so that caller can act
+ *    on the head before any body byte is consumed.
+ * c) body is consumed as it arrives, chunk framing is removed before it is
+ *    passed to the body handler. bytes consumed always cover the raw framing,
+ *    so they can be forwarded as they are.
+ * d) Parse() stops at the end of message, bytes left belong to the next one.
+ */
+
+class HttpMessageParser
+{
+    public:
+
+        enum ParserType
+        {
+            HPT_REQUEST,
+            HPT_RESPONSE,
+        };
+
+        enum ParserState
+        {
+            HPS_HEAD,
+            HPS_BODY,
+            HPS_CHUNK_SIZE,
+            HPS_CHUNK_DATA,
+            HPS_CHUNK_END,
+            HPS_TRAILER,
+            HPS_DONE,
+            HPS_ERROR,
+        };
+
+        enum BodyType
+        {
+            HBT_NONE,
+            HBT_LENGTH,
+            HBT_CHUNKED,
+            HBT_CLOSE, // response delimited by closing the connection
+        };
+
+        typedef std::pair<std::string, std::string> Header;
+        typedef void (* BodyHandler)(void* arg, const char* data, int len);
+
+        explicit HttpMessageParser(ParserType type, int maxHeadSize = 8*1024);
+        ~HttpMessageParser();
+
+        // prepare for next message, body handler is kept.
+        void Reset();
+
+        // response to HEAD request has no body.
+        void SetHeadRequest(bool head) { headRequest_ = head; }
+        void SetBodyHandler(BodyHandler handler, void* arg) { bodyHandler_ = handler; bodyArg_ = arg; }
+
+        // return bytes consumed, -1 if message is malformed.
+        int Parse(const char* data, int len);
+
+        // connection closed by peer, complete the message if it is close delimited.
+        // return false if message is truncated.
+        bool FinishOnClose();
+
+        ParserState GetState() const { return state_; }
+        bool IsHeadComplete() const { return state_ != HPS_HEAD && state_ != HPS_ERROR; }
+        bool IsMessageComplete() const { return state_ == HPS_DONE; }
+
+        BodyType GetBodyType() const { return bodyType_; }
+        int64_t GetContentLength() const { return contentLength_; }
+
+        // request line.
+        const std::string& GetMethod() const { return method_; }
+        const std::string& GetUrl() const { return url_; }
+
+        // status line.
+        int GetStatusCode() const { return status_; }
+        const std::string& GetReason() const { return reason_; }
+
+        const std::string& GetVersion() const { return version_; }
+        bool IsHttp10() const { return version_ == "HTTP/1.0"; }
+
+        const std::vector<Header>& GetHeaders() const { return headers_; }
+
+        // header name is case insensitive, return NULL if not found.
+        const std::string* GetHeader(const char* name) const;
+
+        // whether comma separated value of the header contains token, case insensitive.
+        bool HasHeaderToken(const char* name, const char* token) const;
+
+        // whether the connection can be reused after this message.
+        bool IsKeepAlive() const;
+
+        // hop-by-hop headers that must not be forwarded by proxy.
+        static bool IsHopByHopHeader(const std::string& name);
+
+        // helpers shared with HttpClient and HttpAsyncClient.
+        // header line without CRLF, name and value with spaces around trimmed.
+        static bool ParseHeaderLine(const char* start, const char* end, Header* header);
+
+        // header name is case insensitive, return NULL if not found.
+        static const std::string* FindHeader(const std::vector<Header>& headers, const char* name);
+
+        // whether comma separated header value contains token, case insensitive.
+        static bool HasToken(const std::string& value, const char* token);
+
+    private:
+
+        int ParseHead(const char* data, int len);
+        bool ParseStartLine(const char* start, const char* end);
+        bool SetupBody();
+
+        int ParseChunkSize(const char* data, int len);
+        int ParseTrailer(const char* data, int len);
+
+        inline void OnBody(const char* data, int len);
+
+        const ParserType type_;
+        const int maxHeadSize_;
+
+        ParserState state_;
+        BodyType bodyType_;
+
+        bool headRequest_;
+        int64_t contentLength_;
+        int64_t left_; // body or chunk bytes left
+
+        int status_;
+        std::string method_;
+        std::string url_;
+        std::string version_;
+        std::string reason_;
+        std::vector<Header> headers_;
+
+        BodyHandler bodyHandler_;
+        void* bodyArg_;
+};
+
+#endif // __HTTP_MESSAGE_PARSER_H__
@@ -0,0 +1,405 @@
+#include "HttpMultipartParser.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+static const char HTTP_CRLF[] = "\r\n";
+static const char HTTP_HEAD_END[] = "\r\n\r\n";
+static const char MULTIPART_DASH[] = "--";
+
+static const int HTTP_CRLF_LEN = sizeof(HTTP_CRLF) - 1;
+static const int HTTP_HEAD_END_LEN = sizeof(HTTP_HEAD_END) - 1;
+static const int MULTIPART_DASH_LEN = sizeof(MULTIPART_DASH) - 1;
+
+// rfc 2046, boundary is 1 to 70 chars.
+#define MAX_BOUNDARY_LEN (70)
+
+// padding allowed between boundary and its line end.
+#define MAX_BOUNDARY_PADDING (256)
+
+static inline const char* FindCrlf(const char* start, const char* end)
+{
+    return std::search(start, end, HTTP_CRLF, HTTP_CRLF + HTTP_CRLF_LEN);
+}
+
+static inline const char* SkipSpace(const char* start, const char* end)
+{
+    while (start < end && (*start == ' ' || *start == '\t')) ++start;
+
+    return start;
+}
+
+static inline const char* TrimSpace(const char* start, const char* end)
+{
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) --end;
+
+    return end;
+}
+
+// value of parameter of header value like: type; key1=val1; key2="val 2".
+static bool GetParam(const std::string& value, const char* key, std::string* out)
+{
+    size_t klen = strlen(key);
+    const char* end = value.c_str() + value.size();
+    const char* cur = std::find(value.c_str(), end, ';');
+
+    while (cur < end)
+    {
+        const char* start = SkipSpace(cur + 1, end);
+        const char* semi = std::find(start, end, ';');
+        const char* eq = std::find(start, semi, '=');
+
+        if (eq == semi)
+        {
+            cur = semi;
+            continue;
+        }
+
+        const char* name_end = TrimSpace(start, eq);
+        const char* val = SkipSpace(eq + 1, end);
+
+        std::string param;
+
+        if (val < end && *val == '"')
+        {
+            // quoted string may contain ';', escaped chars are taken as they are.
+            for (++val; val < end && *val != '"'; ++val)
+            {
+                if (*val == '\\' && val + 1 < end) ++val;
+
+                param.push_back(*val);
+            }
+
+            cur = std::find(val, end, ';');
+        }
+        else
+        {
+            param.assign(val, TrimSpace(val, semi));
+            cur = semi;
+        }
+
+        if (size_t(name_end - start) == klen && strncasecmp(start, key, klen) == 0)
+        {
+            out->swap(param);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+HttpMultipartParser::HttpMultipartParser(int maxHeadSize)
+    :maxHeadSize_(maxHeadSize)
+    ,state_(HMS_START)
+    ,partNum_(0)
+    ,handler_(NULL)
+    ,arg_(NULL)
+{
+    memset(skip_, 0, sizeof(skip_));
+}
+
+HttpMultipartParser::~HttpMultipartParser()
+{
+}
+
+bool HttpMultipartParser::ParseBoundary(const std::string& contentType, std::string* boundary)
+{
+    static const char type[] = "multipart/";
+    static const size_t type_len = sizeof(type) - 1;
+
+    if (strncasecmp(contentType.c_str(), type, type_len) != 0) return false;
+
+    std::string value;
+    if (!GetParam(contentType, "boundary", &value)) return false;
+
+    if (value.empty() || value.size() > MAX_BOUNDARY_LEN) return false;
+
+    boundary->swap(value);
+    return true;
+}
+
+bool HttpMultipartParser::Init(const std::string& contentType)
+{
+    Reset();
+
+    std::string boundary;
+    if (!ParseBoundary(contentType, &boundary)) return false;
+
+    boundary_ = HTTP_CRLF;
+    boundary_ += MULTIPART_DASH;
+    boundary_ += boundary;
+
+    BuildSkip(boundary_.data(), boundary_.size(), skip_);
+    return true;
+}
+
+void HttpMultipartParser::Reset()
+{
+    state_ = HMS_START;
+    partNum_ = 0;
+
+    boundary_.clear();
+    name_.clear();
+    fileName_.clear();
+    headers_.clear();
+}
+
+void HttpMultipartParser::BuildSkip(const char* needle, int nlen, unsigned char* skip)
+{
+    memset(skip, nlen, 256);
+
+    // distance from the last occurrence to the end, last char excluded.
+    for (int i = 0; i < nlen - 1; ++i)
+    {
+        skip[(unsigned char)needle[i]] = nlen - 1 - i;
+    }
+}
+
+int HttpMultipartParser::Search(const char* data, int len, const char* needle, int nlen, const unsigned char* skip)
+{
+    if (nlen <= 0 || len < nlen) return -1;
+
+    const char last = needle[nlen - 1];
+
+    int i = 0;
+    while (i <= len - nlen)
+    {
+        char c = data[i + nlen - 1];
+
+        if (c == last && memcmp(data + i, needle, nlen - 1) == 0) return i;
+
+        i += skip[(unsigned char)c];
+    }
+
+    return -1;
+}
+
+const std::string* HttpMultipartParser::GetPartHeader(const char* name) const
+{
+    for (size_t i = 0; i < headers_.size(); ++i)
+    {
+        if (strcasecmp(headers_[i].first.c_str(), name) == 0) return &headers_[i].second;
+    }
+
+    return NULL;
+}
+
+inline void HttpMultipartParser::OnEvent(PartEvent evt, const char* data, int len)
+{
+    if (handler_) handler_(arg_, evt, data, len);
+}
+
+int HttpMultipartParser::Parse(const char* data, int len)
+{
+    if (!IsActive()) return -1;
+
+    int consumed = 0;
+
+    while (consumed < len)
+    {
+        const char* cur = data + consumed;
+        int left = len - consumed;
+
+        int ret = 0;
+
+        switch (state_)
+        {
+            case HMS_START:
+                {
+                    ret = ParseStart(cur, left);
+                }
+                break;
+            case HMS_PREAMBLE:
+                {
+                    ret = ParsePreamble(cur, left);
+                }
+                break;
+            case HMS_BOUNDARY:
+                {
+                    ret = ParseAfterBoundary(cur, left);
+                }
+                break;
+            case HMS_HEAD:
+                {
+                    ret = ParseHead(cur, left);
+                }
+                break;
+            case HMS_DATA:
+                {
+                    ret = ParseData(cur, left);
+                }
+                break;
+            case HMS_DONE:
+                {
+                    // epilogue is ignored.
+                    ret = left;
+                }
+                break;
+            default:
+                {
+                    ret = -1;
+                }
+                break;
+        }
+
+        if (ret < 0)
+        {
+            state_ = HMS_ERROR;
+            return -1;
+        }
+
+        // need more data.
+        if (ret == 0) break;
+
+        consumed += ret;
+    }
+
+    return consumed;
+}
+
+// number of bytes at the end of data that may be the start of a boundary.
+int HttpMultipartParser::HoldBack(const char* data, int len) const
+{
+    int blen = boundary_.size();
+    int i = len > blen - 1? len - blen + 1 : 0;
+
+    for (; i < len; ++i)
+    {
+        if (data[i] == '\r' && memcmp(data + i, boundary_.data(), len - i) == 0) return len - i;
+    }
+
+    return 0;
+}
+
+int HttpMultipartParser::ParseStart(const char* data, int len)
+{
+    // the first boundary has no line end ahead.
+    const char* dash = boundary_.data() + HTTP_CRLF_LEN;
+    int dlen = boundary_.size() - HTTP_CRLF_LEN;
+
+    int n = len < dlen? len : dlen;
+
+    if (memcmp(data, dash, n) != 0)
+    {
+        state_ = HMS_PREAMBLE;
+        return ParsePreamble(data, len);
+    }
+
+    if (n < dlen) return 0;
+
+    state_ = HMS_BOUNDARY;
+    return dlen;
+}
+
+int HttpMultipartParser::ParsePreamble(const char* data, int len)
+{
+    int pos = Search(data, len, boundary_.data(), boundary_.size(), skip_);
+
+    if (pos >= 0)
+    {
+        state_ = HMS_BOUNDARY;
+        return pos + boundary_.size();
+    }
+
+    return len - HoldBack(data, len);
+}
+
+int HttpMultipartParser::ParseAfterBoundary(const char* data, int len)
+{
+    if (len < MULTIPART_DASH_LEN) return 0;
+
+    if (memcmp(data, MULTIPART_DASH, MULTIPART_DASH_LEN) == 0)
+    {
+        state_ = HMS_DONE;
+        return MULTIPART_DASH_LEN;
+    }
+
+    const char* end = data + len;
+    const char* line_end = FindCrlf(data, end);
+
+    if (line_end == end) return len >= MAX_BOUNDARY_PADDING? -1 : 0;
+
+    // only padding is allowed after boundary.
+    if (SkipSpace(data, line_end) != line_end) return -1;
+
+    headers_.clear();
+    name_.clear();
+    fileName_.clear();
+
+    state_ = HMS_HEAD;
+    return line_end + HTTP_CRLF_LEN - data;
+}
+
+int HttpMultipartParser::ParseHead(const char* data, int len)
+{
+    const char* end = data + len;
+    const char* head_end = NULL;
+
+    // part may have no header at all.
+    if (len >= HTTP_CRLF_LEN && memcmp(data, HTTP_CRLF, HTTP_CRLF_LEN) == 0)
+    {
+        head_end = data;
+    }
+    else
+    {
+        const char* found = std::search(data, end, HTTP_HEAD_END, HTTP_HEAD_END + HTTP_HEAD_END_LEN);
+        if (found == end) return len >= maxHeadSize_? -1 : 0;
+
+        head_end = found + HTTP_CRLF_LEN;
+    }
+
+    const char* cur = data;
+
+    while (cur < head_end)
+    {
+        const char* line_end = FindCrlf(cur, end);
+
+        const char* colon = std::find(cur, line_end, ':');
+        if (colon == line_end || colon == cur) return -1;
+
+        const char* value = SkipSpace(colon + 1, line_end);
+        const char* value_end = TrimSpace(value, line_end);
+
+        headers_.push_back(Header(std::string(cur, colon), std::string(value, value_end)));
+
+        cur = line_end + HTTP_CRLF_LEN;
+    }
+
+    const std::string* disposition = GetPartHeader("Content-Disposition");
+    if (disposition) ParseDisposition(*disposition);
+
+    ++partNum_;
+    state_ = HMS_DATA;
+
+    OnEvent(HME_PART_BEGIN, NULL, 0);
+
+    return head_end + HTTP_CRLF_LEN - data;
+}
+
+int HttpMultipartParser::ParseData(const char* data, int len)
+{
+    int pos = Search(data, len, boundary_.data(), boundary_.size(), skip_);
+
+    if (pos >= 0)
+    {
+        if (pos > 0) OnEvent(HME_PART_DATA, data, pos);
+
+        state_ = HMS_BOUNDARY;
+        OnEvent(HME_PART_END, NULL, 0);
+
+        return pos + boundary_.size();
+    }
+
+    int n = len - HoldBack(data, len);
+    if (n > 0) OnEvent(HME_PART_DATA, data, n);
+
+    return n;
+}
+
+void HttpMultipartParser::ParseDisposition(const std::string& value)
+{
+    GetParam(value, "name", &name_);
+    GetParam(value, "filename", &fileName_);
+}
@@ -0,0 +1,116 @@
+#ifndef __HTTP_MULTIPART_PARSER_H__
+#define __HTTP_MULTIPART_PARSER_H__
+
+#include <string>
+#include <vector>
+#include <utility>
+
+/*
+ * incremental parser of multipart/form-data body(rfc 7578), parts are streamed
+ * to handler as they arrive, so upload of any size is parsed in constant memory.
+ *
+ * usage:
+ * a) feed data by Parse(), it returns the number of bytes consumed, like HttpMessageParser,
+ *    data not consumed must be presented again with more data appended.
+ * b) bytes that may be the start of a boundary are held back, so at most
+ *    boundary length + 3 bytes(or a part head being received) are left unconsumed.
+ * c) boundaries are searched by boyer-moore-horspool, part data is passed to handler
+ *    in place, never copied.
+ * d) everything after the close delimiter is consumed and ignored.
+ */
+
+class HttpMultipartParser
+{
+    public:
+
+        enum ParserState
+        {
+            HMS_START,    // expecting the first boundary
+            HMS_PREAMBLE, // garbage before the first boundary
+            HMS_BOUNDARY, // after a boundary, expecting "--" or line end
+            HMS_HEAD,
+            HMS_DATA,
+            HMS_DONE,     // close delimiter seen
+            HMS_ERROR,
+        };
+
+        enum PartEvent
+        {
+            HME_PART_BEGIN, // head of part is parsed
+            HME_PART_DATA,
+            HME_PART_END,
+        };
+
+        typedef std::pair<std::string, std::string> Header;
+
+        // data and len are only meaningful for HME_PART_DATA.
+        typedef void (* PartHandler)(void* arg, PartEvent evt, const char* data, int len);
+
+        explicit HttpMultipartParser(int maxHeadSize = 4*1024);
+        ~HttpMultipartParser();
+
+        // boundary is taken from value of Content-Type, return false if it is not
+        // multipart or has no valid boundary.
+        bool Init(const std::string& contentType);
+        void Reset();
+
+        bool IsActive() const { return !boundary_.empty(); }
+
+        void SetPartHandler(PartHandler handler, void* arg) { handler_ = handler; arg_ = arg; }
+
+        // return bytes consumed, -1 if body is malformed.
+        int Parse(const char* data, int len);
+
+        ParserState GetState() const { return state_; }
+        bool IsComplete() const { return state_ == HMS_DONE; }
+
+        // number of parts begun so far.
+        int GetPartNum() const { return partNum_; }
+
+        // head of current part, header name is case insensitive, return NULL if not found.
+        const std::vector<Header>& GetPartHeaders() const { return headers_; }
+        const std::string* GetPartHeader(const char* name) const;
+
+        // parameters of Content-Disposition, empty if absent.
+        const std::string& GetPartName() const { return name_; }
+        const std::string& GetFileName() const { return fileName_; }
+
+        // search needle in data by boyer-moore-horspool, skip is the table built by BuildSkip(),
+        // return offset of the first match, -1 if not found.
+        static int Search(const char* data, int len, const char* needle, int nlen, const unsigned char* skip);
+        static void BuildSkip(const char* needle, int nlen, unsigned char* skip);
+
+        // boundary parameter of a multipart Content-Type value, 1 to 70 chars.
+        static bool ParseBoundary(const std::string& contentType, std::string* boundary);
+
+    private:
+
+        int ParseStart(const char* data, int len);
+        int ParsePreamble(const char* data, int len);
+        int ParseAfterBoundary(const char* data, int len);
+        int ParseHead(const char* data, int len);
+        int ParseData(const char* data, int len);
+
+        void ParseDisposition(const std::string& value);
+
+        int HoldBack(const char* data, int len) const;
+        inline void OnEvent(PartEvent evt, const char* data, int len);
+
+        const int maxHeadSize_;
+
+        ParserState state_;
+        int partNum_;
+
+        // "\r\n--" + boundary, the first boundary comes without the leading "\r\n".
+        std::string boundary_;
+        unsigned char skip_[256];
+
+        std::string name_;
+        std::string fileName_;
+        std::vector<Header> headers_;
+
+        PartHandler handler_;
+        void* arg_;
+};
+
+#endif // __HTTP_MULTIPART_PARSER_H__
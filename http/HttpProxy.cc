@@ -0,0 +1,909 @@
+#include "HttpProxy.h"
+#include "HttpMessageParser.h"
+
+#include "sys/Log.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+// a side stops reading when its peer has this many bytes waiting to be written.
+#define MAX_PROXY_PENDING (64*1024)
+
+// size of buffer holding output, the largest HttpWriteBuffer hands out by default.
+#define PROXY_WRITE_SIZE (8*1024)
+
+static const char HTTP_BAD_REQUEST_RESPONSE[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char HTTP_BAD_GATEWAY_RESPONSE[] =
+    "HTTP/1.1 502 Bad Gateway\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char HTTP_NO_UPSTREAM_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char HTTP_CRLF[] = "\r\n";
+
+struct ProxyPeer
+{
+    ProxyPeer(SocketConnection* conn, bool upstream)
+        :upstream_(upstream)
+        ,conn_(conn)
+        ,handle_(conn->GetHandle())
+        ,partner_(NULL)
+        ,index_(-1)
+        ,parser_(upstream? HttpMessageParser::HPT_RESPONSE : HttpMessageParser::HPT_REQUEST)
+        ,readBuffer_()
+        ,outSize_(0)
+        ,connected_(!upstream)
+        ,eof_(false)
+        ,dead_(false)
+        ,closing_(false)
+        ,responded_(false)
+        ,keepAlive_(false)
+        ,dirty_(false)
+        ,idle_(false)
+        ,prevIdle_(NULL)
+        ,nextIdle_(NULL)
+    {
+    }
+
+    const bool upstream_;
+    SocketConnection* conn_;
+
+    // slot of conn_ is reused by later connections, events are matched by handle.
+    const ConnHandle handle_;
+
+    // the other side of current request.
+    ProxyPeer* partner_;
+
+    // index of upstream, for upstream connection only.
+    int index_;
+
+    // parses requests from downstream, responses from upstream.
+    HttpMessageParser parser_;
+    HttpReadBuffer readBuffer_;
+
+    HttpBufferList output_;
+    int outSize_;
+
+    bool connected_;
+    bool eof_;       // closed by remote
+    bool dead_;      // close now
+    bool closing_;   // close when output is flushed
+    bool responded_; // downstream: final response head is sent
+    bool keepAlive_; // downstream: keep connection after current response
+    bool dirty_;     // in the list to be settled
+
+    // link in idle list of upstream.
+    bool idle_;
+    ProxyPeer* prevIdle_;
+    ProxyPeer* nextIdle_;
+};
+
+// header is not forwarded if it is hop-by-hop, or listed in Connection header.
+static bool ShouldForwardHeader(const HttpMessageParser& parser, const std::string& name)
+{
+    if (HttpMessageParser::IsHopByHopHeader(name)) return false;
+
+    return !parser.HasHeaderToken("Connection", name.c_str());
+}
+
+HttpProxy::HttpProxy()
+    :stop_(false)
+    ,listenFd_(-1)
+    ,maxIdle_(32)
+    ,next_(0)
+    ,writeBuffer_()
+    ,tcpServer_()
+    ,peer_(tcpServer_.max_conn_id)
+{
+}
+
+HttpProxy::~HttpProxy()
+{
+    DestroyServer();
+}
+
+void HttpProxy::DestroyServer()
+{
+    for (size_t i = 0; i < peer_.PageNum(); ++i)
+    {
+        ProxyPeer** page = peer_.GetPage(i);
+        if (page == NULL) continue;
+
+        for (size_t j = 0; j < peer_.PageSize(); ++j)
+        {
+            ProxyPeer* peer = page[j];
+            if (peer == NULL) continue;
+
+            HttpBuffer* buf;
+            while ((buf = peer->output_.PopFront()) != NULL)
+            {
+                writeBuffer_.ReleaseWriteBuffer(buf);
+            }
+
+            peer->conn_->CloseConnection();
+
+            delete peer;
+            page[j] = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < upstream_.size(); ++i)
+    {
+        upstream_[i].idle_ = NULL;
+        upstream_[i].idleNum_ = 0;
+        upstream_[i].outstanding_ = 0;
+    }
+
+    dirty_.clear();
+}
+
+int HttpProxy::AddUpstream(const char* host, int port)
+{
+    Upstream up;
+
+    up.host_ = host;
+    up.port_ = port;
+    up.outstanding_ = 0;
+    up.idleNum_ = 0;
+    up.idle_ = NULL;
+    up.requests_ = 0;
+    up.connects_ = 0;
+
+    upstream_.push_back(up);
+
+    return upstream_.size() - 1;
+}
+
+int64_t HttpProxy::GetUpstreamRequests(int index) const
+{
+    if (index < 0 || index >= (int)upstream_.size()) return 0;
+
+    return upstream_[index].requests_;
+}
+
+int64_t HttpProxy::GetUpstreamConnects(int index) const
+{
+    if (index < 0 || index >= (int)upstream_.size()) return 0;
+
+    return upstream_[index].connects_;
+}
+
+void HttpProxy::SetExclusiveAccept(bool exclusive)
+{
+    tcpServer_.SetExclusiveAccept(exclusive);
+}
+
+void HttpProxy::SetListenSock(int fd)
+{
+    listenFd_ = fd;
+    tcpServer_.WatchRawSocket(fd, true);
+}
+
+void HttpProxy::RunServer()
+{
+    tcpServer_.SetWatchAcceptedSock(true);
+
+    RunPoll();
+}
+
+void HttpProxy::SetStop()
+{
+    stop_ = true;
+}
+
+void HttpProxy::RunPoll()
+{
+    while (stop_ == false)
+    {
+        SocketEvent evt;
+
+        tcpServer_.RunPoll(&evt);
+
+        PollHandler(evt);
+    }
+}
+
+ProxyPeer* HttpProxy::CreatePeer(SocketConnection* conn, bool upstream)
+{
+    ProxyPeer** slot = peer_.Alloc(conn->GetConnectionId());
+    if (slot == NULL) return NULL;
+
+    delete *slot;
+    *slot = new ProxyPeer(conn, upstream);
+
+    return *slot;
+}
+
+void HttpProxy::PollHandler(SocketEvent evt)
+{
+    if (evt.code == SC_ACCEPTED)
+    {
+        if (CreatePeer(evt.conn, false) == NULL) evt.conn->CloseConnection();
+        return;
+    }
+
+    ProxyPeer** slot = peer_.Get(evt.conn->GetConnectionId());
+    if (slot == NULL || *slot == NULL || (*slot)->handle_ != evt.conn->GetHandle()) return;
+
+    ProxyPeer* peer = *slot;
+
+    switch (evt.code)
+    {
+        case SC_READ:
+        case SC_WRITE:
+            {
+                HandleEvent(peer);
+            }
+            break;
+        case SC_CONNECTED:
+            {
+                HandleConnected(peer);
+            }
+            break;
+        case SC_FAIL_CONN:
+            {
+                HandleConnectFail(peer);
+            }
+            break;
+        default:
+            {
+            }
+            break;
+    }
+
+    SettleDirty();
+}
+
+void HttpProxy::HandleEvent(ProxyPeer* peer)
+{
+    if (peer->connected_ && peer->outSize_ > 0 && FlushPeer(peer) < 0) peer->dead_ = true;
+
+    if (CanRead(peer) && ReadPeer(peer) < 0) peer->eof_ = true;
+
+    ProcessPeer(peer);
+
+    // output of peer is drained, partner may carry on with the data it holds.
+    if (peer->partner_)
+    {
+        ProcessPeer(peer->partner_);
+        MarkDirty(peer->partner_);
+    }
+
+    MarkDirty(peer);
+}
+
+void HttpProxy::HandleConnected(ProxyPeer* peer)
+{
+    peer->connected_ = true;
+    MarkDirty(peer);
+}
+
+void HttpProxy::HandleConnectFail(ProxyPeer* peer)
+{
+    slog(LOG_WARN, "proxy: failed to connect to upstream %s:%d",
+            upstream_[peer->index_].host_.c_str(), upstream_[peer->index_].port_);
+
+    peer->dead_ = true;
+    MarkDirty(peer);
+}
+
+void HttpProxy::MarkDirty(ProxyPeer* peer)
+{
+    if (peer->dirty_) return;
+
+    peer->dirty_ = true;
+    dirty_.push_back(peer);
+}
+
+// flush, re-arm or close the peers touched by current event.
+// closing a peer may touch its partner, the list grows while walking it.
+void HttpProxy::SettleDirty()
+{
+    for (size_t i = 0; i < dirty_.size(); ++i)
+    {
+        ProxyPeer* peer = dirty_[i];
+
+        peer->dirty_ = false;
+
+        if (!peer->dead_ && peer->connected_ && peer->outSize_ > 0 && FlushPeer(peer) < 0)
+        {
+            peer->dead_ = true;
+        }
+
+        if (peer->dead_ || (peer->closing_ && peer->outSize_ == 0))
+        {
+            ClosePeer(peer);
+            continue;
+        }
+
+        bool write = peer->outSize_ > 0 || !peer->connected_;
+
+        peer->conn_->WatchEvent(CanRead(peer), write);
+    }
+
+    dirty_.clear();
+}
+
+void HttpProxy::ClosePeer(ProxyPeer* peer)
+{
+    ProxyPeer* partner = peer->partner_;
+
+    if (peer->upstream_)
+    {
+        if (partner)
+        {
+            Unpair(peer);
+
+            // nothing is sent yet, downstream can still be told what happened.
+            if (partner->responded_) partner->dead_ = true;
+            else ReplyError(partner, HTTP_BAD_GATEWAY_RESPONSE, sizeof(HTTP_BAD_GATEWAY_RESPONSE) - 1);
+
+            MarkDirty(partner);
+        }
+        else if (peer->idle_)
+        {
+            RemoveIdle(peer);
+        }
+    }
+    else if (partner)
+    {
+        // upstream is in the middle of a request, can't be reused.
+        Unpair(partner);
+
+        partner->dead_ = true;
+        MarkDirty(partner);
+    }
+
+    HttpBuffer* buf;
+    while ((buf = peer->output_.PopFront()) != NULL)
+    {
+        writeBuffer_.ReleaseWriteBuffer(buf);
+    }
+
+    int id = peer->conn_->GetConnectionId();
+
+    peer->conn_->CloseConnection();
+
+    ProxyPeer** slot = peer_.Get(id);
+    if (slot && *slot == peer) *slot = NULL;
+
+    delete peer;
+}
+
+// least outstanding requests, ties are taken in turn.
+HttpProxy::Upstream* HttpProxy::PickUpstream()
+{
+    size_t num = upstream_.size();
+    if (num == 0) return NULL;
+
+    size_t best = next_ % num;
+
+    for (size_t i = 1; i < num; ++i)
+    {
+        size_t cur = (next_ + i) % num;
+        if (upstream_[cur].outstanding_ < upstream_[best].outstanding_) best = cur;
+    }
+
+    next_ = best + 1;
+
+    return &upstream_[best];
+}
+
+ProxyPeer* HttpProxy::AcquireUpstream(Upstream* up)
+{
+    // most recently used connection first, it is the least likely to be timed out by upstream.
+    if (up->idle_)
+    {
+        ProxyPeer* peer = up->idle_;
+        RemoveIdle(peer);
+        return peer;
+    }
+
+    SocketConnection* conn = tcpServer_.ConnectToAsync(up->host_.c_str(), up->port_);
+    if (conn == NULL)
+    {
+        slog(LOG_WARN, "proxy: failed to connect to upstream %s:%d", up->host_.c_str(), up->port_);
+        return NULL;
+    }
+
+    ProxyPeer* peer = CreatePeer(conn, true);
+    if (peer == NULL)
+    {
+        conn->CloseConnection();
+        return NULL;
+    }
+
+    ++up->connects_;
+
+    peer->index_ = up - &upstream_[0];
+    peer->connected_ = conn->IsConnected();
+
+    return peer;
+}
+
+void HttpProxy::ReleaseUpstream(ProxyPeer* peer, bool reuse)
+{
+    Upstream& up = upstream_[peer->index_];
+
+    MarkDirty(peer);
+
+    if (!reuse || up.idleNum_ >= maxIdle_)
+    {
+        peer->dead_ = true;
+        return;
+    }
+
+    peer->parser_.Reset();
+
+    peer->idle_ = true;
+    peer->prevIdle_ = NULL;
+    peer->nextIdle_ = up.idle_;
+
+    if (up.idle_) up.idle_->prevIdle_ = peer;
+
+    up.idle_ = peer;
+    ++up.idleNum_;
+}
+
+void HttpProxy::RemoveIdle(ProxyPeer* peer)
+{
+    Upstream& up = upstream_[peer->index_];
+
+    if (peer->prevIdle_) peer->prevIdle_->nextIdle_ = peer->nextIdle_;
+    else up.idle_ = peer->nextIdle_;
+
+    if (peer->nextIdle_) peer->nextIdle_->prevIdle_ = peer->prevIdle_;
+
+    peer->idle_ = false;
+    peer->prevIdle_ = NULL;
+    peer->nextIdle_ = NULL;
+
+    --up.idleNum_;
+}
+
+void HttpProxy::Pair(ProxyPeer* down, ProxyPeer* up)
+{
+    down->partner_ = up;
+    up->partner_ = down;
+
+    ++upstream_[up->index_].outstanding_;
+    ++upstream_[up->index_].requests_;
+}
+
+void HttpProxy::Unpair(ProxyPeer* up)
+{
+    up->partner_->partner_ = NULL;
+    up->partner_ = NULL;
+
+    --upstream_[up->index_].outstanding_;
+}
+
+bool HttpProxy::CanRead(ProxyPeer* peer)
+{
+    if (peer->eof_ || peer->dead_ || peer->closing_) return false;
+
+    ProxyPeer* partner = peer->partner_;
+
+    // head is parsed before it is forwarded, it is never held back.
+    bool streaming = peer->parser_.IsHeadComplete();
+
+    if (partner && streaming && partner->outSize_ >= MAX_PROXY_PENDING) return false;
+
+    int size = 0;
+    peer->readBuffer_.GetFreeBuffer(size);
+
+    return size > 0;
+}
+
+int HttpProxy::ReadPeer(ProxyPeer* peer)
+{
+    int size = 0;
+    char* buf = peer->readBuffer_.GetFreeBuffer(size);
+
+    if (size <= 0) return 0;
+
+    int n = peer->conn_->ReadBuffer(buf, size);
+    if (n > 0) peer->readBuffer_.IncreaseContentRange(n);
+
+    return n;
+}
+
+int HttpProxy::FlushPeer(ProxyPeer* peer)
+{
+    HttpBuffer* buf;
+
+    while ((buf = peer->output_.GetFront()) != NULL)
+    {
+        // buffers queued behind are coalesced into the same segments.
+        int sz = peer->conn_->SendBuffer(buf->curPtr_, buf->curSize_, buf != peer->output_.GetTail());
+        if (sz < 0) return -1;
+
+        peer->outSize_ -= sz;
+
+        if (sz < buf->curSize_)
+        {
+            buf->curPtr_ += sz;
+            buf->curSize_ -= sz;
+            break;
+        }
+
+        peer->output_.PopFront();
+        writeBuffer_.ReleaseWriteBuffer(buf);
+    }
+
+    return 0;
+}
+
+bool HttpProxy::AppendOutput(ProxyPeer* peer, const char* data, int len)
+{
+    HttpBuffer* tail = peer->output_.GetTail();
+
+    MarkDirty(peer);
+
+    while (len > 0)
+    {
+        int room = 0;
+        if (tail) room = tail->memory_ + tail->size_ - (tail->curPtr_ + tail->curSize_);
+
+        if (room == 0)
+        {
+            tail = writeBuffer_.AllocWriteBuffer(PROXY_WRITE_SIZE);
+            if (tail == NULL)
+            {
+                peer->dead_ = true;
+                return false;
+            }
+
+            peer->output_.PushBack(tail);
+            room = tail->size_;
+        }
+
+        int sz = room < len? room : len;
+
+        memcpy(tail->curPtr_ + tail->curSize_, data, sz);
+
+        tail->curSize_ += sz;
+        peer->outSize_ += sz;
+
+        data += sz;
+        len  -= sz;
+    }
+
+    return true;
+}
+
+void HttpProxy::ReplyError(ProxyPeer* down, const char* response, int len)
+{
+    AppendOutput(down, response, len);
+
+    down->responded_ = true;
+    down->closing_ = true;
+}
+
+void HttpProxy::ProcessPeer(ProxyPeer* peer)
+{
+    if (peer->dead_) return;
+
+    if (peer->upstream_) ProcessUpstream(peer);
+    else ProcessDownstream(peer);
+}
+
+void HttpProxy::ProcessDownstream(ProxyPeer* down)
+{
+    HttpReadBuffer& buffer = down->readBuffer_;
+    HttpMessageParser& parser = down->parser_;
+
+    while (!down->dead_ && !down->closing_)
+    {
+        const char* data = buffer.GetContentStart();
+        int len = buffer.GetContenLen();
+
+        if (parser.GetState() == HttpMessageParser::HPS_HEAD)
+        {
+            int n = 0;
+
+            if (len > 0) n = parser.Parse(data, len);
+
+            if (n < 0)
+            {
+                ReplyError(down, HTTP_BAD_REQUEST_RESPONSE, sizeof(HTTP_BAD_REQUEST_RESPONSE) - 1);
+                return;
+            }
+
+            if (n == 0)
+            {
+                // closed between requests, or in the middle of a head.
+                if (down->eof_) down->closing_ = true;
+                return;
+            }
+
+            if (!ForwardRequestHead(down)) return;
+
+            buffer.ConsumeBuffer(n);
+            continue;
+        }
+
+        // request is forwarded, waiting for response.
+        if (parser.IsMessageComplete()) return;
+
+        ProxyPeer* up = down->partner_;
+        if (up == NULL || up->outSize_ >= MAX_PROXY_PENDING) return;
+
+        int n = 0;
+
+        if (len > 0) n = parser.Parse(data, len);
+
+        if (n < 0)
+        {
+            Unpair(up);
+
+            up->dead_ = true;
+            MarkDirty(up);
+
+            if (down->responded_) down->dead_ = true;
+            else ReplyError(down, HTTP_BAD_REQUEST_RESPONSE, sizeof(HTTP_BAD_REQUEST_RESPONSE) - 1);
+
+            return;
+        }
+
+        if (n == 0)
+        {
+            // body is truncated.
+            if (down->eof_) down->dead_ = true;
+            return;
+        }
+
+        // raw bytes are forwarded, chunk framing included.
+        AppendOutput(up, data, n);
+        buffer.ConsumeBuffer(n);
+    }
+}
+
+void HttpProxy::ProcessUpstream(ProxyPeer* up)
+{
+    HttpReadBuffer& buffer = up->readBuffer_;
+    HttpMessageParser& parser = up->parser_;
+
+    while (!up->dead_)
+    {
+        const char* data = buffer.GetContentStart();
+        int len = buffer.GetContenLen();
+
+        ProxyPeer* down = up->partner_;
+
+        if (down == NULL)
+        {
+            // idle connection is closed by upstream, or sends garbage.
+            if (len > 0 || up->eof_)
+            {
+                up->dead_ = true;
+                MarkDirty(up);
+            }
+
+            return;
+        }
+
+        if (parser.GetState() == HttpMessageParser::HPS_HEAD)
+        {
+            int n = 0;
+
+            if (len > 0) n = parser.Parse(data, len);
+
+            if (n < 0 || (n == 0 && up->eof_))
+            {
+                up->dead_ = true;
+                MarkDirty(up);
+                return;
+            }
+
+            if (n == 0) return;
+
+            if (!ForwardResponseHead(up)) return;
+
+            buffer.ConsumeBuffer(n);
+
+            if (!parser.IsMessageComplete()) continue;
+
+            // interim response, the final one follows.
+            if (parser.GetStatusCode() < 200)
+            {
+                parser.Reset();
+                parser.SetHeadRequest(down->parser_.GetMethod() == "HEAD");
+                continue;
+            }
+
+            FinishResponse(up);
+            return;
+        }
+
+        if (down->outSize_ >= MAX_PROXY_PENDING) return;
+
+        int n = 0;
+
+        if (len > 0) n = parser.Parse(data, len);
+
+        if (n < 0)
+        {
+            up->dead_ = true;
+            MarkDirty(up);
+            return;
+        }
+
+        if (n == 0)
+        {
+            if (!up->eof_) return;
+
+            if (parser.FinishOnClose()) FinishResponse(up);
+            else up->dead_ = true;
+
+            MarkDirty(up);
+            return;
+        }
+
+        AppendOutput(down, data, n);
+        buffer.ConsumeBuffer(n);
+
+        if (parser.IsMessageComplete())
+        {
+            FinishResponse(up);
+            return;
+        }
+    }
+}
+
+bool HttpProxy::ForwardRequestHead(ProxyPeer* down)
+{
+    const HttpMessageParser& parser = down->parser_;
+
+    Upstream* upstream = PickUpstream();
+    if (upstream == NULL)
+    {
+        ReplyError(down, HTTP_NO_UPSTREAM_RESPONSE, sizeof(HTTP_NO_UPSTREAM_RESPONSE) - 1);
+        return false;
+    }
+
+    ProxyPeer* up = AcquireUpstream(upstream);
+    if (up == NULL)
+    {
+        ReplyError(down, HTTP_BAD_GATEWAY_RESPONSE, sizeof(HTTP_BAD_GATEWAY_RESPONSE) - 1);
+        return false;
+    }
+
+    Pair(down, up);
+
+    up->parser_.Reset();
+    up->parser_.SetHeadRequest(parser.GetMethod() == "HEAD");
+
+    down->responded_ = false;
+    down->keepAlive_ = false;
+
+    std::string head;
+    head.reserve(512);
+
+    head += parser.GetMethod();
+    head += " ";
+    head += parser.GetUrl();
+    head += " ";
+    head += parser.GetVersion();
+    head += HTTP_CRLF;
+
+    std::string forwarded;
+    const std::vector<HttpMessageParser::Header>& headers = parser.GetHeaders();
+
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        const HttpMessageParser::Header& header = headers[i];
+
+        if (strcasecmp(header.first.c_str(), "X-Forwarded-For") == 0)
+        {
+            forwarded = header.second + ", ";
+            continue;
+        }
+
+        if (!ShouldForwardHeader(parser, header.first)) continue;
+
+        head += header.first;
+        head += ": ";
+        head += header.second;
+        head += HTTP_CRLF;
+    }
+
+    forwarded += down->conn_->buff_;
+
+    head += "X-Forwarded-For: " + forwarded + HTTP_CRLF;
+
+    // upstream connection is kept regardless of what downstream asks for.
+    head += "Connection: keep-alive\r\n";
+    head += HTTP_CRLF;
+
+    return AppendOutput(up, head.c_str(), head.size());
+}
+
+bool HttpProxy::ForwardResponseHead(ProxyPeer* up)
+{
+    ProxyPeer* down = up->partner_;
+    const HttpMessageParser& parser = up->parser_;
+
+    bool interim = parser.GetStatusCode() < 200;
+
+    std::string head;
+    head.reserve(512);
+
+    char status[16];
+    snprintf(status, sizeof(status), "%d", parser.GetStatusCode());
+
+    head += parser.GetVersion();
+    head += " ";
+    head += status;
+    head += " ";
+    head += parser.GetReason();
+    head += HTTP_CRLF;
+
+    const std::vector<HttpMessageParser::Header>& headers = parser.GetHeaders();
+
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        if (!ShouldForwardHeader(parser, headers[i].first)) continue;
+
+        head += headers[i].first;
+        head += ": ";
+        head += headers[i].second;
+        head += HTTP_CRLF;
+    }
+
+    if (!interim)
+    {
+        // response delimited by closing upstream has to be delimited the same way downstream.
+        down->keepAlive_ = down->parser_.IsKeepAlive()
+            && parser.GetBodyType() != HttpMessageParser::HBT_CLOSE;
+
+        head += down->keepAlive_? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+        down->responded_ = true;
+    }
+
+    head += HTTP_CRLF;
+
+    return AppendOutput(down, head.c_str(), head.size());
+}
+
+void HttpProxy::FinishResponse(ProxyPeer* up)
+{
+    ProxyPeer* down = up->partner_;
+
+    // upstream answers before taking the whole request, neither side can be reused.
+    bool request_done = down->parser_.IsMessageComplete();
+
+    bool reuse = request_done && up->parser_.IsKeepAlive() && !up->eof_
+        && up->readBuffer_.GetContenLen() == 0;
+
+    bool keep = request_done && down->keepAlive_ && !down->eof_;
+
+    Unpair(up);
+    ReleaseUpstream(up, reuse);
+
+    MarkDirty(down);
+
+    if (!keep)
+    {
+        down->closing_ = true;
+        return;
+    }
+
+    down->parser_.Reset();
+    down->responded_ = false;
+
+    // pipelined request may be buffered already.
+    ProcessDownstream(down);
+}
@@ -0,0 +1,117 @@
+#ifndef __HTTP_PROXY_H__
+#define __HTTP_PROXY_H__
+
+#include "HttpBuffer.h"
+#include "SocketServer.h"
+#include "misc/NonCopyable.h"
+#include "misc/PagedTable.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct ProxyPeer;
+
+/*
+ * http reverse proxy, one instance per reactor(worker).
+ *
+ * a) requests from downstream are forwarded to the upstream with the least
+ *    outstanding requests, ties are broken by round robin.
+ * b) keep-alive upstream connections are pooled per upstream and reused by
+ *    later requests, pool is owned by the reactor, no locking involved.
+ * c) bodies are streamed both ways as they arrive, a side stops reading when
+ *    its peer has too much data waiting to be written.
+ * d) requests on one downstream connection are forwarded one at a time.
+ */
+
+class HttpProxy: public noncopyable
+{
+    public:
+
+        HttpProxy();
+        ~HttpProxy();
+
+        // upstream must be added before RunServer(), return index of the upstream.
+        int AddUpstream(const char* host, int port);
+
+        // max number of idle keep-alive connections kept for each upstream.
+        void SetMaxIdlePerUpstream(int num) { maxIdle_ = num; }
+
+        // watch listen socket with EPOLLEXCLUSIVE, see SocketServer::SetExclusiveAccept().
+        void SetExclusiveAccept(bool exclusive);
+
+        void SetListenSock(int fd);
+        void RunServer();
+        void SetStop();
+
+        int GetUpstreamNum() const { return upstream_.size(); }
+
+        // requests forwarded to and connections opened to upstream denoted by index.
+        int64_t GetUpstreamRequests(int index) const;
+        int64_t GetUpstreamConnects(int index) const;
+
+    private:
+
+        struct Upstream
+        {
+            std::string host_;
+            int port_;
+
+            int outstanding_;
+            int idleNum_;
+            ProxyPeer* idle_;
+
+            int64_t requests_;
+            int64_t connects_;
+        };
+
+        void RunPoll();
+        void DestroyServer();
+        void PollHandler(SocketEvent evt);
+
+        ProxyPeer* CreatePeer(SocketConnection* conn, bool upstream);
+        void ClosePeer(ProxyPeer* peer);
+
+        // peers touched by an event are settled(flushed, re-armed or closed) after it.
+        void MarkDirty(ProxyPeer* peer);
+        void SettleDirty();
+
+        Upstream* PickUpstream();
+        ProxyPeer* AcquireUpstream(Upstream* up);
+        void ReleaseUpstream(ProxyPeer* peer, bool reuse);
+        void RemoveIdle(ProxyPeer* peer);
+        void Pair(ProxyPeer* down, ProxyPeer* up);
+        void Unpair(ProxyPeer* up);
+
+        void HandleEvent(ProxyPeer* peer);
+        void HandleConnected(ProxyPeer* peer);
+        void HandleConnectFail(ProxyPeer* peer);
+
+        bool CanRead(ProxyPeer* peer);
+        int  ReadPeer(ProxyPeer* peer);
+        int  FlushPeer(ProxyPeer* peer);
+        bool AppendOutput(ProxyPeer* peer, const char* data, int len);
+
+        void ProcessPeer(ProxyPeer* peer);
+        void ProcessDownstream(ProxyPeer* down);
+        void ProcessUpstream(ProxyPeer* up);
+        bool ForwardRequestHead(ProxyPeer* down);
+        bool ForwardResponseHead(ProxyPeer* up);
+        void FinishResponse(ProxyPeer* up);
+        void ReplyError(ProxyPeer* down, const char* response, int len);
+
+        bool stop_;
+        int  listenFd_;
+        int  maxIdle_;
+        size_t next_;
+
+        std::vector<Upstream> upstream_;
+        std::vector<ProxyPeer*> dirty_;
+
+        HttpWriteBuffer writeBuffer_;
+        SocketServer tcpServer_;
+        PagedTable<ProxyPeer*> peer_;
+};
+
+#endif
+
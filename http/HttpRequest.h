@@ -5,6 +5,10 @@
 #include <string>
 #include <stdlib.h>
 
+#include "HttpUrl.h"
+
+class HttpArena;
+
 class HttpRequest
 {
     public:
@@ -23,6 +27,7 @@ class HttpRequest
         {
             HV_10,
             HV_11,
+            HV_20,
             HV_INVALID
         };
 
@@ -31,9 +36,12 @@ class HttpRequest
     public:
 
         HttpRequest()
-            : bodyLen_(0)
+            : arena_(NULL)
+            , userData_(NULL)
+            , bodyLen_(0)
             , method_(HM_INVALID)
             , version_(HV_INVALID)
+            , urlCached_(true)
         {
         }
 
@@ -99,10 +107,14 @@ class HttpRequest
             return version_ != HV_INVALID;
         }
 
+        // http/2 has no version in request line, set by Http2Session.
+        void SetVersion(HttpVersion version) { version_ = version; }
+
         const char* GetVersionName() const
         {
             if (version_ == HV_10) return "HTTP/1.0";
             else if (version_ == HV_11) return "HTTP/1.1";
+            else if (version_ == HV_20) return "HTTP/2.0";
 
             return "UNKNOWN";
         }
@@ -112,23 +124,46 @@ class HttpRequest
             return version_;
         }
 
+        // target of request line, kept by caller(in arena) until the request is done.
+        bool SetTarget(const char* data, int len)
+        {
+            urlCached_ = false;
+            return target_.Parse(data, len);
+        }
+
+        const HttpUrl& GetTarget() const { return target_; }
+
+        // query parameter decoded in arena, raw key is compared.
+        bool GetQueryParam(const char* key, HttpStrRef* value) const
+        {
+            HttpStrRef raw;
+            if (!target_.FindParam(key, &raw)) return false;
+
+            return HttpUrl::Decode(arena_, raw, true, value);
+        }
+
         void SetUrl(const std::string& url)
         {
             reqUrl_ = url;
+            urlCached_ = true;
         }
 
+        // copies of the raw path and query, made on first use.
         const std::string& GetUrl() const
         {
+            CacheUrl();
             return reqUrl_;
         }
 
         void SetUrlData(const std::string& data)
         {
             urlData_ = data;
+            urlCached_ = true;
         }
 
         const std::string& GetUrlData() const
         {
+            CacheUrl();
             return urlData_;
         }
 
@@ -166,6 +201,13 @@ class HttpRequest
             httpBody_.append(start, end);
         }
 
+        // whole body at once, eg, from DATA frames of http/2.
+        void SetBody(const char* data, size_t len)
+        {
+            bodyLen_ = len;
+            httpBody_.assign(data, len);
+        }
+
         void AddHeader(const char* key, const char* value) { httpHeader_[key] = value; }
         const std::map<std::string, std::string>& GetHeader() const { return httpHeader_; }
 
@@ -177,23 +219,48 @@ class HttpRequest
             return it->second;
         }
 
+        // memory for handler, released as a whole once the response is sent.
+        void SetArena(HttpArena* arena) { arena_ = arena; }
+        HttpArena* GetArena() const { return arena_; }
+
+        // state of handler kept across calls for the same request, eg, upload in progress.
+        void SetUserData(void* data) { userData_ = data; }
+        void* GetUserData() const { return userData_; }
+
         void CleanUp()
         {
+            target_.Clear();
+            urlCached_ = true;
             reqUrl_ = "";
             urlData_ = "";
             httpBody_ = "";
             httpHeader_.clear();
             bodyLen_ = 0;
+            userData_ = NULL;
         }
 
     private:
 
+        void CacheUrl() const
+        {
+            if (urlCached_) return;
+
+            reqUrl_.assign(target_.GetPath().data_, target_.GetPath().len_);
+            urlData_.assign(target_.GetQuery().data_, target_.GetQuery().len_);
+            urlCached_ = true;
+        }
+
+        HttpArena* arena_;
+        void* userData_;
         size_t bodyLen_;
         HttpMethod method_;
         HttpVersion version_;
 
-        std::string reqUrl_;
-        std::string urlData_; // data after url in POST request
+        HttpUrl target_;
+
+        mutable bool urlCached_;
+        mutable std::string reqUrl_;
+        mutable std::string urlData_; // data after url in POST request
         std::string httpBody_;
         std::map<std::string, std::string> httpHeader_;
 };
@@ -15,17 +15,20 @@ class HttpResponse
         {
             HSC_UNKNOWN,
             HSC_200 = 200, // sucess
+            HSC_206 = 206, // partial content
+            HSC_304 = 304, // not modified
             HSC_400 = 400, // bad request
             HSC_401 = 401, // unauthorized
             HSC_403 = 403, // forbidden
             HSC_404 = 404, // not found
+            HSC_416 = 416, // range not satisfiable
             HSC_500 = 500, // internal error
             HSC_503 = 503, // unavailable
         };
 
     public:
 
-        HttpResponse(): response_(false)
+        HttpResponse(): response_(false), closeConn_(false), statusCode_(HSC_UNKNOWN), bodyRef_(NULL), bodyRefLen_(0)
         {
             msgLen_ = 13 + 2; //HTTP/1.1 404\r\n
         }
@@ -35,6 +38,7 @@ class HttpResponse
 
         void SetCloseConn(bool close) { closeConn_ = close; }
         void SetStatusCode(HttpStatusCode code) { statusCode_ = code; }
+        HttpStatusCode GetStatusCode() const { return statusCode_; }
 
         bool ShouldCloseConnection() const { return closeConn_; }
 
@@ -53,7 +57,38 @@ class HttpResponse
             statusMsg_ = msg;
         }
 
-        void SetBody(const char* body) { httpBody_ = body; }
+        void SetBody(const char* body) { httpBody_ = body; bodyRef_ = NULL; bodyRefLen_ = 0; }
+
+        // body referred without copying, data must stay valid until the response is sent,
+        // eg, allocated from HttpRequest::GetArena().
+        void SetBodyRef(const char* data, size_t len)
+        {
+            httpBody_ = "";
+            bodyRef_ = data;
+            bodyRefLen_ = len;
+        }
+
+        // keep the connection open as a server-sent events stream after the response,
+        // events published to topic are sent to it then, see HttpServer::PublishEvent().
+        void SetEventStream(const char* topic)
+        {
+            streamTopic_ = topic;
+
+            SetShouldResponse(true);
+            SetStatusCode(HSC_200);
+            SetStatusMessage("OK");
+            AddHeader("Content-Type", "text/event-stream");
+            AddHeader("Cache-Control", "no-cache");
+            AddHeader("Connection", "keep-alive");
+        }
+
+        const std::map<std::string, std::string>& GetHeader() const { return httpHeader_; }
+
+        // GetBodySize() bytes, set by SetBody() or SetBodyRef().
+        const char* GetBody() const { return bodyRef_? bodyRef_ : httpBody_.data(); }
+
+        bool IsEventStream() const { return !streamTopic_.empty(); }
+        const std::string& GetStreamTopic() const { return streamTopic_; }
 
         size_t GenerateResponse(char* buffer, size_t size) const
         {
@@ -95,11 +130,12 @@ class HttpResponse
 
             sz += 2;
 
-            tmp = httpBody_.size();
+            tmp = GetBodySize();
 
             if (sz + tmp + 1 >= size) return false;
 
-            memcpy(buffer + sz, httpBody_.c_str(), tmp + 1);
+            memcpy(buffer + sz, bodyRef_? bodyRef_ : httpBody_.c_str(), tmp);
+            buffer[sz + tmp] = '\0';
 
             sz += tmp;
 
@@ -110,13 +146,18 @@ class HttpResponse
         {
             closeConn_ = false;
             response_ = false;
-            msgLen_ = 0;
+            statusCode_ = HSC_UNKNOWN;
+            msgLen_ = 13 + 2;
             statusMsg_ = "";
             httpBody_  = "";
+            bodyRef_ = NULL;
+            bodyRefLen_ = 0;
+            streamTopic_ = "";
             httpHeader_.clear();
         }
 
-        size_t GetResponseSize() const { return msgLen_ + statusMsg_.size() + 2 + httpBody_.size() + 2; }
+        size_t GetBodySize() const { return bodyRef_? bodyRefLen_ : httpBody_.size(); }
+        size_t GetResponseSize() const { return msgLen_ + statusMsg_.size() + 2 + GetBodySize() + 2; }
 
     private:
 
@@ -128,6 +169,10 @@ class HttpResponse
         HttpStatusCode statusCode_;
         std::string statusMsg_;
         std::string httpBody_;
+        std::string streamTopic_;
+
+        const char* bodyRef_;
+        size_t bodyRefLen_;
         std::map<std::string, std::string> httpHeader_;
 };
 
@@ -1,6 +1,28 @@
 #include "HttpServer.h"
 
 #include "sys/Log.h"
+#include "sys/Clock.h"
+
+#include <string>
+
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+// heartbeat of event stream is an empty comment.
+static const char HTTP_STREAM_HEARTBEAT[] = ":\n\n";
+
+// heartbeats are scheduled at this fraction of the interval.
+#define HTTP_HEARTBEAT_TICKS (16)
+
+// answer to connections shed by overload controller, no handler involved.
+static const char HTTP_OVERLOAD_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "Retry-After: 1\r\n"
+    "\r\n";
 
 static void DefaultHttpRequestHandler(const HttpRequest& req, HttpResponse& response)
 {
@@ -13,8 +35,10 @@ static void DefaultHttpRequestHandler(const HttpRequest& req, HttpResponse& resp
     const map<string, string>& headers = req.GetHeader();
     map<string, string>::const_iterator it = headers.begin();
 
-    string body ;
-    body.reserve(128);
+    // body lives in arena of the request, it is referred by response without copying,
+    // destructor of the string frees nothing.
+    HttpArenaString body((HttpArenaAllocator<char>(req.GetArena())));
+    body.reserve(1024);
 
     body = "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 1.0 Frameset//EN\" \"http://www.w3.org/TR/xhtml1/DTD/xhtml1-Frameset.dtd\">\
 <html>\
@@ -30,25 +54,26 @@ static void DefaultHttpRequestHandler(const HttpRequest& req, HttpResponse& resp
     body += "<p>";
     while (it != headers.end())
     {
-        body += it->first;
+        body.append(it->first.data(), it->first.size());
         body += ":";
-        body += it->second;
+        body.append(it->second.data(), it->second.size());
         body += "</p>";
 
         ++it;
     }
 
     body += "</p>";
-    body += "Body from request: </p> " + req.GetHttpBody();
+    body += "Body from request: </p> ";
+    body.append(req.GetHttpBody().data(), req.GetHttpBody().size());
 
     body += "</p>\
              </body>\
              </html>";
 
-    response.SetBody(body.c_str());
+    response.SetBodyRef(body.data(), body.size());
 
     char bodylen[32] = {0};
-    snprintf(bodylen, 32, "%d", body.size());
+    snprintf(bodylen, 32, "%d", (int)body.size());
 
     response.AddHeader("Connection", "close");
     response.AddHeader("Host", "miliao server");
@@ -72,63 +97,428 @@ HttpServer::HttpServer()
     :stop_(false)
     ,watching_(false)
     ,listenFd_(-1)
+    ,timerFd_(-1)
+    ,heartbeatFd_(-1)
+    ,heartbeat_(0)
+    ,handler_(DefaultHttpRequestHandler)
+    ,partHandler_(NULL)
+    ,strategy_(AS_SHARED)
+    ,tls_(NULL)
+    ,overload_()
     ,tcpServer_()
-    ,conn_(new HttpClient*[tcpServer_.max_conn_id])
+    ,conn_(tcpServer_.max_conn_id)
+    ,heartbeats_(NULL)
+    ,sweep_(0)
 {
+    pthread_mutex_init(&eventLock_, NULL);
+
+    // replace the old "unwatch at 7/8, rewatch at 1/2" rule with a smooth connection limit.
+    OverloadController::Config config;
+    config.maxConnection = tcpServer_.max_conn_id - tcpServer_.max_conn_id/8;
 
+    overload_.SetConfig(config);
 }
 
 HttpServer::~HttpServer()
 {
     DestroyServer();
+
+    for (HttpEntityMap::iterator it = entities_.begin(); it != entities_.end(); ++it)
+    {
+        delete it->second;
+    }
+
+    pthread_mutex_destroy(&eventLock_);
+}
+
+void HttpServer::AddEntity(const std::string& path, HttpEntity* entity)
+{
+    HttpEntity*& slot = entities_[path];
+
+    if (slot != entity) delete slot;
+
+    slot = entity;
 }
 
 void HttpServer::DestroyServer()
 {
-    for (int i = 0; i < tcpServer_.max_conn_id; ++i)
+    for (size_t i = 0; i < conn_.PageNum(); ++i)
     {
-        if (conn_[i]) delete conn_[i];
+        HttpClient** page = conn_.GetPage(i);
+        if (page == NULL) continue;
+
+        for (size_t j = 0; j < conn_.PageSize(); ++j)
+        {
+            delete page[j];
+            page[j] = NULL;
+        }
     }
 
-    delete[] conn_;
+    if (timerFd_ >= 0)
+    {
+        tcpServer_.UnwatchSocket(timerFd_);
+        close(timerFd_);
+        timerFd_ = -1;
+    }
+
+    if (heartbeatFd_ >= 0)
+    {
+        tcpServer_.UnwatchSocket(heartbeatFd_);
+        close(heartbeatFd_);
+        heartbeatFd_ = -1;
+    }
+
+    delete heartbeats_;
+    heartbeats_ = NULL;
+}
+
+HttpReadStats HttpServer::GetReadStats() const
+{
+    HttpReadStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    for (size_t i = 0; i < conn_.PageNum(); ++i)
+    {
+        HttpClient** page = conn_.GetPage(i);
+        if (page == NULL) continue;
+
+        for (size_t j = 0; j < conn_.PageSize(); ++j)
+        {
+            if (page[j] == NULL) continue;
+
+            const HttpReadStats& client = page[j]->GetReadStats();
+
+            stats.events     += client.events;
+            stats.reads      += client.reads;
+            stats.bytes      += client.bytes;
+            stats.drained    += client.drained;
+            stats.budgetHits += client.budgetHits;
+            stats.grows      += client.grows;
+            stats.shrinks    += client.shrinks;
+        }
+    }
+
+    return stats;
+}
+
+void HttpServer::SetAcceptStrategy(AcceptStrategy strategy)
+{
+    strategy_ = strategy;
+    tcpServer_.SetExclusiveAccept(strategy == AS_EXCLUSIVE);
+
+    // connections hashed to a SO_REUSEPORT socket wait in its own backlog,
+    // pausing accept only delays them instead of passing them to other workers.
+    OverloadController::Config config = overload_.GetConfig();
+    config.allowPause = (strategy != AS_REUSEPORT);
+
+    overload_.SetConfig(config);
+}
+
+void HttpServer::SetOverloadConfig(const OverloadController::Config& config)
+{
+    OverloadController::Config conf = config;
+    if (strategy_ == AS_REUSEPORT) conf.allowPause = false;
+
+    overload_.SetConfig(conf);
 }
 
 void HttpServer::SetListenSock(int fd)
 {
     listenFd_ = fd;
+    tcpServer_.SetTlsContext(fd, tls_);
     watching_ = tcpServer_.WatchRawSocket(fd, true);
 }
 
 void HttpServer::RunServer()
 {
     tcpServer_.SetWatchAcceptedSock(true);
-    for (int i = 0; i < tcpServer_.max_conn_id; ++i)
+
+    // timer to re-evaluate load while accept is paused.
+    timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd_ >= 0 && !tcpServer_.WatchRawSocket(timerFd_, false))
+    {
+        slog(LOG_ERROR, "http server: failed to watch timer fd");
+        close(timerFd_);
+        timerFd_ = -1;
+    }
+
+    if (heartbeat_ > 0)
     {
-        conn_[i] = NULL;
+        int64_t tick = heartbeat_ / HTTP_HEARTBEAT_TICKS;
+        if (tick < 1000) tick = 1000;
+
+        heartbeatFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        struct itimerspec spec;
+        spec.it_interval.tv_sec  = tick / 1000000;
+        spec.it_interval.tv_nsec = (tick % 1000000) * 1000;
+        spec.it_value = spec.it_interval;
+
+        if (heartbeatFd_ < 0 || timerfd_settime(heartbeatFd_, 0, &spec, NULL) != 0
+                || !tcpServer_.WatchRawSocket(heartbeatFd_, false))
+        {
+            slog(LOG_ERROR, "http server: failed to setup heartbeat timer");
+            if (heartbeatFd_ >= 0) close(heartbeatFd_);
+            heartbeatFd_ = -1;
+        }
+        else
+        {
+            heartbeats_ = new TimerWheel<ConnHandle>(tick, 2 * HTTP_HEARTBEAT_TICKS, MonotonicMicroSec());
+        }
     }
 
     RunPoll();
 }
 
+void HttpServer::SetHeartbeat(int64_t interval)
+{
+    heartbeat_ = interval > 0? interval : 0;
+}
+
+int HttpServer::PublishEvent(const char* topic, const char* event, const char* data)
+{
+    if (data == NULL) data = "";
+
+    std::string frame;
+    frame.reserve(64 + strlen(data));
+
+    if (event && *event)
+    {
+        frame += "event: ";
+        frame += event;
+        frame += "\n";
+    }
+
+    const char* line = data;
+
+    while (true)
+    {
+        const char* end = strchr(line, '\n');
+
+        frame += "data: ";
+        frame.append(line, end? end - line : strlen(line));
+        frame += "\n";
+
+        if (end == NULL) break;
+
+        line = end + 1;
+    }
+
+    frame += "\n";
+
+    // frame is shared by all the streams, not copied for each.
+    int num = tcpServer_.Publish(topic, frame.c_str(), frame.size());
+
+    if (num > 0 && heartbeat_ > 0)
+    {
+        int64_t now = MonotonicMicroSec();
+
+        pthread_mutex_lock(&eventLock_);
+        lastEvent_[topic] = now;
+        pthread_mutex_unlock(&eventLock_);
+    }
+
+    return num;
+}
+
+void HttpServer::StartStream(SocketConnection* conn, HttpClient* client)
+{
+    ConnHandle handle = conn->GetHandle();
+
+    if (!tcpServer_.Subscribe(handle, client->GetStreamTopic().c_str())) return;
+
+    if (heartbeats_) heartbeats_->Schedule(handle, MonotonicMicroSec() + heartbeat_);
+}
+
+void HttpServer::HandleHeartbeat(SocketConnection* conn)
+{
+    uint64_t expired;
+    conn->ReadBuffer((char*)&expired, sizeof(expired));
+
+    int64_t now = MonotonicMicroSec();
+
+    expired_.clear();
+    heartbeats_->Advance(now, &expired_);
+
+    // stream that is closed fails to send, and is dropped from the wheel.
+    for (size_t i = 0; i < expired_.size(); ++i)
+    {
+        ConnHandle handle = expired_[i];
+
+        // an event is sent within the interval, heartbeat waits for the rest of it.
+        int64_t last = GetLastEvent(handle, now);
+        if (last > now - heartbeat_)
+        {
+            heartbeats_->Schedule(handle, last + heartbeat_);
+        }
+        else if (tcpServer_.Send(handle, HTTP_STREAM_HEARTBEAT, sizeof(HTTP_STREAM_HEARTBEAT) - 1))
+        {
+            heartbeats_->Schedule(handle, now + heartbeat_);
+        }
+    }
+
+    if (now < sweep_) return;
+
+    sweep_ = now + heartbeat_;
+
+    // topics no heartbeat is put off by any more.
+    pthread_mutex_lock(&eventLock_);
+
+    std::map<std::string, int64_t>::iterator it = lastEvent_.begin();
+    while (it != lastEvent_.end())
+    {
+        if (it->second <= now - heartbeat_) lastEvent_.erase(it++);
+        else ++it;
+    }
+
+    pthread_mutex_unlock(&eventLock_);
+}
+
+// 0 if stream of handle has no event in the interval before now.
+int64_t HttpServer::GetLastEvent(ConnHandle handle, int64_t now)
+{
+    HttpClient** slot = conn_.Get((uint32_t)handle);
+    if (slot == NULL || *slot == NULL || !(*slot)->IsStreaming()) return 0;
+
+    int64_t last = 0;
+
+    pthread_mutex_lock(&eventLock_);
+
+    std::map<std::string, int64_t>::iterator it = lastEvent_.find((*slot)->GetStreamTopic());
+    if (it != lastEvent_.end() && it->second > now - heartbeat_) last = it->second;
+
+    pthread_mutex_unlock(&eventLock_);
+
+    return last;
+}
+
+bool HttpServer::SetPauseTimer(bool enable)
+{
+    if (timerFd_ < 0) return false;
+
+    int64_t interval = enable? overload_.GetConfig().pauseInterval : 0;
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec  = interval / 1000000;
+    spec.it_interval.tv_nsec = (interval % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+
+    return timerfd_settime(timerFd_, 0, &spec, NULL) == 0;
+}
+
+void HttpServer::HandleTimer(SocketConnection* conn)
+{
+    uint64_t expired;
+
+    // reading re-arms the timer fd in poller.
+    conn->ReadBuffer((char*)&expired, sizeof(expired));
+
+    overload_.Tick();
+}
+
+void HttpServer::UpdateAcceptState()
+{
+    if (listenFd_ < 0) return;
+
+    overload_.SetConnection(tcpServer_.GetConnNumber());
+
+    bool pause = overload_.ShouldPauseAccept();
+
+    // paused without a timer, nothing would resume it.
+    if (pause && timerFd_ < 0) pause = false;
+
+    if (watching_ && pause)
+    {
+        watching_ = !tcpServer_.UnwatchSocket(listenFd_);
+        if (!watching_)
+        {
+            SetPauseTimer(true);
+            slog(LOG_INFO, "http server: accept paused, pressure:%f", overload_.GetPressure());
+        }
+    }
+    else if (!watching_ && !pause)
+    {
+        watching_ = tcpServer_.WatchRawSocket(listenFd_, true);
+        if (watching_)
+        {
+            SetPauseTimer(false);
+            slog(LOG_INFO, "http server: accept resumed, pressure:%f", overload_.GetPressure());
+        }
+    }
+}
+
+void HttpServer::HandleAccepted(SocketConnection* conn, HttpClient* client)
+{
+    OverloadController::Decision decision = overload_.Admit();
+
+    if (decision == OverloadController::OD_ADMIT)
+    {
+        client->ResetClient(conn);
+        return;
+    }
+
+    // newly accepted socket has an empty send buffer, the short answer always fits in.
+    if (decision == OverloadController::OD_REJECT)
+    {
+        conn->SendBuffer(HTTP_OVERLOAD_RESPONSE, sizeof(HTTP_OVERLOAD_RESPONSE) - 1);
+    }
+
+    conn->CloseConnection();
+}
+
 void HttpServer::PollHandler(SocketEvent evt)
 {
     int id = evt.conn->GetConnectionId();
-    if (conn_[id] == NULL) conn_[id] = new HttpClient(DefaultHttpRequestHandler);
+
+    if (id == timerFd_)
+    {
+        if (evt.code == SC_READ) HandleTimer(evt.conn);
+        return;
+    }
+
+    if (id == heartbeatFd_)
+    {
+        if (evt.code == SC_READ) HandleHeartbeat(evt.conn);
+        return;
+    }
+
+    // pages of the table are allocated on first use, slots start as NULL.
+    HttpClient** slot = conn_.Alloc(id);
+    if (slot == NULL) return;
+
+    if (*slot == NULL)
+    {
+        *slot = new HttpClient(handler_);
+        (*slot)->RegisterPartHandler(partHandler_);
+        (*slot)->SetEntities(&entities_);
+    }
+
+    HttpClient* client = *slot;
 
     switch (evt.code)
     {
         case SC_READ:
         case SC_WRITE:
             {
-                conn_[id]->ProcessEvent(evt);
+                int pending = client->GetPendingWriteSize();
+                int64_t handled = client->GetHandledNum();
+                bool streaming = client->IsStreaming();
+
+                client->ProcessEvent(evt);
+
+                if (!streaming && client->IsStreaming()) StartStream(evt.conn, client);
+
+                overload_.AddPendingWrite(client->GetPendingWriteSize() - pending);
+
+                if (client->GetHandledNum() != handled)
+                {
+                    overload_.RecordHandlerLatency(client->GetLastHandlerLatency());
+                }
             }
             break;
         case SC_ACCEPTED:
             {
-                static int co = 0;
-                ++co;
-                slog(LOG_INFO, "accept(%d)", co);
-                conn_[id]->ResetClient(evt.conn);
+                HandleAccepted(evt.conn, client);
             }
             break;
         case SC_FAIL_CONN:
@@ -149,25 +539,17 @@ void HttpServer::PollHandler(SocketEvent evt)
 
 void HttpServer::RunPoll()
 {
-    int num_conn;
-    int total = tcpServer_.max_conn_id;
-
     while (stop_ == false)
     {
         SocketEvent evt;
-        num_conn = tcpServer_.GetConnNumber();
 
-        if (watching_ && num_conn > total - total/8)
-        {
-            watching_ = !tcpServer_.UnwatchSocket(listenFd_);
-        }
-        else if (!watching_ && num_conn <= total/2)
-        {
-            // this may be buggy, if half of the connections stay long.
-            watching_ = tcpServer_.WatchRawSocket(listenFd_, true);
-        }
+        UpdateAcceptState();
 
         tcpServer_.RunPoll(&evt);
+
+        // time the event waits after poller returns it, grows when the loop falls behind.
+        overload_.RecordLoopLag(MonotonicMicroSec() - tcpServer_.GetLastPollTime());
+
         PollHandler(evt);
     }
 }
@@ -3,7 +3,24 @@
 
 #include "HttpClient.h"
 #include "SocketServer.h"
+#include "OverloadController.h"
 #include "misc/NonCopyable.h"
+#include "misc/PagedTable.h"
+#include "misc/TimerWheel.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+// how forked workers share the incoming connections.
+enum AcceptStrategy
+{
+    AS_SHARED,    // one listen socket watched by all workers, every worker wakes up on a new connection.
+    AS_EXCLUSIVE, // one listen socket watched with EPOLLEXCLUSIVE, only one worker wakes up.
+    AS_REUSEPORT, // one SO_REUSEPORT listen socket per worker, kernel distributes connections.
+};
 
 class HttpServer: public noncopyable
 {
@@ -13,20 +30,86 @@ class HttpServer: public noncopyable
         ~HttpServer();
 
         void SetStop();
+
+        // strategy must be set before calling SetListenSock().
+        void SetAcceptStrategy(AcceptStrategy strategy);
         void SetListenSock(int fd);
         void RunServer();
 
+        void SetOverloadConfig(const OverloadController::Config& config);
+
+        // handler of requests, must be set before calling RunServer().
+        void SetHttpHandler(HttpClient::HttpHandler handler) { handler_ = handler; }
+
+        // handler of parts of multipart bodies, see HttpClient::RegisterPartHandler().
+        // must be set before calling RunServer().
+        void SetPartHandler(HttpClient::PartHandler handler) { partHandler_ = handler; }
+
+        // serve GET/HEAD of path by entity, with conditional and range requests answered
+        // without running the handler. server takes the ownership, entity of the same path
+        // is replaced. must be called before RunServer().
+        void AddEntity(const std::string& path, HttpEntity* entity);
+
+        // interval(micro seconds) of comment frames sent to idle event streams to keep
+        // them alive, 0 disables it. must be set before calling RunServer().
+        void SetHeartbeat(int64_t interval);
+
+        // send an event to streams of topic set by HttpResponse::SetEventStream(),
+        // data of multiple lines is sent as multiple data fields, NULL is sent as an empty one.
+        // heartbeat of the streams is put off for an interval after it.
+        // thread safe, return number of streams it is sent to.
+        int PublishEvent(const char* topic, const char* event, const char* data);
+
+        // connections accepted speak tls of ctx, see SocketTls.h, NULL for plain text.
+        // must be set before calling SetListenSock(), ctx must outlive the server.
+        void SetTlsContext(TlsContext* ctx) { tls_ = ctx; }
+
+        // responses of threshold bytes or more are sent by MSG_ZEROCOPY, 0 disables it.
+        void SetZeroCopy(int threshold) { tcpServer_.SetZeroCopy(threshold); }
+        const OverloadController& GetOverloadController() const { return overload_; }
+
+        // sum of read counters of all the clients, bytes/events tells throughput of an event,
+        // reads/events the syscalls it costs. call it from the thread running the server.
+        HttpReadStats GetReadStats() const;
+
     private:
 
         void RunPoll();
         void DestroyServer();
         void PollHandler(SocketEvent evt);
 
+        void HandleAccepted(SocketConnection* conn, HttpClient* client);
+        void HandleTimer(SocketConnection* conn);
+        void HandleHeartbeat(SocketConnection* conn);
+        void StartStream(SocketConnection* conn, HttpClient* client);
+        int64_t GetLastEvent(ConnHandle handle, int64_t now);
+        void UpdateAcceptState();
+        bool SetPauseTimer(bool enable);
+
         bool stop_;
         bool watching_;
         int  listenFd_;
+        int  timerFd_;
+        int  heartbeatFd_;
+        int64_t heartbeat_;
+        HttpClient::HttpHandler handler_;
+        HttpClient::PartHandler partHandler_;
+        HttpEntityMap entities_;
+        AcceptStrategy strategy_;
+        TlsContext* tls_;
+        OverloadController overload_;
         SocketServer tcpServer_;
-        HttpClient** conn_;
+        PagedTable<HttpClient*> conn_;
+
+        // streams waiting for next heartbeat, and the ones due, kept to save allocation.
+        TimerWheel<ConnHandle>* heartbeats_;
+        std::vector<ConnHandle> expired_;
+
+        // time of last event published to streams of each topic, entries older than an
+        // interval are swept once an interval.
+        int64_t sweep_;
+        pthread_mutex_t eventLock_;
+        std::map<std::string, int64_t> lastEvent_;
 };
 
 #endif
@@ -0,0 +1,383 @@
+#include "HttpUrl.h"
+#include "HttpArena.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline bool IsCtrl(unsigned char c)
+{
+    return c <= 0x20 || c == 0x7f;
+}
+
+static inline int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+    return -1;
+}
+
+// offset of the first '?', '#' or control char from start, len if none.
+static int ScanTarget(const char* data, int start, int len)
+{
+    int i = start;
+
+#ifdef __SSE2__
+    const __m128i question = _mm_set1_epi8('?');
+    const __m128i hash = _mm_set1_epi8('#');
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+
+        // v <= 0x20 as unsigned, bytes >= 0x80 pass.
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v);
+
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, question), _mm_cmpeq_epi8(v, hash)),
+                _mm_or_si128(ctrl, _mm_cmpeq_epi8(v, del)));
+
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; ++i)
+    {
+        char c = data[i];
+        if (c == '?' || c == '#' || IsCtrl(c)) return i;
+    }
+
+    return len;
+}
+
+// offset of the first control char from start, len if none.
+static int ScanCtrl(const char* data, int start, int len)
+{
+    int i = start;
+
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i ctrl = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, space), v), _mm_cmpeq_epi8(v, del));
+
+        int mask = _mm_movemask_epi8(ctrl);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; ++i)
+    {
+        if (IsCtrl(data[i])) return i;
+    }
+
+    return len;
+}
+
+// offset of the first a or b from start, len if none.
+static int ScanAny(const char* data, int start, int len, char a, char b)
+{
+    int i = start;
+
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; ++i)
+    {
+        if (data[i] == a || data[i] == b) return i;
+    }
+
+    return len;
+}
+
+// whether path has "//" or "/." that normalizing would change.
+static bool NeedNormalize(const char* data, int len)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i dot = _mm_set1_epi8('.');
+
+    for (; i + 17 <= len; i += 16)
+    {
+        __m128i cur = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i next = _mm_loadu_si128((const __m128i*)(data + i + 1));
+
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(cur, slash),
+                _mm_or_si128(_mm_cmpeq_epi8(next, slash), _mm_cmpeq_epi8(next, dot)));
+
+        if (_mm_movemask_epi8(hit)) return true;
+    }
+#endif
+
+    for (; i + 1 < len; ++i)
+    {
+        if (data[i] == '/' && (data[i + 1] == '/' || data[i + 1] == '.')) return true;
+    }
+
+    return false;
+}
+
+bool HttpQueryIterator::Next(HttpStrRef* key, HttpStrRef* value)
+{
+    while (cur_ < end_)
+    {
+        const char* amp = (const char*)memchr(cur_, '&', end_ - cur_);
+        if (amp == NULL) amp = end_;
+
+        const char* start = cur_;
+        cur_ = amp < end_? amp + 1 : end_;
+
+        if (amp == start) continue;
+
+        const char* eq = (const char*)memchr(start, '=', amp - start);
+
+        if (eq == NULL)
+        {
+            *key = HttpStrRef(start, amp - start);
+            *value = HttpStrRef();
+        }
+        else
+        {
+            *key = HttpStrRef(start, eq - start);
+            *value = HttpStrRef(eq + 1, amp - eq - 1);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool HttpUrl::Parse(const char* data, int len)
+{
+    Clear();
+
+    if (len <= 0) return false;
+
+    int start = 0;
+
+    // absolute form, path starts after authority.
+    if (data[0] != '/' && data[0] != '*')
+    {
+        const char* scheme = (const char*)memmem(data, len, "://", 3);
+        if (scheme == NULL) return false;
+
+        int host = scheme + 3 - data;
+
+        start = ScanAny(data, host, len, '/', '?');
+        if (ScanCtrl(data, 0, start) < start) return false;
+    }
+
+    int pos = ScanTarget(data, start, len);
+
+    path_ = HttpStrRef(data + start, pos - start);
+
+    if (pos < len && data[pos] == '?')
+    {
+        int qs = pos + 1;
+
+        pos = ScanTarget(data, qs, len);
+        while (pos < len && data[pos] == '?') pos = ScanTarget(data, pos + 1, len);
+
+        query_ = HttpStrRef(data + qs, pos - qs);
+    }
+
+    if (pos < len && data[pos] == '#')
+    {
+        int fs = pos + 1;
+
+        // anything but control chars is allowed in fragment.
+        pos = ScanCtrl(data, fs, len);
+
+        fragment_ = HttpStrRef(data + fs, pos - fs);
+    }
+
+    if (pos < len)
+    {
+        Clear();
+        return false;
+    }
+
+    // authority only, eg, "http://host".
+    if (path_.Empty()) path_ = HttpStrRef("/", 1);
+
+    target_ = HttpStrRef(data, len);
+    return true;
+}
+
+void HttpUrl::Clear()
+{
+    target_ = HttpStrRef();
+    path_ = HttpStrRef();
+    query_ = HttpStrRef();
+    fragment_ = HttpStrRef();
+}
+
+bool HttpUrl::FindParam(const char* key, HttpStrRef* value) const
+{
+    HttpStrRef k;
+    HttpQueryIterator it(query_);
+
+    while (it.Next(&k, value))
+    {
+        if (k.Equals(key)) return true;
+    }
+
+    return false;
+}
+
+bool HttpUrl::GetNormalizedPath(HttpArena* arena, HttpStrRef* out) const
+{
+    HttpStrRef decoded;
+    if (!Decode(arena, path_, false, &decoded)) return false;
+
+    if (decoded.data_[0] != '/' || !NeedNormalize(decoded.data_, decoded.len_))
+    {
+        *out = decoded;
+        return true;
+    }
+
+    char* dst = (char*)decoded.data_;
+
+    // raw path is not touched.
+    if (decoded.data_ == path_.data_)
+    {
+        if (arena == NULL) return false;
+
+        dst = arena->Strdup(path_.data_, path_.len_);
+        if (dst == NULL) return false;
+    }
+
+    int len = NormalizePath(dst, decoded.len_, dst);
+    if (len < 0) return false;
+
+    *out = HttpStrRef(dst, len);
+    return true;
+}
+
+bool HttpUrl::Decode(HttpArena* arena, const HttpStrRef& raw, bool plus, HttpStrRef* out)
+{
+    if (ScanAny(raw.data_, 0, raw.len_, '%', plus? '+' : '%') == raw.len_)
+    {
+        *out = raw;
+        return true;
+    }
+
+    if (arena == NULL) return false;
+
+    char* dst = (char*)arena->Alloc(raw.len_ + 1);
+    if (dst == NULL) return false;
+
+    int len = Decode(raw.data_, raw.len_, dst, plus);
+    if (len < 0) return false;
+
+    dst[len] = 0;
+
+    *out = HttpStrRef(dst, len);
+    return true;
+}
+
+int HttpUrl::Decode(const char* src, int len, char* dst, bool plus)
+{
+    int i = 0;
+    int out = 0;
+
+    while (i < len)
+    {
+        // plain run is copied as a whole.
+        int next = ScanAny(src, i, len, '%', plus? '+' : '%');
+
+        if (next > i)
+        {
+            memmove(dst + out, src + i, next - i);
+            out += next - i;
+            i = next;
+        }
+
+        if (i == len) break;
+
+        if (src[i] == '+')
+        {
+            dst[out++] = ' ';
+            ++i;
+            continue;
+        }
+
+        if (i + 2 >= len) return -1;
+
+        int hi = HexValue(src[i + 1]);
+        int lo = HexValue(src[i + 2]);
+
+        if (hi < 0 || lo < 0 || (hi == 0 && lo == 0)) return -1;
+
+        dst[out++] = (char)(hi << 4 | lo);
+        i += 3;
+    }
+
+    return out;
+}
+
+int HttpUrl::NormalizePath(const char* src, int len, char* dst)
+{
+    int out = 0;
+    int i = 0;
+
+    while (i < len)
+    {
+        // src[i] is '/', segment runs to the next one.
+        int end = i + 1;
+        while (end < len && src[end] != '/') ++end;
+
+        const char* seg = src + i + 1;
+        int slen = end - i - 1;
+
+        bool last = end == len;
+
+        if (slen == 0 || (slen == 1 && seg[0] == '.'))
+        {
+            if (last) dst[out++] = '/';
+        }
+        else if (slen == 2 && seg[0] == '.' && seg[1] == '.')
+        {
+            if (out == 0) return -1;
+
+            while (dst[out - 1] != '/') --out;
+            --out;
+
+            if (last) dst[out++] = '/';
+        }
+        else
+        {
+            dst[out++] = '/';
+            memmove(dst + out, seg, slen);
+            out += slen;
+        }
+
+        i = end;
+    }
+
+    if (out == 0) dst[out++] = '/';
+
+    return out;
+}
@@ -0,0 +1,99 @@
+#ifndef __HTTP_URL_H__
+#define __HTTP_URL_H__
+
+#include <string>
+#include <string.h>
+
+class HttpArena;
+
+// bytes not owned, valid as long as the memory it points to.
+struct HttpStrRef
+{
+    HttpStrRef(): data_(""), len_(0) {}
+    HttpStrRef(const char* data, int len): data_(data), len_(len) {}
+
+    bool Empty() const { return len_ == 0; }
+    bool Equals(const char* str) const { return strlen(str) == (size_t)len_ && memcmp(data_, str, len_) == 0; }
+
+    std::string ToString() const { return std::string(data_, len_); }
+
+    const char* data_;
+    int len_;
+};
+
+// walk "k1=v1&k2&k3=v3" without allocating, keys and values are raw, not decoded.
+class HttpQueryIterator
+{
+    public:
+
+        explicit HttpQueryIterator(const HttpStrRef& query)
+            :cur_(query.data_), end_(query.data_ + query.len_)
+        {
+        }
+
+        // value is empty if there is no '=', empty pairs are skipped.
+        bool Next(HttpStrRef* key, HttpStrRef* value);
+
+    private:
+
+        const char* cur_;
+        const char* end_;
+};
+
+/*
+ * view of request target, split in place into path, query and fragment, nothing is copied.
+ *
+ * a) target is scanned once when it is set, 16 bytes a time with sse2,
+ *    control chars are rejected.
+ * b) query parameters are only looked at when asked for.
+ * c) decoded/normalized strings are made in arena, and only if there is something to
+ *    decode, otherwise the raw bytes are returned as they are.
+ */
+class HttpUrl
+{
+    public:
+
+        HttpUrl() {}
+
+        // origin form("/a?b"), absolute form("http://host/a?b") or "*", data must outlive the view.
+        // return false if target is empty or has control chars.
+        bool Parse(const char* data, int len);
+        void Clear();
+
+        bool IsSet() const { return target_.len_ > 0; }
+
+        const HttpStrRef& GetTarget() const { return target_; }
+
+        // raw parts, query and fragment exclude the leading '?' and '#'.
+        const HttpStrRef& GetPath() const { return path_; }
+        const HttpStrRef& GetQuery() const { return query_; }
+        const HttpStrRef& GetFragment() const { return fragment_; }
+
+        HttpQueryIterator GetQueryIterator() const { return HttpQueryIterator(query_); }
+
+        // raw value of the first parameter whose raw key is key.
+        bool FindParam(const char* key, HttpStrRef* value) const;
+
+        // path decoded and normalized, return false if it is malformed or goes above root.
+        bool GetNormalizedPath(HttpArena* arena, HttpStrRef* out) const;
+
+        // decode %XX, and '+' to space if plus is set, out points to raw if nothing to decode.
+        // return false on bad escape or "%00", or if there is no memory(arena may be NULL).
+        static bool Decode(HttpArena* arena, const HttpStrRef& raw, bool plus, HttpStrRef* out);
+
+        // dst may be src, return length decoded, -1 on bad escape or "%00".
+        static int Decode(const char* src, int len, char* dst, bool plus);
+
+        // remove "." and ".." segments and repeated '/' of path starting with '/', dst may be src.
+        // return length of result, -1 if ".." goes above root.
+        static int NormalizePath(const char* src, int len, char* dst);
+
+    private:
+
+        HttpStrRef target_;
+        HttpStrRef path_;
+        HttpStrRef query_;
+        HttpStrRef fragment_;
+};
+
+#endif // __HTTP_URL_H__
@@ -0,0 +1,136 @@
+#include "OverloadController.h"
+
+#define EWMA_SHIFT (3)
+
+static inline void UpdateEwma(int64_t& avg, int64_t sample)
+{
+    // avg keeps 2^EWMA_SHIFT times the average.
+    avg += sample - (avg >> EWMA_SHIFT);
+}
+
+static inline double Ratio(int64_t val, int64_t limit)
+{
+    if (limit <= 0) return 0;
+
+    return (double)val / (double)limit;
+}
+
+OverloadController::Config::Config()
+    :maxLoopLag(20*1000)
+    ,maxPendingWrite(64*1024*1024)
+    ,maxHandlerLatency(50*1000)
+    ,maxConnection(0)
+    ,shedRange(1.0)
+    ,pauseInterval(10*1000)
+    ,allowPause(true)
+    ,reject503(true)
+{
+}
+
+OverloadController::OverloadController(const Config& config)
+    :config_(config)
+    ,loopLag_(0)
+    ,handlerLatency_(0)
+    ,pendingWrite_(0)
+    ,connection_(0)
+    ,handlerSamples_(0)
+    ,credit_(0)
+    ,admitted_(0)
+    ,shed_(0)
+{
+}
+
+OverloadController::~OverloadController()
+{
+}
+
+void OverloadController::SetConfig(const Config& config)
+{
+    config_ = config;
+}
+
+void OverloadController::RecordLoopLag(int64_t lag)
+{
+    if (lag < 0) lag = 0;
+
+    UpdateEwma(loopLag_, lag);
+}
+
+void OverloadController::RecordHandlerLatency(int64_t latency)
+{
+    if (latency < 0) latency = 0;
+
+    ++handlerSamples_;
+    UpdateEwma(handlerLatency_, latency);
+}
+
+void OverloadController::AddPendingWrite(int64_t delta)
+{
+    pendingWrite_ += delta;
+
+    if (pendingWrite_ < 0) pendingWrite_ = 0;
+}
+
+void OverloadController::SetConnection(int64_t num)
+{
+    connection_ = num;
+}
+
+void OverloadController::Tick()
+{
+    // loop is idle, lag is gone.
+    UpdateEwma(loopLag_, 0);
+
+    // no request is handled since last tick, let the old latency fade out.
+    if (handlerSamples_ == 0) handlerLatency_ >>= 1;
+
+    handlerSamples_ = 0;
+}
+
+double OverloadController::GetPressure() const
+{
+    double pressure = Ratio(loopLag_ >> EWMA_SHIFT, config_.maxLoopLag);
+    double tmp = Ratio(handlerLatency_ >> EWMA_SHIFT, config_.maxHandlerLatency);
+
+    if (tmp > pressure) pressure = tmp;
+
+    tmp = Ratio(pendingWrite_, config_.maxPendingWrite);
+    if (tmp > pressure) pressure = tmp;
+
+    tmp = Ratio(connection_, config_.maxConnection);
+    if (tmp > pressure) pressure = tmp;
+
+    return pressure;
+}
+
+double OverloadController::GetAdmitRatio() const
+{
+    double pressure = GetPressure();
+
+    if (pressure <= 1.0) return 1.0;
+    if (config_.shedRange <= 0) return 0;
+
+    double ratio = 1.0 - (pressure - 1.0) / config_.shedRange;
+
+    return ratio > 0? ratio : 0;
+}
+
+bool OverloadController::ShouldPauseAccept() const
+{
+    return config_.allowPause && GetAdmitRatio() <= 0;
+}
+
+OverloadController::Decision OverloadController::Admit()
+{
+    credit_ += GetAdmitRatio();
+
+    if (credit_ >= 1.0)
+    {
+        credit_ -= 1.0;
+        ++admitted_;
+        return OD_ADMIT;
+    }
+
+    ++shed_;
+    return config_.reject503? OD_REJECT : OD_DROP;
+}
@@ -0,0 +1,98 @@
+#ifndef __OVERLOAD_CONTROLLER_H__
+#define __OVERLOAD_CONTROLLER_H__
+
+#include <stdint.h>
+
+#include "misc/NonCopyable.h"
+
+/*
+ * admission control for new connections.
+ *
+ * load is measured by four signals, each normalized by its limit:
+ *  a) event loop lag: time between poller returning an event and the event being handled.
+ *  b) bytes waiting to be written to all connections.
+ *  c) handler latency: time spent generating a response.
+ *  d) number of connections.
+ *
+ * pressure is the highest of them, 1.0 means one of the limits is reached.
+ * beyond that, new connections are shed gradually: the admitted fraction drops
+ * linearly from 1 at pressure 1.0 to 0 at pressure 1.0 + shedRange.
+ * when fully saturated the owner may stop accepting for a while(pause),
+ * leaving connections in the backlog for other workers.
+ */
+
+class OverloadController: public noncopyable
+{
+    public:
+
+        struct Config
+        {
+            Config();
+
+            int64_t maxLoopLag;         // micro seconds
+            int64_t maxPendingWrite;    // bytes
+            int64_t maxHandlerLatency;  // micro seconds
+            int64_t maxConnection;
+
+            double shedRange;           // pressure range over which accepts are shed
+            int64_t pauseInterval;      // micro seconds to recheck when accept is paused
+
+            bool allowPause;            // stop accepting when fully saturated
+            bool reject503;             // answer shed connections with 503 instead of closing
+        };
+
+        enum Decision
+        {
+            OD_ADMIT,
+            OD_REJECT, // answer with 503 and close
+            OD_DROP,   // close silently
+        };
+
+        explicit OverloadController(const Config& config = Config());
+        ~OverloadController();
+
+        void SetConfig(const Config& config);
+        const Config& GetConfig() const { return config_; }
+
+        void RecordLoopLag(int64_t lag);
+        void RecordHandlerLatency(int64_t latency);
+        void AddPendingWrite(int64_t delta);
+        void SetConnection(int64_t num);
+
+        // decay stale samples, call it periodically when the loop is idle.
+        void Tick();
+
+        // decide for a newly accepted connection.
+        Decision Admit();
+
+        double GetPressure() const;
+
+        // fraction of new connections to admit.
+        double GetAdmitRatio() const;
+        bool ShouldPauseAccept() const;
+
+        int64_t GetAdmitted() const { return admitted_; }
+        int64_t GetShed() const { return shed_; }
+        int64_t GetPendingWrite() const { return pendingWrite_; }
+
+    private:
+
+        Config config_;
+
+        // exponential weighted moving average, scaled by 8.
+        int64_t loopLag_;
+        int64_t handlerLatency_;
+
+        int64_t pendingWrite_;
+        int64_t connection_;
+
+        int handlerSamples_;
+
+        // error diffusion, to admit exactly the given ratio without a random generator.
+        double credit_;
+
+        int64_t admitted_;
+        int64_t shed_;
+};
+
+#endif // __OVERLOAD_CONTROLLER_H__
@@ -0,0 +1,406 @@
+#include "RpcChannel.h"
+
+#include "sys/Log.h"
+
+#include <string.h>
+#include <algorithm>
+
+#define RPC_READ_BUFFER (8*1024)
+#define RPC_MAX_FRAME (4*1024*1024)
+
+// frames are coalesced into chunks of this size, the largest pooled by HttpWriteBuffer,
+// larger frame takes a buffer of its own.
+#define RPC_CHUNK_SIZE (8*1024)
+
+// reading stops while output waiting for peer exceeds it.
+#define RPC_MAX_OUTPUT (1024*1024)
+
+// varint of length, and of id and type.
+#define RPC_MAX_HEADER (20)
+
+#define RPC_MAX_IOV (64)
+
+RpcChannel::RpcChannel(SocketConnection* conn)
+    :conn_(conn)
+    ,handler_(NULL)
+    ,handlerArg_(NULL)
+    ,maxFrame_(RPC_MAX_FRAME)
+    ,nextId_(1)
+    ,handling_(false)
+    ,closing_(false)
+    ,readBuffer_(RPC_READ_BUFFER)
+    ,outSize_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+RpcChannel::~RpcChannel()
+{
+    ReleaseOutput();
+}
+
+void RpcChannel::ResetChannel(SocketConnection* conn)
+{
+    calls_.clear();
+    ReleaseOutput();
+
+    readBuffer_.ResetBuffer();
+    readBuffer_.Resize(RPC_READ_BUFFER);
+    readBuffer_.ReleaseBuffer();
+
+    handling_ = false;
+    closing_ = false;
+    conn_ = conn;
+}
+
+void RpcChannel::SetRequestHandler(RpcRequestHandler handler, void* arg)
+{
+    handler_ = handler;
+    handlerArg_ = arg;
+}
+
+int RpcChannel::EncodeVarint(uint64_t val, char* out)
+{
+    int n = 0;
+
+    while (val >= 0x80)
+    {
+        out[n++] = (char)(val | 0x80);
+        val >>= 7;
+    }
+
+    out[n++] = (char)val;
+    return n;
+}
+
+int RpcChannel::DecodeVarint(const char* data, int len, uint64_t* val)
+{
+    uint64_t ret = 0;
+
+    for (int i = 0; i < len && i < 10; ++i)
+    {
+        unsigned char c = (unsigned char)data[i];
+
+        // 10th byte holds the top bit only.
+        if (i == 9 && c > 1) return -1;
+
+        ret |= (uint64_t)(c & 0x7f) << (7 * i);
+
+        if ((c & 0x80) == 0)
+        {
+            *val = ret;
+            return i + 1;
+        }
+    }
+
+    return len >= 10? -1 : 0;
+}
+
+uint64_t RpcChannel::Call(const char* data, int len, RpcReplyHandler handler, void* arg)
+{
+    uint64_t id = nextId_;
+
+    if (!QueueFrame(RMT_REQUEST, id, data, len)) return 0;
+
+    RpcCall call = { handler, arg };
+    calls_[id] = call;
+
+    ++nextId_;
+    return id;
+}
+
+bool RpcChannel::Notify(const char* data, int len)
+{
+    return QueueFrame(RMT_NOTIFY, 0, data, len);
+}
+
+bool RpcChannel::Reply(uint64_t id, const char* data, int len)
+{
+    return QueueFrame(RMT_RESPONSE, id, data, len);
+}
+
+bool RpcChannel::ReplyError(uint64_t id, const char* data, int len)
+{
+    return QueueFrame(RMT_ERROR, id, data, len);
+}
+
+bool RpcChannel::QueueFrame(int type, uint64_t id, const char* data, int len)
+{
+    if (conn_ == NULL || closing_ || len < 0) return false;
+
+    char head[RPC_MAX_HEADER];
+    char tag[10];
+
+    int tagLen = EncodeVarint(id << 2 | type, tag);
+    int frameLen = tagLen + len;
+
+    if (frameLen > maxFrame_) return false;
+
+    int headLen = EncodeVarint(frameLen, head);
+    memcpy(head + headLen, tag, tagLen);
+    headLen += tagLen;
+
+    // frame goes to the tail chunk if it fits, so that small ones share a buffer.
+    HttpBuffer* tail = output_.GetTail();
+    int total = headLen + len;
+
+    if (tail == NULL || tail->memory_ + tail->size_ - (tail->curPtr_ + tail->curSize_) < total)
+    {
+        tail = writeBuffer_.AllocWriteBuffer(std::max(total, RPC_CHUNK_SIZE));
+        if (tail == NULL) return false;
+
+        output_.PushBack(tail);
+    }
+
+    char* end = tail->curPtr_ + tail->curSize_;
+
+    memcpy(end, head, headLen);
+    if (len > 0) memcpy(end + headLen, data, len);
+
+    tail->curSize_ += total;
+    outSize_ += total;
+
+    ++stats_.sent;
+    return true;
+}
+
+int RpcChannel::Flush()
+{
+    if (conn_ == NULL) return -1;
+
+    int written = 0;
+
+    while (output_.GetFront())
+    {
+        int num = 0;
+        int total = 0;
+        struct iovec iov[RPC_MAX_IOV];
+
+        for (HttpBuffer* buf = output_.GetFront(); buf && num < RPC_MAX_IOV; buf = buf->next_)
+        {
+            iov[num].iov_base = buf->curPtr_;
+            iov[num].iov_len = buf->curSize_;
+
+            total += buf->curSize_;
+            ++num;
+        }
+
+        int n = conn_->SendVector(iov, num);
+        if (n < 0) return -1;
+
+        ++stats_.writes;
+
+        int sent = n;
+
+        written += n;
+        outSize_ -= n;
+
+        // drop chunks written, the one written in part is left at the front.
+        while (n > 0)
+        {
+            HttpBuffer* buf = output_.GetFront();
+
+            if (n < buf->curSize_)
+            {
+                buf->curPtr_ += n;
+                buf->curSize_ -= n;
+                break;
+            }
+
+            n -= buf->curSize_;
+            output_.PopFront();
+            writeBuffer_.ReleaseWriteBuffer(buf);
+        }
+
+        // socket buffer is full, socket is watched for writing by now.
+        if (sent < total) break;
+    }
+
+    return written;
+}
+
+int RpcChannel::ProcessEvent(SocketEvent evt)
+{
+    if (conn_ == NULL) return -1;
+
+    if (evt.code == SC_READ && ReadFrames() < 0)
+    {
+        Close();
+        return -1;
+    }
+
+    if (closing_ || Flush() < 0)
+    {
+        Close();
+        return -1;
+    }
+
+    // peer doesn't take what it asked for, it is not read until it does.
+    if (outSize_ >= RPC_MAX_OUTPUT) conn_->WatchEvent(false, true);
+
+    return 0;
+}
+
+// read and dispatch until socket is drained.
+int RpcChannel::ReadFrames()
+{
+    while (!closing_)
+    {
+        int free = 0;
+        char* buf = readBuffer_.GetFreeBuffer(free);
+
+        // frame being read doesn't fit, buffer grows to hold it.
+        if (free <= 0)
+        {
+            uint64_t len = 0;
+            int sz = DecodeVarint(readBuffer_.GetContentStart(), readBuffer_.GetContenLen(), &len);
+
+            int need = sz + (int)len;
+            int size = readBuffer_.GetSize();
+
+            while (size < need) size *= 2;
+
+            if (sz <= 0 || !readBuffer_.Resize(size)) return -1;
+            continue;
+        }
+
+        int n = conn_->ReadBuffer(buf, free, false);
+
+        ++stats_.reads;
+
+        if (n < 0) return n;
+        if (n == 0) break;
+
+        readBuffer_.IncreaseContentRange(n);
+
+        if (ParseFrames() < 0) return -1;
+
+        // a short read tells socket is drained.
+        if (n < free) break;
+    }
+
+    // armed once for all the reads above.
+    if (!closing_) conn_->FinishRead();
+
+    // buffer grown for a large frame goes back once it is consumed.
+    if (readBuffer_.GetContenLen() == 0 && readBuffer_.GetSize() > RPC_READ_BUFFER) readBuffer_.Resize(RPC_READ_BUFFER);
+
+    return 0;
+}
+
+int RpcChannel::ParseFrames()
+{
+    handling_ = true;
+
+    while (!closing_)
+    {
+        const char* start = readBuffer_.GetContentStart();
+        int avail = readBuffer_.GetContenLen();
+
+        uint64_t len = 0;
+        int sz = DecodeVarint(start, avail, &len);
+
+        if (sz < 0 || len > (uint64_t)maxFrame_)
+        {
+            slog(LOG_WARN, "rpc: malformed frame, fd(%d), length:%llu", conn_->fd_, (unsigned long long)len);
+            handling_ = false;
+            return -1;
+        }
+
+        if (sz == 0 || avail - sz < (int)len) break;
+
+        if (!Dispatch(start + sz, (int)len))
+        {
+            slog(LOG_WARN, "rpc: malformed frame, fd(%d)", conn_->fd_);
+            handling_ = false;
+            return -1;
+        }
+
+        readBuffer_.ConsumeBuffer(sz + (int)len);
+    }
+
+    handling_ = false;
+    return 0;
+}
+
+bool RpcChannel::Dispatch(const char* frame, int len)
+{
+    uint64_t tag = 0;
+    int sz = DecodeVarint(frame, len, &tag);
+    if (sz <= 0) return false;
+
+    RpcMessage msg;
+    msg.type_ = (int)(tag & 3);
+    msg.id_ = tag >> 2;
+    msg.data_ = frame + sz;
+    msg.size_ = len - sz;
+
+    ++stats_.received;
+
+    if (msg.type_ == RMT_REQUEST || msg.type_ == RMT_NOTIFY)
+    {
+        if (handler_) handler_(handlerArg_, this, msg);
+        else if (msg.type_ == RMT_REQUEST) ReplyError(msg.id_, "no handler", 10);
+
+        return true;
+    }
+
+    // reply of a call that is no longer waited for is dropped.
+    std::map<uint64_t, RpcCall>::iterator it = calls_.find(msg.id_);
+    if (it == calls_.end()) return true;
+
+    RpcCall call = it->second;
+    calls_.erase(it);
+
+    call.handler(call.arg, msg.type_ == RMT_RESPONSE? RS_OK : RS_ERROR, msg);
+    return true;
+}
+
+void RpcChannel::Close()
+{
+    if (conn_ == NULL) return;
+
+    // frames being dispatched are in read buffer, it is left until they are done.
+    if (handling_)
+    {
+        closing_ = true;
+        return;
+    }
+
+    conn_->CloseConnection();
+    conn_ = NULL;
+
+    FailCalls();
+    ReleaseOutput();
+
+    readBuffer_.ResetBuffer();
+    readBuffer_.ReleaseBuffer();
+}
+
+void RpcChannel::FailCalls()
+{
+    RpcMessage msg = { RMT_ERROR, 0, NULL, 0 };
+
+    // handler may make calls of its own, which fail as connection is closed.
+    std::map<uint64_t, RpcCall> calls;
+    calls.swap(calls_);
+
+    for (std::map<uint64_t, RpcCall>::iterator it = calls.begin(); it != calls.end(); ++it)
+    {
+        msg.id_ = it->first;
+        it->second.handler(it->second.arg, RS_CLOSED, msg);
+    }
+}
+
+void RpcChannel::ReleaseOutput()
+{
+    HttpBuffer* buf = output_.PopFront();
+
+    while (buf)
+    {
+        writeBuffer_.ReleaseWriteBuffer(buf);
+        buf = output_.PopFront();
+    }
+
+    outSize_ = 0;
+}
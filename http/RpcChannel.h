@@ -0,0 +1,152 @@
+#ifndef __RPC_CHANNEL_H__
+#define __RPC_CHANNEL_H__
+
+#include "HttpBuffer.h"
+#include "SocketServer.h"
+#include "misc/NonCopyable.h"
+
+#include <map>
+#include <stdint.h>
+
+/*
+ * framed messages over a connection of SocketServer, for internal services that don't
+ * need http. the same channel serves either end, connection accepted or connected.
+ *
+ * a) frame is a varint(LEB128) length of the rest, a varint of id << 2 | type, and payload.
+ * b) frames are parsed in place from a mirrored read buffer, which grows to hold a frame
+ *    larger than it, payload is passed to handler without copying, valid during the call.
+ * c) frames queued are coalesced into chunks, which are flushed by one sendmsg() per event,
+ *    so that replies to requests read in one event go out by one syscall. frames queued
+ *    out of event handling, eg, calls made by client, go out by next Flush().
+ * d) reading stops while output waiting for peer exceeds 1MB, until peer takes it.
+ * e) handlers must not delete the channel, Close() is fine.
+ */
+
+enum RpcMessageType
+{
+    RMT_REQUEST,  // reply is expected, by id of the request
+    RMT_RESPONSE, // reply of request
+    RMT_ERROR,    // reply of request that fails, payload tells why
+    RMT_NOTIFY,   // one way message, id is 0
+};
+
+enum RpcStatus
+{
+    RS_OK,
+    RS_ERROR,  // peer replied by RMT_ERROR
+    RS_CLOSED, // connection is closed before reply arrives
+};
+
+struct RpcMessage
+{
+    int type_;
+    uint64_t id_;
+    const char* data_;
+    int size_;
+};
+
+// counters of a channel, sent/writes tells how many frames a syscall carries.
+struct RpcStats
+{
+    int64_t sent;     // frames queued
+    int64_t received; // frames read
+    int64_t writes;   // sendmsg() of flushing
+    int64_t reads;    // read calls made
+};
+
+class RpcChannel;
+
+// requests and notifications from peer, request is answered by RpcChannel::Reply() with id
+// of the message, in the handler or later.
+typedef void (* RpcRequestHandler)(void* arg, RpcChannel* channel, const RpcMessage& msg);
+
+// reply of a call, payload is NULL if status is RS_CLOSED.
+typedef void (* RpcReplyHandler)(void* arg, int status, const RpcMessage& reply);
+
+class RpcChannel: public noncopyable
+{
+    public:
+
+        explicit RpcChannel(SocketConnection* conn = NULL);
+
+        // calls pending are dropped without calling handler.
+        ~RpcChannel();
+
+        // take a new connection, state of the old one is dropped.
+        void ResetChannel(SocketConnection* conn);
+
+        void SetRequestHandler(RpcRequestHandler handler, void* arg);
+
+        // frame larger than size(bytes) closes the connection, 4MB by default.
+        void SetMaxFrameSize(int size) { maxFrame_ = size; }
+
+        // return value < 0 indicates connection is closed, pending calls have failed then.
+        int ProcessEvent(SocketEvent evt);
+
+        // return id of the call, handler is called once with the reply or on failure.
+        // 0 is returned if connection is closed, handler is not called then.
+        uint64_t Call(const char* data, int len, RpcReplyHandler handler, void* arg);
+
+        bool Notify(const char* data, int len);
+        bool Reply(uint64_t id, const char* data, int len);
+        bool ReplyError(uint64_t id, const char* data, int len);
+
+        // write frames queued, return bytes written, -1 if connection is closed.
+        int Flush();
+
+        // fail calls pending with RS_CLOSED, and close the connection.
+        void Close();
+
+        bool IsClosed() const { return conn_ == NULL; }
+        SocketConnection* GetConnection() const { return conn_; }
+
+        int GetPendingCalls() const { return (int)calls_.size(); }
+        int GetPendingWriteSize() const { return outSize_; }
+        const RpcStats& GetStats() const { return stats_; }
+
+        // return bytes taken by the varint, at most 10.
+        static int EncodeVarint(uint64_t val, char* out);
+
+        // return bytes consumed, 0 if data is short of it, -1 if it is malformed.
+        static int DecodeVarint(const char* data, int len, uint64_t* val);
+
+    private:
+
+        struct RpcCall
+        {
+            RpcReplyHandler handler;
+            void* arg;
+        };
+
+        int  ReadFrames();
+        int  ParseFrames();
+        bool Dispatch(const char* frame, int len);
+        bool QueueFrame(int type, uint64_t id, const char* data, int len);
+        void ReleaseOutput();
+        void FailCalls();
+
+        SocketConnection* conn_;
+
+        RpcRequestHandler handler_;
+        void* handlerArg_;
+
+        int maxFrame_;
+        uint64_t nextId_;
+
+        // set while frames are dispatched, Close() from handler is done once they are.
+        bool handling_;
+        bool closing_;
+
+        std::map<uint64_t, RpcCall> calls_;
+
+        HttpReadBuffer readBuffer_;
+
+        // chunks of frames queued, flushed from the front, appended to the tail.
+        int outSize_;
+        HttpBufferList output_;
+        HttpWriteBuffer writeBuffer_;
+
+        RpcStats stats_;
+};
+
+#endif
@@ -1,15 +1,22 @@
 #include "SocketPoll.h"
+#include "sys/Clock.h"
 
 #include <sys/epoll.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
 #include <assert.h>
 
+// budget the spinning starts from when it is grown from 0, and falls back to 0 below.
+#define BUSY_POLL_MIN_SPIN 10
 
 SocketPoll::SocketPoll()
     :epoll_(-1)
+    ,maxSpin_(0)
 {
+    memset(&stats_, 0, sizeof(stats_));
     Init();
 }
 
@@ -32,40 +39,64 @@ void SocketPoll::Release() const
 bool SocketPoll::AddSocket(int file, void* data, bool write) const
 {
     struct epoll_event ev;
-    ev.events = EPOLLIN | (write? EPOLLOUT : 0) | EPOLLONESHOT;
+    ev.events = EPOLLIN | (write? (uint32_t)EPOLLOUT : 0) | EPOLLONESHOT;
     ev.data.ptr = data;
 
     int ret = epoll_ctl(epoll_, EPOLL_CTL_ADD, file, &ev);
     return (ret != -1);
 }
 
+bool SocketPoll::AddListenSocket(int file, void* data, bool exclusive) const
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = data;
+
+#ifdef EPOLLEXCLUSIVE
+    if (exclusive)
+    {
+        ev.events |= EPOLLEXCLUSIVE;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, file, &ev) != -1) return true;
+
+        // kernel before 4.5, fall back to plain level triggered.
+        if (errno != EINVAL) return false;
+
+        ev.events = EPOLLIN;
+    }
+#endif
+
+    return epoll_ctl(epoll_, EPOLL_CTL_ADD, file, &ev) != -1;
+}
+
 bool SocketPoll::RemoveSocket(int file) const
 {
     return (epoll_ctl(epoll_, EPOLL_CTL_DEL, file, NULL) != -1);
 }
 
-bool SocketPoll::ModifySocket(int file, void* data, bool write) const
+bool SocketPoll::ModifySocket(int file, void* data, bool write, bool read) const
 {
     struct epoll_event ev;
-    ev.events = EPOLLIN | (write? EPOLLOUT : 0) | EPOLLONESHOT;
+    ev.events = (read? (uint32_t)EPOLLIN : 0) | (write? (uint32_t)EPOLLOUT : 0) | EPOLLONESHOT;
     ev.data.ptr = data;
 
     return (epoll_ctl(epoll_, EPOLL_CTL_MOD, file, &ev) != -1);
 }
 
-int SocketPoll::WaitAll(PollEvent* ve, size_t max) const
+int SocketPoll::WaitAll(PollEvent* ve, size_t max, int timeout) const
 {
     PollEvent event;
     // variant array
     struct epoll_event ev[max];
-    int n = epoll_wait(epoll_, ev, max, -1);
+    int n = (maxSpin_ > 0 && timeout != 0)? SpinWait(ev, max, timeout) : epoll_wait(epoll_, ev, max, timeout);
 
     for (int i = 0; i < n; ++i)
     {
         unsigned flag = ev[i].events;
         event.data  = ev[i].data.ptr;
         event.write = ((flag & EPOLLOUT) != 0);
-        event.read  = ((flag & EPOLLIN) != 0);
+        // error and hang up are reported as readable, reading finds them out.
+        event.read  = ((flag & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0);
+        event.error = ((flag & EPOLLERR) != 0);
 
         ve[i] = event;
     }
@@ -73,6 +104,65 @@ int SocketPoll::WaitAll(PollEvent* ve, size_t max) const
     return n;
 }
 
+void SocketPoll::SetBusyPoll(int maxSpin)
+{
+    maxSpin_ = maxSpin > 0? maxSpin : 0;
+    stats_.budget = 0;
+}
+
+int SocketPoll::SpinWait(struct epoll_event* ev, size_t max, int timeout) const
+{
+    int n = 0;
+    int64_t start = MonotonicMicroSec();
+    int64_t now = start;
+
+    while (stats_.budget > 0)
+    {
+        n = epoll_wait(epoll_, ev, max, 0);
+        now = MonotonicMicroSec();
+
+        if (n != 0 || now - start >= stats_.budget) break;
+    }
+
+    stats_.spinTime += now - start;
+
+    if (n != 0)
+    {
+        if (n > 0) ++stats_.spinHits;
+        return n;
+    }
+
+    if (timeout > 0)
+    {
+        timeout -= (int)((now - start) / 1000);
+        if (timeout < 0) timeout = 0;
+    }
+
+    n = epoll_wait(epoll_, ev, max, timeout);
+
+    int64_t end = MonotonicMicroSec();
+
+    ++stats_.sleeps;
+    stats_.sleepTime += end - now;
+
+    if (n < 0) return n;
+
+    if (end - start > maxSpin_)
+    {
+        // idle for long, spinning is a waste.
+        stats_.budget /= 2;
+        if (stats_.budget < BUSY_POLL_MIN_SPIN) stats_.budget = 0;
+    }
+    else if (n > 0)
+    {
+        // would have been caught by spinning longer.
+        stats_.budget = stats_.budget? stats_.budget * 2 : BUSY_POLL_MIN_SPIN;
+        if (stats_.budget > maxSpin_) stats_.budget = maxSpin_;
+    }
+
+    return n;
+}
+
 bool SocketPoll::SetSocketNonBlocking(int fd)
 {
     int flag = fcntl(fd, F_GETFL, 0);
@@ -2,6 +2,7 @@
 #define __SOCKET_POLL_H_
 
 #include <vector>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "misc/NonCopyable.h"
@@ -17,8 +18,24 @@ struct PollEvent
     void* data;
     bool  read;
     bool  write;
+
+    // EPOLLERR, reported as readable too. error queue of socket raises it without an error,
+    // see SocketConnection::SendZeroCopy().
+    bool  error;
+};
+
+// counters of busy polling, spinTime against sleepTime tells cpu traded for latency.
+struct PollStats
+{
+    uint64_t spinHits;  // waits that found events while spinning
+    uint64_t sleeps;    // waits that blocked in the end
+    int64_t  spinTime;  // micro seconds spent spinning
+    int64_t  sleepTime; // micro seconds spent blocking
+    int      budget;    // micro seconds to spin for by next wait
 };
 
+struct epoll_event;
+
 class SocketPoll: public noncopyable
 {
     public:
@@ -27,10 +44,29 @@ class SocketPoll: public noncopyable
         ~SocketPoll();
 
         bool AddSocket(int sock, void* data, bool write = false) const;
+
+        // listen socket is watched level triggered, never re-armed.
+        // exclusive: register with EPOLLEXCLUSIVE, so that only one of the pollers
+        // sharing the socket is woken up for a new connection.
+        bool AddListenSocket(int sock, void* data, bool exclusive = false) const;
         bool RemoveSocket(int sock) const;
 
-        bool ModifySocket(int sock, void* data, bool write = false) const;
-        int  WaitAll(PollEvent* ve, size_t max = -1) const;
+        // read = false stops watching readable, for flow control.
+        bool ModifySocket(int sock, void* data, bool write = false, bool read = true) const;
+        // timeout in milli seconds, -1 waits until any event comes.
+        int  WaitAll(PollEvent* ve, size_t max = -1, int timeout = -1) const;
+
+        // fd of epoll, so that it can be watched by other poller.
+        int  GetPollFd() const { return epoll_; }
+
+        // busy polling: WaitAll() spins with non-blocking epoll_wait() for a budget before
+        // blocking, to save the wake up of a sleeping thread. the budget grows when events
+        // come shortly after blocking, and shrinks when blocking lasts longer than maxSpin,
+        // so it follows the rate of arrivals, up to maxSpin micro seconds. 0 disables it.
+        // not thread safe, call it before polling.
+        void SetBusyPoll(int maxSpin);
+
+        const PollStats& GetPollStats() const { return stats_; }
 
         static bool SetSocketNonBlocking(int fd);
 
@@ -39,7 +75,12 @@ class SocketPoll: public noncopyable
         void Init();
         void Release() const;
 
+        int SpinWait(struct epoll_event* ev, size_t max, int timeout) const;
+
         int epoll_;
+        int maxSpin_;
+
+        mutable PollStats stats_;
 };
 
 #endif // __SOCKET_POLL_H_
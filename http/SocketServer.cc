@@ -1,29 +1,51 @@
 #include "SocketServer.h"
 #include "SocketPoll.h"
+#include "UringPoll.h"
+#include "DnsResolver.h"
+#include "SocketTls.h"
 
 #include "sys/Log.h"
 #include "sys/Defs.h"
+#include "sys/Clock.h"
 #include "sys/AtomicOps.h"
+#include "misc/PagedTable.h"
+#include "misc/LockFreeBuffer.h"
 #include "thread/Thread.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <assert.h>
 #include <string.h>
 #include <netdb.h>
+#include <signal.h>
+#include <pthread.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <linux/errqueue.h>
 
+#include <map>
+#include <set>
+#include <deque>
 #include <queue>
+#include <string>
+#include <vector>
+#include <algorithm>
 
-typedef int (* SocketPredicateProc)(int, struct addrinfo*);
+typedef int (* SocketPredicateProc)(int, const struct sockaddr*, socklen_t);
 
 enum SocketStatus
 {
@@ -32,6 +54,167 @@ enum SocketStatus
     SS_CONNECTED,
     SS_CONNECTING,
     SS_PACCEPT, // pending accept
+    SS_RESOLVING, // fd is reserved, waiting for host name to be resolved
+};
+
+// max number of events retrieved from poller by one wait.
+#define MAX_POLL_EVENT (1024)
+
+// max number of queued buffers written by one writev().
+#define MAX_SEND_IOV (64)
+
+// node of data queued by SocketServer::Send(), or of a payload shared by SendShared().
+struct SocketSendNode
+{
+    MpscNode node_;
+    ConnHandle handle_;
+    SocketSendNode* next_;
+    SharedBuffer* shared_;
+    int size_;
+    int offset_;
+    char data_[1];
+};
+
+struct SharedBuffer
+{
+    volatile int ref_;
+    int size_;
+    char data_[1];
+};
+
+static inline char* SendNodeData(SocketSendNode* node)
+{
+    return node->shared_? node->shared_->data_ : node->data_;
+}
+
+static inline void FreeSendNode(SocketSendNode* node)
+{
+    if (node->shared_) SocketServer::ReleaseShared(node->shared_);
+
+    free(node);
+}
+
+// default capacity of a pipe, used if it can't be queried.
+#define DEFAULT_PIPE_SIZE (64*1024)
+
+// two connections forwarding to each other by splice().
+// pipe_[i] carries data read from conn_[i] to conn_[1 - i].
+struct SocketSplice
+{
+    SocketConnection* conn_[2];
+
+    int pipe_[2][2];
+    int pending_[2]; // bytes in pipe_[i]
+    int capacity_;
+
+    // pipe_[i] takes no more until some is passed on, a pipe is filled by
+    // buffers of small reads before bytes reach capacity_.
+    bool full_[2];
+
+    bool eof_[2];  // conn_[i] reaches end of file
+    bool done_[2]; // data from conn_[i] is all passed on, and end of file too
+
+    // with io_uring, forwarding waits for operations started before to complete.
+    bool active_;
+};
+
+// io_uring backend.
+#define RING_ENTRIES (4096)
+#define RING_BUFFER_NUM (1024)
+#define RING_BUFFER_SIZE (16*1024)
+
+// max bytes queued by SendBuffer() per connection.
+#define RING_SEND_LIMIT (256*1024)
+
+// user data of an operation: generation of the slot, operation, fd.
+// generation tells completion of a closed connection from the one reusing its fd.
+#define RING_GEN_MASK (0x0FFFFFFF)
+
+enum RingOp
+{
+    RO_NONE,
+    RO_EPOLL, // fd of epoll is readable
+    RO_ACCEPT,
+    RO_RECV,
+    RO_SEND,
+};
+
+// connection driven by io_uring.
+struct SocketRing
+{
+    // user waits for SC_READ or SC_WRITE, both are cleared once an event is reported.
+    bool read_;
+    bool write_;
+
+    bool ready_;   // in ready list, to be reported
+    bool dirty_;   // in send list, to be sent by next submitting
+
+    bool accepting_;
+    bool recving_;
+    bool sending_;
+
+    // received data not read by user yet, bid_ is -1 if none.
+    int bid_;
+    int len_;
+    int offset_;
+
+    // reported after data received is read.
+    bool eof_;
+    int error_;
+
+    bool sendError_;
+    int outBytes_; // bytes in outHead_ list
+
+    // sendmsg in flight.
+    struct msghdr msg_;
+    struct iovec iov_[MAX_SEND_IOV];
+};
+
+// default max number of datagrams read by one recvmmsg(), and buffer size of each.
+#define DEFAULT_DGRAM_BATCH (32)
+#define DEFAULT_DGRAM_SIZE (2048)
+
+// limit of vlen of recvmmsg() and sendmmsg().
+#define MAX_DGRAM_BATCH (1024)
+
+// datagrams written by one sendmmsg().
+#define MAX_SEND_DGRAM (64)
+
+// buffers in pool per datagram of a batch.
+#define DGRAM_POOL_FACTOR (16)
+
+// udp socket bound by SocketServer::BindUdp().
+struct SocketUdp
+{
+    // datagrams of the batch being handled by user, buffers come from pool.
+    int num_;
+    SocketDatagram* datagrams_;
+
+    struct mmsghdr* msgs_;
+    struct iovec* iov_;
+
+    bool write_;   // user waits for writable
+    bool starved_; // pool is out of buffer, wait for other batches to be released
+};
+
+// how often sockets closed with zero copy sends in flight are checked for completion.
+#define ZEROCOPY_LINGER_CHECK (10)
+
+struct ZeroCopyPending
+{
+    uint32_t id_; // kernel numbers zero copy sends of a socket from 0
+    ZeroCopyDone done_;
+    void* arg_;
+};
+
+struct SocketZeroCopy
+{
+    int fd_;
+    bool enabled_; // SO_ZEROCOPY is set, false if socket doesn't support it
+    bool read_;    // events the connection was armed with last time
+    bool write_;
+    uint32_t next_;
+    std::deque<ZeroCopyPending> pending_;
 };
 
 union SockAddrAll
@@ -39,17 +222,55 @@ union SockAddrAll
 	struct sockaddr s;
 	struct sockaddr_in v4;
 	struct sockaddr_in6 v6;
+	struct sockaddr_un un;
+};
+
+// "unix:/path" for a path, "unix:@name" for abstract namespace.
+static const char UNIX_ADDR_PREFIX[] = "unix:";
+static const size_t UNIX_ADDR_PREFIX_LEN = sizeof(UNIX_ADDR_PREFIX) - 1;
+
+static inline bool IsUnixAddress(const char* host)
+{
+    return strncmp(host, UNIX_ADDR_PREFIX, UNIX_ADDR_PREFIX_LEN) == 0;
+}
+
+// textual peer address, "unix" for unix domain socket.
+static void FormatPeerName(const union SockAddrAll& addr, char* buff, size_t size)
+{
+    if (addr.s.sa_family == AF_INET)
+    {
+        inet_ntop(AF_INET, &addr.v4.sin_addr, buff, size);
+    }
+    else if (addr.s.sa_family == AF_INET6)
+    {
+        inet_ntop(AF_INET6, &addr.v6.sin6_addr, buff, size);
+    }
+    else
+    {
+        snprintf(buff, size, "unix");
+    }
+}
+
+// lookup started by ConnectToAsync(), passed back to polling thread when done.
+struct SocketResolve: public DnsQuery
+{
+    ConnHandle handle_;
+    int port_;
 };
 
 class ServerImpl: public noncopyable
 {
     public:
 
-        ServerImpl();
+        explicit ServerImpl(SocketBackend backend);
         ~ServerImpl();
 
+        SocketBackend GetBackend() const { return uring_? SB_IO_URING : SB_EPOLL; }
+
         // connect to addr, and add the corresponding socket to epoll for watching.
         SocketConnection* ConnectTo(const char* addr, int port, uintptr_t opaque);
+        SocketConnection* ConnectToAsync(const char* host, int port, uintptr_t opaque);
+        void SetDnsCache(int ttl, int negativeTtl);
 
         bool CloseSocket(int fd);
         // connect to ip:port, return the socket fd, not add to epoll for watching.
@@ -59,46 +280,234 @@ class ServerImpl: public noncopyable
         bool WatchSocket(int fd, bool listen);
         bool WatchRawSocket(int fd, bool listen);
         bool UnwatchSocket(int fd);
+        bool WatchEvent(int fd, bool read, bool write);
+        bool Splice(int fd1, int fd2);
+
+        int BindUdp(const char* host, int port, uintptr_t opaque);
+        void SetDatagramBatch(int batch, int size);
+        int SendDatagrams(int fd, const SocketDatagram* datagrams, int num);
 
         void SetWatchAcceptedSock(bool watch) { watchAccepted_ = watch; }
+        void SetExclusiveAccept(bool exclusive) { exclusiveAccept_ = exclusive; }
+
+        void SetSocketOptions(const SocketOptions& opts) { sockOpts_ = opts; }
+        const SocketOptions& GetSocketOptions() const { return sockOpts_; }
+
+        void SetTlsContext(int fd, TlsContext* ctx);
+
+        int ReadBuffer(int fd, char* buffer, int sz, bool rearm = true);
+        bool FinishRead(int fd);
+        int SendBuffer(int fd, const char* buffer, int sz, bool more = false);
 
-        int ReadBuffer(int fd, char* buffer, int sz);
-        int SendBuffer(int fd, const char* buffer, int sz);
+        int SendVector(int fd, const struct iovec* iov, int num);
+
+        void SetZeroCopy(int threshold) { zeroCopy_ = threshold; }
+        int  SendZeroCopy(int fd, const char* buffer, int sz, ZeroCopyDone done, void* arg);
+
+        // thread safe.
+        bool Send(ConnHandle handle, const char* data, int sz);
+        bool SendShared(ConnHandle handle, SharedBuffer* buf);
+
+        bool Subscribe(ConnHandle handle, const char* topic);
+        bool Unsubscribe(ConnHandle handle, const char* topic);
+        int  Publish(const char* topic, const char* data, int sz);
+        void DropSubscriptions(ConnHandle handle);
 
         int  GetConnNumber() const;
+        int64_t GetLastPollTime() const { return pollTime_; }
+
+        void SetBusyPoll(int maxSpin) { poller_.SetBusyPoll(maxSpin); }
+        PollStats GetPollStats() const { return poller_.GetPollStats(); }
+
         void StartServer();
-        void StopServer();
+        void StopServer(int zeroCopyWait);
         void RunPoll(SocketEvent* res);
 
     private:
 
-        inline void ResetSocketSlot(SocketConnection*) const;
-        void ForceSocketClose(SocketConnection* so) const;
-        SocketConnection* SetupSocketConnection(int fd, uintptr_t opaque, bool poll);
+        inline SocketConnection* GetSocket(int fd) const;
+        inline void ResetSocketSlot(SocketConnection*);
+        inline bool RearmSocket(SocketConnection*, bool write, bool read = true);
+        inline void QueueEvent(const SocketEvent& evt);
+        inline bool PollSocket(SocketConnection*, bool listen);
+        void ForceSocketClose(SocketConnection* so);
+        SocketConnection* SetupSocketConnection(int fd, uintptr_t opaque, int status, bool poll);
 
         int WaitPollerIfNecessary();
 
         SocketCode HandleAcceptReady(SocketConnection* sock, SocketConnection*& conn);
+        SocketCode SetupAccepted(SocketConnection* sock, int fd, const union SockAddrAll& addr, SocketConnection*& conn);
         SocketCode HandleConnectDone(SocketConnection* sock);
 
         void SetupServer();
         void ShutDownAllSockets();
 
+        // data queued by Send() and lookups done by resolver, from other threads.
+        void WakePoller();
+        void HandleWakeup();
+        SocketConnection* GetSendTarget(ConnHandle handle) const;
+        void QueueSendNode(SocketConnection* sock, SocketSendNode* node);
+        void FlushSendQueue(SocketConnection* sock);
+        int  WriteOutbound(SocketConnection* sock) const;
+        static void ConsumeOutbound(SocketConnection* sock, size_t n);
+        static void ReleaseOutbound(SocketConnection* sock);
+
+        // connections accepted by listen socket of SetTlsContext().
+        bool HandleTlsHandshake(SocketConnection* sock);
+        int  TlsRead(SocketConnection* sock, char* buffer, int sz);
+        int  TlsSend(SocketConnection* sock, const char* buffer, int sz);
+
+        // connections paired by Splice().
+        void HandleSpliceEvent(SocketConnection* sock, const PollEvent* event);
+        bool PumpSplice(SocketSplice* splice, int from) const;
+        void RearmSplice(SocketSplice* splice) const;
+        void FinishSplice(SocketSplice* splice);
+
+        // io_uring backend.
+        inline bool IsRingConn(const SocketConnection* sock) const;
+        static uint64_t RingData(const SocketConnection* sock, int op);
+        SocketConnection* GetRingSocket(uint64_t data) const;
+        static SocketRing* GetRing(SocketConnection* sock);
+        static void ResetRing(SocketRing* ring);
+        static void RingCountOutbound(SocketConnection* sock);
+        static bool RingHasInput(const SocketRing* ring);
+        static bool RingWritable(const SocketRing* ring);
+
+        bool IsPollThread() const;
+        void RingWatch(SocketConnection* sock);
+        void RingAttach(SocketConnection* sock);
+        void RingArm(SocketConnection* sock, bool write, bool read);
+        void RingRecv(SocketConnection* sock);
+        int  RingRead(SocketConnection* sock, char* buffer, int sz);
+        int  RingSend(SocketConnection* sock, const char* buffer, int sz);
+        int  RingSend(SocketConnection* sock, const struct iovec* iov, int num);
+        void RingMarkReady(SocketConnection* sock);
+        void RingMarkSend(SocketConnection* sock);
+        void RingSubmitSends();
+        void RingReport();
+        void RingRecycle(int bid);
+        void RingRelease(SocketConnection* sock);
+
+        void HandleRingEvent(const UringEvent& event);
+        void HandleRingAccept(const UringEvent& event);
+        void HandleRingRecv(const UringEvent& event);
+        void HandleRingSend(const UringEvent& event);
+
+        // connections paired by Splice() are moved from io_uring to epoll.
+        bool RingSpliceInput(SocketConnection* sock);
+        void RingStartSplice(SocketSplice* splice);
+
+        // udp sockets bound by BindUdp().
+        void HandleUdpEvent(SocketConnection* sock, const PollEvent* event);
+        void ReadDatagrams(SocketConnection* sock);
+        void ReleaseDatagrams(SocketConnection* sock);
+        void RearmUdp(SocketConnection* sock) const;
+        void ReleaseUdp(SocketConnection* sock);
+
+        // name resolution of ConnectToAsync().
+        DnsResolver* GetResolver();
+        static void OnResolved(DnsQuery* query);
+        void HandleResolved(SocketResolve* query);
+        int  StartConnect(SocketConnection* sock, const std::vector<DnsAddress>& addrs, int port);
+        void ReleaseResolver();
+
+        // MSG_ZEROCOPY sends of SendZeroCopy().
+        bool EnableZeroCopy(SocketConnection* sock);
+        static int  ReapZeroCopy(SocketZeroCopy* zc);
+        static void DropZeroCopy(SocketZeroCopy* zc);
+        bool LingerZeroCopy(SocketConnection* sock);
+        void CheckZeroCopyLinger();
+        void WaitZeroCopyLinger(int timeout);
+
+        static void InitSocketSlot(SocketConnection*, void*);
+
     private:
 
         mutable int connNum_;
 
         int pollEventIndex_;
         int pollEventNum_;
+        int64_t pollTime_;
 
         const int maxSocket_;
 
         bool isRunning_;
 
         bool watchAccepted_;
+        bool exclusiveAccept_;
+
+        SocketOptions sockOpts_;
+
+        // tls contexts of listen sockets, by fd, so that they last as listen socket is rewatched.
+        std::map<int, TlsContext*> tlsListen_;
+
+        // threshold of zero copy sending, and sockets closed before their zero copy sends complete,
+        // which are kept open, so that completions can still be read from their error queue.
+        int zeroCopy_;
+        std::vector<SocketZeroCopy*> zcLinger_;
+
+        // eventfd to wake up poller when data is queued by Send().
+        int wakeFd_;
+        volatile int wakePending_;
+
+        // connections with data queued by Send().
+        MpscQueue readyQueue_;
+
+        // subscribers of topics of Publish(), and topics of each subscriber.
+        pthread_mutex_t topicLock_;
+        std::map<std::string, std::set<ConnHandle> > topics_;
+        std::map<ConnHandle, std::set<std::string> > subscriptions_;
+        volatile int subscribedNum_;
+
+        // created on first use, lookups done are queued to resolvedQueue_.
+        DnsResolver* resolver_;
+        int dnsTtl_;
+        int dnsNegativeTtl_;
+        MpscQueue resolvedQueue_;
+
+        // buffers of datagrams, created by first BindUdp().
+        int dgramBatch_;
+        int dgramSize_;
+        LockFreeBuffer* dgramPool_;
+
+        // udp socket whose batch is returned by last RunPoll(), released by next one.
+        SocketConnection* lastUdp_;
+        std::vector<SocketConnection*> starvedUdp_;
+
+        // io_uring backend, NULL if epoll is used.
+        UringPoll* uring_;
+        int ringEventIndex_;
+        int ringEventNum_;
+        UringEvent ringEvent_[MAX_POLL_EVENT];
+
+        // connections to report events for, to send data for, to receive when buffers are back.
+        // connections are referred to by RingData() of RO_NONE.
+        std::vector<uint64_t> ringReady_;
+        std::vector<uint64_t> ringSend_;
+        std::vector<uint64_t> ringStarved_;
+
+        // data of closed connections, being sent, freed on completion.
+        std::map<uint64_t, SocketSendNode*> ringOrphan_;
+
+        // sockets watched from other threads, and the thread that runs RunPoll().
+        MpscQueue watchQueue_;
+        pthread_t pollThread_;
+        volatile bool polling_;
+
+        PagedTable<SocketConnection> sockets_;
+        PollEvent pollEvent_[MAX_POLL_EVENT];
+
+        // event queued with handle of the connection at that time, the connection may be
+        // closed and its slot taken by a new one before the event is returned.
+        struct QueuedEvent
+        {
+            SocketEvent evt;
+            ConnHandle handle;
+        };
 
-        SocketConnection* sockets_;
-        PollEvent* pollEvent_;
+        // events retrieved but not yet returned by RunPoll().
+        std::queue<SocketEvent> acceptQueue_;
+        std::queue<QueuedEvent> readWriteQueue_;
         SocketPoll poller_;
 };
 
@@ -113,7 +522,21 @@ static size_t CalcMaxFileDesc()
 
 // SocketConnection definition.
 SocketConnection::SocketConnection(ServerImpl* server)
-    :server_(server)
+    :fd_(-1)
+    ,status_(SS_INVALID)
+    ,gen_(0)
+    ,opaque_(0)
+    ,sendPending_(0)
+    ,outHead_(NULL)
+    ,outTail_(NULL)
+    ,splice_(NULL)
+    ,udp_(NULL)
+    ,ring_(NULL)
+    ,zc_(NULL)
+    ,tls_(NULL)
+    ,file_(false)
+    ,watchPending_(0)
+    ,server_(server)
 {
 }
 
@@ -121,14 +544,29 @@ SocketConnection::~SocketConnection()
 {
 }
 
-int SocketConnection::SendBuffer(const char* buff, int sz)
+int SocketConnection::SendBuffer(const char* buff, int sz, bool more)
+{
+    return server_->SendBuffer(fd_, buff, sz, more);
+}
+
+int SocketConnection::SendZeroCopy(const char* buff, int sz, ZeroCopyDone done, void* arg)
+{
+    return server_->SendZeroCopy(fd_, buff, sz, done, arg);
+}
+
+int SocketConnection::SendVector(const struct iovec* iov, int num)
+{
+    return server_->SendVector(fd_, iov, num);
+}
+
+int SocketConnection::ReadBuffer(char* buff, int sz, bool rearm)
 {
-    return server_->SendBuffer(fd_, buff, sz);
+    return server_->ReadBuffer(fd_, buff, sz, rearm);
 }
 
-int SocketConnection::ReadBuffer(char* buff, int sz)
+bool SocketConnection::FinishRead()
 {
-    return server_->ReadBuffer(fd_, buff, sz);
+    return server_->FinishRead(fd_);
 }
 
 void SocketConnection::CloseConnection()
@@ -136,6 +574,16 @@ void SocketConnection::CloseConnection()
     server_->CloseSocket(fd_);
 }
 
+bool SocketConnection::WatchEvent(bool read, bool write)
+{
+    return server_->WatchEvent(fd_, read, write);
+}
+
+int SocketConnection::SendDatagrams(const SocketDatagram* datagrams, int num)
+{
+    return server_->SendDatagrams(fd_, datagrams, num);
+}
+
 bool SocketConnection::IsConnected() const
 {
     return status_ == SS_CONNECTED || status_ == SS_LISTENING;
@@ -151,25 +599,75 @@ int SocketConnection::GetConnectionId() const
     return fd_;
 }
 
+ConnHandle SocketConnection::GetHandle() const
+{
+    return (((ConnHandle)gen_) << 32) | (uint32_t)fd_;
+}
+
 // ServerImpl
-ServerImpl::ServerImpl()
+ServerImpl::ServerImpl(SocketBackend backend)
     :connNum_(0)
     ,pollEventIndex_(0)
     ,pollEventNum_(0)
+    ,pollTime_(0)
     ,maxSocket_(CalcMaxFileDesc())
     ,isRunning_(false)
     ,watchAccepted_(false)
-    ,sockets_(new SocketConnection[maxSocket_])
-    ,pollEvent_(new PollEvent[maxSocket_])
+    ,exclusiveAccept_(false)
+    ,zeroCopy_(0)
+    ,wakeFd_(-1)
+    ,wakePending_(0)
+    ,resolver_(NULL)
+    ,dnsTtl_(60)
+    ,dnsNegativeTtl_(5)
+    ,dgramBatch_(DEFAULT_DGRAM_BATCH)
+    ,dgramSize_(DEFAULT_DGRAM_SIZE)
+    ,dgramPool_(NULL)
+    ,lastUdp_(NULL)
+    ,uring_(NULL)
+    ,ringEventIndex_(0)
+    ,ringEventNum_(0)
+    ,polling_(false)
+    ,sockets_(maxSocket_, 256, &ServerImpl::InitSocketSlot, this)
     ,poller_()
 {
-    for (int i = 0; i < maxSocket_; ++i)
+    pthread_mutex_init(&topicLock_, NULL);
+    subscribedNum_ = 0;
+
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (wakeFd_ < 0 || !poller_.AddSocket(wakeFd_, &wakeFd_))
     {
-        sockets_[i].status_ = SS_INVALID;
-        sockets_[i].SetServerImpl(this);
+        slog(LOG_ERROR, "server: failed to setup wakeup fd, error:%s", strerror(errno));
+    }
+
+    if (backend == SB_DEFAULT)
+    {
+        const char* env = getenv("SOCKET_SERVER_BACKEND");
+        backend = (env && strcmp(env, "io_uring") == 0)? SB_IO_URING : SB_EPOLL;
+    }
+
+    if (backend == SB_IO_URING)
+    {
+        uring_ = new UringPoll();
+
+        // sockets left to epoll are reported by polling fd of epoll.
+        if (!uring_->Init(RING_ENTRIES, RING_BUFFER_NUM, RING_BUFFER_SIZE)
+                || !uring_->PollAdd(poller_.GetPollFd(), RingData(NULL, RO_EPOLL), true, false))
+        {
+            slog(LOG_WARN, "server: io_uring is not supported, fall back to epoll");
+
+            delete uring_;
+            uring_ = NULL;
+        }
     }
 }
 
+void ServerImpl::InitSocketSlot(SocketConnection* sock, void* server)
+{
+    sock->SetServerImpl((ServerImpl*)server);
+}
+
 void ServerImpl::SetupServer()
 {
     isRunning_ = true;
@@ -177,9 +675,39 @@ void ServerImpl::SetupServer()
 
 ServerImpl::~ServerImpl()
 {
+    ReleaseResolver();
     ShutDownAllSockets();
-    delete[] sockets_;
-    delete[] pollEvent_;
+
+    // kernel lets go of buffers being sent once the ring is closed.
+    delete uring_;
+
+    std::map<uint64_t, SocketSendNode*>::iterator it;
+    for (it = ringOrphan_.begin(); it != ringOrphan_.end(); ++it)
+    {
+        SocketSendNode* cur = it->second;
+        while (cur)
+        {
+            SocketSendNode* next = cur->next_;
+            FreeSendNode(cur);
+            cur = next;
+        }
+    }
+
+    // no waiting here, StopServer() does it. done() of sends still in flight is never
+    // called, their buffers are pinned by kernel and must not be reused.
+    for (size_t i = 0; i < zcLinger_.size(); ++i)
+    {
+        ReapZeroCopy(zcLinger_[i]);
+        DropZeroCopy(zcLinger_[i]);
+
+        close(zcLinger_[i]->fd_);
+        delete zcLinger_[i];
+    }
+
+    delete dgramPool_;
+    if (wakeFd_ >= 0) close(wakeFd_);
+
+    pthread_mutex_destroy(&topicLock_);
 }
 
 int ServerImpl::GetConnNumber() const
@@ -187,41 +715,95 @@ int ServerImpl::GetConnNumber() const
     return connNum_;
 }
 
-void ServerImpl::ForceSocketClose(SocketConnection* sock) const
+void ServerImpl::ForceSocketClose(SocketConnection* sock)
 {
     assert(sock);
 
     if (sock->status_ == SS_INVALID) return;
 
+    // socket driven by io_uring is not in epoll, spliced ones are removed by FinishSplice().
+    bool ring = uring_ && (sock->status_ == SS_LISTENING || IsRingConn(sock) || sock->splice_);
+
+    // the other connection of the pair is handed back to user.
+    if (sock->splice_) FinishSplice(sock->splice_);
+    if (sock->udp_) ReleaseUdp(sock);
+    if (sock->tls_) sock->tls_->Shutdown();
+    if (sock->status_ == SS_LISTENING) tlsListen_.erase(sock->fd_);
+
     --connNum_;
-    poller_.RemoveSocket(sock->fd_);
+
+    if (ring) RingRelease(sock);
+    else poller_.RemoveSocket(sock->fd_);
+
     ResetSocketSlot(sock);
+    ReleaseOutbound(sock);
 
-    close(sock->fd_);
+    if (!LingerZeroCopy(sock)) close(sock->fd_);
     slog(LOG_VERB, "force closing socket:%d", sock->fd_);
 }
 
 void ServerImpl::ShutDownAllSockets()
 {
-    for (int i = 0; i < maxSocket_; i++)
+    // only pages that have ever been used can hold live sockets.
+    for (size_t i = 0; i < sockets_.PageNum(); ++i)
     {
-        SocketConnection* so = &sockets_[i];
-        ForceSocketClose(so);
+        SocketConnection* page = sockets_.GetPage(i);
+        if (page == NULL) continue;
+
+        for (size_t j = 0; j < sockets_.PageSize(); ++j)
+        {
+            ForceSocketClose(&page[j]);
+
+            delete page[j].ring_;
+            page[j].ring_ = NULL;
+        }
     }
 
     isRunning_ = false;
 }
 
-SocketConnection* ServerImpl::SetupSocketConnection(int fd, uintptr_t opaque, bool poll)
+// listen socket is level triggered, the others are one shot.
+bool ServerImpl::PollSocket(SocketConnection* sock, bool listen)
+{
+    if (uring_ && (listen || IsRingConn(sock)))
+    {
+        if (IsPollThread())
+        {
+            RingWatch(sock);
+            return !listen || sock->ring_->accepting_;
+        }
+
+        if (atomic_cas(&sock->watchPending_, 0, 1))
+        {
+            watchQueue_.Push(&sock->watchNode_);
+            WakePoller();
+        }
+
+        return true;
+    }
+
+    if (listen) return poller_.AddListenSocket(sock->fd_, sock, exclusiveAccept_);
+
+    return poller_.AddSocket(sock->fd_, sock, sock->outHead_ != NULL);
+}
+
+SocketConnection* ServerImpl::SetupSocketConnection(int fd, uintptr_t opaque, int status, bool poll)
 {
-    SocketConnection* so = &sockets_[fd];
+    SocketConnection* so = sockets_.Alloc(fd);
+
+    if (so == NULL)
+    {
+        slog(LOG_ERROR, "SetupSocketConnection, fd out of range: %d", fd);
+        return NULL;
+    }
 
     assert(so->status_ == SS_INVALID);
 
     so->fd_ = fd;
     so->opaque_ = opaque;
+    so->status_ = status;
 
-    if (poll && !poller_.AddSocket(fd, so))
+    if (poll && !PollSocket(so, status == SS_LISTENING))
     {
         slog(LOG_ERROR, "SetupSocketConnection failed, fd: %d, opaque:%d", fd, opaque);
         ResetSocketSlot(so);
@@ -232,14 +814,113 @@ SocketConnection* ServerImpl::SetupSocketConnection(int fd, uintptr_t opaque, bo
     return so;
 }
 
-void ServerImpl::ResetSocketSlot(SocketConnection* sock) const
+SocketConnection* ServerImpl::GetSocket(int fd) const
+{
+    if (fd < 0) return NULL;
+
+    return sockets_.Get(fd);
+}
+
+void ServerImpl::ResetSocketSlot(SocketConnection* sock)
 {
     sock->status_ = SS_INVALID;
+    sock->file_ = false;
+
+    delete sock->tls_;
+    sock->tls_ = NULL;
+
+    // invalidate all handles referring to this slot.
+    ConnHandle handle = sock->GetHandle();
+    ++sock->gen_;
+
+    // subscribe of a handle racing with this is caught by Publish().
+    if (subscribedNum_ > 0) DropSubscriptions(handle);
+}
+
+void ServerImpl::QueueEvent(const SocketEvent& evt)
+{
+    QueuedEvent queued = { evt, evt.conn->GetHandle() };
+    readWriteQueue_.push(queued);
+}
+
+// keep watching writable as long as there is data queued by Send().
+bool ServerImpl::RearmSocket(SocketConnection* sock, bool write, bool read)
+{
+    if (IsRingConn(sock))
+    {
+        RingArm(sock, write, read);
+        return true;
+    }
+
+    // completion of zero copy send wakes the socket up, which is armed again as it was.
+    if (sock->zc_)
+    {
+        sock->zc_->read_ = read;
+        sock->zc_->write_ = write;
+    }
+
+    // data decrypted already is not told by epoll, it is reported readable by itself.
+    if (sock->tls_ && read && !sock->tls_->ready_ && sock->tls_->HasPending())
+    {
+        SocketEvent evt = { SC_READ, sock, NULL, 0 };
+
+        sock->tls_->ready_ = true;
+        QueueEvent(evt);
+        read = false;
+    }
+
+    return poller_.ModifySocket(sock->fd_, sock, write || sock->outHead_ != NULL, read);
+}
+
+static void SetSocketOption(int fd, int level, int name, int value, const char* desc)
+{
+    if (setsockopt(fd, level, name, &value, sizeof(value)) == -1)
+    {
+        slog(LOG_WARN, "server: failed to set %s of fd(%d), error:%s", desc, fd, strerror(errno));
+    }
+}
+
+static void ApplyBufferOptions(int fd, const SocketOptions& opts)
+{
+    if (opts.rcvBuf > 0) SetSocketOption(fd, SOL_SOCKET, SO_RCVBUF, opts.rcvBuf, "SO_RCVBUF");
+    if (opts.sndBuf > 0) SetSocketOption(fd, SOL_SOCKET, SO_SNDBUF, opts.sndBuf, "SO_SNDBUF");
+}
+
+// buffer sizes of listen socket are inherited by sockets accepted, and advertised in handshake.
+static void ApplyListenOptions(int fd, const SocketOptions& opts)
+{
+    ApplyBufferOptions(fd, opts);
+
+#ifdef TCP_DEFER_ACCEPT
+    if (opts.deferAccept > 0) SetSocketOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, opts.deferAccept, "TCP_DEFER_ACCEPT");
+#endif
+
+#ifdef TCP_FASTOPEN
+    if (opts.fastOpen > 0) SetSocketOption(fd, IPPROTO_TCP, TCP_FASTOPEN, opts.fastOpen, "TCP_FASTOPEN");
+#endif
+}
+
+// accepted socket takes buffer sizes from listen socket already.
+static void ApplyConnOptions(int fd, const SocketOptions& opts, bool buffers)
+{
+    if (buffers) ApplyBufferOptions(fd, opts);
+
+    if (opts.noDelay) SetSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+
+    // one shot, not set again after reads.
+#ifdef TCP_QUICKACK
+    if (opts.quickAck) SetSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#endif
 }
 
-static int TryConnectTo(int fd, struct addrinfo* ai_ptr)
+static inline bool IsTcpAddress(const union SockAddrAll& addr)
 {
-    int status = connect(fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+    return addr.s.sa_family == AF_INET || addr.s.sa_family == AF_INET6;
+}
+
+static int TryConnectTo(int fd, const struct sockaddr* addr, socklen_t len)
+{
+    int status = connect(fd, addr, len);
     if (status != 0 && errno != EINPROGRESS)
     {
         slog(LOG_ERROR, "connect failed, error:%s\n", strerror(errno));
@@ -251,11 +932,91 @@ static int TryConnectTo(int fd, struct addrinfo* ai_ptr)
     return 2;
 }
 
+// return length of the address, -1 if path is too long.
+static int MakeUnixAddress(const char* host, struct sockaddr_un* addr)
+{
+    const char* path = host + UNIX_ADDR_PREFIX_LEN;
+    size_t len = strlen(path);
+
+    if (len == 0 || len >= sizeof(addr->sun_path)) return -1;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path, len);
+
+    // abstract namespace, name is not null terminated.
+    if (path[0] == '@')
+    {
+        addr->sun_path[0] = '\0';
+        return offsetof(struct sockaddr_un, sun_path) + len;
+    }
+
+    return sizeof(*addr);
+}
+
+// remove socket file left by a process that is gone, so that the path can be bound again.
+// a file some process still listens on is kept.
+static void RemoveStaleUnixSocket(const struct sockaddr_un* addr, socklen_t len, int socktype)
+{
+    struct stat st;
+    if (addr->sun_path[0] == '\0' || stat(addr->sun_path, &st) != 0 || !S_ISSOCK(st.st_mode)) return;
+
+    int fd = socket(AF_UNIX, socktype, 0);
+    if (fd < 0) return;
+
+    if (connect(fd, (const struct sockaddr*)addr, len) != 0 && errno == ECONNREFUSED)
+    {
+        unlink(addr->sun_path);
+    }
+
+    close(fd);
+}
+
+// unix domain socket version of AllocSocketFd().
+static int AllocUnixSocketFd(SocketPredicateProc proc, const char* host,
+                             int* stat, union SockAddrAll* addr, int socktype)
+{
+    struct sockaddr_un un;
+
+    int len = MakeUnixAddress(host, &un);
+    if (len < 0)
+    {
+        slog(LOG_ERROR, "invalid unix socket address:%s\n", host);
+        return -1;
+    }
+
+    if (proc != &TryConnectTo) RemoveStaleUnixSocket(&un, len, socktype);
+
+    int sock = socket(AF_UNIX, socktype, 0);
+    if (sock < 0) return -1;
+
+    SocketPoll::SetSocketNonBlocking(sock);
+
+    int status = proc(sock, (struct sockaddr*)&un, len);
+    if (status <= 0)
+    {
+        slog(LOG_ERROR, "alloc unix socket fd fail, target:%s, error:%s\n", host, strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    if (stat) *stat = status;
+    if (addr) memcpy(&addr->un, &un, sizeof(un));
+
+    return sock;
+}
+
 // thread safe
-static struct addrinfo* AllocSocketFd(SocketPredicateProc proc,
-                                      const char* host, const char* port,
-                                      int* sfd, int* stat)
+// return socket accepted by proc, address it is accepted for is copied to addr.
+// opts of connection are applied to tcp socket before proc, buffer sizes count in handshake.
+static int AllocSocketFd(SocketPredicateProc proc,
+                         const char* host, const char* port,
+                         int* stat, union SockAddrAll* addr,
+                         int socktype = SOCK_STREAM,
+                         const SocketOptions* opts = NULL)
 {
+    if (IsUnixAddress(host)) return AllocUnixSocketFd(proc, host, stat, addr, socktype);
+
     int status;
     int sock = -1;
     struct addrinfo ai_hints;
@@ -264,8 +1025,8 @@ static struct addrinfo* AllocSocketFd(SocketPredicateProc proc,
 
     memset(&ai_hints, 0, sizeof(ai_hints));
     ai_hints.ai_family   = AF_UNSPEC;
-    ai_hints.ai_socktype = SOCK_STREAM;
-    ai_hints.ai_protocol = IPPROTO_TCP;
+    ai_hints.ai_socktype = socktype;
+    ai_hints.ai_protocol = (socktype == SOCK_DGRAM)? IPPROTO_UDP : IPPROTO_TCP;
 
     status = getaddrinfo(host, port, &ai_hints, &ai_list);
     if (status) goto _failed;
@@ -281,7 +1042,9 @@ static struct addrinfo* AllocSocketFd(SocketPredicateProc proc,
         SocketPoll::SetSocketNonBlocking(sock);
 #endif
 
-        status = proc(sock, ai_ptr);
+        if (opts) ApplyConnOptions(sock, *opts, true);
+
+        status = proc(sock, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
         if (status > 0) break;
 
         close(sock);
@@ -289,25 +1052,27 @@ static struct addrinfo* AllocSocketFd(SocketPredicateProc proc,
     }
 
     if (sock < 0) goto _failed;
-    if (sfd) *sfd = sock;
     if (stat) *stat = status;
 
-    return ai_ptr;
+    if (addr && ai_ptr->ai_addrlen <= sizeof(*addr)) memcpy(addr, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+
+    freeaddrinfo(ai_list);
+    return sock;
 
 _failed:
 
     slog(LOG_ERROR, "alloc socket fd fail, target:host(%s),port(%s)\n", host, port);
-    freeaddrinfo(ai_list);
-    return NULL;
+    if (ai_list) freeaddrinfo(ai_list);
+    return -1;
 }
 
 // in case of error occurs, let user handles the error.
 // closing socket should be the last step to be taken
-int ServerImpl::SendBuffer(int fd, const char* buffer, int sz)
+int ServerImpl::SendBuffer(int fd, const char* buffer, int sz, bool more)
 {
-    SocketConnection* sock = &sockets_[fd];
+    SocketConnection* sock = GetSocket(fd);
 
-    if (sock->status_ == SS_INVALID || sock->fd_ != fd)
+    if (sock == NULL || sock->status_ == SS_INVALID || sock->fd_ != fd)
     {
         slog(LOG_ERROR, "send, invalid socketid,sock(%d)", fd);
         return -2;
@@ -315,7 +1080,12 @@ int ServerImpl::SendBuffer(int fd, const char* buffer, int sz)
 
     assert(sock->status_ != SS_LISTENING);
 
-    int n = write(fd, buffer, sz);
+    if (IsRingConn(sock)) return RingSend(sock, buffer, sz);
+    if (sock->tls_ && !sock->tls_->IsKtlsSend()) return TlsSend(sock, buffer, sz);
+
+    // send() is for sockets only, fd watched by user may be anything.
+    // peer gone is told by EPIPE rather than by killing the process.
+    int n = sock->file_? write(fd, buffer, sz) : send(fd, buffer, sz, (more? MSG_MORE : 0) | MSG_NOSIGNAL);
     if (n < 0)
     {
         if (EINTR == errno || EAGAIN == errno)
@@ -329,30 +1099,279 @@ int ServerImpl::SendBuffer(int fd, const char* buffer, int sz)
         }
     }
 
-    if (n < sz)
-    {
-        poller_.ModifySocket(sock->fd_, sock, true);
-    }
-    else
-    {
-        poller_.ModifySocket(sock->fd_, sock, false);
-    }
+    RearmSocket(sock, n < sz);
 
     return n;
 }
 
-int ServerImpl::ReadBuffer(int fd, char* buffer, int sz)
+int ServerImpl::SendVector(int fd, const struct iovec* iov, int num)
 {
-    assert(fd >=0 && fd <= maxSocket_);
-    SocketConnection* sock = &sockets_[fd];
+    SocketConnection* sock = GetSocket(fd);
 
-    assert(sz);
-    assert(sock->status_ != SS_INVALID);
+    if (sock == NULL || sock->status_ == SS_INVALID || sock->fd_ != fd)
+    {
+        slog(LOG_ERROR, "send, invalid socketid,sock(%d)", fd);
+        return -2;
+    }
 
-    int n = (int)read(fd, buffer, sz);
+    assert(sock->status_ != SS_LISTENING);
+
+    if (num > MAX_SEND_IOV) num = MAX_SEND_IOV;
+
+    if (IsRingConn(sock)) return RingSend(sock, iov, num);
+
+    // openssl writes a buffer at a time.
+    if (sock->tls_ && !sock->tls_->IsKtlsSend())
+    {
+        int total = 0;
+
+        for (int i = 0; i < num; ++i)
+        {
+            int n = TlsSend(sock, (const char*)iov[i].iov_base, (int)iov[i].iov_len);
+            if (n < 0) return -1;
+
+            total += n;
+            if (n < (int)iov[i].iov_len) break;
+        }
+
+        return total;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < num; ++i) total += iov[i].iov_len;
+
+    ssize_t n = 0;
+
+    if (sock->file_)
+    {
+        n = writev(fd, iov, num);
+    }
+    else
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec*)iov;
+        msg.msg_iovlen = num;
+
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    }
+
+    if (n < 0)
+    {
+        if (EINTR == errno || EAGAIN == errno)
+        {
+            n = 0;
+        }
+        else
+        {
+            slog(LOG_ERROR, "server:write to %d(fd=%d) failed.", fd, sock->fd_);
+            return -1;
+        }
+    }
+
+    RearmSocket(sock, (size_t)n < total);
+
+    return (int)n;
+}
+
+int ServerImpl::SendZeroCopy(int fd, const char* buffer, int sz, ZeroCopyDone done, void* arg)
+{
+    SocketConnection* sock = GetSocket(fd);
+
+    if (sock == NULL || sock->status_ == SS_INVALID || sock->fd_ != fd)
+    {
+        slog(LOG_ERROR, "send, invalid socketid,sock(%d)", fd);
+        return -2;
+    }
+
+    int n = -1;
+
+#ifdef MSG_ZEROCOPY
+    if (zeroCopy_ > 0 && sz >= zeroCopy_ && !uring_ && !sock->udp_ && !sock->tls_ && EnableZeroCopy(sock))
+    {
+        n = send(fd, buffer, sz, MSG_ZEROCOPY | MSG_NOSIGNAL);
+
+        if (n > 0)
+        {
+            ZeroCopyPending pending = { sock->zc_->next_++, done, arg };
+            sock->zc_->pending_.push_back(pending);
+        }
+        else if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            n = 0;
+        }
+        else if (n < 0 && errno != ENOBUFS)
+        {
+            slog(LOG_ERROR, "server:write to %d(fd=%d) failed.", fd, sock->fd_);
+            return -1;
+        }
+
+        // ENOBUFS: out of memory to pin pages with(optmem_max), copied instead.
+        if (n >= 0)
+        {
+            RearmSocket(sock, n < sz);
+            return n;
+        }
+    }
+#endif
+
+    n = SendBuffer(fd, buffer, sz);
+    if (n > 0) done(arg);
+
+    return n;
+}
+
+bool ServerImpl::EnableZeroCopy(SocketConnection* sock)
+{
+    if (sock->zc_) return sock->zc_->enabled_;
+
+    SocketZeroCopy* zc = new SocketZeroCopy;
+
+    zc->fd_ = sock->fd_;
+    zc->enabled_ = false;
+    zc->read_ = true;
+    zc->write_ = false;
+    zc->next_ = 0;
+
+#ifdef SO_ZEROCOPY
+    int one = 1;
+    zc->enabled_ = (setsockopt(sock->fd_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0);
+#endif
+
+    // unix domain socket for example.
+    if (!zc->enabled_) slog(LOG_VERB, "server: zero copy is not supported, fd(%d)", sock->fd_);
+
+    sock->zc_ = zc;
+    return zc->enabled_;
+}
+
+// read completions from error queue of socket, return the number of them.
+int ServerImpl::ReapZeroCopy(SocketZeroCopy* zc)
+{
+    int num = 0;
+
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    while (!zc->pending_.empty())
+    {
+        char control[128];
+        struct msghdr msg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(zc->fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                        || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) continue;
+
+            struct sock_extended_err* err = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+            // sends from ee_info to ee_data are done, they complete in order.
+            while (!zc->pending_.empty() && (int32_t)(err->ee_data - zc->pending_.front().id_) >= 0)
+            {
+                ZeroCopyPending pending = zc->pending_.front();
+                zc->pending_.pop_front();
+
+                pending.done_(pending.arg_);
+            }
+
+            ++num;
+        }
+    }
+#endif
+
+    return num;
+}
+
+// sends not completed are forgotten without done(), buffers may still be read by kernel.
+void ServerImpl::DropZeroCopy(SocketZeroCopy* zc)
+{
+    if (zc->pending_.empty()) return;
+
+    slog(LOG_WARN, "server: %d zero copy sends of fd(%d) never completed, buffers are leaked",
+            (int)zc->pending_.size(), zc->fd_);
+
+    zc->pending_.clear();
+}
+
+// return true if socket is kept open for sends in flight, it is closed once they complete.
+bool ServerImpl::LingerZeroCopy(SocketConnection* sock)
+{
+    SocketZeroCopy* zc = sock->zc_;
+    if (zc == NULL) return false;
+
+    sock->zc_ = NULL;
+
+    ReapZeroCopy(zc);
+
+    if (zc->pending_.empty())
+    {
+        delete zc;
+        return false;
+    }
+
+    // data already sent goes on, followed by FIN, as close() does.
+    shutdown(zc->fd_, SHUT_RDWR);
+    zcLinger_.push_back(zc);
+
+    return true;
+}
+
+void ServerImpl::CheckZeroCopyLinger()
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < zcLinger_.size(); ++i)
+    {
+        SocketZeroCopy* zc = zcLinger_[i];
+
+        ReapZeroCopy(zc);
+
+        if (!zc->pending_.empty())
+        {
+            zcLinger_[kept++] = zc;
+            continue;
+        }
+
+        close(zc->fd_);
+        delete zc;
+    }
+
+    zcLinger_.resize(kept);
+}
+
+void ServerImpl::WaitZeroCopyLinger(int timeout)
+{
+    int64_t deadline = MonotonicMicroSec() + (int64_t)timeout * 1000;
+
+    while (!zcLinger_.empty())
+    {
+        CheckZeroCopyLinger();
+
+        if (zcLinger_.empty() || MonotonicMicroSec() >= deadline) break;
+
+        usleep(ZEROCOPY_LINGER_CHECK * 1000);
+    }
+}
+
+int ServerImpl::ReadBuffer(int fd, char* buffer, int sz, bool rearm)
+{
+    SocketConnection* sock = GetSocket(fd);
+
+    assert(sz);
+    assert(sock && sock->status_ != SS_INVALID);
+
+    if (IsRingConn(sock)) return RingRead(sock, buffer, sz);
+    if (sock->tls_) return TlsRead(sock, buffer, sz);
+
+    int n = (int)read(fd, buffer, sz);
 
     // epoll is set ot EPOLLONESHOT, need to rewatch the fd after reading.
-    poller_.ModifySocket(sock->fd_, sock, false);
+    if (rearm) RearmSocket(sock, false);
 
     if (n < 0)
     {
@@ -377,37 +1396,89 @@ int ServerImpl::ReadBuffer(int fd, char* buffer, int sz)
     return n;
 }
 
+bool ServerImpl::FinishRead(int fd)
+{
+    SocketConnection* sock = GetSocket(fd);
+
+    if (sock == NULL || sock->fd_ != fd || sock->status_ != SS_CONNECTED) return false;
+
+    // reads of these arm the connection by themselves.
+    if (IsRingConn(sock) || sock->tls_) return true;
+
+    return RearmSocket(sock, false);
+}
+
+void ServerImpl::SetTlsContext(int fd, TlsContext* ctx)
+{
+    if (ctx) tlsListen_[fd] = ctx;
+    else tlsListen_.erase(fd);
+}
+
+// return true if handshake is done or fails, socket is armed for what it waits for otherwise.
+bool ServerImpl::HandleTlsHandshake(SocketConnection* sock)
+{
+    if (sock->tls_->Handshake() != 0) return true;
+
+    bool write = sock->tls_->WantWrite();
+    poller_.ModifySocket(sock->fd_, sock, write, !write);
+
+    return false;
+}
+
+int ServerImpl::TlsRead(SocketConnection* sock, char* buffer, int sz)
+{
+    sock->tls_->ready_ = false;
+
+    int n = sock->tls_->Read(buffer, sz);
+
+    // reading may wait for socket to be writable, eg, to answer a key update.
+    RearmSocket(sock, sock->tls_->WantWrite());
+
+    if (n < 0) slog(LOG_VERB, "tls connection closed, sock(%d)", sock->fd_);
+
+    return n;
+}
+
+int ServerImpl::TlsSend(SocketConnection* sock, const char* buffer, int sz)
+{
+    int n = sock->tls_->Write(buffer, sz);
+    if (n < 0)
+    {
+        slog(LOG_ERROR, "server:tls write to fd(%d) failed.", sock->fd_);
+        return -1;
+    }
+
+    RearmSocket(sock, n < sz);
+
+    return n;
+}
+
 SocketConnection* ServerImpl::ConnectTo(const char* host, int _port, uintptr_t opaque)
 {
     char port[16];
     sprintf(port, "%d", _port);
 
-    int sock;
     int status = 0;
+    union SockAddrAll addr;
 
-    struct addrinfo* ai_ptr = NULL;
-    ai_ptr = AllocSocketFd(&TryConnectTo, host, port, &sock, &status);
-    if (sock < 0 || ai_ptr == NULL) return NULL;
+    // options are set before connect, sizes of buffers decide window scale of handshake.
+    int sock = AllocSocketFd(&TryConnectTo, host, port, &status, &addr, SOCK_STREAM, &sockOpts_);
+    if (sock < 0) return NULL;
 
     // alloc socket entity, and poll the socket
-    SocketConnection* new_sock = SetupSocketConnection(sock, opaque, true);
+    SocketConnection* new_sock = SetupSocketConnection(sock, opaque, (status == 1)? SS_CONNECTED : SS_CONNECTING, true);
+    if (new_sock == NULL)
+    {
+        close(sock);
+        return NULL;
+    }
 
     if (status == 1)
     {
-        // convert addr into string
-        struct sockaddr* addr = ai_ptr->ai_addr;
-        void* sin_addr = (ai_ptr->ai_family == AF_INET)?
-            (void*)&((struct sockaddr_in*)addr)->sin_addr:
-            (void*)&((struct sockaddr_in6*)addr)->sin6_addr;
-
-        inet_ntop(ai_ptr->ai_family, sin_addr, new_sock->buff_, sizeof(new_sock->buff_));
-
-        new_sock->status_ = SS_CONNECTED;
+        FormatPeerName(addr, new_sock->buff_, sizeof(new_sock->buff_));
     }
     else
     {
-        new_sock->status_ = SS_CONNECTING;
-
         // socket is nonblocking, connection is not complete
         // need to set fd writable to track the status.
         poller_.ModifySocket(new_sock->fd_, new_sock, true);
@@ -416,185 +1487,1995 @@ SocketConnection* ServerImpl::ConnectTo(const char* host, int _port, uintptr_t o
     return new_sock;
 }
 
-static int TryListenTo(int fd, struct addrinfo* ai_ptr)
+void ServerImpl::SetDnsCache(int ttl, int negativeTtl)
+{
+    dnsTtl_ = ttl;
+    dnsNegativeTtl_ = negativeTtl;
+}
+
+DnsResolver* ServerImpl::GetResolver()
+{
+    if (resolver_ == NULL) resolver_ = new DnsResolver(2, dnsTtl_, dnsNegativeTtl_);
+
+    return resolver_;
+}
+
+// lookups in progress are done by destroying resolver, queries are freed here.
+void ServerImpl::ReleaseResolver()
+{
+    if (resolver_ == NULL) return;
+
+    delete resolver_;
+    resolver_ = NULL;
+
+    MpscNode* node;
+    while ((node = resolvedQueue_.Pop()) != NULL)
+    {
+        delete container_of(node, SocketResolve, node_);
+    }
+}
+
+SocketConnection* ServerImpl::ConnectToAsync(const char* host, int port, uintptr_t opaque)
+{
+    // numeric address or unix socket never blocks.
+    struct in6_addr numeric;
+    if (IsUnixAddress(host) || inet_pton(AF_INET, host, &numeric) == 1 || inet_pton(AF_INET6, host, &numeric) == 1)
+    {
+        return ConnectTo(host, port, opaque);
+    }
+
+    DnsResolver* resolver = GetResolver();
+
+    std::vector<DnsAddress> addrs;
+    int cached = resolver->Lookup(host, addrs);
+    if (cached < 0) return NULL;
+
+    // reserve the fd and the slot of connection, so that the connection can be returned
+    // right now, socket of the right family takes over the fd when connecting.
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return NULL;
+
+    SocketConnection* sock = SetupSocketConnection(fd, opaque, SS_RESOLVING, false);
+    if (sock == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if (cached > 0)
+    {
+        if (StartConnect(sock, addrs, port) > 0) return sock;
+
+        poller_.RemoveSocket(sock->fd_);
+        ResetSocketSlot(sock);
+        close(sock->fd_);
+        return NULL;
+    }
+
+    SocketResolve* query = new SocketResolve();
+
+    query->host_ = host;
+    query->handle_ = sock->GetHandle();
+    query->port_ = port;
+    query->done_ = &ServerImpl::OnResolved;
+    query->arg_ = this;
+
+    resolver->Resolve(query);
+
+    return sock;
+}
+
+// called in resolver thread.
+void ServerImpl::OnResolved(DnsQuery* query)
+{
+    ServerImpl* server = (ServerImpl*)query->arg_;
+
+    server->resolvedQueue_.Push(&query->node_);
+    server->WakePoller();
+}
+
+void ServerImpl::HandleResolved(SocketResolve* query)
+{
+    SocketConnection* sock = GetSocket((int)(uint32_t)query->handle_);
+
+    // connection is closed by user while resolving.
+    if (sock == NULL || sock->status_ != SS_RESOLVING || sock->GetHandle() != query->handle_)
+    {
+        delete query;
+        return;
+    }
+
+    int status = -1;
+    if (query->error_ == 0) status = StartConnect(sock, query->addrs_, query->port_);
+
+    delete query;
+
+    SocketEvent evt;
+    evt.conn = sock;
+
+    if (status < 0)
+    {
+        evt.code = SC_FAIL_CONN;
+        QueueEvent(evt);
+    }
+    else if (status == 1)
+    {
+        evt.code = SC_CONNECTED;
+        QueueEvent(evt);
+    }
+}
+
+// try addresses in turn, return 1 if connected, 2 if in progress, -1 on failure.
+int ServerImpl::StartConnect(SocketConnection* sock, const std::vector<DnsAddress>& addrs, int port)
+{
+    for (size_t i = 0; i < addrs.size(); ++i)
+    {
+        union SockAddrAll addr;
+
+        if (addrs[i].len_ > sizeof(addr)) continue;
+
+        memcpy(&addr, &addrs[i].addr_, addrs[i].len_);
+
+        if (addr.s.sa_family == AF_INET) addr.v4.sin_port = htons(port);
+        else if (addr.s.sa_family == AF_INET6) addr.v6.sin6_port = htons(port);
+        else continue;
+
+        int fd = socket(addr.s.sa_family, SOCK_STREAM, IPPROTO_TCP);
+        if (fd < 0) continue;
+
+        SocketPoll::SetSocketNonBlocking(fd);
+
+        // the new socket takes over the fd of the connection, the old one is closed.
+        int ret = dup2(fd, sock->fd_);
+        close(fd);
+
+        if (ret < 0) return -1;
+
+        ApplyConnOptions(sock->fd_, sockOpts_, true);
+
+        int status = TryConnectTo(sock->fd_, &addr.s, addrs[i].len_);
+        if (status < 0) continue;
+
+        sock->status_ = (status == 1)? SS_CONNECTED : SS_CONNECTING;
+
+        if (!PollSocket(sock, false)) return -1;
+
+        if (status == 1)
+        {
+            FormatPeerName(addr, sock->buff_, sizeof(sock->buff_));
+        }
+        else
+        {
+            poller_.ModifySocket(sock->fd_, sock, true);
+        }
+
+        return status;
+    }
+
+    return -1;
+}
+
+static int TryListenTo(int fd, const struct sockaddr* addr, socklen_t len)
+{
+    int reuse = 1;
+    int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void*)&reuse, sizeof(int));
+
+    if (ret == -1) return -1;
+
+    if (bind(fd, addr, len) == -1) return -1;
+
+    if (listen(fd, 64) == -1) return -1;
+
+    return 1;
+}
+
+static int TryListenToReusePort(int fd, const struct sockaddr* addr, socklen_t len)
+{
+#ifdef SO_REUSEPORT
+    int reuse = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void*)&reuse, sizeof(int)) == -1) return -1;
+#endif
+
+    return TryListenTo(fd, addr, len);
+}
+
+static int TryBindTo(int fd, const struct sockaddr* addr, socklen_t len)
+{
+    int reuse = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void*)&reuse, sizeof(int)) == -1) return -1;
+
+    if (bind(fd, addr, len) == -1) return -1;
+
+    return 1;
+}
+
+int ListenTo(const char* host, int _port, bool reuseport)
+{
+    char port[16];
+    sprintf(port, "%d", _port);
+
+    SocketPredicateProc proc = reuseport? &TryListenToReusePort : &TryListenTo;
+
+    return AllocSocketFd(proc, host, port, NULL, NULL);
+}
+
+int ServerImpl::ListenTo(const char* host, int _port, uintptr_t opaque)
+{
+    int listen_fd = ::ListenTo(host, _port);
+    if (listen_fd < 0) return -1;
+
+    if (!IsUnixAddress(host)) ApplyListenOptions(listen_fd, sockOpts_);
+
+    // set up socket, but not put it into epoll yet.
+    // call start socket to if user wants to.
+    SocketConnection* new_sock = SetupSocketConnection(listen_fd, opaque, SS_LISTENING, true);
+    if (new_sock == NULL)
+    {
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+void ServerImpl::SetDatagramBatch(int batch, int size)
+{
+    if (dgramPool_) return;
+
+    dgramBatch_ = std::min(std::max(batch, 1), MAX_DGRAM_BATCH);
+    dgramSize_ = std::max(size, 1);
+}
+
+int ServerImpl::BindUdp(const char* host, int _port, uintptr_t opaque)
+{
+    char port[16];
+    sprintf(port, "%d", _port);
+
+    if (dgramPool_ == NULL)
+    {
+        try
+        {
+            dgramPool_ = new LockFreeBuffer(dgramBatch_ * DGRAM_POOL_FACTOR, dgramSize_);
+        }
+        catch (...)
+        {
+            slog(LOG_ERROR, "server: out of memory for datagram buffers");
+            return -1;
+        }
+    }
+
+    int fd = AllocSocketFd(&TryBindTo, host, port, NULL, NULL, SOCK_DGRAM);
+    if (fd < 0) return -1;
+
+    SocketConnection* sock = SetupSocketConnection(fd, opaque, SS_CONNECTED, false);
+    if (sock == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+
+    SocketUdp* udp = new SocketUdp;
+
+    udp->num_ = 0;
+    udp->datagrams_ = new SocketDatagram[dgramBatch_];
+    udp->msgs_ = new struct mmsghdr[dgramBatch_];
+    udp->iov_ = new struct iovec[dgramBatch_];
+    udp->write_ = false;
+    udp->starved_ = false;
+
+    sock->udp_ = udp;
+
+    if (!PollSocket(sock, false))
+    {
+        ReleaseUdp(sock);
+        ResetSocketSlot(sock);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// make sure this function is thread safe
+bool ServerImpl::CloseSocket(int fd)
+{
+    SocketConnection* sock = GetSocket(fd);
+    if (sock == NULL || sock->status_ == SS_INVALID || sock->fd_ != fd)
+    {
+        slog(LOG_WARN, "try to close bad socket, fd(%d)", fd);
+        return false;
+    }
+
+    ForceSocketClose(sock);
+
+    return true;
+}
+
+// make sure this function thread safe.
+bool ServerImpl::WatchSocket(int fd, bool listen)
+{
+    SocketConnection* sock = GetSocket(fd);
+    if (sock == NULL) return false;
+
+    if (sock->status_ == SS_PACCEPT || sock->status_ == SS_INVALID)
+    {
+        bool listening = (listen && sock->status_ == SS_INVALID);
+
+        sock->status_ = listening? SS_LISTENING : SS_CONNECTED;
+
+        if (!PollSocket(sock, listening))
+        {
+            ResetSocketSlot(sock);
+            return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool ServerImpl::WatchRawSocket(int fd, bool listen)
+{
+    SocketConnection* sock = sockets_.Alloc(fd);
+    if (sock == NULL || sock->status_ != SS_INVALID) return false;
+
+    struct stat st;
+
+    sock->fd_ = fd;
+    sock->status_ = listen? SS_LISTENING:SS_CONNECTED;
+    sock->file_ = (fstat(fd, &st) == 0 && !S_ISSOCK(st.st_mode));
+
+    if (!PollSocket(sock, listen))
+    {
+        ResetSocketSlot(sock);
+        return false;
+    }
+
+    return true;
+}
+
+bool ServerImpl::WatchEvent(int fd, bool read, bool write)
+{
+    SocketConnection* sock = GetSocket(fd);
+
+    if (sock == NULL || sock->fd_ != fd) return false;
+    if (sock->status_ != SS_CONNECTED && sock->status_ != SS_CONNECTING) return false;
+
+    return RearmSocket(sock, write, read);
+}
+
+bool ServerImpl::Splice(int fd1, int fd2)
+{
+    SocketConnection* sock[2] = {GetSocket(fd1), GetSocket(fd2)};
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (sock[i] == NULL || sock[i]->status_ != SS_CONNECTED) return false;
+        if (sock[i]->splice_ || sock[i]->udp_) return false;
+
+        // data of tls goes through openssl.
+        if (sock[i]->tls_) return false;
+
+        // error queue is read by server until zero copy sends complete.
+        if (sock[i]->zc_ && !sock[i]->zc_->pending_.empty()) return false;
+
+        // with io_uring, data queued is sent before forwarding starts.
+        if (sock[i]->outHead_ && !uring_) return false;
+    }
+
+    if (fd1 == fd2) return false;
+
+    SocketSplice* splice = new SocketSplice;
+
+    if (pipe2(splice->pipe_[0], O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        delete splice;
+        return false;
+    }
+
+    if (pipe2(splice->pipe_[1], O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        close(splice->pipe_[0][0]);
+        close(splice->pipe_[0][1]);
+        delete splice;
+        return false;
+    }
+
+    splice->capacity_ = DEFAULT_PIPE_SIZE;
+
+#ifdef F_GETPIPE_SZ
+    int capacity = fcntl(splice->pipe_[0][1], F_GETPIPE_SZ);
+    if (capacity > 0) splice->capacity_ = capacity;
+#endif
+
+    for (int i = 0; i < 2; ++i)
+    {
+        splice->conn_[i] = sock[i];
+        splice->pending_[i] = 0;
+        splice->full_[i] = false;
+        splice->eof_[i] = false;
+        splice->done_[i] = false;
+
+        sock[i]->splice_ = splice;
+    }
+
+    splice->active_ = (uring_ == NULL);
+
+    if (splice->active_)
+    {
+        RearmSplice(splice);
+        return true;
+    }
+
+    // data received already goes first, receiving in flight is called back.
+    for (int i = 0; i < 2; ++i)
+    {
+        SocketRing* st = GetRing(sock[i]);
+
+        if (st->recving_) uring_->Cancel(RingData(sock[i], RO_RECV));
+
+        st->read_ = false;
+        st->write_ = false;
+
+        if (!RingSpliceInput(sock[i]))
+        {
+            FinishSplice(splice);
+            return true;
+        }
+    }
+
+    RingStartSplice(splice);
+    return true;
+}
+
+// splice() has no MSG_NOSIGNAL, SIGPIPE of a peer gone is held back around it.
+static ssize_t SpliceOut(int pipe, int dst, int len)
+{
+    sigset_t sigpipe, old;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &old);
+
+    ssize_t n = ::splice(pipe, NULL, dst, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    int err = errno;
+
+    // signal raised by it is taken, one pending before is left to the thread.
+    if (n < 0 && err == EPIPE && !sigismember(&old, SIGPIPE))
+    {
+        struct timespec zero = { 0, 0 };
+        sigtimedwait(&sigpipe, NULL, &zero);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    errno = err;
+    return n;
+}
+
+// move data from conn_[from] to the other connection, as much as possible.
+// return false on error.
+bool ServerImpl::PumpSplice(SocketSplice* splice, int from) const
+{
+    int src = splice->conn_[from]->fd_;
+    int dst = splice->conn_[1 - from]->fd_;
+    int* pipe = splice->pipe_[from];
+    int& pending = splice->pending_[from];
+
+    if (splice->done_[from]) return true;
+
+    while (true)
+    {
+        bool progress = false;
+
+        if (!splice->eof_[from] && !splice->full_[from] && pending < splice->capacity_)
+        {
+            ssize_t n = ::splice(src, NULL, pipe[1], NULL, splice->capacity_ - pending,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+            if (n > 0)
+            {
+                pending += n;
+                progress = true;
+            }
+            else if (n == 0)
+            {
+                splice->eof_[from] = true;
+            }
+            else if (errno == EAGAIN)
+            {
+                // either source is drained or pipe is full, an empty pipe can't be full.
+                splice->full_[from] = (pending > 0);
+            }
+            else if (errno != EINTR)
+            {
+                slog(LOG_VERB, "server: splice from fd(%d) failed, error:%s", src, strerror(errno));
+                return false;
+            }
+        }
+
+        if (pending > 0)
+        {
+            ssize_t n = SpliceOut(pipe[0], dst, pending);
+
+            if (n > 0)
+            {
+                pending -= n;
+                progress = true;
+                splice->full_[from] = false;
+            }
+            else if (n < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                slog(LOG_VERB, "server: splice to fd(%d) failed, error:%s", dst, strerror(errno));
+                return false;
+            }
+        }
+
+        if (!progress) break;
+    }
+
+    if (splice->eof_[from] && pending == 0)
+    {
+        // pass end of file on, the other direction may still be going.
+        shutdown(dst, SHUT_WR);
+        splice->done_[from] = true;
+    }
+
+    return true;
+}
+
+// connection with nothing to wait for is left disarmed.
+void ServerImpl::RearmSplice(SocketSplice* splice) const
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        SocketConnection* sock = splice->conn_[i];
+
+        bool read  = !splice->eof_[i] && !splice->full_[i] && splice->pending_[i] < splice->capacity_;
+        bool write = splice->pending_[1 - i] > 0;
+
+        if (read || write) poller_.ModifySocket(sock->fd_, sock, write, read);
+    }
+}
+
+void ServerImpl::HandleSpliceEvent(SocketConnection* sock, const PollEvent* event)
+{
+    SocketSplice* splice = sock->splice_;
+    int index = (splice->conn_[0] == sock)? 0 : 1;
+
+    bool ok = true;
+
+    if (event->read) ok = PumpSplice(splice, index);
+
+    // write readiness of this connection drains the other direction.
+    if (ok && event->write) ok = PumpSplice(splice, 1 - index);
+
+    if (!ok || (splice->done_[0] && splice->done_[1]))
+    {
+        FinishSplice(splice);
+        return;
+    }
+
+    RearmSplice(splice);
+}
+
+void ServerImpl::FinishSplice(SocketSplice* splice)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        close(splice->pipe_[i][0]);
+        close(splice->pipe_[i][1]);
+
+        SocketConnection* sock = splice->conn_[i];
+        sock->splice_ = NULL;
+
+        // connection goes back to io_uring, and is driven by user again.
+        if (uring_)
+        {
+            if (splice->active_) poller_.RemoveSocket(sock->fd_);
+
+            RingCountOutbound(sock);
+        }
+
+        // connection being closed by user is skipped when events are returned.
+        SocketEvent evt;
+        evt.code = SC_SPLICE_DONE;
+        evt.conn = sock;
+
+        QueueEvent(evt);
+    }
+
+    delete splice;
+}
+
+int ServerImpl::SendDatagrams(int fd, const SocketDatagram* datagrams, int num)
+{
+    SocketConnection* sock = GetSocket(fd);
+
+    if (sock == NULL || sock->status_ == SS_INVALID || sock->fd_ != fd || sock->udp_ == NULL)
+    {
+        slog(LOG_ERROR, "send datagrams, invalid udp socket(%d)", fd);
+        return -1;
+    }
+
+    int sent = 0;
+
+    while (sent < num)
+    {
+        struct mmsghdr msgs[MAX_SEND_DGRAM];
+        struct iovec iov[MAX_SEND_DGRAM];
+
+        int batch = std::min(num - sent, MAX_SEND_DGRAM);
+
+        for (int i = 0; i < batch; ++i)
+        {
+            const SocketDatagram& dgram = datagrams[sent + i];
+
+            iov[i].iov_base = dgram.data;
+            iov[i].iov_len  = dgram.size;
+
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+
+            if (dgram.addrLen > 0)
+            {
+                msgs[i].msg_hdr.msg_name = (void*)&dgram.addr;
+                msgs[i].msg_hdr.msg_namelen = dgram.addrLen;
+            }
+        }
+
+        int n = sendmmsg(fd, msgs, batch, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+
+            slog(LOG_ERROR, "server: sendmmsg to fd(%d) failed, error:%s", fd, strerror(errno));
+            return sent? sent : -1;
+        }
+
+        sent += n;
+        if (n < batch) break;
+    }
+
+    if (sent < num)
+    {
+        sock->udp_->write_ = true;
+        RearmUdp(sock);
+    }
+
+    return sent;
+}
+
+void ServerImpl::HandleUdpEvent(SocketConnection* sock, const PollEvent* event)
+{
+    SocketUdp* udp = sock->udp_;
+
+    if (event->write && udp->write_)
+    {
+        SocketEvent evt;
+        evt.code = SC_WRITE;
+        evt.conn = sock;
+
+        udp->write_ = false;
+        QueueEvent(evt);
+    }
+
+    if (event->read && udp->num_ == 0) ReadDatagrams(sock);
+
+    RearmUdp(sock);
+}
+
+// read a batch of datagrams, as many as buffers can be taken from pool.
+void ServerImpl::ReadDatagrams(SocketConnection* sock)
+{
+    SocketUdp* udp = sock->udp_;
+
+    int num = 0;
+    while (num < dgramBatch_)
+    {
+        char* buff = dgramPool_->AllocBuffer();
+        if (buff == NULL) break;
+
+        udp->datagrams_[num++].data = buff;
+    }
+
+    if (num == 0)
+    {
+        slog(LOG_WARN, "server: out of datagram buffers, udp socket(%d) waits", sock->fd_);
+
+        udp->starved_ = true;
+        starvedUdp_.push_back(sock);
+        return;
+    }
+
+    for (int i = 0; i < num; ++i)
+    {
+        SocketDatagram& dgram = udp->datagrams_[i];
+
+        udp->iov_[i].iov_base = dgram.data;
+        udp->iov_[i].iov_len  = dgramPool_->Granularity();
+
+        memset(&udp->msgs_[i], 0, sizeof(udp->msgs_[i]));
+        udp->msgs_[i].msg_hdr.msg_iov = &udp->iov_[i];
+        udp->msgs_[i].msg_hdr.msg_iovlen = 1;
+        udp->msgs_[i].msg_hdr.msg_name = &dgram.addr;
+        udp->msgs_[i].msg_hdr.msg_namelen = sizeof(dgram.addr);
+    }
+
+    int n;
+    while ((n = recvmmsg(sock->fd_, udp->msgs_, num, MSG_DONTWAIT, NULL)) < 0 && errno == EINTR);
+
+    if (n < 0 && errno != EAGAIN)
+    {
+        slog(LOG_WARN, "server: recvmmsg from fd(%d) failed, error:%s", sock->fd_, strerror(errno));
+    }
+
+    if (n < 0) n = 0;
+
+    for (int i = n; i < num; ++i)
+    {
+        dgramPool_->ReleaseBuffer(udp->datagrams_[i].data);
+    }
+
+    if (n == 0) return;
+
+    for (int i = 0; i < n; ++i)
+    {
+        udp->datagrams_[i].size = udp->msgs_[i].msg_len;
+        udp->datagrams_[i].addrLen = udp->msgs_[i].msg_hdr.msg_namelen;
+    }
+
+    udp->num_ = n;
+
+    SocketEvent evt;
+    evt.code = SC_DATAGRAM;
+    evt.conn = sock;
+
+    QueueEvent(evt);
+}
+
+// return buffers of the batch to pool, and go on reading.
+void ServerImpl::ReleaseDatagrams(SocketConnection* sock)
+{
+    SocketUdp* udp = sock->udp_;
+
+    for (int i = 0; i < udp->num_; ++i)
+    {
+        dgramPool_->ReleaseBuffer(udp->datagrams_[i].data);
+    }
+
+    udp->num_ = 0;
+    RearmUdp(sock);
+
+    std::vector<SocketConnection*> starved;
+    starved.swap(starvedUdp_);
+
+    for (size_t i = 0; i < starved.size(); ++i)
+    {
+        starved[i]->udp_->starved_ = false;
+        RearmUdp(starved[i]);
+    }
+}
+
+// not readable while a batch is being handled, or no buffer is available.
+void ServerImpl::RearmUdp(SocketConnection* sock) const
+{
+    SocketUdp* udp = sock->udp_;
+
+    poller_.ModifySocket(sock->fd_, sock, udp->write_, udp->num_ == 0 && !udp->starved_);
+}
+
+void ServerImpl::ReleaseUdp(SocketConnection* sock)
+{
+    SocketUdp* udp = sock->udp_;
+
+    for (int i = 0; i < udp->num_; ++i)
+    {
+        dgramPool_->ReleaseBuffer(udp->datagrams_[i].data);
+    }
+
+    if (udp->starved_)
+    {
+        starvedUdp_.erase(std::find(starvedUdp_.begin(), starvedUdp_.end(), sock));
+    }
+
+    if (lastUdp_ == sock) lastUdp_ = NULL;
+
+    delete[] udp->datagrams_;
+    delete[] udp->msgs_;
+    delete[] udp->iov_;
+    delete udp;
+
+    sock->udp_ = NULL;
+}
+
+// io_uring backend
+bool ServerImpl::IsRingConn(const SocketConnection* sock) const
+{
+    return uring_ && sock->status_ == SS_CONNECTED && sock->splice_ == NULL && sock->udp_ == NULL
+        && sock->tls_ == NULL && !sock->file_;
+}
+
+uint64_t ServerImpl::RingData(const SocketConnection* sock, int op)
+{
+    if (sock == NULL) return (uint64_t)op << 32;
+
+    return ((uint64_t)(sock->gen_ & RING_GEN_MASK) << 36) | ((uint64_t)op << 32) | (uint32_t)sock->fd_;
+}
+
+// return NULL if the connection is gone.
+SocketConnection* ServerImpl::GetRingSocket(uint64_t data) const
+{
+    int fd = (int)(uint32_t)data;
+    SocketConnection* sock = GetSocket(fd);
+
+    if (sock == NULL || sock->status_ == SS_INVALID || sock->fd_ != fd || sock->ring_ == NULL) return NULL;
+    if ((sock->gen_ & RING_GEN_MASK) != (uint32_t)(data >> 36)) return NULL;
+
+    return sock;
+}
+
+SocketRing* ServerImpl::GetRing(SocketConnection* sock)
+{
+    if (sock->ring_ == NULL)
+    {
+        sock->ring_ = new SocketRing;
+        ResetRing(sock->ring_);
+    }
+
+    return sock->ring_;
+}
+
+void ServerImpl::ResetRing(SocketRing* ring)
+{
+    ring->read_ = false;
+    ring->write_ = false;
+    ring->ready_ = false;
+    ring->dirty_ = false;
+    ring->accepting_ = false;
+    ring->recving_ = false;
+    ring->sending_ = false;
+    ring->bid_ = -1;
+    ring->len_ = 0;
+    ring->offset_ = 0;
+    ring->eof_ = false;
+    ring->error_ = 0;
+    ring->sendError_ = false;
+    ring->outBytes_ = 0;
+}
+
+void ServerImpl::RingCountOutbound(SocketConnection* sock)
+{
+    SocketRing* st = GetRing(sock);
+
+    st->outBytes_ = 0;
+    for (SocketSendNode* cur = sock->outHead_; cur; cur = cur->next_)
+    {
+        st->outBytes_ += cur->size_ - cur->offset_;
+    }
+}
+
+bool ServerImpl::RingHasInput(const SocketRing* ring)
+{
+    return ring->bid_ >= 0 || ring->eof_ || ring->error_;
+}
+
+bool ServerImpl::RingWritable(const SocketRing* ring)
+{
+    return ring->sendError_ || ring->outBytes_ < RING_SEND_LIMIT;
+}
+
+// io_uring is not thread safe, it is only touched by the thread polling.
+// any thread is fine before polling starts.
+bool ServerImpl::IsPollThread() const
+{
+    return !polling_ || pthread_equal(pollThread_, pthread_self());
+}
+
+void ServerImpl::RingWatch(SocketConnection* sock)
+{
+    if (sock->status_ == SS_LISTENING)
+    {
+        SocketRing* st = GetRing(sock);
+        if (st->accepting_) return;
+
+        if (uring_->Accept(sock->fd_, RingData(sock, RO_ACCEPT))) st->accepting_ = true;
+        else slog(LOG_ERROR, "server: failed to accept, fd(%d)", sock->fd_);
+
+        return;
+    }
+
+    if (IsRingConn(sock)) RingAttach(sock);
+}
+
+// connection is handed to io_uring, data may be queued before.
+void ServerImpl::RingAttach(SocketConnection* sock)
+{
+    RingCountOutbound(sock);
+    RingArm(sock, false, true);
+}
+
+// io_uring counterpart of rearming an one shot epoll event.
+void ServerImpl::RingArm(SocketConnection* sock, bool write, bool read)
+{
+    SocketRing* st = GetRing(sock);
+
+    st->read_ = read;
+    st->write_ = write;
+
+    if (read && !st->recving_ && !RingHasInput(st)) RingRecv(sock);
+    if (sock->outHead_ && !st->sending_) RingMarkSend(sock);
+
+    if ((read && RingHasInput(st)) || (write && RingWritable(st))) RingMarkReady(sock);
+}
+
+void ServerImpl::RingRecv(SocketConnection* sock)
+{
+    SocketRing* st = GetRing(sock);
+
+    if (uring_->Recv(sock->fd_, RingData(sock, RO_RECV)))
+    {
+        st->recving_ = true;
+        return;
+    }
+
+    slog(LOG_ERROR, "server: failed to queue receiving, fd(%d)", sock->fd_);
+    st->error_ = ENOMEM;
+}
+
+void ServerImpl::RingMarkReady(SocketConnection* sock)
+{
+    SocketRing* st = GetRing(sock);
+    if (st->ready_) return;
+
+    st->ready_ = true;
+    ringReady_.push_back(RingData(sock, RO_NONE));
+}
+
+void ServerImpl::RingMarkSend(SocketConnection* sock)
+{
+    SocketRing* st = GetRing(sock);
+    if (st->dirty_) return;
+
+    st->dirty_ = true;
+    ringSend_.push_back(RingData(sock, RO_NONE));
+}
+
+int ServerImpl::RingRead(SocketConnection* sock, char* buffer, int sz)
+{
+    SocketRing* st = GetRing(sock);
+
+    if (st->bid_ < 0)
+    {
+        if (st->eof_)
+        {
+            slog(LOG_VERB, "socket closed by remote, sock(%d)", sock->fd_);
+            return -1;
+        }
+
+        if (st->error_)
+        {
+            slog(LOG_ERROR, "read sock error, fd(%d), error:%s", sock->fd_, strerror(st->error_));
+            return -1;
+        }
+
+        RingArm(sock, false, true);
+        return 0;
+    }
+
+    int n = std::min(sz, st->len_ - st->offset_);
+    memcpy(buffer, uring_->GetBuffer(st->bid_) + st->offset_, n);
+
+    st->offset_ += n;
+    if (st->offset_ == st->len_)
+    {
+        int bid = st->bid_;
+        st->bid_ = -1;
+        RingRecycle(bid);
+    }
+
+    RingArm(sock, false, true);
+    return n;
+}
+
+// data is queued and sent by next submitting, up to RING_SEND_LIMIT per connection.
+int ServerImpl::RingSend(SocketConnection* sock, const char* buffer, int sz)
+{
+    struct iovec iov = { (void*)buffer, (size_t)sz };
+
+    return RingSend(sock, &iov, 1);
+}
+
+// buffers are gathered into one node.
+int ServerImpl::RingSend(SocketConnection* sock, const struct iovec* iov, int num)
+{
+    SocketRing* st = GetRing(sock);
+
+    if (st->sendError_)
+    {
+        slog(LOG_ERROR, "server:write to fd(%d) failed.", sock->fd_);
+        return -1;
+    }
+
+    int sz = 0;
+    for (int i = 0; i < num; ++i) sz += (int)iov[i].iov_len;
+
+    int n = std::min(sz, RING_SEND_LIMIT - st->outBytes_);
+
+    if (n > 0)
+    {
+        SocketSendNode* node = (SocketSendNode*)malloc(sizeof(SocketSendNode) + n);
+
+        if (node)
+        {
+            node->handle_ = sock->GetHandle();
+            node->next_   = NULL;
+            node->shared_ = NULL;
+            node->size_   = n;
+            node->offset_ = 0;
+
+            int copied = 0;
+            for (int i = 0; i < num && copied < n; ++i)
+            {
+                int len = std::min((int)iov[i].iov_len, n - copied);
+
+                memcpy(node->data_ + copied, iov[i].iov_base, len);
+                copied += len;
+            }
+
+            if (sock->outTail_) sock->outTail_->next_ = node;
+            else sock->outHead_ = node;
+
+            sock->outTail_ = node;
+            st->outBytes_ += n;
+        }
+        else
+        {
+            n = 0;
+        }
+    }
+    else
+    {
+        n = 0;
+    }
+
+    RingArm(sock, n < sz, true);
+    return n;
+}
+
+// one sendmsg in flight per connection, so that data goes out in order.
+void ServerImpl::RingSubmitSends()
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < ringSend_.size(); ++i)
+    {
+        SocketConnection* sock = GetRingSocket(ringSend_[i]);
+        if (sock == NULL) continue;
+
+        SocketRing* st = sock->ring_;
+        if (st->sending_ || st->sendError_ || sock->outHead_ == NULL)
+        {
+            st->dirty_ = false;
+            continue;
+        }
+
+        int num = 0;
+        SocketSendNode* cur = sock->outHead_;
+
+        while (cur && num < MAX_SEND_IOV)
+        {
+            st->iov_[num].iov_base = SendNodeData(cur) + cur->offset_;
+            st->iov_[num].iov_len  = cur->size_ - cur->offset_;
+
+            ++num;
+            cur = cur->next_;
+        }
+
+        memset(&st->msg_, 0, sizeof(st->msg_));
+        st->msg_.msg_iov = st->iov_;
+        st->msg_.msg_iovlen = num;
+
+        // submission ring is full, try next round.
+        if (!uring_->SendMsg(sock->fd_, RingData(sock, RO_SEND), &st->msg_))
+        {
+            ringSend_[kept++] = ringSend_[i];
+            continue;
+        }
+
+        st->dirty_ = false;
+        st->sending_ = true;
+    }
+
+    ringSend_.resize(kept);
+}
+
+// report events user waits for, as one shot epoll does.
+void ServerImpl::RingReport()
+{
+    for (size_t i = 0; i < ringReady_.size(); ++i)
+    {
+        SocketConnection* sock = GetRingSocket(ringReady_[i]);
+        if (sock == NULL) continue;
+
+        SocketRing* st = sock->ring_;
+        st->ready_ = false;
+
+        if (!IsRingConn(sock)) continue;
+
+        SocketEvent evt;
+        evt.conn = sock;
+
+        if (st->read_ && RingHasInput(st))
+        {
+            evt.code = SC_READ;
+        }
+        else if (st->write_ && RingWritable(st))
+        {
+            evt.code = SC_WRITE;
+        }
+        else
+        {
+            continue;
+        }
+
+        st->read_ = false;
+        st->write_ = false;
+
+        QueueEvent(evt);
+    }
+
+    ringReady_.clear();
+}
+
+// connections that ran out of buffers receive again.
+void ServerImpl::RingRecycle(int bid)
+{
+    uring_->RecycleBuffer(bid);
+
+    if (ringStarved_.empty()) return;
+
+    std::vector<uint64_t> starved;
+    starved.swap(ringStarved_);
+
+    for (size_t i = 0; i < starved.size(); ++i)
+    {
+        SocketConnection* sock = GetRingSocket(starved[i]);
+        if (sock == NULL || !IsRingConn(sock)) continue;
+
+        RingArm(sock, sock->ring_->write_, sock->ring_->read_);
+    }
+}
+
+// connection is closed or unwatched, receiving and accepting in flight are cancelled.
+// kernel holds the file until operations complete, whose completions are then stale.
+void ServerImpl::RingRelease(SocketConnection* sock)
+{
+    SocketRing* st = sock->ring_;
+    if (st == NULL) return;
+
+    // operations queued refer to the socket by fd, which may be reused once it is closed,
+    // so they go to kernel now. so does cancelling, an operation in flight holds the socket
+    // open, peer would not see it closed until the next round of polling otherwise.
+    bool submit = uring_->HasQueued() || st->accepting_ || st->recving_;
+
+    if (st->accepting_) uring_->Cancel(RingData(sock, RO_ACCEPT));
+    if (st->recving_) uring_->Cancel(RingData(sock, RO_RECV));
+
+    if (st->sending_)
+    {
+        // data being sent goes on, buffers are freed on completion.
+        ringOrphan_[RingData(sock, RO_SEND)] = sock->outHead_;
+        sock->outHead_ = NULL;
+        sock->outTail_ = NULL;
+    }
+    else if (sock->outHead_ && !st->sendError_)
+    {
+        // data accepted by SendBuffer() is written out as epoll backend does, as much as socket takes.
+        WriteOutbound(sock);
+    }
+
+    if (submit) uring_->Submit();
+
+    int bid = st->bid_;
+    ResetRing(st);
+
+    if (bid >= 0) RingRecycle(bid);
+}
+
+void ServerImpl::HandleRingEvent(const UringEvent& event)
+{
+    // completion of cancelling.
+    if (event.data == 0) return;
+
+    switch ((event.data >> 32) & 0xF)
+    {
+        case RO_EPOLL:
+            {
+                pollEventNum_ = poller_.WaitAll(pollEvent_, MAX_POLL_EVENT, 0);
+                pollEventIndex_ = 0;
+
+                if (pollEventNum_ < 0) pollEventNum_ = 0;
+
+                if (!uring_->PollAdd(poller_.GetPollFd(), RingData(NULL, RO_EPOLL), true, false))
+                {
+                    slog(LOG_ERROR, "server: failed to poll fd of epoll");
+                }
+            }
+            break;
+        case RO_ACCEPT:
+            HandleRingAccept(event);
+            break;
+        case RO_RECV:
+            HandleRingRecv(event);
+            break;
+        case RO_SEND:
+            HandleRingSend(event);
+            break;
+        default:
+            slog(LOG_WARN, "server: unknown io_uring completion:%lu", (unsigned long)event.data);
+            break;
+    }
+}
+
+void ServerImpl::HandleRingAccept(const UringEvent& event)
+{
+    SocketConnection* sock = GetRingSocket(event.data);
+
+    if (sock == NULL || sock->status_ != SS_LISTENING)
+    {
+        if (event.result >= 0) close(event.result);
+        return;
+    }
+
+    SocketRing* st = sock->ring_;
+    if (!UringPoll::HasMore(event.flags)) st->accepting_ = false;
+
+    if (event.result >= 0)
+    {
+        union SockAddrAll ua;
+        socklen_t len = sizeof(ua);
+
+        SocketConnection* conn = NULL;
+
+        // peer may have gone already.
+        if (getpeername(event.result, &ua.s, &len) != 0)
+        {
+            close(event.result);
+        }
+        else if (SetupAccepted(sock, event.result, ua, conn) == SC_SUCC)
+        {
+            SocketEvent evt;
+            evt.code = SC_ACCEPTED;
+            evt.conn = conn;
+
+            acceptQueue_.push(evt);
+        }
+    }
+    else if (event.result != -EAGAIN && event.result != -ECANCELED)
+    {
+        slog(LOG_WARN, "server: accept failed, fd(%d), error:%s", sock->fd_, strerror(-event.result));
+    }
+
+    // multishot accept is terminated by kernel.
+    if (!st->accepting_)
+    {
+        if (uring_->Accept(sock->fd_, RingData(sock, RO_ACCEPT))) st->accepting_ = true;
+        else slog(LOG_ERROR, "server: failed to accept again, fd(%d)", sock->fd_);
+    }
+}
+
+void ServerImpl::HandleRingRecv(const UringEvent& event)
+{
+    SocketConnection* sock = GetRingSocket(event.data);
+    int bid = UringPoll::HasBuffer(event.flags)? UringPoll::GetBufferId(event.flags) : -1;
+
+    if (sock == NULL)
+    {
+        if (bid >= 0) RingRecycle(bid);
+        return;
+    }
+
+    SocketRing* st = sock->ring_;
+    st->recving_ = false;
+
+    bool starved = false;
+
+    if (event.result > 0 && bid >= 0)
+    {
+        st->bid_ = bid;
+        st->len_ = event.result;
+        st->offset_ = 0;
+
+        bid = -1;
+    }
+    else if (event.result == 0)
+    {
+        st->eof_ = true;
+    }
+    else if (event.result == -ENOBUFS)
+    {
+        starved = true;
+    }
+    else if (event.result != -EAGAIN && event.result != -EINTR && event.result != -ECANCELED)
+    {
+        st->error_ = -event.result;
+    }
+
+    if (bid >= 0) RingRecycle(bid);
+
+    if (sock->splice_)
+    {
+        if (RingSpliceInput(sock)) RingStartSplice(sock->splice_);
+        else FinishSplice(sock->splice_);
+
+        return;
+    }
+
+    // receive again when a buffer is back.
+    if (starved)
+    {
+        ringStarved_.push_back(RingData(sock, RO_NONE));
+        return;
+    }
+
+    if (IsRingConn(sock)) RingArm(sock, st->write_, st->read_);
+}
+
+void ServerImpl::HandleRingSend(const UringEvent& event)
+{
+    SocketConnection* sock = GetRingSocket(event.data);
+
+    if (sock == NULL)
+    {
+        std::map<uint64_t, SocketSendNode*>::iterator it = ringOrphan_.find(event.data);
+        if (it == ringOrphan_.end()) return;
+
+        SocketSendNode* cur = it->second;
+        while (cur)
+        {
+            SocketSendNode* next = cur->next_;
+            FreeSendNode(cur);
+            cur = next;
+        }
+
+        ringOrphan_.erase(it);
+        return;
+    }
+
+    SocketRing* st = sock->ring_;
+    st->sending_ = false;
+
+    if (event.result >= 0)
+    {
+        st->outBytes_ -= event.result;
+        ConsumeOutbound(sock, event.result);
+    }
+    else if (event.result != -EAGAIN && event.result != -EINTR && event.result != -ECANCELED)
+    {
+        // leave it to user to find out by next SendBuffer().
+        slog(LOG_VERB, "server: send failed, fd(%d), error:%s", sock->fd_, strerror(-event.result));
+
+        st->sendError_ = true;
+        ReleaseOutbound(sock);
+    }
+
+    if (sock->splice_)
+    {
+        if (sock->outHead_) RingMarkSend(sock);
+        else RingStartSplice(sock->splice_);
+
+        return;
+    }
+
+    if (IsRingConn(sock)) RingArm(sock, st->write_, st->read_);
+}
+
+// pass data received by io_uring on to the pipe of splice.
+// return false if it fails.
+bool ServerImpl::RingSpliceInput(SocketConnection* sock)
+{
+    SocketSplice* splice = sock->splice_;
+    SocketRing* st = GetRing(sock);
+
+    int index = (splice->conn_[0] == sock)? 0 : 1;
+
+    if (st->bid_ >= 0)
+    {
+        int bid = st->bid_;
+        int n = st->len_ - st->offset_;
+
+        ssize_t ret = write(splice->pipe_[index][1], uring_->GetBuffer(bid) + st->offset_, n);
+
+        st->bid_ = -1;
+        RingRecycle(bid);
+
+        if (ret != n)
+        {
+            slog(LOG_ERROR, "server: failed to pass data to splice, fd(%d)", sock->fd_);
+            return false;
+        }
+
+        splice->pending_[index] += n;
+    }
+
+    if (st->eof_ || st->error_) splice->eof_[index] = true;
+
+    return true;
+}
+
+// connections are moved to epoll once operations started by io_uring are all done.
+void ServerImpl::RingStartSplice(SocketSplice* splice)
+{
+    if (splice->active_) return;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        SocketConnection* sock = splice->conn_[i];
+        SocketRing* st = GetRing(sock);
+
+        if (st->recving_ || st->sending_ || sock->outHead_) return;
+    }
+
+    splice->active_ = true;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        SocketConnection* sock = splice->conn_[i];
+
+        if (!poller_.AddSocket(sock->fd_, sock))
+        {
+            FinishSplice(splice);
+            return;
+        }
+    }
+
+    if (!PumpSplice(splice, 0) || !PumpSplice(splice, 1) || (splice->done_[0] && splice->done_[1]))
+    {
+        FinishSplice(splice);
+        return;
+    }
+
+    RearmSplice(splice);
+}
+
+bool ServerImpl::UnwatchSocket(int fd)
+{
+    SocketConnection* conn = GetSocket(fd);
+
+    if (conn == NULL || conn->status_ == SS_INVALID) return false;
+
+    if (uring_ && (conn->status_ == SS_LISTENING || IsRingConn(conn)))
+    {
+        RingRelease(conn);
+    }
+    else if (!poller_.RemoveSocket(fd))
+    {
+        return false;
+    }
+
+    // fd goes back to user, a duplicate of it is kept for sends in flight to complete.
+    SocketZeroCopy* zc = conn->zc_;
+    conn->zc_ = NULL;
+
+    if (zc)
+    {
+        ReapZeroCopy(zc);
+
+        if (!zc->pending_.empty() && (zc->fd_ = dup(fd)) >= 0)
+        {
+            zcLinger_.push_back(zc);
+        }
+        else
+        {
+            if (zc->fd_ < 0) zc->fd_ = fd;
+
+            DropZeroCopy(zc);
+            delete zc;
+        }
+    }
+
+    ResetSocketSlot(conn);
+    return true;
+}
+
+SocketCode ServerImpl::HandleConnectDone(SocketConnection* sock)
+{
+    int error;
+    socklen_t len = sizeof(error);
+    int code = getsockopt(sock->fd_, SOL_SOCKET, SO_ERROR, &error, &len);
+
+    if (code < 0 || error) return SC_FAIL_CONN;
+
+    sock->status_ = SS_CONNECTED;
+
+    if (uring_)
+    {
+        poller_.RemoveSocket(sock->fd_);
+        RingAttach(sock);
+    }
+    else
+    {
+        RearmSocket(sock, false);
+    }
+
+    // retrieve peer name of the connected socket.
+    union SockAddrAll u;
+    socklen_t slen = sizeof(u);
+
+    if (getpeername(sock->fd_, &u.s, &slen) == 0)
+    {
+        FormatPeerName(u, sock->buff_, sizeof(sock->buff_));
+    }
+
+    return SC_CONNECTED;
+}
+
+SocketCode ServerImpl::HandleAcceptReady(SocketConnection* sock, SocketConnection*& conn)
+{
+    union SockAddrAll ua;
+    socklen_t len = sizeof(ua);
+
+#ifdef _GNU_SOURCE
+    int client_fd = accept4(sock->fd_, &ua.s, &len, SOCK_NONBLOCK);
+    if (client_fd < 0) return SC_ERROR;
+#else
+    int client_fd = accept(sock->fd_, &ua.s, &len);
+    if (client_fd < 0) return SC_ERROR;
+
+    SocketPoll::SetSocketNonBlocking(client_fd);
+#endif
+
+    return SetupAccepted(sock, client_fd, ua, conn);
+}
+
+SocketCode ServerImpl::SetupAccepted(SocketConnection* sock, int fd, const union SockAddrAll& addr, SocketConnection*& conn)
+{
+    std::map<int, TlsContext*>::const_iterator it = tlsListen_.find(sock->fd_);
+    TlsContext* tls = it == tlsListen_.end()? NULL : it->second;
+
+    // tls connection is set up before it is watched, so that it goes to epoll.
+    SocketConnection* new_sock = SetupSocketConnection(fd, sock->opaque_,
+            watchAccepted_? SS_CONNECTED : SS_PACCEPT, watchAccepted_ && tls == NULL);
+
+    if (new_sock == NULL)
+    {
+        close(fd);
+        return SC_ERROR;
+    }
+
+    if (tls)
+    {
+        new_sock->tls_ = new SocketTls;
+
+        if (!new_sock->tls_->Init(tls, fd) || (watchAccepted_ && !PollSocket(new_sock, false)))
+        {
+            ResetSocketSlot(new_sock);
+            close(fd);
+            return SC_ERROR;
+        }
+    }
+
+    if (IsTcpAddress(addr)) ApplyConnOptions(fd, sockOpts_, false);
+
+    ++connNum_;
+    conn = new_sock;
+
+    FormatPeerName(addr, new_sock->buff_, sizeof(new_sock->buff_));
+
+    return SC_SUCC;
+}
+
+// early check only, poller thread verifies the handle again before writing.
+SocketConnection* ServerImpl::GetSendTarget(ConnHandle handle) const
+{
+    int fd = (int)(uint32_t)handle;
+    uint32_t gen = (uint32_t)(handle >> 32);
+
+    SocketConnection* sock = GetSocket(fd);
+    if (sock == NULL) return NULL;
+
+    if (sock->gen_ != gen || sock->status_ == SS_INVALID || sock->status_ == SS_LISTENING) return NULL;
+
+    return sock;
+}
+
+bool ServerImpl::Send(ConnHandle handle, const char* data, int sz)
+{
+    SocketConnection* sock = GetSendTarget(handle);
+    if (sock == NULL || sz <= 0) return false;
+
+    SocketSendNode* node = (SocketSendNode*)malloc(sizeof(SocketSendNode) + sz);
+    if (node == NULL) return false;
+
+    node->handle_ = handle;
+    node->next_   = NULL;
+    node->shared_ = NULL;
+    node->size_   = sz;
+    node->offset_ = 0;
+    memcpy(node->data_, data, sz);
+
+    QueueSendNode(sock, node);
+    return true;
+}
+
+bool ServerImpl::SendShared(ConnHandle handle, SharedBuffer* buf)
+{
+    SocketConnection* sock = GetSendTarget(handle);
+    if (sock == NULL || buf == NULL) return false;
+
+    SocketSendNode* node = (SocketSendNode*)malloc(sizeof(SocketSendNode));
+    if (node == NULL) return false;
+
+    atomic_increment(&buf->ref_);
+
+    node->handle_ = handle;
+    node->next_   = NULL;
+    node->shared_ = buf;
+    node->size_   = buf->size_;
+    node->offset_ = 0;
+
+    QueueSendNode(sock, node);
+    return true;
+}
+
+bool ServerImpl::Subscribe(ConnHandle handle, const char* topic)
+{
+    pthread_mutex_lock(&topicLock_);
+
+    // checked under lock, or it may miss DropSubscriptions() of the connection closing.
+    bool valid = (GetSendTarget(handle) != NULL);
+    if (valid)
+    {
+        topics_[topic].insert(handle);
+        subscriptions_[handle].insert(topic);
+        subscribedNum_ = subscriptions_.size();
+    }
+
+    pthread_mutex_unlock(&topicLock_);
+
+    return valid;
+}
+
+bool ServerImpl::Unsubscribe(ConnHandle handle, const char* topic)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&topicLock_);
+
+    std::map<std::string, std::set<ConnHandle> >::iterator it = topics_.find(topic);
+    if (it != topics_.end())
+    {
+        found = (it->second.erase(handle) > 0);
+        if (it->second.empty()) topics_.erase(it);
+    }
+
+    std::map<ConnHandle, std::set<std::string> >::iterator sub = subscriptions_.find(handle);
+    if (sub != subscriptions_.end())
+    {
+        sub->second.erase(topic);
+        if (sub->second.empty()) subscriptions_.erase(sub);
+
+        subscribedNum_ = subscriptions_.size();
+    }
+
+    pthread_mutex_unlock(&topicLock_);
+
+    return found;
+}
+
+void ServerImpl::DropSubscriptions(ConnHandle handle)
+{
+    pthread_mutex_lock(&topicLock_);
+
+    std::map<ConnHandle, std::set<std::string> >::iterator sub = subscriptions_.find(handle);
+    if (sub != subscriptions_.end())
+    {
+        std::set<std::string>::iterator topic;
+        for (topic = sub->second.begin(); topic != sub->second.end(); ++topic)
+        {
+            std::map<std::string, std::set<ConnHandle> >::iterator it = topics_.find(*topic);
+            if (it == topics_.end()) continue;
+
+            it->second.erase(handle);
+            if (it->second.empty()) topics_.erase(it);
+        }
+
+        subscriptions_.erase(sub);
+        subscribedNum_ = subscriptions_.size();
+    }
+
+    pthread_mutex_unlock(&topicLock_);
+}
+
+int ServerImpl::Publish(const char* topic, const char* data, int sz)
 {
-    int reuse = 1;
-    int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void*)&reuse, sizeof(int));
+    std::vector<ConnHandle> subscribers;
 
-    if (ret == -1) return -1;
+    // sending takes locks of connections, it is done out of topicLock_.
+    pthread_mutex_lock(&topicLock_);
 
-    if (bind(fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen) == -1) return -1;
+    std::map<std::string, std::set<ConnHandle> >::iterator it = topics_.find(topic);
+    if (it != topics_.end()) subscribers.assign(it->second.begin(), it->second.end());
 
-    if (listen(fd, 64) == -1) return -1;
+    pthread_mutex_unlock(&topicLock_);
 
-    return 1;
+    if (subscribers.empty()) return 0;
+
+    SharedBuffer* buf = SocketServer::CreateShared(data, sz);
+    if (buf == NULL) return -1;
+
+    int num = 0;
+
+    for (size_t i = 0; i < subscribers.size(); ++i)
+    {
+        if (SendShared(subscribers[i], buf))
+        {
+            ++num;
+        }
+        else if (GetSendTarget(subscribers[i]) == NULL)
+        {
+            // connection closed as it subscribed.
+            DropSubscriptions(subscribers[i]);
+        }
+    }
+
+    SocketServer::ReleaseShared(buf);
+    return num;
 }
 
-int ListenTo(const char* host, int _port)
+void ServerImpl::QueueSendNode(SocketConnection* sock, SocketSendNode* node)
 {
-    int status = 0;
-    int listen_fd = -1;
-    struct addrinfo* ai_ptr = NULL;
+    sock->sendQueue_.Push(&node->node_);
 
-    char port[16];
-    sprintf(port, "%d", _port);
+    // only the producer that flips the flag links the connection to ready list.
+    if (!atomic_cas(&sock->sendPending_, 0, 1)) return;
 
-    ai_ptr = AllocSocketFd(&TryListenTo, host, port, &listen_fd, &status);
-    if (listen_fd < 0 || ai_ptr == NULL) return -1;
+    readyQueue_.Push(&sock->readyNode_);
 
-    return listen_fd;
+    WakePoller();
 }
 
-int ServerImpl::ListenTo(const char* host, int _port, uintptr_t opaque)
+void ServerImpl::WakePoller()
 {
-    int listen_fd = ::ListenTo(host, _port);
-    if (listen_fd < 0) return -1;
-
-    // set up socket, but not put it into epoll yet.
-    // call start socket to if user wants to.
-    SocketConnection* new_sock = SetupSocketConnection(listen_fd, opaque, true);
+    if (!atomic_cas(&wakePending_, 0, 1)) return;
 
-    new_sock->status_ = SS_LISTENING;
-    return listen_fd;
+    uint64_t one = 1;
+    if (write(wakeFd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        slog(LOG_ERROR, "server: failed to wake up poller, error:%s", strerror(errno));
+    }
 }
 
-// make sure this function is thread safe
-bool ServerImpl::CloseSocket(int fd)
+void ServerImpl::HandleWakeup()
 {
-    SocketConnection* sock = &sockets_[fd];
-    if (sock->status_ == SS_INVALID || sock->fd_ != fd)
+    wakePending_ = 0;
+    atomic_barrier();
+
+    uint64_t count;
+    while (read(wakeFd_, &count, sizeof(count)) < 0 && errno == EINTR);
+
+    poller_.ModifySocket(wakeFd_, &wakeFd_, false);
+
+    MpscNode* node;
+    while ((node = readyQueue_.Pop()) != NULL)
     {
-        slog(LOG_WARN, "try to close bad socket, fd(%d)", fd);
-        return false;
+        SocketConnection* sock = container_of(node, SocketConnection, readyNode_);
+
+        // clear the flag before draining, so that data queued from now on will notify again.
+        sock->sendPending_ = 0;
+        atomic_barrier();
+
+        FlushSendQueue(sock);
     }
 
-    ForceSocketClose(sock);
+    while ((node = resolvedQueue_.Pop()) != NULL)
+    {
+        HandleResolved(container_of(node, SocketResolve, node_));
+    }
 
-    return true;
+    while ((node = watchQueue_.Pop()) != NULL)
+    {
+        SocketConnection* sock = container_of(node, SocketConnection, watchNode_);
+
+        sock->watchPending_ = 0;
+        atomic_barrier();
+
+        RingWatch(sock);
+    }
 }
 
-// make sure this function thread safe.
-bool ServerImpl::WatchSocket(int fd, bool listen)
+void ServerImpl::FlushSendQueue(SocketConnection* sock)
 {
-    SocketConnection* sock = &sockets_[fd];
-    if (sock->status_ == SS_PACCEPT || sock->status_ == SS_INVALID)
+    int queued = 0;
+
+    MpscNode* node;
+    while ((node = sock->sendQueue_.Pop()) != NULL)
     {
-        if (!poller_.AddSocket(sock->fd_, sock))
-        {
-            ResetSocketSlot(sock);
-            return false;
-        }
+        SocketSendNode* data = container_of(node, SocketSendNode, node_);
 
-        if (sock->status_ == SS_PACCEPT || (!listen && sock->status_ == SS_INVALID))
-        {
-            sock->status_ = SS_CONNECTED;
-        }
-        else
+        // connection is closed or slot is reused since data was queued.
+        if (sock->status_ == SS_INVALID || sock->status_ == SS_LISTENING
+                || data->handle_ != sock->GetHandle())
         {
-            sock->status_ = SS_LISTENING;
+            FreeSendNode(data);
+            continue;
         }
 
-        return true;
+        data->next_ = NULL;
+
+        if (sock->outTail_) sock->outTail_->next_ = data;
+        else sock->outHead_ = data;
+
+        sock->outTail_ = data;
+        queued += data->size_;
     }
 
-    return false;
-}
+    if (sock->outHead_ == NULL) return;
 
-bool ServerImpl::WatchRawSocket(int fd, bool listen)
-{
-    SocketConnection* sock = &sockets_[fd];
-    if (sock->status_ != SS_INVALID) return false;
+    // io_uring sends it with next submitting.
+    if (uring_ && (IsRingConn(sock) || (sock->splice_ && !sock->splice_->active_)))
+    {
+        SocketRing* st = GetRing(sock);
+        st->outBytes_ += queued;
 
-    sock->fd_ = fd;
-    sock->status_ = listen? SS_LISTENING:SS_CONNECTED;
+        if (st->sendError_)
+        {
+            slog(LOG_ERROR, "server: failed to send queued data, fd(%d)", sock->fd_);
+            ReleaseOutbound(sock);
+            return;
+        }
+
+        if (!st->sending_) RingMarkSend(sock);
+        return;
+    }
 
-    if (!poller_.AddSocket(sock->fd_, sock))
+    if (WriteOutbound(sock) < 0)
     {
-        ResetSocketSlot(sock);
-        return false;
+        // leave it to the reader to find out and close the connection.
+        slog(LOG_ERROR, "server: failed to send queued data, fd(%d)", sock->fd_);
+        ReleaseOutbound(sock);
+        return;
     }
 
-    return true;
+    if (sock->outHead_ && sock->status_ != SS_PACCEPT) RearmSocket(sock, true);
 }
 
-bool ServerImpl::UnwatchSocket(int fd)
+// write queued data until socket buffer is full.
+// return -1 on error.
+int ServerImpl::WriteOutbound(SocketConnection* sock) const
 {
-    SocketConnection* conn = &sockets_[fd];
+    while (sock->outHead_)
+    {
+        int num = 0;
+        size_t total = 0;
+        struct iovec iov[MAX_SEND_IOV];
+        SocketSendNode* cur = sock->outHead_;
 
-    if (conn->status_ == SS_INVALID) return false;
-    if (!poller_.RemoveSocket(fd)) return false;
+        while (cur && num < MAX_SEND_IOV)
+        {
+            iov[num].iov_base = SendNodeData(cur) + cur->offset_;
+            iov[num].iov_len  = cur->size_ - cur->offset_;
 
-    ResetSocketSlot(conn);
-    return true;
-}
+            total += iov[num].iov_len;
+            ++num;
+            cur = cur->next_;
+        }
 
-SocketCode ServerImpl::HandleConnectDone(SocketConnection* sock)
-{
-    int error;
-    socklen_t len = sizeof(error);
-    int code = getsockopt(sock->fd_, SOL_SOCKET, SO_ERROR, &error, &len);
+        ssize_t n = 0;
 
-    if (code < 0 || error) return SC_FAIL_CONN;
+        if (sock->tls_ && !sock->tls_->IsKtlsSend())
+        {
+            // openssl writes a buffer at a time.
+            n = sock->tls_->Write((const char*)iov[0].iov_base, (int)iov[0].iov_len);
+            if (n < 0) return -1;
 
-    sock->status_ = SS_CONNECTED;
-    poller_.ModifySocket(sock->fd_, sock, false);
+            total = iov[0].iov_len;
+        }
+        else if (sock->file_)
+        {
+            n = writev(sock->fd_, iov, num);
+        }
+        else
+        {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = num;
 
-    // retrieve peer name of the connected socket.
-    union SockAddrAll u;
-    socklen_t slen = sizeof(u);
+            n = sendmsg(sock->fd_, &msg, MSG_NOSIGNAL);
+        }
 
-    if (getpeername(sock->fd_, &u.s, &slen) == 0)
-    {
-        void* sin_addr = (u.s.sa_family == AF_INET)?
-            (void*)&u.v4.sin_addr:(void*)&u.v6.sin6_addr;
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return 0;
+
+            return -1;
+        }
+
+        ConsumeOutbound(sock, n);
 
-        inet_ntop(u.s.sa_family, sin_addr, sock->buff_, sizeof(sock->buff_));
+        // socket buffer is full.
+        if ((size_t)n < total) return 0;
     }
 
-    return SC_CONNECTED;
+    return 0;
 }
 
-SocketCode ServerImpl::HandleAcceptReady(SocketConnection* sock, SocketConnection*& conn)
+// drop n bytes written from the head of queued data.
+void ServerImpl::ConsumeOutbound(SocketConnection* sock, size_t n)
 {
-    union SockAddrAll ua;
-    socklen_t len = sizeof(ua);
+    while (n > 0)
+    {
+        SocketSendNode* head = sock->outHead_;
+        size_t left = head->size_ - head->offset_;
 
-#ifdef _GNU_SOURCE
-    int client_fd = accept4(sock->fd_, &ua.s, &len, SOCK_NONBLOCK);
-    if (client_fd < 0) return SC_ERROR;
-#else
-    int client_fd = accept(sock->fd_, &ua.s, &len);
-    if (client_fd < 0) return SC_ERROR;
+        if (n < left)
+        {
+            head->offset_ += n;
+            break;
+        }
 
-    SocketPoll::SetSocketNonBlocking(client_fd);
-#endif
+        n -= left;
+        sock->outHead_ = head->next_;
+        FreeSendNode(head);
+    }
 
-    ++connNum_;
-    SocketConnection* new_sock = SetupSocketConnection(client_fd, sock->opaque_, watchAccepted_);
+    if (sock->outHead_ == NULL) sock->outTail_ = NULL;
+}
 
-    conn = new_sock;
-    if (watchAccepted_)
-    {
-        new_sock->status_ = SS_CONNECTED;
-    }
-    else
+void ServerImpl::ReleaseOutbound(SocketConnection* sock)
+{
+    SocketSendNode* cur = sock->outHead_;
+    while (cur)
     {
-        new_sock->status_ = SS_PACCEPT;
+        SocketSendNode* next = cur->next_;
+        FreeSendNode(cur);
+        cur = next;
     }
 
-    void* sin_addr = (ua.s.sa_family == AF_INET)?
-        (void*)&ua.v4.sin_addr : (void*)&ua.v6.sin6_addr;
+    sock->outHead_ = NULL;
+    sock->outTail_ = NULL;
 
-    inet_ntop(ua.s.sa_family, sin_addr, new_sock->buff_, sizeof(new_sock->buff_));
+    if (sock->ring_) sock->ring_->outBytes_ = 0;
 
-    return SC_SUCC;
+    // data queued for current connection, producers that are still
+    // linking their nodes will be dropped in next flush by handle checking.
+    MpscNode* node;
+    while ((node = sock->sendQueue_.Pop()) != NULL)
+    {
+        FreeSendNode(container_of(node, SocketSendNode, node_));
+    }
 }
 
 int ServerImpl::WaitPollerIfNecessary()
 {
     if (pollEventIndex_ != pollEventNum_) return 1;
 
-    pollEventNum_ = poller_.WaitAll(pollEvent_, maxSocket_);
+    if (uring_)
+    {
+        if (ringEventIndex_ != ringEventNum_) return 1;
+
+        // one io_uring_enter() submits all operations queued in this round, and waits.
+        RingSubmitSends();
+
+        ringEventNum_ = uring_->Wait(ringEvent_, MAX_POLL_EVENT);
+        pollTime_ = MonotonicMicroSec();
+
+        ringEventIndex_ = 0;
+        if (ringEventNum_ > 0) return 1;
+
+        ringEventNum_ = 0;
+        return -1;
+    }
+
+    pollEventNum_ = poller_.WaitAll(pollEvent_, MAX_POLL_EVENT, zcLinger_.empty()? -1 : ZEROCOPY_LINGER_CHECK);
+    pollTime_ = MonotonicMicroSec();
+
+    if (!zcLinger_.empty()) CheckZeroCopyLinger();
 
     pollEventIndex_ = 0;
     if (pollEventNum_ > 0) return 1;
@@ -609,31 +3490,77 @@ int ServerImpl::WaitPollerIfNecessary()
 void ServerImpl::RunPoll(SocketEvent* result)
 {
     int ret = 0;
-    static std::queue<SocketEvent> accept_queue;
-    static std::queue<SocketEvent> read_write_queue;
+
+    pollThread_ = pthread_self();
+    polling_ = true;
+
+    // user is done with the batch returned last time.
+    if (lastUdp_)
+    {
+        ReleaseDatagrams(lastUdp_);
+        lastUdp_ = NULL;
+    }
 
     while (1)
     {
-        if (!accept_queue.empty())
+        if (!acceptQueue_.empty())
         {
-            *result = accept_queue.front();
-            accept_queue.pop();
+            *result = acceptQueue_.front();
+            acceptQueue_.pop();
             return;
         }
 
-        if (!read_write_queue.empty())
+        while (!readWriteQueue_.empty())
         {
-            *result = read_write_queue.front();
-            read_write_queue.pop();
+            QueuedEvent queued = readWriteQueue_.front();
+            readWriteQueue_.pop();
+
+            *result = queued.evt;
+
+            // connection closed by user while handling previous events, slot may be reused since.
+            if (result->conn->status_ == SS_INVALID || result->conn->GetHandle() != queued.handle) continue;
+
+            if (result->conn->tls_) result->conn->tls_->ready_ = false;
+
+            if (result->code == SC_DATAGRAM)
+            {
+                SocketUdp* udp = result->conn->udp_;
+                if (udp == NULL || udp->num_ == 0) continue;
+
+                result->datagrams = udp->datagrams_;
+                result->count = udp->num_;
+
+                lastUdp_ = result->conn;
+            }
+
             return;
         }
 
+        if (!ringReady_.empty())
+        {
+            RingReport();
+            if (!readWriteQueue_.empty()) continue;
+        }
+
         if ((ret = WaitPollerIfNecessary()) < 0) continue;
 
+        // completion of fd of epoll fills pollEvent_.
+        while (ringEventIndex_ < ringEventNum_)
+        {
+            HandleRingEvent(ringEvent_[ringEventIndex_++]);
+        }
+
         while (pollEventIndex_ < pollEventNum_)
         {
             SocketEvent evt;
             PollEvent* event = &pollEvent_[pollEventIndex_++];
+
+            if (event->data == &wakeFd_)
+            {
+                HandleWakeup();
+                continue;
+            }
+
             SocketConnection* sock = (SocketConnection*)event->data;
 
             evt.conn = sock;
@@ -643,7 +3570,7 @@ void ServerImpl::RunPoll(SocketEvent* result)
                 case SS_CONNECTING:
                     {
                         evt.code = HandleConnectDone(sock);
-                        read_write_queue.push(evt);
+                        QueueEvent(evt);
                     }
                     break;
                 case SS_LISTENING:
@@ -653,12 +3580,14 @@ void ServerImpl::RunPoll(SocketEvent* result)
                         if (ret == SC_SUCC)
                         {
                             evt.code = SC_ACCEPTED;
-                            accept_queue.push(evt);
+                            acceptQueue_.push(evt);
                         }
                         else
                         {
                             evt.code = SC_ERROR;
-                            slog(LOG_WARN, "server accept erro");
+
+                            // connection taken by other process sharing the listen socket.
+                            if (errno != EAGAIN) slog(LOG_WARN, "server accept erro");
                         }
                     }
                     break;
@@ -669,6 +3598,53 @@ void ServerImpl::RunPoll(SocketEvent* result)
                     break;
                 default:
                     {
+                        if (sock->splice_)
+                        {
+                            HandleSpliceEvent(sock, event);
+                            break;
+                        }
+
+                        if (sock->udp_)
+                        {
+                            HandleUdpEvent(sock, event);
+                            break;
+                        }
+
+                        // connection is reported readable once handshake is done, or fails,
+                        // as it is when reading waits for socket to be writable.
+                        if (sock->tls_ && (!sock->tls_->IsEstablished() || sock->tls_->WantWrite()))
+                        {
+                            if (!HandleTlsHandshake(sock)) break;
+
+                            event->read = true;
+                        }
+
+                        // completions of zero copy sends wake the socket up as an error, which
+                        // can't be told from input. if there is input too, socket is reported
+                        // again once it is armed for reading.
+                        if (event->error && sock->zc_ && ReapZeroCopy(sock->zc_) > 0)
+                        {
+                            if (!event->write)
+                            {
+                                RearmSocket(sock, sock->zc_->write_, sock->zc_->read_);
+                                break;
+                            }
+
+                            event->read = false;
+                        }
+
+                        // data queued by Send() is written by server itself.
+                        if (event->write && sock->outHead_)
+                        {
+                            if (WriteOutbound(sock) < 0) ReleaseOutbound(sock);
+
+                            if (!event->read)
+                            {
+                                RearmSocket(sock, false);
+                                break;
+                            }
+                        }
+
                         if (event->write)
                         {
                             evt.code = SC_WRITE;
@@ -679,7 +3655,7 @@ void ServerImpl::RunPoll(SocketEvent* result)
                             evt.code = SC_READ;
                         }
 
-                        read_write_queue.push(evt);
+                        QueueEvent(evt);
                     }
                     break;
             }
@@ -694,18 +3670,18 @@ void ServerImpl::StartServer()
     SetupServer();
 }
 
-void ServerImpl::StopServer()
+void ServerImpl::StopServer(int zeroCopyWait)
 {
-    if (!isRunning_) return;
+    if (isRunning_) ShutDownAllSockets();
 
-    ShutDownAllSockets();
+    WaitZeroCopyLinger(zeroCopyWait);
 }
 
 // SocketServer
-SocketServer::SocketServer()
+SocketServer::SocketServer(SocketBackend backend)
     :impl_(NULL)
 {
-    impl_ = new ServerImpl();
+    impl_ = new ServerImpl(backend);
 }
 
 SocketServer::~SocketServer()
@@ -713,14 +3689,19 @@ SocketServer::~SocketServer()
     delete impl_;
 }
 
+SocketBackend SocketServer::GetBackend() const
+{
+    return impl_->GetBackend();
+}
+
 void SocketServer::StartServer()
 {
     impl_->StartServer();
 }
 
-void SocketServer::StopServer()
+void SocketServer::StopServer(int zeroCopyWait)
 {
-    impl_->StopServer();
+    impl_->StopServer(zeroCopyWait);
 }
 
 SocketConnection* SocketServer::ConnectTo(const char* ip, int port , uintptr_t opaque)
@@ -728,19 +3709,83 @@ SocketConnection* SocketServer::ConnectTo(const char* ip, int port , uintptr_t o
     return impl_->ConnectTo(ip, port, opaque);
 }
 
+SocketConnection* SocketServer::ConnectToAsync(const char* host, int port, uintptr_t opaque)
+{
+    return impl_->ConnectToAsync(host, port, opaque);
+}
+
+void SocketServer::SetDnsCache(int ttl, int negativeTtl)
+{
+    impl_->SetDnsCache(ttl, negativeTtl);
+}
+
+bool SocketServer::Send(ConnHandle handle, const char* data, int sz)
+{
+    return impl_->Send(handle, data, sz);
+}
+
 int SocketServer::ListenTo(const char* ip, int port, uintptr_t opaque)
 {
     return impl_->ListenTo(ip, port, opaque);
 }
 
-int SocketServer::SendBuffer(int fd, const char* data, int sz)
+int SocketServer::SendBuffer(int fd, const char* data, int sz, bool more)
+{
+    return impl_->SendBuffer(fd, data, sz, more);
+}
+
+SharedBuffer* SocketServer::CreateShared(const char* data, int sz)
+{
+    if (sz <= 0) return NULL;
+
+    SharedBuffer* buf = (SharedBuffer*)malloc(sizeof(SharedBuffer) + sz);
+    if (buf == NULL) return NULL;
+
+    buf->ref_ = 1;
+    buf->size_ = sz;
+    memcpy(buf->data_, data, sz);
+
+    return buf;
+}
+
+void SocketServer::ReleaseShared(SharedBuffer* buf)
+{
+    if (atomic_decrement(&buf->ref_) == 1) free(buf);
+}
+
+bool SocketServer::SendShared(ConnHandle handle, SharedBuffer* buf)
 {
-    return impl_->SendBuffer(fd, data, sz);
+    return impl_->SendShared(handle, buf);
 }
 
-int SocketServer::ReadBuffer(int fd, char* data, int sz)
+bool SocketServer::Subscribe(ConnHandle handle, const char* topic)
 {
-    return impl_->ReadBuffer(fd, data, sz);
+    return impl_->Subscribe(handle, topic);
+}
+
+bool SocketServer::Unsubscribe(ConnHandle handle, const char* topic)
+{
+    return impl_->Unsubscribe(handle, topic);
+}
+
+int SocketServer::Publish(const char* topic, const char* data, int sz)
+{
+    return impl_->Publish(topic, data, sz);
+}
+
+int SocketServer::SendZeroCopy(int fd, const char* data, int sz, ZeroCopyDone done, void* arg)
+{
+    return impl_->SendZeroCopy(fd, data, sz, done, arg);
+}
+
+int SocketServer::SendVector(int fd, const struct iovec* iov, int num)
+{
+    return impl_->SendVector(fd, iov, num);
+}
+
+int SocketServer::ReadBuffer(int fd, char* data, int sz, bool rearm)
+{
+    return impl_->ReadBuffer(fd, data, sz, rearm);
 }
 
 bool SocketServer::CloseSocket(int fd)
@@ -748,11 +3793,26 @@ bool SocketServer::CloseSocket(int fd)
     return impl_->CloseSocket(fd);
 }
 
+int SocketServer::BindUdp(const char* host, int port, uintptr_t opaque)
+{
+    return impl_->BindUdp(host, port, opaque);
+}
+
+void SocketServer::SetDatagramBatch(int batch, int size)
+{
+    impl_->SetDatagramBatch(batch, size);
+}
+
 bool SocketServer::WatchSocket(int fd, bool listen)
 {
     return impl_->WatchSocket(fd, listen);
 }
 
+bool SocketServer::Splice(int fd1, int fd2)
+{
+    return impl_->Splice(fd1, fd2);
+}
+
 bool SocketServer::WatchRawSocket(int fd, bool listen)
 {
     return impl_->WatchRawSocket(fd, listen);
@@ -763,6 +3823,31 @@ void SocketServer::SetWatchAcceptedSock(bool watch)
     impl_->SetWatchAcceptedSock(watch);
 }
 
+void SocketServer::SetExclusiveAccept(bool exclusive)
+{
+    impl_->SetExclusiveAccept(exclusive);
+}
+
+void SocketServer::SetZeroCopy(int threshold)
+{
+    impl_->SetZeroCopy(threshold);
+}
+
+void SocketServer::SetSocketOptions(const SocketOptions& opts)
+{
+    impl_->SetSocketOptions(opts);
+}
+
+const SocketOptions& SocketServer::GetSocketOptions() const
+{
+    return impl_->GetSocketOptions();
+}
+
+void SocketServer::SetTlsContext(int fd, TlsContext* ctx)
+{
+    impl_->SetTlsContext(fd, ctx);
+}
+
 void SocketServer::RunPoll(SocketEvent* evt)
 {
     impl_->RunPoll(evt);
@@ -778,5 +3863,20 @@ int SocketServer::GetConnNumber() const
     return impl_->GetConnNumber();
 }
 
+int64_t SocketServer::GetLastPollTime() const
+{
+    return impl_->GetLastPollTime();
+}
+
+void SocketServer::SetBusyPoll(int maxSpin)
+{
+    impl_->SetBusyPoll(maxSpin);
+}
+
+PollStats SocketServer::GetPollStats() const
+{
+    return impl_->GetPollStats();
+}
+
 const int SocketServer::max_conn_id = CalcMaxFileDesc();
 
@@ -2,14 +2,48 @@
 #define __SOCKET_SERVER_H__
 
 #include "misc/functor.h"
+#include "misc/MpscQueue.h"
 #include "misc/NonCopyable.h"
+#include "http/SocketPoll.h"
 #include <stdint.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 
-int ListenTo(const char* host, int _port);
+// reuseport: set SO_REUSEPORT, so that each worker can own a listen socket of the same address.
+// host of "unix:/path" or "unix:@name"(abstract namespace) listens to a unix domain socket,
+// port is ignored then. socket file left by a dead process is removed, reuseport is not supported.
+int ListenTo(const char* host, int _port, bool reuseport = false);
 
 class ServerImpl;
 class SocketServer;
 
+struct SocketSendNode;
+struct SocketSplice;
+struct SocketUdp;
+struct SocketRing;
+struct SocketZeroCopy;
+struct SocketTls;
+struct SharedBuffer;
+
+class TlsContext;
+
+// called when kernel is done with the buffer of SocketConnection::SendZeroCopy().
+typedef void (* ZeroCopyDone)(void* arg);
+
+// SB_DEFAULT takes io_uring if environment variable SOCKET_SERVER_BACKEND is "io_uring",
+// epoll otherwise. io_uring needs linux 5.19 or later, epoll is used if it is not supported.
+enum SocketBackend
+{
+    SB_DEFAULT,
+    SB_EPOLL,
+    SB_IO_URING,
+};
+
+// 64 bits connection handle: generation of the slot in high 32 bits, fd in low 32 bits.
+// generation changes every time a slot is released, so a stale handle never addresses
+// a new connection that happens to reuse the fd.
+typedef uint64_t ConnHandle;
+
 enum SocketCode
 {
     SC_READ, // socket is ready to read data, SocketEvent::fd denotes corresponding fd, note: corresponding fd will be removed poller
@@ -18,6 +52,8 @@ enum SocketCode
     SC_ACCEPTED, //
     SC_FAIL_CONN, // fail to connect, need to close socket.
     SC_ERROR,  // out of resource: socket fd or memory
+    SC_SPLICE_DONE, // forwarding set up by SocketServer::Splice() stops, connection is left open.
+    SC_DATAGRAM, // datagrams read from udp socket, SocketEvent::datagrams holds the batch.
 
     SC_SUCC
 };
@@ -29,11 +65,40 @@ struct SocketConnection
         explicit SocketConnection(ServerImpl* server = 0);
         ~SocketConnection();
 
-        int SendBuffer(const char* buff, int sz);
-        int ReadBuffer(char* buff, int sz);
+        // more: more data follows soon, kernel holds a partial segment back(MSG_MORE),
+        // until data is sent without it. ignored by io_uring backend, which batches anyway.
+        int SendBuffer(const char* buff, int sz, bool more = false);
+
+        // same as SendBuffer(), but sz of zero copy threshold(SocketServer::SetZeroCopy()) or
+        // more is sent by MSG_ZEROCOPY, kernel sends from the buffer in place instead of a copy.
+        // the buffer must be kept unchanged until done(arg) is called, which is called once for
+        // each call returning > 0, from polling thread when kernel reports completion, or before
+        // return if data is copied: small send, socket or backend without zero copy support.
+        // a connection closed or unwatched with sends in flight is kept open by server until they
+        // complete. those still in flight when server is destroyed never get done() called,
+        // StopServer() can wait for them before that.
+        int SendZeroCopy(const char* buff, int sz, ZeroCopyDone done, void* arg);
+
+        // same as SendBuffer(), but buffers are gathered by one sendmsg(), 64 of them at most,
+        // return bytes sent of them in order. buffers are still written one by one over tls.
+        int SendVector(const struct iovec* iov, int num);
+
+        // rearm = false leaves a plain epoll connection unarmed after reading, so that a loop
+        // of reads costs one epoll_ctl() by FinishRead() after it, instead of one per read.
+        // tls and io_uring connections are armed by each read as before.
+        int ReadBuffer(char* buff, int sz, bool rearm = true);
+        bool FinishRead();
 
         void CloseConnection();
 
+        // re-arm the one shot watching of this connection without reading or sending.
+        // read = false keeps the connection from being reported readable, for flow control.
+        bool WatchEvent(bool read, bool write);
+
+        // udp socket only, send datagrams by sendmmsg(), return number of datagrams sent,
+        // -1 on error. socket is watched for SC_WRITE if not all of them are sent.
+        int SendDatagrams(const struct SocketDatagram* datagrams, int num);
+
         bool IsConnected() const;
 
         uintptr_t GetOpaqueValue() const;
@@ -41,49 +106,198 @@ struct SocketConnection
         void SetServerImpl(ServerImpl* server) { server_ = server; }
 
         int GetConnectionId() const;
+        ConnHandle GetHandle() const;
 
     public:
 
         int fd_;
         int status_;
+        uint32_t gen_;
         uintptr_t opaque_;
         char buff_[64];
 
+        // outbound data queued by SocketServer::Send() from any thread.
+        MpscQueue sendQueue_;
+
+        // link in server's ready list, valid when sendPending_ is set.
+        MpscNode readyNode_;
+        volatile int sendPending_;
+
+        // data taken from sendQueue_ but not yet written, owned by poller thread.
+        SocketSendNode* outHead_;
+        SocketSendNode* outTail_;
+
+        // set when the connection is paired by SocketServer::Splice().
+        SocketSplice* splice_;
+
+        // set when the socket is bound by SocketServer::BindUdp().
+        SocketUdp* udp_;
+
+        // io_uring operations of the connection, for io_uring backend only.
+        SocketRing* ring_;
+
+        // zero copy sends waiting for completion, set by first SendZeroCopy().
+        SocketZeroCopy* zc_;
+
+        // set when the socket is accepted by a listen socket of SocketServer::SetTlsContext().
+        SocketTls* tls_;
+
+        // set when fd watched by WatchRawSocket() is not a socket(eg, timerfd),
+        // which io_uring backend leaves to epoll.
+        bool file_;
+
+        // link in server's watch list, socket watched from other thread than the polling
+        // one is handed to the polling thread, which owns the io_uring.
+        MpscNode watchNode_;
+        volatile int watchPending_;
+
     private:
 
         ServerImpl* server_;
 };
 
+// datagram of udp socket, addr is the source of datagram read, or destination of one to send.
+// addrLen of 0 sends to the peer the socket is connected to.
+struct SocketDatagram
+{
+    char* data;
+    int size;
+    socklen_t addrLen;
+    struct sockaddr_storage addr;
+};
+
 struct SocketEvent
 {
     SocketCode code;
     SocketConnection* conn;
+
+    // SC_DATAGRAM only, datagrams are valid until next call to RunPoll().
+    SocketDatagram* datagrams;
+    int count;
 };
 
+// options the server applies to tcp sockets it listens, accepts or connects by,
+// unix domain sockets are left alone. 0 keeps the system default.
+struct SocketOptions
+{
+    SocketOptions()
+        :noDelay(true), quickAck(false), deferAccept(0), fastOpen(0), rcvBuf(0), sndBuf(0)
+    {
+    }
+
+    bool noDelay;    // TCP_NODELAY of connections, so that small responses are not delayed by Nagle.
+    bool quickAck;   // TCP_QUICKACK of connections, set once at accept or connect, it is a hint
+                     // kernel clears as it goes back to delayed ack, so only early acks are quick.
+    int  deferAccept;// TCP_DEFER_ACCEPT of listen socket, seconds to wait for data before accepting.
+    int  fastOpen;   // TCP_FASTOPEN of listen socket, max pending fast open requests.
+    int  rcvBuf;     // SO_RCVBUF of listen socket and connections.
+    int  sndBuf;     // SO_SNDBUF of listen socket and connections.
+};
+
+/*
+ * with io_uring backend, listen socket accepts by multishot accept, connected socket
+ * receives into a ring of buffers provided to kernel, and sends by queued sendmsg,
+ * operations of all sockets are submitted by one io_uring_enter() per round of polling.
+ * connecting socket, splice and udp socket are still watched by epoll, whose fd is polled
+ * by io_uring. the api works the same, except that:
+ *
+ * a) ReadBuffer() copies out data received already.
+ * b) SendBuffer() and SendVector() queue data instead of writing it, 256KB at most per connection,
+ *    size queued is returned, data goes out by next round of polling, error of sending
+ *    is returned by later calls.
+ * c) data received already is dropped by UnwatchSocket().
+ */
 class SocketServer: public noncopyable
 {
     public:
 
-        SocketServer();
+        explicit SocketServer(SocketBackend backend = SB_DEFAULT);
         ~SocketServer();
 
+        // SB_EPOLL or SB_IO_URING, the one in use.
+        SocketBackend GetBackend() const;
+
         // start server
         void StartServer();
 
         // stop server.
-        // close all sockets
-        void StopServer();
+        // close all sockets, wait up to zeroCopyWait milliseconds for zero copy sends in flight.
+        // done() of those still not complete is never called, kernel may read their buffers.
+        void StopServer(int zeroCopyWait = 0);
 
         void RunPoll(SocketEvent* evt);
 
         int ListenTo(const char* ip, int port, uintptr_t opaque = 0);
         int GetConnNumber() const;
 
-        // connect to a remote host
+        // monotonic time(micro seconds) when poller returned the events being handled.
+        int64_t GetLastPollTime() const;
+
+        // spin for events up to maxSpin micro seconds before sleeping, for latency critical
+        // deployment that has cpu to spare, see SocketPoll::SetBusyPoll(). epoll backend only.
+        // call it before polling, stats are to be read in polling thread.
+        void SetBusyPoll(int maxSpin);
+        PollStats GetPollStats() const;
+
+        // connect to a remote host, or unix domain socket as ListenTo() takes.
         SocketConnection* ConnectTo(const char* ip, int port, uintptr_t opaque = 0);
 
+        // same as ConnectTo(), but host name is resolved by resolver threads instead of
+        // blocking the polling thread. connection is returned before it is resolved,
+        // SC_CONNECTED or SC_FAIL_CONN is reported when it is done.
+        // resolved addresses are cached, return NULL if a failed lookup is cached.
+        SocketConnection* ConnectToAsync(const char* host, int port, uintptr_t opaque = 0);
+
+        // seconds to cache lookups of ConnectToAsync() for, call before connecting.
+        void SetDnsCache(int ttl, int negativeTtl);
+
+        // thread safe, can be called from any thread.
+        // data is copied and queued to the connection denoted by handle,
+        // the polling thread is woken up to write it out.
+        // return false if handle is stale or out of memory.
+        // note: don't mix with SocketConnection::SendBuffer() on the same connection.
+        bool Send(ConnHandle handle, const char* data, int sz);
+
+        // payload to be sent to many connections, copied once, shared by reference by all of
+        // them, freed when the last one is done with it. creator holds a reference to release.
+        // thread safe, return NULL if sz <= 0 or out of memory.
+        static SharedBuffer* CreateShared(const char* data, int sz);
+        static void ReleaseShared(SharedBuffer* buf);
+
+        // same as Send(), but payload is queued by reference, without copying.
+        bool SendShared(ConnHandle handle, SharedBuffer* buf);
+
+        // pub/sub, thread safe. connection closed is dropped from topics it subscribed.
+        bool Subscribe(ConnHandle handle, const char* topic);
+        bool Unsubscribe(ConnHandle handle, const char* topic);
+
+        // data is copied once and sent to each subscriber of topic by SendShared(),
+        // return number of subscribers it is queued to, -1 if out of memory.
+        int Publish(const char* topic, const char* data, int sz);
+
+        // bind a udp socket and watch it, return the fd, -1 on failure.
+        // datagrams are read by recvmmsg() in batches, each batch is reported by one SC_DATAGRAM.
+        // the socket is not read again until RunPoll() is called next, buffers of the batch
+        // are returned to pool then, they can be sent back by SendDatagrams() before that.
+        int BindUdp(const char* host, int port, uintptr_t opaque = 0);
+
+        // max datagrams read by one recvmmsg(), and buffer size of a datagram, longer one is
+        // truncated. buffers come from a pool created by first BindUdp(), call this before it.
+        void SetDatagramBatch(int batch, int size);
+
         // add the corresponding socket to be watched.
         bool WatchSocket(int fd, bool listen = false);
+
+        // pair two connected sockets, bytes read from one are moved to the other in kernel
+        // by splice() through a pipe, both ways, without being copied to user space.
+        // a direction stops reading when its pipe is full, until the receiver catches up.
+        // end of file is passed on by shutting down the write side of the receiver.
+        // events of the pair are handled by server and not reported, until both directions
+        // reach end of file or an error occurs, then SC_SPLICE_DONE is reported for each.
+        // data already read or queued by Send() must be sent before calling this.
+        // function is not thread safe, call it in polling thread.
+        bool Splice(int fd1, int fd2);
+
         bool WatchRawSocket(int fd, bool listen = false);
 
         bool UnwatchSocket(int fd);
@@ -93,6 +307,26 @@ class SocketServer: public noncopyable
         // function is not thread safe.
         void SetWatchAcceptedSock(bool watch);
 
+        // watch listen sockets with EPOLLEXCLUSIVE, for listen socket shared by
+        // multiple processes. takes effect on sockets watched afterwards.
+        void SetExclusiveAccept(bool exclusive);
+
+        // sends of threshold bytes or more by SocketConnection::SendZeroCopy() go by MSG_ZEROCOPY,
+        // 0 disables it(default). pinning pages and handling completions costs more than copying
+        // small buffers, it pays for large ones only, 64KB or so. epoll backend only.
+        void SetZeroCopy(int threshold);
+
+        // takes effect on sockets listened, accepted or connected afterwards.
+        // options of a listen socket watched by WatchSocket() are up to the caller.
+        void SetSocketOptions(const SocketOptions& opts);
+        const SocketOptions& GetSocketOptions() const;
+
+        // connections accepted by listen socket fd speak tls of ctx from now on, see
+        // SocketTls.h. it lasts as listen socket is unwatched and watched again, NULL stops it.
+        // ctx may be shared by servers of other threads, it must outlive the connections.
+        // connections of tls can't be spliced, zero copy sending copies instead.
+        void SetTlsContext(int fd, TlsContext* ctx);
+
     public:
 
         static const int max_conn_id;
@@ -102,8 +336,10 @@ class SocketServer: public noncopyable
         friend class SocketConnection;
 
         bool CloseSocket(int fd);
-        int SendBuffer(int fd, const char* buff, int sz);
-        int ReadBuffer(int fd, char* data, int sz);
+        int SendBuffer(int fd, const char* buff, int sz, bool more);
+        int SendZeroCopy(int fd, const char* buff, int sz, ZeroCopyDone done, void* arg);
+        int SendVector(int fd, const struct iovec* iov, int num);
+        int ReadBuffer(int fd, char* data, int sz, bool rearm);
 
         ServerImpl* impl_;
 };
@@ -0,0 +1,368 @@
+#include "SocketTls.h"
+
+#include "sys/Log.h"
+#include "sys/AtomicOps.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <openssl/err.h>
+
+// defaults of openssl.
+#define TLS_SESSION_CACHE_SIZE (20*1024)
+#define TLS_SESSION_TIMEOUT (300)
+
+#define TLS_TICKET_KEY_LEN (80)
+
+static const unsigned char TLS_SESSION_ID_CONTEXT[] = "socket-server";
+
+// socket bio of openssl, but records are sent by send(MSG_NOSIGNAL), not write(),
+// so that a peer gone doesn't raise SIGPIPE. ctrl, kTLS included, is the original's.
+static BIO_METHOD* gs_sock_method = NULL;
+static pthread_once_t gs_sock_once = PTHREAD_ONCE_INIT;
+static int (* gs_sock_write)(BIO*, const char*, int) = NULL;
+
+// records of kTLS go by sendmsg() of openssl, SIGPIPE is held back around it.
+static int KtlsSockWrite(BIO* bio, const char* data, int len)
+{
+    sigset_t pipe, old;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, &old);
+
+    int n = gs_sock_write(bio, data, len);
+    int err = errno;
+
+    // signal raised by it is taken, one pending before is left to the thread.
+    if (n < 0 && err == EPIPE && !sigismember(&old, SIGPIPE))
+    {
+        struct timespec zero = { 0, 0 };
+        sigtimedwait(&pipe, NULL, &zero);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    errno = err;
+    return n;
+}
+
+static int SockWrite(BIO* bio, const char* data, int len)
+{
+    if (BIO_get_ktls_send(bio)) return KtlsSockWrite(bio, data, len);
+
+    errno = 0;
+    int n = (int)send(BIO_get_fd(bio, NULL), data, len, MSG_NOSIGNAL);
+
+    BIO_clear_retry_flags(bio);
+    if (n <= 0 && BIO_sock_should_retry(n)) BIO_set_retry_write(bio);
+
+    return n;
+}
+
+static void InitSockMethod()
+{
+    const BIO_METHOD* sock = BIO_s_socket();
+
+    BIO_METHOD* method = BIO_meth_new(BIO_TYPE_SOCKET, "socket without SIGPIPE");
+    if (method == NULL) return;
+
+    gs_sock_write = BIO_meth_get_write(sock);
+
+    BIO_meth_set_write(method, &SockWrite);
+    BIO_meth_set_read(method, BIO_meth_get_read(sock));
+    BIO_meth_set_puts(method, BIO_meth_get_puts(sock));
+    BIO_meth_set_ctrl(method, BIO_meth_get_ctrl(sock));
+    BIO_meth_set_create(method, BIO_meth_get_create(sock));
+    BIO_meth_set_destroy(method, BIO_meth_get_destroy(sock));
+
+    gs_sock_method = method;
+}
+
+static void LogTlsError(const char* what, int fd)
+{
+    char buf[256];
+    unsigned long err = ERR_get_error();
+
+    ERR_error_string_n(err, buf, sizeof(buf));
+    slog(LOG_WARN, "tls: %s failed, fd(%d), error:%s", what, fd, err? buf : strerror(errno));
+
+    ERR_clear_error();
+}
+
+TlsContext::TlsContext()
+    :ctx_(SSL_CTX_new(TLS_server_method()))
+    ,handshakes_(0)
+    ,resumed_(0)
+    ,failures_(0)
+    ,ktlsSend_(0)
+{
+    pthread_once(&gs_sock_once, &InitSockMethod);
+
+    if (ctx_ == NULL)
+    {
+        slog(LOG_ERROR, "tls: failed to create context");
+        return;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx_, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+    // write is retried by the caller with the data it is left with, buffers of idle
+    // connections are given back.
+    SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+            | SSL_MODE_RELEASE_BUFFERS);
+
+    SSL_CTX_set_session_id_context(ctx_, TLS_SESSION_ID_CONTEXT, sizeof(TLS_SESSION_ID_CONTEXT) - 1);
+    SetSessionCache(TLS_SESSION_CACHE_SIZE, TLS_SESSION_TIMEOUT);
+    SetKtls(true);
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_free(ctx_);
+}
+
+bool TlsContext::LoadCertificate(const char* certFile, const char* keyFile)
+{
+    if (ctx_ == NULL) return false;
+
+    if (SSL_CTX_use_certificate_chain_file(ctx_, certFile) != 1
+            || SSL_CTX_use_PrivateKey_file(ctx_, keyFile, SSL_FILETYPE_PEM) != 1
+            || SSL_CTX_check_private_key(ctx_) != 1)
+    {
+        LogTlsError("loading certificate", -1);
+        return false;
+    }
+
+    return true;
+}
+
+void TlsContext::SetSessionCache(int size, int timeout)
+{
+    if (ctx_ == NULL) return;
+
+    SSL_CTX_set_session_cache_mode(ctx_, size > 0? SSL_SESS_CACHE_SERVER : SSL_SESS_CACHE_OFF);
+    SSL_CTX_sess_set_cache_size(ctx_, size);
+    SSL_CTX_set_timeout(ctx_, timeout);
+}
+
+bool TlsContext::SetTicketKey(const unsigned char* key, int len)
+{
+    if (ctx_ == NULL || len != TLS_TICKET_KEY_LEN) return false;
+
+    return SSL_CTX_set_tlsext_ticket_keys(ctx_, (void*)key, len) == 1;
+}
+
+bool TlsContext::SetAlpn(const char* protos)
+{
+    std::string wire;
+
+    while (*protos)
+    {
+        const char* end = strchr(protos, ',');
+        if (end == NULL) end = protos + strlen(protos);
+
+        size_t len = end - protos;
+        if (len == 0 || len > 255) return false;
+
+        wire.push_back((char)len);
+        wire.append(protos, len);
+
+        protos = *end? end + 1 : end;
+    }
+
+    alpn_ = wire;
+
+    if (ctx_) SSL_CTX_set_alpn_select_cb(ctx_, alpn_.empty()? NULL : &TlsContext::SelectAlpn, this);
+
+    return true;
+}
+
+// first protocol of ours that client offers, none is selected if they have nothing in common.
+int TlsContext::SelectAlpn(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+        const unsigned char* in, unsigned int inlen, void* arg)
+{
+    (void)ssl;
+
+    TlsContext* ctx = (TlsContext*)arg;
+
+    unsigned char* selected = NULL;
+    int ret = SSL_select_next_proto(&selected, outlen, (const unsigned char*)ctx->alpn_.data(),
+            ctx->alpn_.size(), in, inlen);
+
+    if (ret != OPENSSL_NPN_NEGOTIATED) return SSL_TLSEXT_ERR_NOACK;
+
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+void TlsContext::SetKtls(bool enable)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+    if (ctx_ == NULL) return;
+
+    if (enable) SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+    else SSL_CTX_clear_options(ctx_, SSL_OP_ENABLE_KTLS);
+#endif
+}
+
+TlsStats TlsContext::GetStats() const
+{
+    TlsStats stats;
+
+    stats.handshakes = handshakes_;
+    stats.resumed = resumed_;
+    stats.failures = failures_;
+    stats.ktlsSend = ktlsSend_;
+
+    return stats;
+}
+
+SocketTls::SocketTls()
+    :ready_(false)
+    ,ssl_(NULL)
+    ,ctx_(NULL)
+    ,established_(false)
+    ,failed_(false)
+    ,ktlsSend_(false)
+    ,wantWrite_(false)
+{
+}
+
+SocketTls::~SocketTls()
+{
+    if (ssl_) SSL_free(ssl_);
+}
+
+bool SocketTls::Init(TlsContext* ctx, int fd)
+{
+    if (ctx->ctx_ == NULL || gs_sock_method == NULL) return false;
+
+    ssl_ = SSL_new(ctx->ctx_);
+
+    BIO* bio = ssl_? BIO_new(gs_sock_method) : NULL;
+    if (bio == NULL)
+    {
+        LogTlsError("creating connection", fd);
+        return false;
+    }
+
+    // fd is closed by server, not by bio.
+    BIO_set_fd(bio, fd, BIO_NOCLOSE);
+    SSL_set_bio(ssl_, bio, bio);
+
+    ctx_ = ctx;
+    SSL_set_accept_state(ssl_);
+
+    return true;
+}
+
+int SocketTls::Handshake()
+{
+    if (established_) return 1;
+    if (failed_) return -1;
+
+    int ret = SSL_do_handshake(ssl_);
+
+    if (ret == 1)
+    {
+        established_ = true;
+        wantWrite_ = false;
+
+        atomic_increment(&ctx_->handshakes_);
+        if (SSL_session_reused(ssl_)) atomic_increment(&ctx_->resumed_);
+
+#ifdef SSL_OP_ENABLE_KTLS
+        ktlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        if (ktlsSend_) atomic_increment(&ctx_->ktlsSend_);
+#endif
+
+        return 1;
+    }
+
+    int err = SSL_get_error(ssl_, ret);
+
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+    {
+        wantWrite_ = (err == SSL_ERROR_WANT_WRITE);
+        return 0;
+    }
+
+    // peer gone, or speaking something else.
+    failed_ = true;
+    atomic_increment(&ctx_->failures_);
+
+    LogTlsError("handshake", SSL_get_fd(ssl_));
+    return -1;
+}
+
+int SocketTls::Read(char* buffer, int sz)
+{
+    if (!established_ || failed_) return failed_? -1 : 0;
+
+    int total = 0;
+    wantWrite_ = false;
+
+    while (total < sz)
+    {
+        int n = SSL_read(ssl_, buffer + total, sz - total);
+
+        if (n > 0)
+        {
+            total += n;
+            continue;
+        }
+
+        int err = SSL_get_error(ssl_, n);
+
+        if (err == SSL_ERROR_WANT_READ) break;
+
+        if (err == SSL_ERROR_WANT_WRITE)
+        {
+            wantWrite_ = true;
+            break;
+        }
+
+        // close_notify, or connection broken, data read before is taken first.
+        failed_ = true;
+
+        if (err != SSL_ERROR_ZERO_RETURN && err != SSL_ERROR_SYSCALL) LogTlsError("reading", SSL_get_fd(ssl_));
+
+        ERR_clear_error();
+        return total > 0? total : -1;
+    }
+
+    return total;
+}
+
+int SocketTls::Write(const char* buffer, int sz)
+{
+    if (failed_) return -1;
+    if (!established_ || sz <= 0) return 0;
+
+    int n = SSL_write(ssl_, buffer, sz);
+    if (n > 0) return n;
+
+    int err = SSL_get_error(ssl_, n);
+
+    // record being sent is kept by openssl, the same data is to be written again.
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) return 0;
+
+    failed_ = true;
+
+    if (err != SSL_ERROR_SYSCALL) LogTlsError("writing", SSL_get_fd(ssl_));
+
+    ERR_clear_error();
+    return -1;
+}
+
+void SocketTls::Shutdown()
+{
+    if (ssl_ == NULL || !established_ || failed_) return;
+
+    // one try, peer's close_notify is not waited for.
+    SSL_shutdown(ssl_);
+    ERR_clear_error();
+}
@@ -0,0 +1,128 @@
+#ifndef __SOCKET_TLS_H__
+#define __SOCKET_TLS_H__
+
+#include "misc/NonCopyable.h"
+
+#include <string>
+#include <stdint.h>
+#include <openssl/ssl.h>
+
+/*
+ * tls of connections accepted by SocketServer(openssl), see SocketServer::SetTlsContext().
+ *
+ * a) handshake is driven by server as the socket turns readable or writable, connection
+ *    is reported readable once it is done, or it fails, ReadBuffer() returns -1 then.
+ * b) ReadBuffer() and SendBuffer() take and give plain data, SendBuffer() before handshake
+ *    is done returns 0, as if socket buffer was full.
+ * c) sessions are resumed by session id from cache of the context, or by ticket encrypted
+ *    by key of the context, a context shared by threads shares both.
+ * d) kernel tls(kTLS) takes over encryption of sending once handshake is done, when kernel
+ *    and openssl support it, data goes by send(), splice() or sendfile() as it does in plain
+ *    text then. receiving goes through openssl anyway, which reads control messages too.
+ * e) tls connection is watched by epoll even with io_uring backend, as splice is, openssl
+ *    reads and writes the socket itself.
+ * f) openssl writes socket through a bio sending with MSG_NOSIGNAL, SIGPIPE is left as
+ *    it is set by the application.
+ */
+
+// counters of handshakes, accumulated over connections of all servers sharing the context.
+struct TlsStats
+{
+    int64_t handshakes; // handshakes done
+    int64_t resumed;    // handshakes that resumed a session, by id or ticket
+    int64_t failures;   // handshakes failed
+    int64_t ktlsSend;   // connections whose sending is offloaded to kernel
+};
+
+class TlsContext: public noncopyable
+{
+    public:
+
+        TlsContext();
+        ~TlsContext();
+
+        // certificate chain and private key in pem files, return false on failure.
+        bool LoadCertificate(const char* certFile, const char* keyFile);
+
+        // max sessions cached and seconds they are good for, 0 size disables the cache.
+        void SetSessionCache(int size, int timeout);
+
+        // key of session tickets, 80 bytes(name, hmac and aes keys), random by default.
+        // workers of the same key resume sessions of each other, rotate it to expire tickets.
+        bool SetTicketKey(const unsigned char* key, int len);
+
+        // protocols of ALPN, comma separated in order of preference, eg, "h2,http/1.1".
+        // http/2 connection starts by its preface, which HttpClient takes as prior knowledge.
+        bool SetAlpn(const char* protos);
+
+        // kernel tls, enabled by default, it is not used where it is not supported anyway.
+        void SetKtls(bool enable);
+
+        TlsStats GetStats() const;
+
+        SSL_CTX* GetContext() const { return ctx_; }
+
+    private:
+
+        friend struct SocketTls;
+
+        static int SelectAlpn(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+                const unsigned char* in, unsigned int inlen, void* arg);
+
+        SSL_CTX* ctx_;
+
+        // wire format of ALPN, protocols prefixed by length.
+        std::string alpn_;
+
+        volatile int64_t handshakes_;
+        volatile int64_t resumed_;
+        volatile int64_t failures_;
+        volatile int64_t ktlsSend_;
+};
+
+// tls state of a connection, owned by server.
+struct SocketTls
+{
+    public:
+
+        SocketTls();
+        ~SocketTls();
+
+        bool Init(TlsContext* ctx, int fd);
+
+        // return 1 if done, 0 if it goes on, WantWrite() tells what to wait for, -1 on failure.
+        int Handshake();
+
+        // plain data, return bytes taken, 0 if it would block, -1 on error or close of peer.
+        // reading goes on until sz bytes are read or socket is drained, as read() does.
+        int Read(char* buffer, int sz);
+        int Write(const char* buffer, int sz);
+
+        // close_notify is sent if it fits in socket buffer, socket is left to caller.
+        void Shutdown();
+
+        bool IsEstablished() const { return established_; }
+        bool IsFailed() const { return failed_; }
+        bool IsKtlsSend() const { return ktlsSend_; }
+        bool WantWrite() const { return wantWrite_; }
+
+        // plain data decrypted already, not to be told by polling socket.
+        bool HasPending() const { return ssl_ && SSL_pending(ssl_) > 0; }
+
+    public:
+
+        // queued to be reported readable for pending data.
+        bool ready_;
+
+    private:
+
+        SSL* ssl_;
+        TlsContext* ctx_;
+
+        bool established_;
+        bool failed_;
+        bool ktlsSend_;
+        bool wantWrite_;
+};
+
+#endif // __SOCKET_TLS_H__
@@ -0,0 +1,454 @@
+#include "UringPoll.h"
+
+#include "sys/Log.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// multishot accept and provided buffer ring come with the same kernel, 5.19.
+#if defined(IORING_ACCEPT_MULTISHOT) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING 1
+#endif
+
+// how long closing a ring waits for kernel to let go of the thread that used it.
+#define URING_EXIT_WAIT (100)
+
+UringPoll::UringPoll()
+    :ringFd_(-1)
+    ,sqRing_(MAP_FAILED)
+    ,cqRing_(MAP_FAILED)
+    ,sqRingSize_(0)
+    ,cqRingSize_(0)
+    ,sqes_(NULL)
+    ,sqesSize_(0)
+    ,sqHead_(NULL)
+    ,sqTail_(NULL)
+    ,sqArray_(NULL)
+    ,sqMask_(0)
+    ,sqEntries_(0)
+    ,sqeTail_(0)
+    ,inflight_(0)
+    ,submitted_(false)
+    ,cqHead_(NULL)
+    ,cqTail_(NULL)
+    ,cqMask_(0)
+    ,cqes_(NULL)
+    ,bufRing_(NULL)
+    ,bufRingSize_(0)
+    ,bufferNum_(0)
+    ,bufferSize_(0)
+    ,bufTail_(0)
+    ,buffers_(NULL)
+{
+}
+
+UringPoll::~UringPoll()
+{
+    Drain();
+    Release();
+}
+
+#ifdef HAVE_IO_URING
+
+static int SysSetup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int SysEnter(int fd, unsigned submit, unsigned complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+
+static int SysRegister(int fd, unsigned op, void* arg, unsigned num)
+{
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, num);
+}
+
+bool UringPoll::Init(unsigned entries, unsigned bufferNum, unsigned bufferSize)
+{
+    // buffer ring takes power of 2 entries.
+    if (bufferNum == 0 || (bufferNum & (bufferNum - 1)) || bufferNum > 32768) return false;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    params.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+#ifdef IORING_SETUP_COOP_TASKRUN
+    // completions are processed when polling thread enters kernel, not by interrupting it.
+    params.flags |= IORING_SETUP_COOP_TASKRUN;
+#endif
+
+    ringFd_ = SysSetup(entries, &params);
+    if (ringFd_ < 0)
+    {
+        slog(LOG_INFO, "uring: io_uring is not available, error:%s", strerror(errno));
+        return false;
+    }
+
+    const unsigned features = IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_FAST_POLL;
+    if ((params.features & features) != features)
+    {
+        slog(LOG_INFO, "uring: kernel lacks features needed:%x", params.features);
+        Release();
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (cqRingSize_ > sqRingSize_) sqRingSize_ = cqRingSize_;
+        cqRingSize_ = 0;
+    }
+
+    sqRing_ = mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        Release();
+        return false;
+    }
+
+    if (cqRingSize_)
+    {
+        cqRing_ = mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            Release();
+            return false;
+        }
+    }
+
+    char* sq = (char*)sqRing_;
+    char* cq = cqRingSize_? (char*)cqRing_ : sq;
+
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        Release();
+        return false;
+    }
+
+    sqes_ = (struct io_uring_sqe*)sqes;
+
+    sqHead_ = (unsigned*)(sq + params.sq_off.head);
+    sqTail_ = (unsigned*)(sq + params.sq_off.tail);
+    sqArray_ = (unsigned*)(sq + params.sq_off.array);
+    sqMask_ = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqeTail_ = *sqTail_;
+
+    cqHead_ = (unsigned*)(cq + params.cq_off.head);
+    cqTail_ = (unsigned*)(cq + params.cq_off.tail);
+    cqMask_ = *(unsigned*)(cq + params.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    bufRingSize_ = bufferNum * sizeof(struct io_uring_buf);
+    void* ring = mmap(NULL, bufRingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        Release();
+        return false;
+    }
+
+    bufRing_ = (struct io_uring_buf_ring*)ring;
+    bufferNum_ = bufferNum;
+    bufferSize_ = bufferSize;
+
+    buffers_ = (char*)mmap(NULL, (size_t)bufferNum * bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers_ == MAP_FAILED)
+    {
+        buffers_ = NULL;
+        Release();
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+
+    reg.ring_addr = (uintptr_t)bufRing_;
+    reg.ring_entries = bufferNum;
+    reg.bgid = 0;
+
+    if (SysRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        slog(LOG_INFO, "uring: provided buffer ring is not supported, error:%s", strerror(errno));
+        Release();
+        return false;
+    }
+
+    for (unsigned i = 0; i < bufferNum; ++i) RecycleBuffer(i);
+
+    return true;
+}
+
+void UringPoll::Release()
+{
+    // kernel drops the thread that submitted to a closed ring from it by a task work, which
+    // interrupts the next blocking call of the thread with EINTR, wait for it here instead.
+    int exit = -1;
+    if (ringFd_ >= 0 && submitted_ && pthread_equal(owner_, pthread_self())) exit = epoll_create1(EPOLL_CLOEXEC);
+
+    if (buffers_) munmap(buffers_, (size_t)bufferNum_ * bufferSize_);
+    if (bufRing_) munmap(bufRing_, bufRingSize_);
+    if (sqes_) munmap(sqes_, sqesSize_);
+    if (cqRing_ != MAP_FAILED) munmap(cqRing_, cqRingSize_);
+    if (sqRing_ != MAP_FAILED) munmap(sqRing_, sqRingSize_);
+    if (ringFd_ >= 0) close(ringFd_);
+
+    buffers_ = NULL;
+    bufRing_ = NULL;
+    sqes_ = NULL;
+    cqRing_ = MAP_FAILED;
+    sqRing_ = MAP_FAILED;
+    ringFd_ = -1;
+    submitted_ = false;
+
+    if (exit >= 0)
+    {
+        struct epoll_event event;
+        epoll_wait(exit, &event, 1, URING_EXIT_WAIT);
+        close(exit);
+    }
+}
+
+struct io_uring_sqe* UringPoll::GetSqe()
+{
+    // submission ring is full, hand what is queued to kernel first.
+    if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+    {
+        Submit(false);
+
+        if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+        {
+            slog(LOG_ERROR, "uring: submission ring is full");
+            return NULL;
+        }
+    }
+
+    unsigned index = sqeTail_ & sqMask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++sqeTail_;
+    ++inflight_;
+
+    return sqe;
+}
+
+int UringPoll::Submit(bool wait)
+{
+    unsigned submit = sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+
+    // completions are there already, no need to wait.
+    if (wait && __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) != *cqHead_) wait = false;
+
+    if (submit == 0 && !wait) return 0;
+
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+
+    if (submit > 0)
+    {
+        owner_ = pthread_self();
+        submitted_ = true;
+    }
+
+    int ret = SysEnter(ringFd_, submit, wait? 1 : 0, wait? IORING_ENTER_GETEVENTS : 0);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+        slog(LOG_ERROR, "uring: io_uring_enter failed, error:%s", strerror(errno));
+    }
+
+    return ret;
+}
+
+bool UringPoll::PollAdd(int fd, uint64_t data, bool read, bool write)
+{
+    struct io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL) return false;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = (read? POLLIN : 0) | (write? POLLOUT : 0);
+    sqe->user_data = data;
+
+    return true;
+}
+
+bool UringPoll::Accept(int fd, uint64_t data)
+{
+    struct io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL) return false;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = data;
+
+    return true;
+}
+
+bool UringPoll::Recv(int fd, uint64_t data)
+{
+    struct io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL) return false;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = bufferSize_;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = data;
+
+    return true;
+}
+
+bool UringPoll::SendMsg(int fd, uint64_t data, const struct msghdr* msg)
+{
+    struct io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL) return false;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = data;
+
+    return true;
+}
+
+bool UringPoll::Cancel(uint64_t data)
+{
+    struct io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL) return false;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->user_data = 0;
+
+    return true;
+}
+
+int UringPoll::Wait(UringEvent* events, int max, bool wait)
+{
+    // completions are reaped even if submitting fails, that is what a full ring needs.
+    Submit(wait);
+
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+
+    int num = 0;
+    while (head != tail && num < max)
+    {
+        const struct io_uring_cqe* cqe = &cqes_[head & cqMask_];
+
+        events[num].data = cqe->user_data;
+        events[num].result = cqe->res;
+        events[num].flags = cqe->flags;
+
+        if ((cqe->flags & IORING_CQE_F_MORE) == 0) --inflight_;
+
+        ++num;
+        ++head;
+    }
+
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+
+    return num;
+}
+
+// operations in flight are cancelled and reaped before the ring is closed, kernel
+// finishes them in this thread then, rather than interrupting the thread that
+// submitted them some time later.
+void UringPoll::Drain()
+{
+    if (ringFd_ < 0 || inflight_ == 0) return;
+
+    struct io_uring_sqe* sqe = GetSqe();
+    if (sqe)
+    {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = 0;
+    }
+
+    UringEvent events[64];
+    int idle = 0;
+
+    // give up if kernel keeps failing to make progress.
+    while (inflight_ > 0 && idle < 3)
+    {
+        if (Wait(events, 64, true) > 0) idle = 0;
+        else ++idle;
+    }
+}
+
+bool UringPoll::HasBuffer(unsigned flags)
+{
+    return (flags & IORING_CQE_F_BUFFER) != 0;
+}
+
+int UringPoll::GetBufferId(unsigned flags)
+{
+    return (int)(flags >> IORING_CQE_BUFFER_SHIFT);
+}
+
+bool UringPoll::HasMore(unsigned flags)
+{
+    return (flags & IORING_CQE_F_MORE) != 0;
+}
+
+void UringPoll::RecycleBuffer(int bid)
+{
+    // entries start at the head of the ring, tail overlays reserved field of the first one.
+    // bufs of the kernel header is off by the empty struct in it when compiled as c++.
+    struct io_uring_buf* buf = (struct io_uring_buf*)bufRing_ + (bufTail_ & (bufferNum_ - 1));
+
+    buf->addr = (uintptr_t)GetBuffer(bid);
+    buf->len = bufferSize_;
+    buf->bid = (uint16_t)bid;
+
+    ++bufTail_;
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+}
+
+#else
+
+// headers of kernel are too old, always fall back to epoll.
+bool UringPoll::Init(unsigned, unsigned, unsigned) { return false; }
+void UringPoll::Drain() {}
+void UringPoll::Release() {}
+bool UringPoll::PollAdd(int, uint64_t, bool, bool) { return false; }
+bool UringPoll::Accept(int, uint64_t) { return false; }
+bool UringPoll::Recv(int, uint64_t) { return false; }
+bool UringPoll::SendMsg(int, uint64_t, const struct msghdr*) { return false; }
+bool UringPoll::Cancel(uint64_t) { return false; }
+int  UringPoll::Wait(UringEvent*, int, bool) { return -1; }
+bool UringPoll::HasBuffer(unsigned) { return false; }
+int  UringPoll::GetBufferId(unsigned) { return -1; }
+bool UringPoll::HasMore(unsigned) { return false; }
+void UringPoll::RecycleBuffer(int) {}
+
+#endif
+
@@ -0,0 +1,126 @@
+#ifndef __URING_POLL_H__
+#define __URING_POLL_H__
+
+#include "misc/NonCopyable.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+// completion of an operation, data is what the operation is queued with.
+struct UringEvent
+{
+    uint64_t data;
+    int result;
+    unsigned flags;
+};
+
+/*
+ * minimal io_uring wrapper by raw system calls, no liburing needed.
+ *
+ * a) operations are queued to submission ring only, they are submitted altogether
+ *    by next Wait(), so that a round of polling costs one io_uring_enter().
+ * b) Recv() takes a buffer from a ring of buffers provided by this class when data
+ *    arrives, the buffer is returned by RecycleBuffer() after it is consumed.
+ * c) not thread safe, one thread owns the ring.
+ * d) destroying it takes a few milliseconds if the owner does it, kernel is waited for to let go
+ *    of the thread, rather than the thread's next blocking call failing with EINTR.
+ */
+class UringPoll: public noncopyable
+{
+    public:
+
+        UringPoll();
+        ~UringPoll();
+
+        // return false if kernel lacks any feature needed(linux 5.19 or later),
+        // the object is not usable then.
+        bool Init(unsigned entries, unsigned bufferNum, unsigned bufferSize);
+
+        // one shot poll.
+        bool PollAdd(int fd, uint64_t data, bool read, bool write);
+
+        // multishot accept, accepted socket is nonblocking.
+        bool Accept(int fd, uint64_t data);
+
+        // receive into a provided buffer.
+        bool Recv(int fd, uint64_t data);
+
+        // msg must be valid until submitted, buffers it refers to until completed.
+        bool SendMsg(int fd, uint64_t data, const struct msghdr* msg);
+
+        // cancel operation queued with data, completion of the cancel itself has data of 0.
+        bool Cancel(uint64_t data);
+
+        // submit queued operations now, without waiting.
+        int Submit() { return Submit(false); }
+
+        // some operations are queued but not submitted yet.
+        bool HasQueued() const { return sqeTail_ != *sqTail_; }
+
+        // submit queued operations, and retrieve completions.
+        // wait for at least one completion if wait is set.
+        int Wait(UringEvent* events, int max, bool wait = true);
+
+        // buffer of a completed Recv(), told by flags of the completion.
+        static bool HasBuffer(unsigned flags);
+        static int  GetBufferId(unsigned flags);
+
+        // more completions will come for the same multishot operation.
+        static bool HasMore(unsigned flags);
+
+        char* GetBuffer(int bid) const { return buffers_ + (size_t)bid * bufferSize_; }
+        void  RecycleBuffer(int bid);
+
+    private:
+
+        struct io_uring_sqe* GetSqe();
+        int  Submit(bool wait);
+        void Drain();
+        void Release();
+
+        int ringFd_;
+
+        void* sqRing_;
+        void* cqRing_;
+        size_t sqRingSize_;
+        size_t cqRingSize_;
+
+        struct io_uring_sqe* sqes_;
+        size_t sqesSize_;
+
+        unsigned* sqHead_;
+        unsigned* sqTail_;
+        unsigned* sqArray_;
+        unsigned sqMask_;
+        unsigned sqEntries_;
+
+        // tail of entries queued, not visible to kernel until submitting.
+        unsigned sqeTail_;
+
+        // operations whose last completion is not reaped yet.
+        unsigned inflight_;
+
+        // thread that submitted last, waited for by Release().
+        bool submitted_;
+        pthread_t owner_;
+
+        unsigned* cqHead_;
+        unsigned* cqTail_;
+        unsigned cqMask_;
+        struct io_uring_cqe* cqes_;
+
+        struct io_uring_buf_ring* bufRing_;
+        size_t bufRingSize_;
+        unsigned bufferNum_;
+        unsigned bufferSize_;
+        uint16_t bufTail_;
+        char* buffers_;
+};
+
+#endif
+
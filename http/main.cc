@@ -1,28 +1,86 @@
 #include "HttpServer.h"
+#include "HttpProxy.h"
 
 #include "sys/Log.h"
 
+#include <string.h>
 #include <unistd.h>
 #include <iostream>
 using namespace std;
 
-static void WorkerProc(int fd)
+// upstreams: comma separated host:port list.
+static void ProxyProc(int fd, AcceptStrategy strategy, const char* upstreams)
+{
+    HttpProxy* proxy = new HttpProxy();
+
+    string list = upstreams;
+    size_t start = 0;
+
+    while (start < list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == string::npos) end = list.size();
+
+        string item = list.substr(start, end - start);
+        size_t colon = item.rfind(':');
+
+        if (colon != string::npos)
+        {
+            proxy->AddUpstream(item.substr(0, colon).c_str(), atoi(item.c_str() + colon + 1));
+        }
+
+        start = end + 1;
+    }
+
+    proxy->SetExclusiveAccept(strategy == AS_EXCLUSIVE);
+    proxy->SetListenSock(fd);
+    proxy->RunServer();
+
+    delete proxy;
+}
+
+static void WorkerProc(const char* addr, int port, int fd, AcceptStrategy strategy, const char* upstreams)
 {
     InitLogger();
 
+    // each worker owns a listen socket bound to the same address.
+    if (strategy == AS_REUSEPORT) fd = ListenTo(addr, port, true);
+
+    if (fd < 0)
+    {
+        cout << "worker failed to listen to " << addr << ":" << port << endl;
+        return;
+    }
+
+    if (upstreams)
+    {
+        ProxyProc(fd, strategy, upstreams);
+        return;
+    }
+
     HttpServer* server = new HttpServer();
 
+    server->SetAcceptStrategy(strategy);
     server->SetListenSock(fd);
     server->RunServer();
 
     delete server;
 }
 
+static AcceptStrategy ParseAcceptStrategy(const char* name)
+{
+    if (strcmp(name, "exclusive") == 0) return AS_EXCLUSIVE;
+    if (strcmp(name, "reuseport") == 0) return AS_REUSEPORT;
+
+    return AS_SHARED;
+}
+
 int main(int argc, char* argv[])
 {
     if (argc <= 1)
     {
         cout << "Please specify addr to listen to" << endl;
+        cout << "usage: " << argv[0] << " addr [port] [log level] [shared|exclusive|reuseport] [upstream host:port,...]" << endl;
         return 0;
     }
 
@@ -34,12 +92,28 @@ int main(int argc, char* argv[])
 
     if (argc >= 4) SetLogLevel(atoi(argv[3]));
 
-    int fd = ListenTo(addr, port);
+    AcceptStrategy strategy = AS_SHARED;
 
-    if (fd < 0)
+    if (argc >= 5) strategy = ParseAcceptStrategy(argv[4]);
+
+    // run as reverse proxy if upstreams are given.
+    const char* upstreams = NULL;
+
+    if (argc >= 6) upstreams = argv[5];
+
+    int fd = -1;
+
+    // with SO_REUSEPORT, a listen socket nobody accepts from would steal connections,
+    // let every worker create its own.
+    if (strategy != AS_REUSEPORT)
     {
-        cout << "failed to listen to " << addr << ":" << port << endl;
-        return 0;
+        fd = ListenTo(addr, port);
+
+        if (fd < 0)
+        {
+            cout << "failed to listen to " << addr << ":" << port << endl;
+            return 0;
+        }
     }
 
     int i = 0;
@@ -53,10 +127,9 @@ int main(int argc, char* argv[])
         ++i;
     }
 
-    if (i < num) WorkerProc(fd);
+    if (i < num) WorkerProc(addr, port, fd, strategy, upstreams);
 
     char c;
     cin >> c;
     return 0;
 }
-
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "http/DnsResolver.h"
+
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <netinet/in.h>
+
+static void PostDone(DnsQuery* query)
+{
+    sem_post((sem_t*)query->arg_);
+}
+
+static void ResolveAndWait(DnsResolver& resolver, DnsQuery& query, const char* host)
+{
+    sem_t sem;
+    sem_init(&sem, 0, 0);
+
+    query.host_ = host;
+    query.done_ = &PostDone;
+    query.arg_ = &sem;
+
+    resolver.Resolve(&query);
+
+    sem_wait(&sem);
+    sem_destroy(&sem);
+}
+
+TEST(DnsResolverTest, CacheTest)
+{
+    DnsResolver resolver(2, 60, 60);
+
+    DnsQuery query;
+    ResolveAndWait(resolver, query, "localhost");
+
+    ASSERT_EQ(0, query.error_);
+    ASSERT_LT(0u, query.addrs_.size());
+    EXPECT_EQ(1, resolver.GetLookups());
+
+    bool loopback = false;
+    for (size_t i = 0; i < query.addrs_.size(); ++i)
+    {
+        const DnsAddress& addr = query.addrs_[i];
+
+        if (addr.family_ != AF_INET) continue;
+
+        const struct sockaddr_in* v4 = (const struct sockaddr_in*)&addr.addr_;
+        loopback = loopback || v4->sin_addr.s_addr == htonl(INADDR_LOOPBACK);
+    }
+
+    EXPECT_TRUE(loopback);
+
+    // answered from cache, in calling thread.
+    DnsQuery cached;
+    ResolveAndWait(resolver, cached, "localhost");
+
+    EXPECT_EQ(0, cached.error_);
+    EXPECT_EQ(query.addrs_.size(), cached.addrs_.size());
+    EXPECT_EQ(1, resolver.GetLookups());
+
+    std::vector<DnsAddress> addrs;
+    EXPECT_EQ(1, resolver.Lookup("localhost", addrs));
+    EXPECT_EQ(query.addrs_.size(), addrs.size());
+
+    // failure is cached too.
+    DnsQuery fail;
+    ResolveAndWait(resolver, fail, "no-such-host.invalid");
+
+    EXPECT_NE(0, fail.error_);
+    EXPECT_EQ(0u, fail.addrs_.size());
+
+    int error = 0;
+    EXPECT_EQ(-1, resolver.Lookup("no-such-host.invalid", addrs, &error));
+    EXPECT_EQ(fail.error_, error);
+    EXPECT_EQ(2, resolver.GetLookups());
+    EXPECT_EQ(2, resolver.GetCacheSize());
+
+    resolver.Clear();
+    EXPECT_EQ(0, resolver.Lookup("localhost", addrs));
+}
+
+TEST(DnsResolverTest, ExpireTest)
+{
+    DnsResolver resolver(1, 1, 1);
+
+    DnsQuery query;
+    ResolveAndWait(resolver, query, "localhost");
+    ASSERT_EQ(0, query.error_);
+
+    std::vector<DnsAddress> addrs;
+    EXPECT_EQ(1, resolver.Lookup("localhost", addrs));
+
+    usleep(1100*1000);
+
+    EXPECT_EQ(0, resolver.Lookup("localhost", addrs));
+
+    ResolveAndWait(resolver, query, "localhost");
+    EXPECT_EQ(0, query.error_);
+    EXPECT_EQ(2, resolver.GetLookups());
+}
+
+// queries are done when resolver is destroyed.
+TEST(DnsResolverTest, ManyQueriesTest)
+{
+    const int num = 64;
+
+    sem_t sem;
+    sem_init(&sem, 0, 0);
+
+    std::vector<DnsQuery> queries(num);
+
+    {
+        DnsResolver resolver(4, 60, 60);
+
+        for (int i = 0; i < num; ++i)
+        {
+            queries[i].host_ = (i % 2)? "localhost" : "no-such-host.invalid";
+            queries[i].done_ = &PostDone;
+            queries[i].arg_ = &sem;
+
+            resolver.Resolve(&queries[i]);
+        }
+
+        for (int i = 0; i < num; ++i) sem_wait(&sem);
+
+        // concurrent queries of a host share lookups.
+        EXPECT_GE(num, resolver.GetLookups());
+        EXPECT_LE(2, resolver.GetLookups());
+    }
+
+    for (int i = 0; i < num; ++i)
+    {
+        if (i % 2) EXPECT_EQ(0, queries[i].error_);
+        else EXPECT_NE(0, queries[i].error_);
+    }
+
+    sem_destroy(&sem);
+}
@@ -0,0 +1,598 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpArena.h"
+#include "http/Http2Session.h"
+
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+struct Frame
+{
+    int type_;
+    int flags_;
+    uint32_t id_;
+    std::string payload_;
+};
+
+static std::string MakeFrame(int type, int flags, uint32_t id, const std::string& payload)
+{
+    std::string out;
+
+    out.push_back((char)(payload.size() >> 16));
+    out.push_back((char)(payload.size() >> 8));
+    out.push_back((char)payload.size());
+    out.push_back((char)type);
+    out.push_back((char)flags);
+    out.push_back((char)(id >> 24));
+    out.push_back((char)(id >> 16));
+    out.push_back((char)(id >> 8));
+    out.push_back((char)id);
+
+    return out + payload;
+}
+
+static std::string MakeUint32(uint32_t val)
+{
+    std::string out;
+
+    out.push_back((char)(val >> 24));
+    out.push_back((char)(val >> 16));
+    out.push_back((char)(val >> 8));
+    out.push_back((char)val);
+
+    return out;
+}
+
+static std::string MakeSetting(int id, uint32_t value)
+{
+    std::string out;
+
+    out.push_back((char)(id >> 8));
+    out.push_back((char)id);
+
+    return out + MakeUint32(value);
+}
+
+// frames of output are taken off, output is cleared.
+static std::vector<Frame> TakeFrames(Http2Session& session)
+{
+    std::vector<Frame> frames;
+    const std::string& out = session.GetOutput();
+
+    size_t off = 0;
+    while (off + 9 <= out.size())
+    {
+        const unsigned char* p = (const unsigned char*)out.data() + off;
+
+        Frame frame;
+        size_t len = p[0] << 16 | p[1] << 8 | p[2];
+        frame.type_ = p[3];
+        frame.flags_ = p[4];
+        frame.id_ = (uint32_t)p[5] << 24 | p[6] << 16 | p[7] << 8 | p[8];
+        frame.payload_ = out.substr(off + 9, len);
+
+        frames.push_back(frame);
+        off += 9 + len;
+    }
+
+    EXPECT_EQ(off, out.size());
+
+    session.GetOutput().clear();
+    return frames;
+}
+
+static void CollectHeader(void* arg, const std::string& name, const std::string& value)
+{
+    std::string* out = (std::string*)arg;
+
+    *out += name + ": " + value + "\n";
+}
+
+static std::string RequestBlock(HpackEncoder& encoder, const char* method, const char* path)
+{
+    std::string block;
+
+    encoder.Encode(":method", method, &block);
+    encoder.Encode(":scheme", "http", &block);
+    encoder.Encode(":path", path, &block);
+    encoder.Encode(":authority", "example.com", &block);
+    encoder.Encode("user-agent", "h2test", &block);
+
+    return block;
+}
+
+// echoes what handler sees, "/big?n" answers n bytes.
+static void TestHandler(void* arg, const HttpRequest& req, HttpResponse& resp)
+{
+    int* count = (int*)arg;
+    ++*count;
+
+    resp.SetStatusCode(HttpResponse::HSC_200);
+    resp.AddHeader("Content-Type", "text/plain");
+
+    std::string body;
+    if (req.GetUrl() == "/big")
+    {
+        body.assign(atoi(req.GetUrlData().c_str()), 'x');
+    }
+    else
+    {
+        std::map<std::string, std::string>::const_iterator it = req.GetHeader().find("User-Agent");
+
+        body = std::string(req.GetVersionName()) + " " + req.GetUrl() + " host=" + req.GetHeader().find("Host")->second
+            + " ua=" + (it == req.GetHeader().end()? "" : it->second) + " body=" + req.GetHttpBody();
+    }
+
+    resp.SetBody(body.c_str());
+}
+
+class Http2SessionTest: public testing::Test
+{
+    protected:
+
+        Http2SessionTest()
+            :count_(0)
+            ,session_(&TestHandler, &count_, &arena_)
+        {
+        }
+
+        // preface exchanged, settings of both acknowledged.
+        void Open(const std::string& settings = "")
+        {
+            session_.Start();
+
+            std::string data = std::string(PREFACE) + MakeFrame(Http2Session::H2F_SETTINGS, 0, 0, settings);
+            ASSERT_EQ((int)data.size(), session_.Process(data.data(), data.size()));
+
+            std::vector<Frame> frames = TakeFrames(session_);
+            ASSERT_EQ(2u, frames.size());
+            EXPECT_EQ(Http2Session::H2F_SETTINGS, frames[0].type_);
+            EXPECT_EQ(0, frames[0].flags_);
+            EXPECT_EQ(MakeSetting(Http2Session::H2S_MAX_CONCURRENT_STREAMS, 128)
+                    + MakeSetting(Http2Session::H2S_MAX_HEADER_LIST_SIZE, 64*1024), frames[0].payload_);
+            EXPECT_EQ(Http2Session::H2F_SETTINGS, frames[1].type_);
+            EXPECT_EQ(Http2Session::H2FL_ACK, frames[1].flags_);
+        }
+
+        int Send(const std::string& data)
+        {
+            return session_.Process(data.data(), data.size());
+        }
+
+        std::string Decode(const Frame& frame)
+        {
+            std::string out;
+            EXPECT_TRUE(decoder_.Decode(frame.payload_.data(), frame.payload_.size(), &CollectHeader, &out));
+            return out;
+        }
+
+        int count_;
+        HttpArena arena_;
+        Http2Session session_;
+
+        HpackEncoder encoder_;
+        HpackDecoder decoder_;
+};
+
+TEST_F(Http2SessionTest, PrefaceTest)
+{
+    EXPECT_EQ(1, Http2Session::MatchPreface(PREFACE, sizeof(PREFACE) - 1));
+    EXPECT_EQ(0, Http2Session::MatchPreface(PREFACE, 3));
+    EXPECT_EQ(-1, Http2Session::MatchPreface("GET / HTTP/1.1\r\n", 16));
+
+    // partial preface is not consumed.
+    EXPECT_EQ(0, session_.Process(PREFACE, 10));
+
+    Open();
+
+    {
+        // SETTINGS must come first.
+        Http2Session session(&TestHandler, &count_, &arena_);
+
+        std::string data = std::string(PREFACE) + MakeFrame(Http2Session::H2F_PING, 0, 0, std::string(8, 'p'));
+        EXPECT_EQ(-1, session.Process(data.data(), data.size()));
+
+        std::vector<Frame> frames = TakeFrames(session);
+        ASSERT_EQ(1u, frames.size());
+        EXPECT_EQ(Http2Session::H2F_GOAWAY, frames[0].type_);
+        EXPECT_EQ(MakeUint32(0) + MakeUint32(Http2Session::H2E_PROTOCOL_ERROR), frames[0].payload_);
+        EXPECT_TRUE(session.IsClosed());
+    }
+
+    {
+        Http2Session session(&TestHandler, &count_, &arena_);
+        EXPECT_EQ(-1, session.Process("GET / HTTP/1.1\r\n\r\n", 18));
+    }
+
+    std::string settings;
+    ASSERT_TRUE(Http2Session::DecodeBase64Url("AAMAAABkAARAAAAA", &settings));
+    EXPECT_EQ(MakeSetting(Http2Session::H2S_MAX_CONCURRENT_STREAMS, 100)
+            + MakeSetting(Http2Session::H2S_INITIAL_WINDOW_SIZE, 0x40000000), settings);
+
+    EXPECT_FALSE(Http2Session::DecodeBase64Url("AAM+AABk", &settings));
+}
+
+TEST_F(Http2SessionTest, RequestTest)
+{
+    Open();
+
+    std::string block = RequestBlock(encoder_, "GET", "/hello?a=1");
+    ASSERT_EQ(9 + (int)block.size(), Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, 1, block)));
+
+    EXPECT_EQ(1, count_);
+    EXPECT_EQ(0, session_.GetStreamNum());
+
+    std::vector<Frame> frames = TakeFrames(session_);
+    ASSERT_EQ(2u, frames.size());
+
+    EXPECT_EQ(Http2Session::H2F_HEADERS, frames[0].type_);
+    EXPECT_EQ(Http2Session::H2FL_END_HEADERS, frames[0].flags_);
+    EXPECT_EQ(1u, frames[0].id_);
+    EXPECT_EQ(":status: 200\ncontent-type: text/plain\n", Decode(frames[0]));
+
+    EXPECT_EQ(Http2Session::H2F_DATA, frames[1].type_);
+    EXPECT_EQ(Http2Session::H2FL_END_STREAM, frames[1].flags_);
+    EXPECT_EQ("HTTP/2.0 /hello host=example.com ua=h2test body=", frames[1].payload_);
+
+    // body split in frames, length checked against content-length.
+    block = RequestBlock(encoder_, "POST", "/post");
+    encoder_.Encode("content-length", "10", &block, false);
+
+    std::string data = MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS, 3, block)
+        + MakeFrame(Http2Session::H2F_DATA, 0, 3, "hello")
+        + MakeFrame(Http2Session::H2F_DATA, Http2Session::H2FL_END_STREAM, 3, "world");
+
+    ASSERT_EQ((int)data.size(), Send(data));
+    EXPECT_EQ(2, count_);
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(2u, frames.size());
+    EXPECT_EQ(":status: 200\ncontent-type: text/plain\n", Decode(frames[0]));
+    EXPECT_EQ("HTTP/2.0 /post host=example.com ua=h2test body=helloworld", frames[1].payload_);
+
+    // length mismatch resets the stream, connection goes on.
+    block = RequestBlock(encoder_, "POST", "/post");
+    encoder_.Encode("content-length", "3", &block, false);
+
+    data = MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS, 5, block)
+        + MakeFrame(Http2Session::H2F_DATA, Http2Session::H2FL_END_STREAM, 5, "toolong");
+
+    ASSERT_EQ((int)data.size(), Send(data));
+    EXPECT_EQ(2, count_);
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_RST_STREAM, frames[0].type_);
+    EXPECT_EQ(5u, frames[0].id_);
+    EXPECT_EQ(MakeUint32(Http2Session::H2E_PROTOCOL_ERROR), frames[0].payload_);
+
+    // block split by CONTINUATION, head gets no body.
+    block = RequestBlock(encoder_, "HEAD", "/head");
+    data = MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_STREAM, 7, block.substr(0, 4))
+        + MakeFrame(Http2Session::H2F_CONTINUATION, 0, 7, block.substr(4, 4))
+        + MakeFrame(Http2Session::H2F_CONTINUATION, Http2Session::H2FL_END_HEADERS, 7, block.substr(8));
+
+    ASSERT_EQ((int)data.size(), Send(data));
+    EXPECT_EQ(3, count_);
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_HEADERS, frames[0].type_);
+    EXPECT_EQ(Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, frames[0].flags_);
+    EXPECT_EQ(":status: 200\ncontent-type: text/plain\n", Decode(frames[0]));
+}
+
+TEST_F(Http2SessionTest, MalformedTest)
+{
+    Open();
+
+    const char* bad[][2] = {
+        { "Upper", "x" },
+        { "connection", "keep-alive" },
+        { "te", "gzip" },
+        { "content-length", "1x" },
+        { "x-bad", "a\r\nb" },
+        { ":unknown", "x" },
+    };
+
+    uint32_t id = 1;
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); ++i, id += 2)
+    {
+        std::string block = RequestBlock(encoder_, "GET", "/");
+        encoder_.Encode(bad[i][0], bad[i][1], &block, false);
+
+        ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, id, block))) << i;
+
+        std::vector<Frame> frames = TakeFrames(session_);
+        ASSERT_EQ(1u, frames.size()) << i;
+        EXPECT_EQ(Http2Session::H2F_RST_STREAM, frames[0].type_) << i;
+        EXPECT_EQ(id, frames[0].id_);
+    }
+
+    // pseudo header after a regular one, no path.
+    std::string block;
+    encoder_.Encode(":method", "GET", &block);
+    encoder_.Encode("accept", "*/*", &block);
+    encoder_.Encode(":path", "/", &block);
+
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, id, block)));
+    EXPECT_EQ(Http2Session::H2F_RST_STREAM, TakeFrames(session_)[0].type_);
+
+    EXPECT_EQ(0, count_);
+    EXPECT_EQ(0, session_.GetStreamNum());
+
+    // still good for a valid one.
+    id += 2;
+    block = RequestBlock(encoder_, "GET", "/");
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, id, block)));
+    EXPECT_EQ(1, count_);
+}
+
+TEST_F(Http2SessionTest, HeaderListTest)
+{
+    Open();
+
+    // a big field is added to table once, then referred to by a byte each time.
+    std::string block = RequestBlock(encoder_, "GET", "/");
+    for (int i = 0; i < 20; ++i)
+    {
+        encoder_.Encode("x-big", std::string(4000, 'b'), &block);
+    }
+
+    ASSERT_GT(16*1024, (int)block.size());
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, 1, block)));
+
+    std::vector<Frame> frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_RST_STREAM, frames[0].type_);
+    EXPECT_EQ(MakeUint32(Http2Session::H2E_ENHANCE_YOUR_CALM), frames[0].payload_);
+
+    EXPECT_EQ(0, count_);
+    EXPECT_EQ(0, session_.GetStreamNum());
+
+    // table is still in sync with peer.
+    block = RequestBlock(encoder_, "GET", "/");
+    encoder_.Encode("x-big", std::string(4000, 'b'), &block);
+
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, 3, block)));
+    EXPECT_EQ(1, count_);
+}
+
+TEST_F(Http2SessionTest, MultiplexTest)
+{
+    Open();
+
+    // streams interleaved, each answered as its request ends.
+    // blocks are encoded in the order they are sent.
+    std::string one = RequestBlock(encoder_, "POST", "/one");
+    std::string two = RequestBlock(encoder_, "POST", "/two");
+
+    std::string data = MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS, 1, one)
+        + MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS, 3, two)
+        + MakeFrame(Http2Session::H2F_DATA, 0, 1, "a")
+        + MakeFrame(Http2Session::H2F_DATA, 0, 3, "b")
+        + MakeFrame(Http2Session::H2F_DATA, Http2Session::H2FL_END_STREAM, 3, "c")
+        + MakeFrame(Http2Session::H2F_DATA, Http2Session::H2FL_END_STREAM, 1, "d");
+
+    // frames cut anywhere are taken whole.
+    size_t consumed = 0;
+    for (size_t end = 7; consumed < data.size(); end += 7)
+    {
+        if (end > data.size()) end = data.size();
+
+        int ret = session_.Process(data.data() + consumed, end - consumed);
+        ASSERT_LE(0, ret);
+        consumed += ret;
+    }
+
+    EXPECT_EQ(2, count_);
+
+    std::vector<Frame> frames = TakeFrames(session_);
+    ASSERT_EQ(4u, frames.size());
+    EXPECT_EQ(3u, frames[0].id_);
+    EXPECT_EQ(3u, frames[1].id_);
+    EXPECT_EQ("HTTP/2.0 /two host=example.com ua=h2test body=bc", frames[1].payload_);
+    EXPECT_EQ(1u, frames[2].id_);
+    EXPECT_EQ(1u, frames[3].id_);
+    EXPECT_EQ("HTTP/2.0 /one host=example.com ua=h2test body=ad", frames[3].payload_);
+
+    // closed stream goes quietly, reused id is an error.
+    EXPECT_LT(0, Send(MakeFrame(Http2Session::H2F_RST_STREAM, 0, 1, MakeUint32(Http2Session::H2E_CANCEL))));
+    EXPECT_EQ(0u, session_.GetOutput().size());
+
+    EXPECT_EQ(-1, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, 4, RequestBlock(encoder_, "GET", "/"))));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_GOAWAY, frames[0].type_);
+    EXPECT_EQ(MakeUint32(3) + MakeUint32(Http2Session::H2E_PROTOCOL_ERROR), frames[0].payload_);
+}
+
+TEST_F(Http2SessionTest, FlowControlTest)
+{
+    Open(MakeSetting(Http2Session::H2S_INITIAL_WINDOW_SIZE, 10));
+
+    std::string block = RequestBlock(encoder_, "GET", "/big?100");
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, 1, block)));
+
+    std::vector<Frame> frames = TakeFrames(session_);
+    ASSERT_EQ(2u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_DATA, frames[1].type_);
+    EXPECT_EQ(0, frames[1].flags_);
+    EXPECT_EQ(10u, frames[1].payload_.size());
+
+    // stream is kept for the rest.
+    EXPECT_EQ(1, session_.GetStreamNum());
+
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_WINDOW_UPDATE, 0, 1, MakeUint32(50))));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(50u, frames[0].payload_.size());
+    EXPECT_EQ(0, frames[0].flags_);
+
+    // new initial size opens the window of open streams.
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_SETTINGS, 0, 0, MakeSetting(Http2Session::H2S_INITIAL_WINDOW_SIZE, 30))));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(2u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_SETTINGS, frames[0].type_);
+    EXPECT_EQ(20u, frames[1].payload_.size());
+
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_WINDOW_UPDATE, 0, 1, MakeUint32(1000))));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(20u, frames[0].payload_.size());
+    EXPECT_EQ(Http2Session::H2FL_END_STREAM, frames[0].flags_);
+    EXPECT_EQ(0, session_.GetStreamNum());
+
+    EXPECT_EQ(65535 - 100, session_.GetSendWindow());
+
+    // window of connection, shared by streams.
+    block = RequestBlock(encoder_, "GET", "/big?70000");
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, 3, block)));
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_WINDOW_UPDATE, 0, 3, MakeUint32(100000))));
+
+    size_t sent = 0;
+    frames = TakeFrames(session_);
+    for (size_t i = 1; i < frames.size(); ++i) sent += frames[i].payload_.size();
+
+    EXPECT_EQ(65535u - 100, sent);
+    EXPECT_EQ(0, session_.GetSendWindow());
+
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_WINDOW_UPDATE, 0, 0, MakeUint32(10000))));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(70000u - sent, frames[0].payload_.size());
+    EXPECT_EQ(Http2Session::H2FL_END_STREAM, frames[0].flags_);
+
+    // body over the limit cancels the stream, window of connection is opened as data
+    // is taken, dropped or not.
+    block = RequestBlock(encoder_, "POST", "/post");
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS, 5, block)));
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_DATA, 0, 5, std::string(HttpRequest::MaxBodyLength, 'a'))));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_RST_STREAM, frames[0].type_);
+    EXPECT_EQ(MakeUint32(Http2Session::H2E_CANCEL), frames[0].payload_);
+    EXPECT_EQ(0, session_.GetStreamNum());
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_DATA, 0, 5, std::string(16384 - HttpRequest::MaxBodyLength, 'a'))));
+        ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_DATA, 0, 5, std::string(HttpRequest::MaxBodyLength, 'a'))));
+    }
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_WINDOW_UPDATE, frames[0].type_);
+    EXPECT_EQ(0u, frames[0].id_);
+    EXPECT_EQ(MakeUint32(32768), frames[0].payload_);
+}
+
+TEST_F(Http2SessionTest, ControlTest)
+{
+    Open();
+
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_PING, 0, 0, "12345678")));
+
+    std::vector<Frame> frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_PING, frames[0].type_);
+    EXPECT_EQ(Http2Session::H2FL_ACK, frames[0].flags_);
+    EXPECT_EQ("12345678", frames[0].payload_);
+
+    // ack of ours, unknown frame, priority.
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_SETTINGS, Http2Session::H2FL_ACK, 0, "")));
+    ASSERT_LT(0, Send(MakeFrame(0x20, 0, 0, "ignored")));
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_PRIORITY, 0, 1, std::string(5, 0))));
+    EXPECT_EQ(0u, session_.GetOutput().size());
+
+    // frame larger than the default size.
+    std::string data = MakeFrame(Http2Session::H2F_DATA, 0, 1, std::string(16385, 'a'));
+    EXPECT_EQ(-1, session_.Process(data.data(), 9));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_GOAWAY, frames[0].type_);
+    EXPECT_EQ(MakeUint32(0) + MakeUint32(Http2Session::H2E_FRAME_SIZE_ERROR), frames[0].payload_);
+    EXPECT_TRUE(session_.IsClosed());
+}
+
+TEST_F(Http2SessionTest, GoawayTest)
+{
+    Open();
+
+    // header block interleaved.
+    std::string block = RequestBlock(encoder_, "GET", "/");
+    std::string data = MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_STREAM, 1, block.substr(0, 2))
+        + MakeFrame(Http2Session::H2F_PING, 0, 0, "12345678");
+
+    EXPECT_EQ(-1, Send(data));
+    EXPECT_EQ(Http2Session::H2F_GOAWAY, TakeFrames(session_)[0].type_);
+}
+
+TEST_F(Http2SessionTest, PeerGoawayTest)
+{
+    Open();
+
+    std::string block = RequestBlock(encoder_, "GET", "/big?100");
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_SETTINGS, 0, 0, MakeSetting(Http2Session::H2S_INITIAL_WINDOW_SIZE, 10))));
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_HEADERS, Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM, 1, block)));
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_GOAWAY, 0, 0, MakeUint32(0) + MakeUint32(0))));
+
+    // stream in flight is finished first.
+    TakeFrames(session_);
+    EXPECT_FALSE(session_.IsClosed());
+
+    ASSERT_LT(0, Send(MakeFrame(Http2Session::H2F_WINDOW_UPDATE, 0, 1, MakeUint32(90))));
+    TakeFrames(session_);
+    EXPECT_TRUE(session_.IsClosed());
+}
+
+TEST_F(Http2SessionTest, UpgradeTest)
+{
+    HttpRequest req;
+    req.SetArena(&arena_);
+    req.SetHttpMethod("GET");
+    req.SetVersion(HttpRequest::HV_11);
+    req.AddHeader("Host", "example.com");
+    ASSERT_TRUE(req.SetTarget("/big?30", 7));
+
+    EXPECT_FALSE(session_.StartUpgrade("!!", req));
+    EXPECT_EQ(0u, session_.GetOutput().size());
+
+    // window of upgrade settings applies to stream 1.
+    std::string settings = "AAQAAAAK";
+    ASSERT_TRUE(session_.StartUpgrade(settings, req));
+    EXPECT_EQ(1, count_);
+
+    std::vector<Frame> frames = TakeFrames(session_);
+    ASSERT_EQ(3u, frames.size());
+    EXPECT_EQ(Http2Session::H2F_SETTINGS, frames[0].type_);
+    EXPECT_EQ(Http2Session::H2F_HEADERS, frames[1].type_);
+    EXPECT_EQ(1u, frames[1].id_);
+    EXPECT_EQ(":status: 200\ncontent-type: text/plain\n", Decode(frames[1]));
+    EXPECT_EQ(10u, frames[2].payload_.size());
+
+    // client preface still comes.
+    std::string data = std::string(PREFACE) + MakeFrame(Http2Session::H2F_SETTINGS, 0, 0, "")
+        + MakeFrame(Http2Session::H2F_WINDOW_UPDATE, 0, 1, MakeUint32(100));
+    ASSERT_EQ((int)data.size(), Send(data));
+
+    frames = TakeFrames(session_);
+    ASSERT_EQ(2u, frames.size());
+    EXPECT_EQ(Http2Session::H2FL_ACK, frames[0].flags_);
+    EXPECT_EQ(20u, frames[1].payload_.size());
+    EXPECT_EQ(Http2Session::H2FL_END_STREAM, frames[1].flags_);
+    EXPECT_EQ(0, session_.GetStreamNum());
+
+    // stream 1 is taken.
+    EXPECT_EQ(-1, Send(MakeFrame(Http2Session::H2F_DATA, 0, 3, "x")));
+}
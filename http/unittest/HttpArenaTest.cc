@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpArena.h"
+
+#include <string.h>
+#include <stdint.h>
+
+TEST(HttpArenaTest, AllocResetTest)
+{
+    HttpArena arena;
+    EXPECT_EQ(0, arena.GetChunkNum());
+
+    char* a = (char*)arena.Alloc(3);
+    char* b = (char*)arena.Alloc(10);
+    ASSERT_TRUE(a != NULL);
+    ASSERT_TRUE(b != NULL);
+
+    // aligned to pointer size, bumped from the same chunk.
+    EXPECT_EQ(0, (uintptr_t)a % sizeof(void*));
+    EXPECT_EQ(0, (uintptr_t)b % sizeof(void*));
+    EXPECT_EQ(a + sizeof(void*), b);
+    EXPECT_EQ(1, arena.GetChunkNum());
+
+    char* s = arena.Strdup("hello", 5);
+    EXPECT_STREQ("hello", s);
+
+    // fills several chunks.
+    size_t sz = HttpArena::GetChunkSize() / 4;
+    for (int i = 0; i < 10; ++i)
+    {
+        char* p = (char*)arena.Alloc(sz);
+        ASSERT_TRUE(p != NULL);
+        memset(p, i, sz);
+    }
+
+    size_t chunks = arena.GetChunkNum();
+    EXPECT_LE(3, chunks);
+
+    // larger than a chunk is allocated alone.
+    char* large = (char*)arena.Alloc(HttpArena::GetChunkSize() * 3);
+    ASSERT_TRUE(large != NULL);
+    memset(large, 'l', HttpArena::GetChunkSize() * 3);
+    EXPECT_EQ(chunks, arena.GetChunkNum());
+
+    // chunks are kept and used again after reset.
+    arena.Reset();
+    EXPECT_EQ(0, arena.GetUsed());
+    EXPECT_EQ(chunks, arena.GetChunkNum());
+    EXPECT_EQ(a, arena.Alloc(1));
+
+    for (int i = 0; i < 10; ++i) arena.Alloc(sz);
+    EXPECT_EQ(chunks, arena.GetChunkNum());
+
+    arena.Clear();
+    EXPECT_EQ(0, arena.GetChunkNum());
+    EXPECT_TRUE(arena.Alloc(8) != NULL);
+}
+
+TEST(HttpArenaTest, ContainerTest)
+{
+    HttpArena arena;
+
+    {
+        HttpArenaString str((HttpArenaAllocator<char>(&arena)));
+        for (int i = 0; i < 1000; ++i) str += "0123456789";
+
+        EXPECT_EQ(10000, str.size());
+        EXPECT_EQ(0, str.compare(9990, 10, "0123456789"));
+
+        HttpArenaVector<int>::Type ids((HttpArenaAllocator<int>(&arena)));
+        for (int i = 0; i < 1000; ++i) ids.push_back(i);
+
+        EXPECT_EQ(1000, ids.size());
+        EXPECT_EQ(999, ids.back());
+    }
+
+    EXPECT_LT(10000 + 1000 * sizeof(int), arena.GetUsed());
+
+    arena.Reset();
+    EXPECT_EQ(0, arena.GetUsed());
+}
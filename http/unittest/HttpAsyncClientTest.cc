@@ -0,0 +1,548 @@
+#include <gtest/gtest.h>
+
+#include "thread/Thread.h"
+#include "http/HttpAsyncClient.h"
+#include "http/HttpMessageParser.h"
+#include "http/unittest/TestUtil.h"
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// stand-in server, one thread per connection.
+// url decides the response:
+// "/close" answers and closes, "/drop" closes without answer, "/garbage" answers garbage,
+// "/chunked" answers in chunks. body of request is echoed back, url if there is no body.
+class ClientBackend: public ThreadBase
+{
+    public:
+
+        ClientBackend()
+            :m_fd(-1), m_conns(0), m_requests(0), m_stop(false)
+        {
+            m_fd = ListenTo("127.0.0.1", 0);
+        }
+
+        // connections end when client closes them, destroy client first.
+        ~ClientBackend()
+        {
+            for (size_t i = 0; i < m_workers.size(); ++i)
+            {
+                m_workers[i]->Join();
+                delete m_workers[i];
+            }
+        }
+
+        int GetPort() const { return GetLocalPort(m_fd); }
+        int GetRequests() const { return m_requests; }
+        int GetConnections() const { return m_conns; }
+
+        void Stop()
+        {
+            m_stop = true;
+
+            // wake up accept().
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(GetPort());
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+            connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+            Join();
+
+            close(fd);
+            close(m_fd);
+        }
+
+        virtual void Run()
+        {
+            int flag = fcntl(m_fd, F_GETFL, 0);
+            fcntl(m_fd, F_SETFL, flag & ~O_NONBLOCK);
+
+            while (true)
+            {
+                int fd = accept(m_fd, NULL, NULL);
+                if (fd < 0) break;
+
+                if (m_stop)
+                {
+                    close(fd);
+                    break;
+                }
+
+                ConnWorker* worker = new ConnWorker(*this, fd, m_conns++);
+                m_workers.push_back(worker);
+                worker->Start();
+            }
+        }
+
+    private:
+
+        class ConnWorker: public ThreadBase
+        {
+            public:
+
+                ConnWorker(ClientBackend& backend, int fd, int id)
+                    :m_backend(backend), m_fd(fd), m_id(id)
+                {
+                }
+
+                virtual void Run()
+                {
+                    std::string pending;
+
+                    while (ServeOne(pending)) {}
+
+                    close(m_fd);
+                }
+
+            private:
+
+                bool ReadRequest(HttpMessageParser& parser, std::string& pending)
+                {
+                    char buf[16*1024];
+
+                    while (true)
+                    {
+                        int n = 0;
+                        while (!pending.empty() && (n = parser.Parse(pending.c_str(), pending.size())) > 0)
+                        {
+                            pending.erase(0, n);
+                        }
+
+                        if (n < 0) return false;
+                        if (parser.IsMessageComplete()) return true;
+
+                        n = read(m_fd, buf, sizeof(buf));
+                        if (n <= 0) return false;
+
+                        pending.append(buf, n);
+                    }
+                }
+
+                bool ServeOne(std::string& pending)
+                {
+                    std::string body;
+                    HttpMessageParser parser(HttpMessageParser::HPT_REQUEST);
+                    parser.SetBodyHandler(&AppendBody, &body);
+
+                    if (!ReadRequest(parser, pending)) return false;
+
+                    __sync_fetch_and_add(&m_backend.m_requests, 1);
+
+                    const std::string& url = parser.GetUrl();
+
+                    if (url == "/drop") return false;
+
+                    if (url == "/garbage")
+                    {
+                        WriteAll(m_fd, "garbage\r\n\r\n", 11);
+                        return false;
+                    }
+
+                    if (body.empty()) body = url;
+
+                    bool close = (url == "/close");
+
+                    char head[256];
+                    snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\n"
+                            "X-Conn: %d\r\n"
+                            "X-Pipelined: %d\r\n"
+                            "X-Host: %s\r\n"
+                            "%s",
+                            m_id, !pending.empty(),
+                            parser.GetHeader("Host")? parser.GetHeader("Host")->c_str() : "",
+                            close? "Connection: close\r\n" : "");
+
+                    std::string resp = head;
+
+                    if (url == "/chunked")
+                    {
+                        resp += "Transfer-Encoding: chunked\r\n\r\n";
+                        resp += "3\r\n/ch\r\n5\r\nunked\r\n0\r\n\r\n";
+                    }
+                    else
+                    {
+                        char len[64];
+                        snprintf(len, sizeof(len), "Content-Length: %d\r\n\r\n", (int)body.size());
+
+                        resp += len;
+                        if (parser.GetMethod() != "HEAD") resp += body;
+                    }
+
+                    return WriteAll(m_fd, resp.c_str(), resp.size()) && !close;
+                }
+
+                ClientBackend& m_backend;
+                int m_fd;
+                int m_id;
+        };
+
+        int m_fd;
+        int m_conns;
+        volatile int m_requests;
+        volatile bool m_stop;
+        std::vector<ConnWorker*> m_workers;
+};
+
+struct ResponseRecorder
+{
+    explicit ResponseRecorder(std::vector<HttpClientResponse>* out): out_(out) {}
+
+    void operator()(HttpClientResponse* resp) { out_->push_back(*resp); }
+
+    std::vector<HttpClientResponse>* out_;
+};
+
+// issues the next request from handler of the previous one.
+struct ChainHandler
+{
+    ChainHandler(HttpAsyncClient* client, const HttpClientRequest& req,
+            int left, std::vector<HttpClientResponse>* out)
+        :client_(client), req_(req), left_(left), out_(out)
+    {
+    }
+
+    void operator()(HttpClientResponse* resp)
+    {
+        out_->push_back(*resp);
+
+        if (--left_ > 0) client_->Request(req_, *this);
+    }
+
+    HttpAsyncClient* client_;
+    HttpClientRequest req_;
+    int left_;
+    std::vector<HttpClientResponse>* out_;
+};
+
+// poll loop of the caller, events not taken by client are counted.
+static int RunUntilDone(SocketServer& server, HttpAsyncClient& client)
+{
+    int others = 0;
+
+    while (client.GetOutstanding() > 0)
+    {
+        SocketEvent evt;
+        server.RunPoll(&evt);
+
+        if (!client.ProcessEvent(evt)) ++others;
+    }
+
+    return others;
+}
+
+static HttpClientRequest MakeRequest(int port, const char* method, const char* url, const std::string& body = "")
+{
+    HttpClientRequest req;
+
+    req.method_ = method;
+    req.host_ = "127.0.0.1";
+    req.port_ = port;
+    req.url_ = url;
+    req.body_ = body;
+
+    return req;
+}
+
+static std::string GetHeader(const HttpClientResponse& resp, const char* name)
+{
+    const std::string* val = resp.GetHeader(name);
+
+    return val? *val : "";
+}
+
+TEST(HttpAsyncClientTest, KeepAliveTest)
+{
+    ClientBackend backend;
+    backend.Start();
+
+    int port = backend.GetPort();
+
+    {
+        SocketServer server;
+        HttpAsyncClient client(server);
+        client.SetMaxConnPerHost(2);
+
+        std::vector<HttpClientResponse> resp;
+
+        // sequential requests share one connection.
+        ChainHandler chain(&client, MakeRequest(port, "GET", "/seq"), 10, &resp);
+        ASSERT_TRUE(client.Request(chain.req_, chain));
+
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(10u, resp.size());
+        for (size_t i = 0; i < resp.size(); ++i)
+        {
+            EXPECT_EQ(HCE_OK, resp[i].error_);
+            EXPECT_EQ(200, resp[i].status_);
+            EXPECT_EQ("/seq", resp[i].body_);
+            EXPECT_EQ("0", GetHeader(resp[i], "X-Conn"));
+        }
+
+        char host[64];
+        snprintf(host, sizeof(host), "127.0.0.1:%d", port);
+        EXPECT_EQ(host, GetHeader(resp[0], "X-Host"));
+
+        EXPECT_EQ(1, client.GetConnects());
+
+        // fan out, bounded by connections per host.
+        resp.clear();
+
+        for (int i = 0; i < 6; ++i)
+        {
+            char body[32];
+            snprintf(body, sizeof(body), "body-%d", i);
+
+            client.Request(MakeRequest(port, "POST", "/echo", body), ResponseRecorder(&resp));
+        }
+
+        EXPECT_EQ(6, client.GetOutstanding());
+
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(6u, resp.size());
+
+        std::vector<std::string> bodies;
+        for (size_t i = 0; i < resp.size(); ++i)
+        {
+            EXPECT_EQ(HCE_OK, resp[i].error_);
+            bodies.push_back(resp[i].body_);
+        }
+
+        std::sort(bodies.begin(), bodies.end());
+        for (int i = 0; i < 6; ++i)
+        {
+            char body[32];
+            snprintf(body, sizeof(body), "body-%d", i);
+            EXPECT_EQ(body, bodies[i]);
+        }
+
+        EXPECT_EQ(2, client.GetConnects());
+        EXPECT_EQ(2, client.GetConnNumber());
+
+        // no body for HEAD, chunked body, large body.
+        resp.clear();
+
+        std::string large(1024*1024, 'x');
+        for (size_t i = 0; i < large.size(); i += 4093) large[i] = 'a' + i % 26;
+
+        client.Request(MakeRequest(port, "HEAD", "/head"), ResponseRecorder(&resp));
+        client.Request(MakeRequest(port, "GET", "/chunked"), ResponseRecorder(&resp));
+        client.Request(MakeRequest(port, "PUT", "/large", large), ResponseRecorder(&resp));
+
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(3u, resp.size());
+
+        for (size_t i = 0; i < resp.size(); ++i)
+        {
+            EXPECT_EQ(HCE_OK, resp[i].error_);
+
+            if (GetHeader(resp[i], "Transfer-Encoding") == "chunked")
+            {
+                EXPECT_EQ("/chunked", resp[i].body_);
+            }
+            else if (GetHeader(resp[i], "Content-Length") == "5")
+            {
+                EXPECT_EQ("", resp[i].body_);
+            }
+            else
+            {
+                EXPECT_TRUE(resp[i].body_ == large);
+            }
+        }
+
+        // the third one waits for a pooled connection.
+        EXPECT_EQ(2, client.GetConnects());
+        EXPECT_EQ(2, client.GetConnNumber());
+    }
+
+    backend.Stop();
+    EXPECT_EQ(2, backend.GetConnections());
+}
+
+TEST(HttpAsyncClientTest, PipelineTest)
+{
+    ClientBackend backend;
+    backend.Start();
+
+    int port = backend.GetPort();
+
+    {
+        SocketServer server;
+        HttpAsyncClient client(server);
+        client.SetMaxConnPerHost(1);
+        client.SetMaxPipeline(4);
+
+        std::vector<HttpClientResponse> resp;
+
+        for (int i = 0; i < 8; ++i)
+        {
+            char url[32];
+            snprintf(url, sizeof(url), "/p%d", i);
+
+            client.Request(MakeRequest(port, "GET", url), ResponseRecorder(&resp));
+        }
+
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(8u, resp.size());
+
+        int pipelined = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            char url[32];
+            snprintf(url, sizeof(url), "/p%d", i);
+
+            EXPECT_EQ(HCE_OK, resp[i].error_);
+            EXPECT_EQ(url, resp[i].body_);
+
+            pipelined += GetHeader(resp[i], "X-Pipelined") == "1";
+        }
+
+        EXPECT_LT(0, pipelined);
+        EXPECT_EQ(1, client.GetConnects());
+
+        // requests behind a closing response are sent again on a new connection.
+        resp.clear();
+
+        const char* urls[] = { "/a", "/close", "/b", "/c" };
+        for (int i = 0; i < 4; ++i)
+        {
+            client.Request(MakeRequest(port, "GET", urls[i]), ResponseRecorder(&resp));
+        }
+
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(4u, resp.size());
+        for (int i = 0; i < 4; ++i)
+        {
+            EXPECT_EQ(HCE_OK, resp[i].error_);
+            EXPECT_EQ(urls[i], resp[i].body_);
+        }
+
+        EXPECT_EQ(2, client.GetConnects());
+    }
+
+    backend.Stop();
+}
+
+TEST(HttpAsyncClientTest, ErrorTest)
+{
+    ClientBackend backend;
+    backend.Start();
+
+    int port = backend.GetPort();
+
+    // nothing listens on the port once it is closed.
+    int fd = ListenTo("127.0.0.1", 0);
+    int closed_port = GetLocalPort(fd);
+    close(fd);
+
+    {
+        SocketServer server;
+        HttpAsyncClient client(server);
+
+        std::vector<HttpClientResponse> resp;
+
+        EXPECT_FALSE(client.Request(MakeRequest(port, "GET", ""), ResponseRecorder(&resp)));
+
+        client.Request(MakeRequest(closed_port, "GET", "/"), ResponseRecorder(&resp));
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(1u, resp.size());
+        EXPECT_EQ(HCE_CONNECT, resp[0].error_);
+
+        // not retried.
+        resp.clear();
+        client.Request(MakeRequest(port, "POST", "/drop", "data"), ResponseRecorder(&resp));
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(1u, resp.size());
+        EXPECT_EQ(HCE_CLOSED, resp[0].error_);
+        EXPECT_EQ(1, backend.GetRequests());
+
+        // retried once.
+        resp.clear();
+        client.Request(MakeRequest(port, "GET", "/drop"), ResponseRecorder(&resp));
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(1u, resp.size());
+        EXPECT_EQ(HCE_CLOSED, resp[0].error_);
+        EXPECT_EQ(3, backend.GetRequests());
+
+        resp.clear();
+        client.Request(MakeRequest(port, "GET", "/garbage"), ResponseRecorder(&resp));
+        RunUntilDone(server, client);
+
+        ASSERT_EQ(1u, resp.size());
+        EXPECT_EQ(HCE_MALFORMED, resp[0].error_);
+
+        EXPECT_EQ(0, client.GetConnNumber());
+    }
+
+    backend.Stop();
+}
+
+
+TEST(HttpAsyncClientTest, SharedLoopTest)
+{
+    ClientBackend backend;
+    backend.Start();
+
+    int port = backend.GetPort();
+
+    {
+        SocketServer server;
+        HttpAsyncClient client(server);
+
+        // a connection of the caller on the same server.
+        int sv[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+        ASSERT_TRUE(server.WatchRawSocket(sv[0], false));
+        ASSERT_EQ(1, write(sv[1], "x", 1));
+
+        std::vector<HttpClientResponse> resp;
+        client.Request(MakeRequest(port, "GET", "/shared"), ResponseRecorder(&resp));
+
+        int others = 0;
+        while (client.GetOutstanding() > 0 || others == 0)
+        {
+            SocketEvent evt;
+            server.RunPoll(&evt);
+
+            if (client.ProcessEvent(evt)) continue;
+
+            EXPECT_EQ(sv[0], evt.conn->fd_);
+            EXPECT_EQ(SC_READ, evt.code);
+
+            char c;
+            EXPECT_EQ(1, evt.conn->ReadBuffer(&c, 1));
+            ++others;
+        }
+
+        EXPECT_EQ(1, others);
+
+        ASSERT_EQ(1u, resp.size());
+        EXPECT_EQ(HCE_OK, resp[0].error_);
+        EXPECT_EQ("/shared", resp[0].body_);
+
+        close(sv[1]);
+    }
+
+    backend.Stop();
+}
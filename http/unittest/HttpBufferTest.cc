@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpBuffer.h"
+
+#include <string>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// feed chunks of a repeating pattern, consume part of it each round, check content is
+// always the expected contiguous bytes.
+static void RunReadBufferRounds(HttpReadBuffer& buffer, int rounds, int chunk, int consume)
+{
+    std::string expected;
+    int seq = 0;
+
+    for (int i = 0; i < rounds; ++i)
+    {
+        int size = 0;
+        char* free = buffer.GetFreeBuffer(size);
+        ASSERT_TRUE(free != NULL);
+        ASSERT_LT(0, size);
+
+        int n = chunk < size? chunk : size;
+        for (int j = 0; j < n; ++j)
+        {
+            free[j] = 'a' + (seq++ % 26);
+            expected.push_back(free[j]);
+        }
+
+        buffer.IncreaseContentRange(n);
+
+        ASSERT_EQ((int)expected.size(), buffer.GetContenLen());
+        ASSERT_EQ(expected.size(), (size_t)(buffer.GetContentEnd() - buffer.GetContentStart()));
+        ASSERT_EQ(0, memcmp(buffer.GetContentStart(), expected.data(), expected.size()));
+
+        int sz = consume < (int)expected.size()? consume : expected.size();
+        buffer.ConsumeBuffer(sz);
+        expected.erase(0, sz);
+    }
+}
+
+TEST(HttpBufferTest, MirroredReadBufferTest)
+{
+    int page = (int)sysconf(_SC_PAGESIZE);
+
+    HttpReadBuffer buffer(100);
+    EXPECT_FALSE(buffer.HasBuffer());
+    EXPECT_EQ(0, buffer.GetContenLen());
+
+    int size = 0;
+    char* free = buffer.GetFreeBuffer(size);
+    ASSERT_TRUE(free != NULL);
+    ASSERT_TRUE(buffer.IsMirrored());
+
+    // rounded up to page size.
+    EXPECT_EQ(page, size);
+
+    memset(free, 'x', page - 10);
+    buffer.IncreaseContentRange(page - 10);
+    buffer.ConsumeBuffer(page - 20);
+
+    // free space wraps around the end, still contiguous, and all of it is usable.
+    free = buffer.GetFreeBuffer(size);
+    EXPECT_EQ(page - 10, size);
+    EXPECT_EQ(buffer.GetContentEnd(), free);
+
+    memcpy(free, "0123456789abcdefghij", 20);
+    buffer.IncreaseContentRange(20);
+
+    // token straddling the end of memory is parsed in place.
+    EXPECT_EQ(30, buffer.GetContenLen());
+    EXPECT_EQ(0, memcmp(buffer.GetContentStart(), "xxxxxxxxxx0123456789abcdefghij", 30));
+
+    buffer.ConsumeBuffer(15);
+    EXPECT_EQ(0, memcmp(buffer.GetContentStart(), "56789abcdefghij", 15));
+    EXPECT_EQ('5', *buffer.GetContentPoint(0));
+    EXPECT_TRUE(buffer.GetContentPoint(15) == NULL);
+
+    buffer.ConsumeBuffer(buffer.GetContenLen());
+    RunReadBufferRounds(buffer, 1000, 1000, 700);
+
+    // memory is kept while content is left.
+    buffer.ReleaseBuffer();
+    EXPECT_TRUE(buffer.HasBuffer());
+
+    buffer.ResetBuffer();
+    buffer.ReleaseBuffer();
+    EXPECT_FALSE(buffer.HasBuffer());
+}
+
+TEST(HttpBufferTest, PlainReadBufferTest)
+{
+    HttpReadBuffer buffer(1024, false);
+
+    int size = 0;
+    char* free = buffer.GetFreeBuffer(size);
+    ASSERT_TRUE(free != NULL);
+    EXPECT_FALSE(buffer.IsMirrored());
+    EXPECT_EQ(1024, size);
+
+    memset(free, 'x', 1000);
+    buffer.IncreaseContentRange(1000);
+    buffer.ConsumeBuffer(990);
+
+    // content is moved to front when free space gets small.
+    free = buffer.GetFreeBuffer(size);
+    EXPECT_EQ(1014, size);
+    EXPECT_EQ(free - 10, buffer.GetContentStart());
+
+    buffer.ConsumeBuffer(buffer.GetContenLen());
+    RunReadBufferRounds(buffer, 1000, 300, 200);
+}
+
+TEST(HttpBufferTest, MirrorFallbackTest)
+{
+    int page = (int)sysconf(_SC_PAGESIZE);
+
+    // a mirrored region freed is reused by the next buffer of the same size.
+    char* first = NULL;
+    {
+        HttpReadBuffer buffer(5 * page);
+
+        int size = 0;
+        first = buffer.GetFreeBuffer(size);
+        ASSERT_TRUE(first != NULL);
+        ASSERT_TRUE(buffer.IsMirrored());
+    }
+
+    {
+        HttpReadBuffer buffer(5 * page);
+
+        int size = 0;
+        EXPECT_EQ(first, buffer.GetFreeBuffer(size));
+        EXPECT_TRUE(buffer.IsMirrored());
+    }
+
+    // out of fds, memfd can't be created, buffer goes on with plain memory.
+    struct rlimit old;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &old));
+
+    int fd = dup(0);
+    ASSERT_LE(0, fd);
+    close(fd);
+
+    struct rlimit limit = old;
+    limit.rlim_cur = fd;
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+
+    HttpReadBuffer buffer(7 * page + 1);
+
+    int size = 0;
+    char* free = buffer.GetFreeBuffer(size);
+
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &old));
+
+    ASSERT_TRUE(free != NULL);
+    EXPECT_FALSE(buffer.IsMirrored());
+    EXPECT_EQ(7 * page + 1, size);
+
+    RunReadBufferRounds(buffer, 1000, 300, 200);
+
+    // and keeps using it once memory is given back.
+    buffer.ReleaseBuffer();
+    EXPECT_TRUE(buffer.GetFreeBuffer(size) != NULL);
+    EXPECT_FALSE(buffer.IsMirrored());
+}
@@ -0,0 +1,310 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpClient.h"
+#include "http/SocketServer.h"
+#include "http/SocketPoll.h"
+
+#include <string>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+static void NotFoundHandler(const HttpRequest&, HttpResponse& response)
+{
+    response.SetShouldResponse(true);
+    response.SetStatusCode(HttpResponse::HSC_404);
+    response.SetStatusMessage("Not Found");
+    response.AddHeader("Content-Length", "0");
+}
+
+static bool WriteRequest(int fd, const std::string& req)
+{
+    size_t off = 0;
+    while (off < req.size())
+    {
+        int n = write(fd, req.data() + off, req.size() - off);
+        if (n <= 0) return false;
+
+        off += n;
+    }
+
+    return true;
+}
+
+// poll and feed events to client until the response arrives.
+static bool ServeRequest(SocketServer& server, HttpClient& client, int peer)
+{
+    static const char expected[] = "HTTP/1.1 404 Not Found\r\n";
+
+    std::string resp;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        char buf[256];
+        int n = recv(peer, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0) resp.append(buf, n);
+
+        if (resp.find("\r\n\r\n") != std::string::npos) return resp.find(expected) == 0;
+
+        SocketEvent evt;
+        server.RunPoll(&evt);
+
+        if (evt.code == SC_READ || evt.code == SC_WRITE) client.ProcessEvent(evt);
+    }
+
+    return false;
+}
+
+TEST(HttpClientTest, DrainReadTest)
+{
+    // io_uring backend reads by its own buffers, sizing of read buffer doesn't apply.
+    SocketServer server(SB_EPOLL);
+
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    int sndbuf = 1024 * 1024;
+    setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    SocketPoll::SetSocketNonBlocking(sv[0]);
+    ASSERT_TRUE(server.WatchRawSocket(sv[0], false));
+
+    HttpClient client(&NotFoundHandler);
+
+    // large request is in socket before the first event.
+    std::string req = "GET /big HTTP/1.1\r\n";
+    for (int i = 0; i < 1000; ++i)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "X-Filler-%04d: %s\r\n", i, std::string(80, 'x').c_str());
+        req += line;
+    }
+    req += "\r\n";
+
+    ASSERT_TRUE(WriteRequest(sv[1], req));
+
+    SocketEvent evt;
+    do
+    {
+        server.RunPoll(&evt);
+    } while (evt.code != SC_READ);
+
+    client.ResetClient(evt.conn);
+    client.ProcessEvent(evt);
+
+    // read in one event, buffer grows as reads fill it up.
+    EXPECT_EQ(1, client.GetReadStats().events);
+    EXPECT_EQ(1, client.GetReadStats().drained);
+    EXPECT_LT(0, client.GetReadStats().grows);
+    EXPECT_LT(64 * 1024, client.GetReadBufferSize());
+    EXPECT_GE(client.GetReadStats().grows + 2, client.GetReadStats().reads);
+
+    ASSERT_TRUE(ServeRequest(server, client, sv[1]));
+    EXPECT_EQ((int64_t)req.size(), client.GetReadStats().bytes);
+
+    // quiet connection gives back memory.
+    const std::string small = "GET /small HTTP/1.1\r\n\r\n";
+    for (int i = 0; i < 8; ++i)
+    {
+        ASSERT_TRUE(WriteRequest(sv[1], small));
+        ASSERT_TRUE(ServeRequest(server, client, sv[1]));
+    }
+
+    EXPECT_LT(0, client.GetReadStats().shrinks);
+    EXPECT_EQ(8 * 1024, client.GetReadBufferSize());
+
+    // busy connection is read by several events, within budget each.
+    HttpReadStats before = client.GetReadStats();
+
+    client.SetReadBudget(16 * 1024);
+    ASSERT_TRUE(WriteRequest(sv[1], req));
+    ASSERT_TRUE(ServeRequest(server, client, sv[1]));
+
+    HttpReadStats after = client.GetReadStats();
+    EXPECT_EQ((int64_t)req.size(), after.bytes - before.bytes);
+    EXPECT_LE((int64_t)req.size() / (16 * 1024), after.events - before.events);
+    EXPECT_LE((int64_t)req.size() / (16 * 1024) - 1, after.budgetHits - before.budgetHits);
+
+    close(sv[1]);
+}
+
+static size_t gs_arenaUsedOnEntry = 0;
+
+static void ArenaHandler(const HttpRequest& req, HttpResponse& response)
+{
+    HttpArena* arena = req.GetArena();
+    gs_arenaUsedOnEntry = arena->GetUsed();
+
+    HttpArenaString body((HttpArenaAllocator<char>(arena)));
+    body.append(req.GetUrl().data(), req.GetUrl().size());
+    body += " from arena";
+
+    char len[16];
+    snprintf(len, sizeof(len), "%d", (int)body.size());
+
+    response.SetShouldResponse(true);
+    response.SetStatusCode(HttpResponse::HSC_404);
+    response.SetStatusMessage("Not Found");
+    response.AddHeader("Content-Length", arena->Strdup(len, strlen(len)));
+    response.SetBodyRef(body.data(), body.size());
+}
+
+TEST(HttpClientTest, ArenaTest)
+{
+    SocketServer server(SB_EPOLL);
+
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    SocketPoll::SetSocketNonBlocking(sv[0]);
+    ASSERT_TRUE(server.WatchRawSocket(sv[0], false));
+
+    HttpClient client(&ArenaHandler);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_TRUE(WriteRequest(sv[1], "GET /arena HTTP/1.1\r\n\r\n"));
+
+        SocketEvent evt;
+        do
+        {
+            server.RunPoll(&evt);
+        } while (evt.code != SC_READ);
+
+        if (i == 0) client.ResetClient(evt.conn);
+        client.ProcessEvent(evt);
+
+        // arena is reset after each response, only the request target is in it.
+        EXPECT_EQ(8u, gs_arenaUsedOnEntry);
+
+        std::string resp;
+        char buf[256];
+        while (resp.find("from arena") == std::string::npos)
+        {
+            int n = read(sv[1], buf, sizeof(buf));
+            ASSERT_LT(0, n);
+            resp.append(buf, n);
+        }
+
+        EXPECT_NE(std::string::npos, resp.find("Content-Length: 17\r\n\r\n/arena from arena"));
+    }
+
+    close(sv[1]);
+}
+
+// feed a request without end of line to a new client, return what ProcessEvent() does.
+static int FeedEndlessLine(SocketServer& server, const std::string& head)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 0;
+
+    SocketPoll::SetSocketNonBlocking(sv[0]);
+    if (!server.WatchRawSocket(sv[0], false)) return 0;
+
+    HttpClient client(&NotFoundHandler);
+
+    std::string req = head + std::string(16 * 1024, 'a');
+    if (!WriteRequest(sv[1], req)) return 0;
+
+    SocketEvent evt;
+    do
+    {
+        server.RunPoll(&evt);
+    } while (evt.code != SC_READ);
+
+    client.ResetClient(evt.conn);
+    int ret = client.ProcessEvent(evt);
+
+    // connection is closed by client on error.
+    char c;
+    if (ret < 0 && read(sv[1], &c, 1) != 0) ret = 0;
+
+    close(sv[1]);
+    return ret;
+}
+
+TEST(HttpClientTest, LineLimitTest)
+{
+    SocketServer server(SB_EPOLL);
+
+    EXPECT_EQ(-1, FeedEndlessLine(server, "GET /"));
+    EXPECT_EQ(-1, FeedEndlessLine(server, "GET / HTTP/1.1\r\nX-Long: "));
+}
+
+TEST(HttpClientTest, BadContentLengthTest)
+{
+    SocketServer server(SB_EPOLL);
+
+    const char* lengths[] = { "-5", "12abc", "abc" };
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+    {
+        int sv[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+        SocketPoll::SetSocketNonBlocking(sv[0]);
+        ASSERT_TRUE(server.WatchRawSocket(sv[0], false));
+
+        HttpClient client(&NotFoundHandler);
+
+        std::string req = std::string("POST /form HTTP/1.1\r\nContent-Length: ") + lengths[i] + "\r\n\r\nbody";
+        ASSERT_TRUE(WriteRequest(sv[1], req));
+
+        SocketEvent evt;
+        do
+        {
+            server.RunPoll(&evt);
+        } while (evt.code != SC_READ);
+
+        client.ResetClient(evt.conn);
+        EXPECT_EQ(-1, client.ProcessEvent(evt));
+
+        std::string resp;
+        char buf[256];
+        int n;
+        while ((n = read(sv[1], buf, sizeof(buf))) > 0) resp.append(buf, n);
+
+        EXPECT_EQ(0u, resp.find("HTTP/1.1 400 Bad Request\r\n")) << lengths[i];
+
+        close(sv[1]);
+    }
+}
+
+TEST(HttpClientTest, EmptyBodyTest)
+{
+    SocketServer server(SB_EPOLL);
+
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    SocketPoll::SetSocketNonBlocking(sv[0]);
+    ASSERT_TRUE(server.WatchRawSocket(sv[0], false));
+
+    HttpClient client(&NotFoundHandler);
+
+    ASSERT_TRUE(WriteRequest(sv[1], "POST /form HTTP/1.1\r\nContent-Length: 0\r\n\r\n"));
+
+    SocketEvent evt;
+    do
+    {
+        server.RunPoll(&evt);
+    } while (evt.code != SC_READ);
+
+    client.ResetClient(evt.conn);
+    client.ProcessEvent(evt);
+
+    // request is complete with its header, no body is waited for.
+    ASSERT_TRUE(ServeRequest(server, client, sv[1]));
+    EXPECT_EQ(1, client.GetHandledNum());
+
+    // next request on the connection is served as usual.
+    ASSERT_TRUE(WriteRequest(sv[1], "GET /next HTTP/1.1\r\n\r\n"));
+    ASSERT_TRUE(ServeRequest(server, client, sv[1]));
+    EXPECT_EQ(2, client.GetHandledNum());
+
+    close(sv[1]);
+}
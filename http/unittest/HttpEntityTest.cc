@@ -0,0 +1,245 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpArena.h"
+#include "http/HttpEntity.h"
+#include "http/HttpRequest.h"
+#include "http/HttpResponse.h"
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+
+static std::string Generate(const HttpResponse& response)
+{
+    std::vector<char> buf(response.GetResponseSize() + 1);
+    size_t sz = response.GenerateResponse(&buf[0], buf.size());
+
+    return std::string(&buf[0], sz);
+}
+
+static void MakeRequest(HttpRequest& req, const char* method)
+{
+    req.CleanUp();
+    req.SetHttpMethod(method);
+    ASSERT_TRUE(req.SetTarget("/a.txt", 6));
+}
+
+TEST(HttpEntityTest, ParseTest)
+{
+    HttpEntity::ByteRange ranges[4];
+
+    ASSERT_EQ(3, HttpEntity::ParseRange("bytes=0-9, 20-,-5", 100, ranges, 4));
+    EXPECT_EQ(0, ranges[0].first_);
+    EXPECT_EQ(9, ranges[0].last_);
+    EXPECT_EQ(20, ranges[1].first_);
+    EXPECT_EQ(99, ranges[1].last_);
+    EXPECT_EQ(95, ranges[2].first_);
+    EXPECT_EQ(99, ranges[2].last_);
+
+    // clamped to the end, unsatisfiable ones are dropped.
+    ASSERT_EQ(2, HttpEntity::ParseRange("bytes=90-200,,100-,-500", 100, ranges, 4));
+    EXPECT_EQ(90, ranges[0].first_);
+    EXPECT_EQ(99, ranges[0].last_);
+    EXPECT_EQ(0, ranges[1].first_);
+    EXPECT_EQ(99, ranges[1].last_);
+
+    EXPECT_EQ(0, HttpEntity::ParseRange("bytes=100-", 100, ranges, 4));
+    EXPECT_EQ(0, HttpEntity::ParseRange("bytes=-0", 100, ranges, 4));
+
+    const char* bad[] = { "items=0-1", "bytes=", "bytes=5-1", "bytes=a-1", "bytes=1", "bytes=0-1,2-3,4-5,6-7,8-9" };
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); ++i)
+    {
+        EXPECT_EQ(-1, HttpEntity::ParseRange(bad[i], 100, ranges, 4)) << bad[i];
+    }
+
+    time_t tm = 0;
+    ASSERT_TRUE(HttpEntity::ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT", &tm));
+    EXPECT_EQ(784111777, tm);
+    EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", HttpEntity::FormatHttpDate(tm));
+
+    EXPECT_FALSE(HttpEntity::ParseHttpDate("Sunday, 06-Nov-94 08:49:37 GMT", &tm));
+    EXPECT_FALSE(HttpEntity::ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT junk", &tm));
+}
+
+TEST(HttpEntityTest, ConditionalTest)
+{
+    HttpEntity entity("0123456789abcdef", 16, "text/plain", 784111777);
+
+    const std::string& etag = entity.GetETag();
+    ASSERT_EQ('"', etag[0]);
+    EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", entity.GetLastModified());
+
+    // same content, same validator.
+    HttpEntity same("0123456789abcdef", 16, "text/html", 0);
+    EXPECT_EQ(etag, same.GetETag());
+
+    HttpArena arena;
+    HttpRequest req;
+    req.SetArena(&arena);
+
+    {
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        EXPECT_EQ(200, entity.Respond(req, resp));
+
+        std::string out = Generate(resp);
+        EXPECT_EQ(0u, out.find("HTTP/1.1 200 OK\r\n"));
+        EXPECT_NE(std::string::npos, out.find("ETag: " + etag + "\r\n"));
+        EXPECT_NE(std::string::npos, out.find("Accept-Ranges: bytes\r\n"));
+        EXPECT_NE(std::string::npos, out.find("Content-Length: 16\r\n"));
+        EXPECT_EQ(out.size() - 20, out.find("\r\n\r\n0123456789abcdef"));
+    }
+
+    {
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("If-None-Match", ("\"other\", W/" + etag).c_str());
+        EXPECT_EQ(304, entity.Respond(req, resp));
+
+        std::string out = Generate(resp);
+        EXPECT_EQ(0u, out.find("HTTP/1.1 304 Not Modified\r\n"));
+        EXPECT_NE(std::string::npos, out.find("ETag: " + etag + "\r\n"));
+        EXPECT_EQ(std::string::npos, out.find("Content-Length"));
+        EXPECT_EQ(out.size() - 4, out.find("\r\n\r\n"));
+    }
+
+    {
+        // If-Modified-Since is not looked at when If-None-Match is there.
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("If-None-Match", "\"other\"");
+        req.AddHeader("If-Modified-Since", "Sun, 06 Nov 1994 08:49:37 GMT");
+        EXPECT_EQ(200, entity.Respond(req, resp));
+    }
+
+    {
+        HttpResponse resp;
+        MakeRequest(req, "HEAD");
+        req.AddHeader("If-Modified-Since", "Mon, 07 Nov 1994 08:49:37 GMT");
+        EXPECT_EQ(304, entity.Respond(req, resp));
+    }
+
+    {
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("If-Modified-Since", "Sat, 05 Nov 1994 08:49:37 GMT");
+        EXPECT_EQ(200, entity.Respond(req, resp));
+    }
+
+    {
+        // head has the length but no body.
+        HttpResponse resp;
+        MakeRequest(req, "HEAD");
+        EXPECT_EQ(200, entity.Respond(req, resp));
+
+        std::string out = Generate(resp);
+        EXPECT_NE(std::string::npos, out.find("Content-Length: 16\r\n"));
+        EXPECT_EQ(out.size() - 4, out.find("\r\n\r\n"));
+    }
+}
+
+TEST(HttpEntityTest, RangeTest)
+{
+    HttpEntity entity("0123456789abcdef", 16, "text/plain", 784111777);
+
+    HttpArena arena;
+    HttpRequest req;
+    req.SetArena(&arena);
+
+    {
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("Range", "bytes=-4");
+        EXPECT_EQ(206, entity.Respond(req, resp));
+
+        std::string out = Generate(resp);
+        EXPECT_EQ(0u, out.find("HTTP/1.1 206 Partial Content\r\n"));
+        EXPECT_NE(std::string::npos, out.find("Content-Range: bytes 12-15/16\r\n"));
+        EXPECT_NE(std::string::npos, out.find("Content-Length: 4\r\n"));
+        EXPECT_EQ(out.size() - 8, out.find("\r\n\r\ncdef"));
+
+        // single range refers to the content in place.
+        EXPECT_EQ(0u, arena.GetUsed());
+    }
+
+    {
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("Range", "bytes=0-1,10-11");
+        EXPECT_EQ(206, entity.Respond(req, resp));
+
+        std::string out = Generate(resp);
+        size_t pos = out.find("Content-Type: multipart/byteranges; boundary=");
+        ASSERT_NE(std::string::npos, pos);
+
+        std::string boundary = out.substr(pos + 45, out.find("\r\n", pos) - pos - 45);
+        std::string body = "\r\n--" + boundary + "\r\nContent-Type: text/plain\r\nContent-Range: bytes 0-1/16\r\n\r\n01"
+            "\r\n--" + boundary + "\r\nContent-Type: text/plain\r\nContent-Range: bytes 10-11/16\r\n\r\nab"
+            "\r\n--" + boundary + "--\r\n";
+
+        char len[32];
+        snprintf(len, sizeof(len), "Content-Length: %d\r\n", (int)body.size());
+
+        EXPECT_NE(std::string::npos, out.find(len));
+        EXPECT_EQ(out.size() - body.size(), out.find(body));
+    }
+
+    {
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("Range", "bytes=16-");
+        EXPECT_EQ(416, entity.Respond(req, resp));
+        EXPECT_NE(std::string::npos, Generate(resp).find("Content-Range: bytes */16\r\n"));
+    }
+
+    {
+        // malformed range is ignored.
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("Range", "bytes=x");
+        EXPECT_EQ(200, entity.Respond(req, resp));
+    }
+
+    {
+        // entity changed since, the whole of it is sent.
+        HttpResponse resp;
+        MakeRequest(req, "GET");
+        req.AddHeader("Range", "bytes=0-1");
+        req.AddHeader("If-Range", "\"stale\"");
+        EXPECT_EQ(200, entity.Respond(req, resp));
+
+        HttpResponse resp2;
+        MakeRequest(req, "GET");
+        req.AddHeader("Range", "bytes=0-1");
+        req.AddHeader("If-Range", entity.GetETag().c_str());
+        EXPECT_EQ(206, entity.Respond(req, resp2));
+
+        HttpResponse resp3;
+        MakeRequest(req, "GET");
+        req.AddHeader("Range", "bytes=0-1");
+        req.AddHeader("If-Range", entity.GetLastModified().c_str());
+        EXPECT_EQ(206, entity.Respond(req, resp3));
+    }
+}
+
+TEST(HttpEntityTest, LoadFileTest)
+{
+    char path[] = "/tmp/http_entity_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(5, write(fd, "hello", 5));
+    close(fd);
+
+    HttpEntity* entity = HttpEntity::LoadFile(path, "text/plain");
+    unlink(path);
+
+    ASSERT_TRUE(entity != NULL);
+    EXPECT_EQ("hello", entity->GetContent());
+    EXPECT_LT(0, entity->GetModifiedTime());
+
+    delete entity;
+
+    EXPECT_TRUE(HttpEntity::LoadFile("/tmp", "text/plain") == NULL);
+    EXPECT_TRUE(HttpEntity::LoadFile(path, "text/plain") == NULL);
+}
@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpHpack.h"
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+static std::string FromHex(const char* hex)
+{
+    std::string out;
+
+    for (const char* p = hex; *p; )
+    {
+        if (*p == ' ')
+        {
+            ++p;
+            continue;
+        }
+
+        unsigned int c = 0;
+        sscanf(p, "%2x", &c);
+        out.push_back((char)c);
+        p += 2;
+    }
+
+    return out;
+}
+
+static void CollectHeader(void* arg, const std::string& name, const std::string& value)
+{
+    std::vector<HpackHeader>* headers = (std::vector<HpackHeader>*)arg;
+
+    headers->push_back(HpackHeader(name, value));
+}
+
+static std::string Join(const std::vector<HpackHeader>& headers)
+{
+    std::string out;
+
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        out += headers[i].first + ": " + headers[i].second + "\n";
+    }
+
+    return out;
+}
+
+TEST(HttpHpackTest, IntegerTest)
+{
+    std::string out;
+
+    // rfc 7541, C.1.
+    HpackEncoder::EncodeInteger(10, 5, 0, &out);
+    EXPECT_EQ(FromHex("0a"), out);
+
+    out.clear();
+    HpackEncoder::EncodeInteger(1337, 5, 0xe0, &out);
+    EXPECT_EQ(FromHex("ff 9a 0a"), out);
+
+    out.clear();
+    HpackEncoder::EncodeInteger(42, 8, 0, &out);
+    EXPECT_EQ(FromHex("2a"), out);
+
+    uint64_t val = 0;
+    EXPECT_EQ(3, HpackEncoder::DecodeInteger((const unsigned char*)"\xff\x9a\x0a", 3, 5, &val));
+    EXPECT_EQ(1337u, val);
+
+    EXPECT_EQ(1, HpackEncoder::DecodeInteger((const unsigned char*)"\x2a", 1, 8, &val));
+    EXPECT_EQ(42u, val);
+
+    // short of data, and too long to be sane.
+    EXPECT_EQ(0, HpackEncoder::DecodeInteger((const unsigned char*)"\x1f\x9a", 2, 5, &val));
+    EXPECT_EQ(-1, HpackEncoder::DecodeInteger((const unsigned char*)"\x1f\xff\xff\xff\xff\xff\xff\x01", 8, 5, &val));
+}
+
+TEST(HttpHpackTest, HuffmanTest)
+{
+    const std::string plain = "www.example.com";
+    std::string out;
+
+    // rfc 7541, C.4.1.
+    HpackEncoder::HuffmanEncode((const unsigned char*)plain.data(), plain.size(), &out);
+    EXPECT_EQ(FromHex("f1e3 c2e5 f23a 6ba0 ab90 f4ff"), out);
+    EXPECT_EQ(out.size(), HpackEncoder::HuffmanLength((const unsigned char*)plain.data(), plain.size()));
+
+    std::string decoded;
+    ASSERT_TRUE(HpackEncoder::HuffmanDecode((const unsigned char*)out.data(), out.size(), &decoded));
+    EXPECT_EQ(plain, decoded);
+
+    // every symbol, codes of 5 to 30 bits.
+    std::string all;
+    for (int i = 0; i < 256; ++i) all.push_back((char)i);
+    all += all;
+
+    out.clear();
+    HpackEncoder::HuffmanEncode((const unsigned char*)all.data(), all.size(), &out);
+    ASSERT_TRUE(HpackEncoder::HuffmanDecode((const unsigned char*)out.data(), out.size(), &decoded));
+    EXPECT_EQ(all, decoded);
+
+    // padding of zeros, padding of a byte or more, EOS.
+    EXPECT_FALSE(HpackEncoder::HuffmanDecode((const unsigned char*)"\x00", 1, &decoded));
+    EXPECT_FALSE(HpackEncoder::HuffmanDecode((const unsigned char*)"\x1f\xff", 2, &decoded));
+    EXPECT_FALSE(HpackEncoder::HuffmanDecode((const unsigned char*)"\xff\xff\xff\xff", 4, &decoded));
+}
+
+TEST(HttpHpackTest, DecoderTest)
+{
+    // rfc 7541, C.3 and C.4, the same requests without and with huffman coding.
+    const char* blocks[2][3] = {
+        {
+            "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+            "8286 84be 5808 6e6f 2d63 6163 6865",
+            "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65",
+        },
+        {
+            "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+            "8286 84be 5886 a8eb 1064 9cbf",
+            "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf",
+        },
+    };
+
+    const char* expect[3] = {
+        ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n",
+        ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n",
+        ":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n",
+    };
+
+    const size_t sizes[3] = { 57, 110, 164 };
+
+    for (int h = 0; h < 2; ++h)
+    {
+        HpackDecoder decoder;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            std::string block = FromHex(blocks[h][i]);
+            std::vector<HpackHeader> headers;
+
+            ASSERT_TRUE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers)) << h << i;
+            EXPECT_EQ(expect[i], Join(headers));
+            EXPECT_EQ(sizes[i], decoder.GetTable().GetSize());
+        }
+
+        EXPECT_EQ(3u, decoder.GetTable().GetEntryNum());
+    }
+}
+
+TEST(HttpHpackTest, TableTest)
+{
+    HpackDecoder decoder;
+    std::vector<HpackHeader> headers;
+
+    // new size takes effect, entries that don't fit are evicted.
+    std::string block = FromHex("4003 6162 6303 7879 7a") + FromHex("4003 6465 6603 7576 77");
+    ASSERT_TRUE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+    EXPECT_EQ(2u, decoder.GetTable().GetEntryNum());
+
+    block = FromHex("3f07 be");
+    ASSERT_TRUE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+    EXPECT_EQ(1u, decoder.GetTable().GetEntryNum());
+    EXPECT_EQ("def: uvw\n", Join(std::vector<HpackHeader>(headers.end() - 1, headers.end())));
+
+    // index out of the table.
+    block = FromHex("bf");
+    EXPECT_FALSE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+
+    // size update after a field, and beyond the bound advertised.
+    block = FromHex("82 3f07");
+    EXPECT_FALSE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+
+    decoder.SetMaxTableSize(100);
+    block = FromHex("3f e11f");
+    EXPECT_FALSE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+
+    // string longer than the block.
+    block = FromHex("4005 6162 63");
+    EXPECT_FALSE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+}
+
+TEST(HttpHpackTest, EncoderTest)
+{
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+
+    std::string block;
+    encoder.Encode(":status", "200", &block);
+    EXPECT_EQ(FromHex("88"), block);
+
+    encoder.Encode("content-type", "text/html; charset=utf-8", &block);
+    encoder.Encode("content-length", "1234", &block, false);
+    encoder.Encode("x-request-id", "abcdef", &block);
+
+    EXPECT_EQ(2u, encoder.GetTable().GetEntryNum());
+
+    std::vector<HpackHeader> headers;
+    ASSERT_TRUE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+    EXPECT_EQ(":status: 200\ncontent-type: text/html; charset=utf-8\ncontent-length: 1234\nx-request-id: abcdef\n", Join(headers));
+
+    // fields indexed are a byte each from now on.
+    block.clear();
+    encoder.Encode("content-type", "text/html; charset=utf-8", &block);
+    encoder.Encode("x-request-id", "abcdef", &block);
+    EXPECT_EQ(2u, block.size());
+
+    headers.clear();
+    ASSERT_TRUE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+    EXPECT_EQ("content-type: text/html; charset=utf-8\nx-request-id: abcdef\n", Join(headers));
+
+    // table shrunk by peer, size update leads next block.
+    encoder.SetMaxTableSize(0);
+    encoder.SetMaxTableSize(64);
+    EXPECT_EQ(0u, encoder.GetTable().GetEntryNum());
+
+    block.clear();
+    encoder.Encode("x-request-id", "abcdef", &block);
+    EXPECT_EQ(FromHex("20 3f21"), block.substr(0, 3));
+
+    headers.clear();
+    ASSERT_TRUE(decoder.Decode(block.data(), block.size(), &CollectHeader, &headers));
+    EXPECT_EQ("x-request-id: abcdef\n", Join(headers));
+    EXPECT_EQ(1u, decoder.GetTable().GetEntryNum());
+    EXPECT_EQ(encoder.GetTable().GetSize(), decoder.GetTable().GetSize());
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpMessageParser.h"
+#include "http/unittest/TestUtil.h"
+
+#include <string>
+#include <string.h>
+#include <algorithm>
+
+// feed data in pieces of the given size, keeping what is not consumed like a read buffer does.
+static int FeedInPieces(HttpMessageParser& parser, const std::string& msg, size_t piece)
+{
+    std::string pending;
+    size_t off = 0;
+    int total = 0;
+
+    while (off < msg.size() && !parser.IsMessageComplete())
+    {
+        size_t sz = std::min(piece, msg.size() - off);
+        pending.append(msg, off, sz);
+        off += sz;
+
+        int n = 0;
+        while ((n = parser.Parse(pending.c_str(), pending.size())) > 0)
+        {
+            pending.erase(0, n);
+            total += n;
+        }
+
+        if (n < 0) return -1;
+    }
+
+    return total;
+}
+
+TEST(HttpMessageParserTest, ChunkedRequestTest)
+{
+    std::string msg = "POST /upload?a=1 HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "X-Empty:\r\n"
+        "Connection: keep-alive,   X-Trace\r\n"
+        "\r\n"
+        "5\r\nhello\r\n"
+        "7;ext=1\r\n, world\r\n"
+        "0\r\n"
+        "Trailer-Field: x\r\n"
+        "\r\n";
+
+    for (size_t piece = 1; piece <= msg.size(); piece += 7)
+    {
+        std::string body;
+        HttpMessageParser parser(HttpMessageParser::HPT_REQUEST);
+        parser.SetBodyHandler(&AppendBody, &body);
+
+        ASSERT_EQ((int)msg.size(), FeedInPieces(parser, msg, piece));
+        ASSERT_TRUE(parser.IsMessageComplete());
+
+        EXPECT_EQ("POST", parser.GetMethod());
+        EXPECT_EQ("/upload?a=1", parser.GetUrl());
+        EXPECT_EQ(HttpMessageParser::HBT_CHUNKED, parser.GetBodyType());
+        EXPECT_EQ("hello, world", body);
+
+        ASSERT_TRUE(parser.GetHeader("host") != NULL);
+        EXPECT_EQ("localhost", *parser.GetHeader("host"));
+        EXPECT_EQ("", *parser.GetHeader("X-Empty"));
+
+        EXPECT_TRUE(parser.HasHeaderToken("Connection", "x-trace"));
+        EXPECT_TRUE(parser.IsKeepAlive());
+    }
+}
+
+TEST(HttpMessageParserTest, PipelineAndLengthTest)
+{
+    std::string msg = "PUT /a HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+        "GET /b HTTP/1.0\r\n\r\n";
+
+    std::string body;
+    HttpMessageParser parser(HttpMessageParser::HPT_REQUEST);
+    parser.SetBodyHandler(&AppendBody, &body);
+
+    const char* data = msg.c_str();
+    int len = msg.size();
+
+    // head first, then body, stop at the end of message.
+    int n = parser.Parse(data, len);
+    ASSERT_EQ((int)msg.find("abc"), n);
+    EXPECT_EQ(3, parser.GetContentLength());
+    EXPECT_FALSE(parser.IsMessageComplete());
+
+    ASSERT_EQ(3, parser.Parse(data + n, len - n));
+    EXPECT_TRUE(parser.IsMessageComplete());
+    EXPECT_EQ("abc", body);
+
+    n += 3;
+    EXPECT_EQ(0, parser.Parse(data + n, len - n));
+
+    parser.Reset();
+
+    ASSERT_EQ(len - n, parser.Parse(data + n, len - n));
+    EXPECT_TRUE(parser.IsMessageComplete());
+    EXPECT_EQ("/b", parser.GetUrl());
+    EXPECT_TRUE(parser.IsHttp10());
+    EXPECT_FALSE(parser.IsKeepAlive());
+}
+
+TEST(HttpMessageParserTest, ResponseTest)
+{
+    HttpMessageParser parser(HttpMessageParser::HPT_RESPONSE);
+
+    // no body for HEAD request, whatever the length says.
+    std::string msg = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    parser.SetHeadRequest(true);
+    ASSERT_EQ((int)msg.size(), parser.Parse(msg.c_str(), msg.size()));
+    EXPECT_TRUE(parser.IsMessageComplete());
+    EXPECT_EQ(200, parser.GetStatusCode());
+    EXPECT_EQ("OK", parser.GetReason());
+
+    parser.Reset();
+    msg = "HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n";
+    ASSERT_EQ((int)msg.size(), parser.Parse(msg.c_str(), msg.size()));
+    EXPECT_TRUE(parser.IsMessageComplete());
+
+    // delimited by closing the connection.
+    parser.Reset();
+    msg = "HTTP/1.1 200 OK\r\n\r\nuntil close";
+    int n = parser.Parse(msg.c_str(), msg.size());
+    ASSERT_EQ((int)msg.find("until"), n);
+    ASSERT_EQ(11, parser.Parse(msg.c_str() + n, msg.size() - n));
+    EXPECT_EQ(HttpMessageParser::HBT_CLOSE, parser.GetBodyType());
+    EXPECT_FALSE(parser.IsMessageComplete());
+    EXPECT_FALSE(parser.IsKeepAlive());
+    EXPECT_TRUE(parser.FinishOnClose());
+    EXPECT_TRUE(parser.IsMessageComplete());
+
+    // truncated body.
+    parser.Reset();
+    msg = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc";
+    ASSERT_EQ((int)msg.size() - 3, parser.Parse(msg.c_str(), msg.size()));
+    ASSERT_EQ(3, parser.Parse(msg.c_str() + msg.size() - 3, 3));
+    EXPECT_FALSE(parser.FinishOnClose());
+}
+
+TEST(HttpMessageParserTest, MalformedTest)
+{
+    const char* bad[] =
+    {
+        "GET / HTTP/2.0\r\n\r\n",
+        "GET /\r\n\r\n",
+        "GET / HTTP/1.1\r\nNoColon\r\n\r\n",
+        "GET / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    };
+
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); ++i)
+    {
+        HttpMessageParser parser(HttpMessageParser::HPT_REQUEST);
+
+        int len = strlen(bad[i]);
+        int n = parser.Parse(bad[i], len);
+        if (n > 0) n = parser.Parse(bad[i] + n, len - n);
+
+        EXPECT_EQ(-1, n) << bad[i];
+        EXPECT_EQ(HttpMessageParser::HPS_ERROR, parser.GetState());
+    }
+
+    // head never ends.
+    HttpMessageParser parser(HttpMessageParser::HPT_REQUEST, 64);
+    std::string head = "GET / HTTP/1.1\r\nX-Long: " + std::string(64, 'a');
+    EXPECT_EQ(-1, parser.Parse(head.c_str(), head.size()));
+}
+
+TEST(HttpMessageParserTest, HelperTest)
+{
+    HttpMessageParser::Header header;
+
+    const char line[] = "Accept-Encoding: \tgzip, br \t";
+    ASSERT_TRUE(HttpMessageParser::ParseHeaderLine(line, line + strlen(line), &header));
+    EXPECT_EQ("Accept-Encoding", header.first);
+    EXPECT_EQ("gzip, br", header.second);
+
+    const char tight[] = "Host:localhost";
+    ASSERT_TRUE(HttpMessageParser::ParseHeaderLine(tight, tight + strlen(tight), &header));
+    EXPECT_EQ("Host", header.first);
+    EXPECT_EQ("localhost", header.second);
+
+    const char empty[] = "X-Empty:";
+    ASSERT_TRUE(HttpMessageParser::ParseHeaderLine(empty, empty + strlen(empty), &header));
+    EXPECT_EQ("", header.second);
+
+    const char no_colon[] = "NoColon";
+    const char no_name[] = ": value";
+    EXPECT_FALSE(HttpMessageParser::ParseHeaderLine(no_colon, no_colon + strlen(no_colon), &header));
+    EXPECT_FALSE(HttpMessageParser::ParseHeaderLine(no_name, no_name + strlen(no_name), &header));
+
+    std::vector<HttpMessageParser::Header> headers;
+    headers.push_back(HttpMessageParser::Header("Connection", "keep-alive, Upgrade"));
+
+    ASSERT_TRUE(HttpMessageParser::FindHeader(headers, "connection") != NULL);
+    EXPECT_TRUE(HttpMessageParser::FindHeader(headers, "Upgrade") == NULL);
+
+    EXPECT_TRUE(HttpMessageParser::HasToken(headers[0].second, "upgrade"));
+    EXPECT_TRUE(HttpMessageParser::HasToken(headers[0].second, "Keep-Alive"));
+    EXPECT_FALSE(HttpMessageParser::HasToken(headers[0].second, "keep"));
+    EXPECT_FALSE(HttpMessageParser::HasToken("", "close"));
+}
@@ -0,0 +1,226 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpMultipartParser.h"
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <algorithm>
+
+struct PartRecord
+{
+    std::string name_;
+    std::string fileName_;
+    std::string type_;
+    std::string data_;
+    bool ended_;
+};
+
+struct PartRecorder
+{
+    HttpMultipartParser* parser_;
+    std::vector<PartRecord> parts_;
+};
+
+static void RecordPart(void* arg, HttpMultipartParser::PartEvent evt, const char* data, int len)
+{
+    PartRecorder* rec = (PartRecorder*)arg;
+
+    if (evt == HttpMultipartParser::HME_PART_BEGIN)
+    {
+        PartRecord part;
+        part.name_ = rec->parser_->GetPartName();
+        part.fileName_ = rec->parser_->GetFileName();
+
+        const std::string* type = rec->parser_->GetPartHeader("content-type");
+        if (type) part.type_ = *type;
+
+        part.ended_ = false;
+        rec->parts_.push_back(part);
+        return;
+    }
+
+    ASSERT_FALSE(rec->parts_.empty());
+
+    if (evt == HttpMultipartParser::HME_PART_DATA)
+    {
+        rec->parts_.back().data_.append(data, len);
+    }
+    else
+    {
+        rec->parts_.back().ended_ = true;
+    }
+}
+
+// feed data in pieces of the given size, keeping what is not consumed like a read buffer does,
+// return the max number of bytes left unconsumed.
+static int FeedInPieces(HttpMultipartParser& parser, const std::string& body, size_t piece)
+{
+    std::string pending;
+    size_t off = 0;
+    size_t maxPending = 0;
+
+    while (off < body.size())
+    {
+        size_t sz = std::min(piece, body.size() - off);
+        pending.append(body, off, sz);
+        off += sz;
+
+        int n = parser.Parse(pending.c_str(), pending.size());
+        if (n < 0) return -1;
+
+        pending.erase(0, n);
+        maxPending = std::max(maxPending, pending.size());
+    }
+
+    if (!pending.empty()) return -1;
+
+    return maxPending;
+}
+
+TEST(HttpMultipartParserTest, SearchTest)
+{
+    unsigned char skip[256];
+
+    const char needle[] = "\r\n--abcab";
+    int nlen = sizeof(needle) - 1;
+
+    HttpMultipartParser::BuildSkip(needle, nlen, skip);
+
+    std::string hay = "xx\r\n--abca\r\n--abcabyy";
+    EXPECT_EQ(10, HttpMultipartParser::Search(hay.data(), hay.size(), needle, nlen, skip));
+    EXPECT_EQ(-1, HttpMultipartParser::Search(hay.data(), 18, needle, nlen, skip));
+    EXPECT_EQ(-1, HttpMultipartParser::Search(needle, nlen - 1, needle, nlen, skip));
+    EXPECT_EQ(0, HttpMultipartParser::Search(needle, nlen, needle, nlen, skip));
+
+    // same result as std::search over random text of a small alphabet.
+    std::string text;
+    unsigned int seed = 7;
+    for (int i = 0; i < 20000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        text.push_back("\r\n-abc"[(seed >> 16) % 6]);
+    }
+
+    const char* cur = text.data();
+    const char* end = cur + text.size();
+
+    while (cur < end)
+    {
+        const char* expect = std::search(cur, end, needle, needle + nlen);
+        int pos = HttpMultipartParser::Search(cur, end - cur, needle, nlen, skip);
+
+        if (expect == end)
+        {
+            EXPECT_EQ(-1, pos);
+            break;
+        }
+
+        ASSERT_EQ(expect - cur, pos);
+        cur = expect + 1;
+    }
+}
+
+TEST(HttpMultipartParserTest, BoundaryTest)
+{
+    std::string boundary;
+
+    EXPECT_TRUE(HttpMultipartParser::ParseBoundary("multipart/form-data; boundary=abc", &boundary));
+    EXPECT_EQ("abc", boundary);
+
+    EXPECT_TRUE(HttpMultipartParser::ParseBoundary("Multipart/Form-Data;charset=x; BOUNDARY=\"a;b c\"", &boundary));
+    EXPECT_EQ("a;b c", boundary);
+
+    EXPECT_FALSE(HttpMultipartParser::ParseBoundary("text/plain; boundary=abc", &boundary));
+    EXPECT_FALSE(HttpMultipartParser::ParseBoundary("multipart/form-data", &boundary));
+    EXPECT_FALSE(HttpMultipartParser::ParseBoundary("multipart/form-data; boundary=", &boundary));
+    EXPECT_FALSE(HttpMultipartParser::ParseBoundary("multipart/form-data; boundary=" + std::string(71, 'x'), &boundary));
+}
+
+TEST(HttpMultipartParserTest, StreamPartsTest)
+{
+    // data contains things that look like part of the boundary.
+    std::string file(5000, 'z');
+    file.replace(100, 8, "\r\n--XyY\r");
+    file.replace(4000, 3, "\r\n-");
+
+    std::string body = "--XyZ\r\n"
+        "Content-Disposition: form-data; name=\"title\"\r\n"
+        "\r\n"
+        "hello\r\n"
+        "--XyZ  \r\n"
+        "Content-Disposition: form-data; name=\"doc\"; filename=\"a; b.txt\"\r\n"
+        "Content-Type: text/plain\r\n"
+        "\r\n"
+        + file +
+        "\r\n--XyZ\r\n"
+        "\r\n"
+        "\r\n--XyZ--\r\n"
+        "epilogue is ignored";
+
+    for (size_t piece = 1; piece <= body.size(); piece = piece * 2 + 1)
+    {
+        HttpMultipartParser parser;
+        ASSERT_TRUE(parser.Init("multipart/form-data; boundary=XyZ"));
+
+        PartRecorder rec;
+        rec.parser_ = &parser;
+        parser.SetPartHandler(&RecordPart, &rec);
+
+        int pending = FeedInPieces(parser, body, piece);
+        ASSERT_LE(0, pending);
+        ASSERT_TRUE(parser.IsComplete());
+
+        // only boundary candidates and part heads are held back.
+        EXPECT_GE(200, pending);
+
+        ASSERT_EQ(3, parser.GetPartNum());
+        ASSERT_EQ(3u, rec.parts_.size());
+
+        EXPECT_EQ("title", rec.parts_[0].name_);
+        EXPECT_EQ("hello", rec.parts_[0].data_);
+        EXPECT_TRUE(rec.parts_[0].ended_);
+
+        EXPECT_EQ("doc", rec.parts_[1].name_);
+        EXPECT_EQ("a; b.txt", rec.parts_[1].fileName_);
+        EXPECT_EQ("text/plain", rec.parts_[1].type_);
+        EXPECT_TRUE(rec.parts_[1].data_ == file);
+        EXPECT_TRUE(rec.parts_[1].ended_);
+
+        // part without head.
+        EXPECT_EQ("", rec.parts_[2].name_);
+        EXPECT_EQ("", rec.parts_[2].data_);
+        EXPECT_TRUE(rec.parts_[2].ended_);
+    }
+}
+
+TEST(HttpMultipartParserTest, PreambleAndErrorTest)
+{
+    HttpMultipartParser parser;
+    EXPECT_EQ(-1, parser.Parse("--b\r\n", 5));
+
+    ASSERT_TRUE(parser.Init("multipart/mixed; boundary=b"));
+
+    PartRecorder rec;
+    rec.parser_ = &parser;
+    parser.SetPartHandler(&RecordPart, &rec);
+
+    std::string body = "preamble\r\n--b\r\n\r\nx\r\n--b--";
+    EXPECT_LE(0, FeedInPieces(parser, body, 3));
+    EXPECT_TRUE(parser.IsComplete());
+    ASSERT_EQ(1u, rec.parts_.size());
+    EXPECT_EQ("x", rec.parts_[0].data_);
+
+    // garbage after boundary.
+    ASSERT_TRUE(parser.Init("multipart/mixed; boundary=b"));
+    const char bad[] = "--b garbage\r\n";
+    EXPECT_EQ(-1, parser.Parse(bad, sizeof(bad) - 1));
+    EXPECT_EQ(HttpMultipartParser::HMS_ERROR, parser.GetState());
+
+    // part head too large.
+    HttpMultipartParser small(64);
+    ASSERT_TRUE(small.Init("multipart/mixed; boundary=b"));
+
+    std::string head = "--b\r\nX-Long: " + std::string(100, 'a');
+    EXPECT_EQ(-1, small.Parse(head.c_str(), head.size()));
+}
@@ -0,0 +1,508 @@
+#include <gtest/gtest.h>
+
+#include "thread/Thread.h"
+#include "http/HttpProxy.h"
+#include "http/HttpMessageParser.h"
+#include "http/unittest/TestUtil.h"
+
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// ListenTo() returns nonblocking socket, backend accepts in blocking mode.
+static void SetBlocking(int fd)
+{
+    int flag = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flag & ~O_NONBLOCK);
+}
+
+static int ConnectLocal(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct timeval tv = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// read one message from a blocking socket, bytes of next message are kept in pending.
+static bool ReadMessage(int fd, HttpMessageParser& parser, std::string& pending)
+{
+    char buf[16*1024];
+
+    while (true)
+    {
+        int n = 0;
+        while (!pending.empty() && (n = parser.Parse(pending.c_str(), pending.size())) > 0)
+        {
+            pending.erase(0, n);
+        }
+
+        if (n < 0) return false;
+        if (parser.IsMessageComplete()) return true;
+
+        n = read(fd, buf, sizeof(buf));
+        if (n <= 0) return parser.FinishOnClose();
+
+        pending.append(buf, n);
+    }
+}
+
+// stand-in upstream serving keep-alive connections, one thread per connection.
+// the response carries the id of the backend and of the connection,
+// body of request is echoed back, url is sent back if there is no body.
+class ProxyBackend: public ThreadBase
+{
+    public:
+
+        explicit ProxyBackend(int id)
+            :m_id(id), m_fd(-1), m_conns(0), m_requests(0), m_stop(false)
+        {
+            m_fd = ListenTo("127.0.0.1", 0);
+        }
+
+        // connections end when proxy closes them, destroy proxy first.
+        ~ProxyBackend()
+        {
+            for (size_t i = 0; i < m_workers.size(); ++i)
+            {
+                m_workers[i]->Join();
+                delete m_workers[i];
+            }
+        }
+
+        int GetPort() const { return GetLocalPort(m_fd); }
+        int GetRequests() const { return m_requests; }
+        int GetConnections() const { return m_conns; }
+
+        void Stop()
+        {
+            m_stop = true;
+
+            // wake up accept().
+            int fd = ConnectLocal(GetPort());
+            Join();
+
+            if (fd >= 0) close(fd);
+
+            close(m_fd);
+        }
+
+        virtual void Run()
+        {
+            SetBlocking(m_fd);
+
+            while (true)
+            {
+                int fd = accept(m_fd, NULL, NULL);
+                if (fd < 0) break;
+
+                if (m_stop)
+                {
+                    close(fd);
+                    break;
+                }
+
+                ConnWorker* worker = new ConnWorker(*this, fd, m_conns++);
+                m_workers.push_back(worker);
+                worker->Start();
+            }
+        }
+
+    private:
+
+        class ConnWorker: public ThreadBase
+        {
+            public:
+
+                ConnWorker(ProxyBackend& backend, int fd, int id)
+                    :m_backend(backend), m_fd(fd), m_id(id)
+                {
+                }
+
+                virtual void Run()
+                {
+                    std::string pending;
+
+                    while (true)
+                    {
+                        std::string body;
+                        HttpMessageParser parser(HttpMessageParser::HPT_REQUEST);
+                        parser.SetBodyHandler(&AppendBody, &body);
+
+                        if (!ReadMessage(m_fd, parser, pending) || parser.GetMethod().empty()) break;
+
+                        __sync_fetch_and_add(&m_backend.m_requests, 1);
+
+                        if (parser.GetUrl() == "/slow") usleep(300*1000);
+
+                        if (body.empty()) body = parser.GetUrl();
+
+                        const std::string* forwarded = parser.GetHeader("X-Forwarded-For");
+
+                        char head[512];
+                        snprintf(head, sizeof(head),
+                                "HTTP/1.1 200 OK\r\n"
+                                "X-Backend: %d\r\n"
+                                "X-Conn: %d\r\n"
+                                "X-Has-Secret: %d\r\n"
+                                "X-Seen-For: %s\r\n",
+                                m_backend.m_id, m_id,
+                                parser.GetHeader("X-Secret") != NULL,
+                                forwarded? forwarded->c_str() : "");
+
+                        std::string resp = head;
+
+                        if (parser.GetHeader("X-Chunked"))
+                        {
+                            resp += "Transfer-Encoding: chunked\r\n\r\n";
+
+                            for (size_t off = 0; off < body.size(); off += 10000)
+                            {
+                                size_t sz = std::min((size_t)10000, body.size() - off);
+
+                                char line[32];
+                                snprintf(line, sizeof(line), "%x\r\n", (unsigned)sz);
+
+                                resp += line;
+                                resp.append(body, off, sz);
+                                resp += "\r\n";
+                            }
+
+                            resp += "0\r\n\r\n";
+                        }
+                        else
+                        {
+                            char len[64];
+                            snprintf(len, sizeof(len), "Content-Length: %d\r\n\r\n", (int)body.size());
+
+                            resp += len;
+                            resp += body;
+                        }
+
+                        if (!WriteAll(m_fd, resp.c_str(), resp.size())) break;
+                    }
+
+                    close(m_fd);
+                }
+
+            private:
+
+                ProxyBackend& m_backend;
+                int m_fd;
+                int m_id;
+        };
+
+        const int m_id;
+        int m_fd;
+        int m_conns;
+        volatile int m_requests;
+        volatile bool m_stop;
+        std::vector<ConnWorker*> m_workers;
+};
+
+class ProxyThread: public ThreadBase
+{
+    public:
+
+        explicit ProxyThread(HttpProxy& proxy)
+            :m_proxy(proxy), m_port(-1)
+        {
+            int fd = ListenTo("127.0.0.1", 0);
+
+            m_port = GetLocalPort(fd);
+            m_proxy.SetListenSock(fd);
+        }
+
+        int GetPort() const { return m_port; }
+
+        void Stop()
+        {
+            m_proxy.SetStop();
+
+            // wake up the poller.
+            int fd = ConnectLocal(m_port);
+            Join();
+
+            if (fd >= 0) close(fd);
+        }
+
+        virtual void Run()
+        {
+            m_proxy.RunServer();
+        }
+
+    private:
+
+        HttpProxy& m_proxy;
+        int m_port;
+};
+
+struct ProxyResponse
+{
+    int status;
+    std::string body;
+    std::string backend;
+    std::string conn;
+    std::string secret;
+    std::string forwarded;
+    std::string connection;
+};
+
+static bool DoRequest(int fd, const std::string& req, ProxyResponse& resp, std::string& pending)
+{
+    if (!WriteAll(fd, req.c_str(), req.size())) return false;
+
+    resp.body.clear();
+
+    HttpMessageParser parser(HttpMessageParser::HPT_RESPONSE);
+    parser.SetBodyHandler(&AppendBody, &resp.body);
+
+    if (!ReadMessage(fd, parser, pending)) return false;
+
+    const std::string* val;
+
+    resp.status = parser.GetStatusCode();
+    resp.backend = (val = parser.GetHeader("X-Backend"))? *val : "";
+    resp.conn = (val = parser.GetHeader("X-Conn"))? *val : "";
+    resp.secret = (val = parser.GetHeader("X-Has-Secret"))? *val : "";
+    resp.forwarded = (val = parser.GetHeader("X-Seen-For"))? *val : "";
+    resp.connection = (val = parser.GetHeader("Connection"))? *val : "";
+
+    return true;
+}
+
+TEST(HttpProxyTest, KeepAliveAndBalanceTest)
+{
+    ProxyBackend backend0(0), backend1(1);
+    backend0.Start();
+    backend1.Start();
+
+    HttpProxy proxy;
+    proxy.AddUpstream("127.0.0.1", backend0.GetPort());
+    proxy.AddUpstream("127.0.0.1", backend1.GetPort());
+
+    ProxyThread thread(proxy);
+    thread.Start();
+
+    int fd = ConnectLocal(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    std::string pending;
+    int hits[2] = {0, 0};
+
+    for (int i = 0; i < 20; ++i)
+    {
+        char req[256];
+        snprintf(req, sizeof(req),
+                "GET /req/%d HTTP/1.1\r\n"
+                "Host: test\r\n"
+                "Connection: keep-alive, X-Secret\r\n"
+                "X-Secret: 1\r\n"
+                "X-Forwarded-For: 10.0.0.1\r\n"
+                "\r\n", i);
+
+        ProxyResponse resp;
+        ASSERT_TRUE(DoRequest(fd, req, resp, pending));
+
+        char url[32];
+        snprintf(url, sizeof(url), "/req/%d", i);
+
+        EXPECT_EQ(200, resp.status);
+        EXPECT_EQ(url, resp.body);
+        EXPECT_EQ("0", resp.secret);
+        EXPECT_EQ("10.0.0.1, 127.0.0.1", resp.forwarded);
+        EXPECT_EQ("keep-alive", resp.connection);
+
+        // one pooled connection per backend is enough for sequential requests.
+        EXPECT_EQ("0", resp.conn);
+
+        ++hits[atoi(resp.backend.c_str())];
+    }
+
+    // no outstanding request, ties go round robin.
+    EXPECT_EQ(10, hits[0]);
+    EXPECT_EQ(10, hits[1]);
+
+    close(fd);
+    thread.Stop();
+
+    EXPECT_EQ(1, proxy.GetUpstreamConnects(0));
+    EXPECT_EQ(1, proxy.GetUpstreamConnects(1));
+    EXPECT_EQ(10, proxy.GetUpstreamRequests(0));
+    EXPECT_EQ(10, proxy.GetUpstreamRequests(1));
+
+    backend0.Stop();
+    backend1.Stop();
+
+    EXPECT_EQ(1, backend0.GetConnections());
+    EXPECT_EQ(1, backend1.GetConnections());
+}
+
+TEST(HttpProxyTest, LeastOutstandingTest)
+{
+    ProxyBackend backend0(0), backend1(1);
+    backend0.Start();
+    backend1.Start();
+
+    HttpProxy proxy;
+    proxy.AddUpstream("127.0.0.1", backend0.GetPort());
+    proxy.AddUpstream("127.0.0.1", backend1.GetPort());
+
+    ProxyThread thread(proxy);
+    thread.Start();
+
+    int slow = ConnectLocal(thread.GetPort());
+    int fast = ConnectLocal(thread.GetPort());
+    ASSERT_LE(0, slow);
+    ASSERT_LE(0, fast);
+
+    std::string req = "GET /slow HTTP/1.1\r\nHost: test\r\n\r\n";
+    ASSERT_TRUE(WriteAll(slow, req.c_str(), req.size()));
+
+    usleep(50*1000);
+
+    // backend of the slow request has one outstanding, the other takes all.
+    std::string pending;
+    for (int i = 0; i < 5; ++i)
+    {
+        ProxyResponse resp;
+        ASSERT_TRUE(DoRequest(fast, "GET /fast HTTP/1.1\r\nHost: test\r\n\r\n", resp, pending));
+
+        EXPECT_EQ(200, resp.status);
+        EXPECT_EQ("1", resp.backend);
+    }
+
+    ProxyResponse resp;
+    std::string slow_pending;
+    ASSERT_TRUE(DoRequest(slow, "", resp, slow_pending));
+    EXPECT_EQ("0", resp.backend);
+    EXPECT_EQ("/slow", resp.body);
+
+    close(slow);
+    close(fast);
+    thread.Stop();
+
+    EXPECT_EQ(1, proxy.GetUpstreamRequests(0));
+    EXPECT_EQ(5, proxy.GetUpstreamRequests(1));
+
+    backend0.Stop();
+    backend1.Stop();
+}
+
+TEST(HttpProxyTest, StreamBodyTest)
+{
+    ProxyBackend backend(0);
+    backend.Start();
+
+    HttpProxy proxy;
+    proxy.AddUpstream("127.0.0.1", backend.GetPort());
+
+    ProxyThread thread(proxy);
+    thread.Start();
+
+    int fd = ConnectLocal(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    // several times the buffering limit of proxy, each way.
+    std::string body(4*1024*1024, '\0');
+    for (size_t i = 0; i < body.size(); ++i)
+    {
+        body[i] = 'a' + (i * 7 + i / 4096) % 26;
+    }
+
+    char head[256];
+    snprintf(head, sizeof(head),
+            "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length: %d\r\n\r\n", (int)body.size());
+
+    std::string pending;
+    ProxyResponse resp;
+    ASSERT_TRUE(DoRequest(fd, head + body, resp, pending));
+    EXPECT_EQ(200, resp.status);
+    EXPECT_TRUE(resp.body == body);
+
+    // chunked both ways, the framing is passed through.
+    std::string req = "POST /echo HTTP/1.1\r\nHost: test\r\n"
+        "Transfer-Encoding: chunked\r\nX-Chunked: 1\r\n\r\n";
+
+    for (size_t off = 0; off < body.size(); off += 65536)
+    {
+        char line[32];
+        snprintf(line, sizeof(line), "%x\r\n", 65536);
+
+        req += line;
+        req.append(body, off, 65536);
+        req += "\r\n";
+    }
+
+    req += "0\r\n\r\n";
+
+    ASSERT_TRUE(DoRequest(fd, req, resp, pending));
+    EXPECT_EQ(200, resp.status);
+    EXPECT_TRUE(resp.body == body);
+
+    close(fd);
+    thread.Stop();
+
+    EXPECT_EQ(1, proxy.GetUpstreamConnects(0));
+
+    backend.Stop();
+}
+
+TEST(HttpProxyTest, UpstreamDownTest)
+{
+    // a port nobody listens to.
+    int fd = ListenTo("127.0.0.1", 0);
+    int port = GetLocalPort(fd);
+    close(fd);
+
+    HttpProxy proxy;
+    proxy.AddUpstream("127.0.0.1", port);
+
+    ProxyThread thread(proxy);
+    thread.Start();
+
+    fd = ConnectLocal(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    std::string pending;
+    ProxyResponse resp;
+    ASSERT_TRUE(DoRequest(fd, "GET / HTTP/1.1\r\nHost: test\r\n\r\n", resp, pending));
+    EXPECT_EQ(502, resp.status);
+
+    close(fd);
+
+    fd = ConnectLocal(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    ASSERT_TRUE(DoRequest(fd, "BROKEN\r\n\r\n", resp, pending));
+    EXPECT_EQ(400, resp.status);
+
+    close(fd);
+    thread.Stop();
+}
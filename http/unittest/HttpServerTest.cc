@@ -0,0 +1,674 @@
+#include <gtest/gtest.h>
+
+#include "thread/Thread.h"
+#include "http/HttpArena.h"
+#include "http/HttpHpack.h"
+#include "http/HttpServer.h"
+
+#include <string>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static void StreamRequestHandler(const HttpRequest& req, HttpResponse& response)
+{
+    if (req.GetUrl() == "/events")
+    {
+        response.SetEventStream("ticks");
+        return;
+    }
+
+    response.SetShouldResponse(true);
+    response.SetStatusCode(HttpResponse::HSC_404);
+    response.SetStatusMessage("Not Found");
+    response.AddHeader("Content-Length", "0");
+}
+
+struct UploadState
+{
+    int parts_;
+    int64_t bytes_;
+    unsigned int sum_;
+};
+
+static void UploadPartHandler(HttpRequest& req, const HttpMultipartParser& parser,
+        HttpMultipartParser::PartEvent evt, const char* data, int len)
+{
+    UploadState* state = (UploadState*)req.GetUserData();
+    if (state == NULL)
+    {
+        state = (UploadState*)req.GetArena()->Alloc(sizeof(UploadState));
+        memset(state, 0, sizeof(*state));
+        req.SetUserData(state);
+    }
+
+    if (evt == HttpMultipartParser::HME_PART_BEGIN)
+    {
+        if (parser.GetFileName() == "big.bin") ++state->parts_;
+        return;
+    }
+
+    if (evt != HttpMultipartParser::HME_PART_DATA) return;
+
+    state->bytes_ += len;
+    for (int i = 0; i < len; ++i) state->sum_ = state->sum_ * 31 + (unsigned char)data[i];
+}
+
+static void UploadRequestHandler(const HttpRequest& req, HttpResponse& response)
+{
+    const UploadState* state = (const UploadState*)req.GetUserData();
+
+    char body[128];
+    int len = snprintf(body, sizeof(body), "parts=%d bytes=%lld sum=%u",
+            state? state->parts_ : 0, state? (long long)state->bytes_ : 0LL, state? state->sum_ : 0);
+
+    char clen[16];
+    snprintf(clen, sizeof(clen), "%d", len);
+
+    response.SetShouldResponse(true);
+    response.SetStatusCode(HttpResponse::HSC_200);
+    response.SetStatusMessage("OK");
+    response.AddHeader("Content-Length", clen);
+    response.SetBody(body);
+}
+
+class HttpServerThread: public ThreadBase
+{
+    public:
+
+        explicit HttpServerThread(HttpServer& server)
+            :m_server(server), m_port(-1)
+        {
+            int fd = ListenTo("127.0.0.1", 0);
+
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            if (getsockname(fd, (struct sockaddr*)&addr, &len) == 0) m_port = ntohs(addr.sin_port);
+
+            m_server.SetListenSock(fd);
+        }
+
+        int GetPort() const { return m_port; }
+
+        // heartbeat timer wakes up the poller.
+        void Stop()
+        {
+            m_server.SetStop();
+            Join();
+        }
+
+        virtual void Run()
+        {
+            m_server.RunServer();
+        }
+
+    private:
+
+        HttpServer& m_server;
+        int m_port;
+};
+
+static int ConnectServer(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct timeval tv = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// read until data ends with delim, bytes read are appended to out.
+static bool ReadUntil(int fd, const char* delim, std::string* out)
+{
+    size_t len = strlen(delim);
+
+    while (out->size() < len || out->compare(out->size() - len, len, delim) != 0)
+    {
+        char c;
+        int n = read(fd, &c, 1);
+        if (n <= 0) return false;
+
+        out->push_back(c);
+    }
+
+    return true;
+}
+
+TEST(HttpServerTest, EventStreamTest)
+{
+    HttpServer server;
+    server.SetHttpHandler(&StreamRequestHandler);
+    server.SetHeartbeat(20000);
+
+    HttpServerThread thread(server);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    const char req[] = "GET /events HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ASSERT_EQ((int)sizeof(req) - 1, write(fd, req, sizeof(req) - 1));
+
+    std::string head;
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\n", &head));
+    EXPECT_EQ(0, head.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos, head.find("Content-Type: text/event-stream\r\n"));
+    EXPECT_EQ(std::string::npos, head.find("Content-Length"));
+
+    // stream is subscribed once its head is sent, shortly after it is read by peer.
+    int num = 0;
+    for (int i = 0; i < 500 && num == 0; ++i)
+    {
+        num = server.PublishEvent("ticks", "tick", "a\nb");
+        if (num == 0) usleep(1000);
+    }
+
+    ASSERT_EQ(1, num);
+    EXPECT_EQ(0, server.PublishEvent("other", "tick", "c"));
+
+    // heartbeats may go ahead of the event.
+    std::string frame;
+    do
+    {
+        frame.clear();
+        ASSERT_TRUE(ReadUntil(fd, "\n\n", &frame));
+    } while (frame == ":\n\n");
+
+    EXPECT_EQ("event: tick\ndata: a\ndata: b\n\n", frame);
+
+    // idle stream is kept alive by heartbeats.
+    frame.clear();
+    ASSERT_TRUE(ReadUntil(fd, "\n\n", &frame));
+    EXPECT_EQ(":\n\n", frame);
+
+    // other requests are served as usual.
+    int fd2 = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd2);
+
+    const char req2[] = "GET /none HTTP/1.1\r\n\r\n";
+    ASSERT_EQ((int)sizeof(req2) - 1, write(fd2, req2, sizeof(req2) - 1));
+
+    head.clear();
+    ASSERT_TRUE(ReadUntil(fd2, "\r\n\r\n", &head));
+    EXPECT_EQ(0, head.find("HTTP/1.1 404 Not Found\r\n"));
+
+    close(fd2);
+
+    // stream closed by peer is dropped.
+    close(fd);
+
+    for (int i = 0; i < 500 && num > 0; ++i)
+    {
+        usleep(1000);
+        num = server.PublishEvent("ticks", NULL, "gone");
+    }
+
+    EXPECT_EQ(0, num);
+
+    thread.Stop();
+}
+
+TEST(HttpServerTest, HeartbeatDeferTest)
+{
+    HttpServer server;
+    server.SetHttpHandler(&StreamRequestHandler);
+    server.SetHeartbeat(200000);
+
+    HttpServerThread thread(server);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    const char req[] = "GET /events HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ASSERT_EQ((int)sizeof(req) - 1, write(fd, req, sizeof(req) - 1));
+
+    std::string head;
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\n", &head));
+
+    // event without data has an empty data field.
+    int num = 0;
+    for (int i = 0; i < 500 && num == 0; ++i)
+    {
+        num = server.PublishEvent("ticks", NULL, NULL);
+        if (num == 0) usleep(1000);
+    }
+
+    ASSERT_EQ(1, num);
+
+    // events keep coming within the interval, no heartbeat is sent.
+    for (int i = 0; i < 50; ++i)
+    {
+        EXPECT_EQ(1, server.PublishEvent("ticks", "tick", ""));
+        usleep(10000);
+    }
+
+    std::string frame;
+    ASSERT_TRUE(ReadUntil(fd, "\n\n", &frame));
+    EXPECT_EQ("data: \n\n", frame);
+
+    for (int i = 0; i < 50; ++i)
+    {
+        frame.clear();
+        ASSERT_TRUE(ReadUntil(fd, "\n\n", &frame));
+        EXPECT_EQ("event: tick\ndata: \n\n", frame);
+    }
+
+    // heartbeat comes back once the stream is idle.
+    frame.clear();
+    ASSERT_TRUE(ReadUntil(fd, "\n\n", &frame));
+    EXPECT_EQ(":\n\n", frame);
+
+    close(fd);
+    thread.Stop();
+}
+
+TEST(HttpServerTest, SplitRequestTest)
+{
+    HttpServer server;
+    server.SetHttpHandler(&StreamRequestHandler);
+    server.SetHeartbeat(20000);
+
+    HttpServerThread thread(server);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    // request trickles in, each piece is read on its own.
+    const char* pieces[] = { "GE", "T /no", "ne HTTP/1.1\r", "\nHost: loc", "alhost\r\n", "\r\n" };
+
+    for (size_t i = 0; i < sizeof(pieces)/sizeof(pieces[0]); ++i)
+    {
+        ASSERT_EQ((int)strlen(pieces[i]), write(fd, pieces[i], strlen(pieces[i])));
+        usleep(5000);
+    }
+
+    std::string head;
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\n", &head));
+    EXPECT_EQ(0, head.find("HTTP/1.1 404 Not Found\r\n"));
+
+    close(fd);
+
+    thread.Stop();
+}
+
+TEST(HttpServerTest, MultipartUploadTest)
+{
+    HttpServer server;
+    server.SetHttpHandler(&UploadRequestHandler);
+    server.SetPartHandler(&UploadPartHandler);
+    server.SetHeartbeat(20000);
+
+    HttpServerThread thread(server);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    // far beyond HttpRequest::MaxBodyLength, never buffered as a whole.
+    std::string file(2*1024*1024, 'x');
+
+    unsigned int sum = 0;
+    for (size_t i = 0; i < file.size(); ++i)
+    {
+        file[i] = (i % 1000 == 998)? '\r' : (i % 1000 == 999)? '\n' : 'a' + i % 26;
+        sum = sum * 31 + (unsigned char)file[i];
+    }
+
+    std::string body = "--bNd\r\n"
+        "Content-Disposition: form-data; name=\"up\"; filename=\"big.bin\"\r\n"
+        "\r\n" + file + "\r\n--bNd--\r\n";
+
+    char head[256];
+    snprintf(head, sizeof(head), "POST /upload HTTP/1.1\r\n"
+            "Content-Type: multipart/form-data; boundary=bNd\r\n"
+            "Content-Length: %d\r\n\r\n", (int)body.size());
+
+    std::string req = head + body;
+
+    size_t off = 0;
+    while (off < req.size())
+    {
+        int n = write(fd, req.data() + off, req.size() - off);
+        ASSERT_LT(0, n);
+
+        off += n;
+    }
+
+    std::string resp;
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\n", &resp));
+    EXPECT_EQ(0, resp.find("HTTP/1.1 200 OK\r\n"));
+
+    char expect[128];
+    snprintf(expect, sizeof(expect), "parts=1 bytes=%d sum=%u", (int)file.size(), sum);
+
+    resp.clear();
+    ASSERT_TRUE(ReadUntil(fd, expect, &resp));
+    EXPECT_EQ(expect, resp);
+
+    close(fd);
+
+    // malformed body closes the connection.
+    fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    const char bad[] = "POST /upload HTTP/1.1\r\n"
+        "Content-Type: multipart/form-data; boundary=bNd\r\n"
+        "Content-Length: 10\r\n\r\n"
+        "--bNd xxxx";
+
+    ASSERT_EQ((int)sizeof(bad) - 1, write(fd, bad, sizeof(bad) - 1));
+
+    resp.clear();
+    EXPECT_FALSE(ReadUntil(fd, "\r\n\r\n", &resp));
+    EXPECT_TRUE(resp.empty());
+
+    close(fd);
+
+    thread.Stop();
+}
+
+static int gs_handlerCalls = 0;
+
+static void CountingRequestHandler(const HttpRequest& req, HttpResponse& response)
+{
+    ++gs_handlerCalls;
+    StreamRequestHandler(req, response);
+}
+
+TEST(HttpServerTest, EntityTest)
+{
+    HttpServer server;
+    server.SetHttpHandler(&CountingRequestHandler);
+    server.SetHeartbeat(20000);
+
+    HttpEntity* entity = new HttpEntity("static content", 14, "text/plain", 784111777);
+    std::string etag = entity->GetETag();
+
+    server.AddEntity("/static.txt", entity);
+
+    HttpServerThread thread(server);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    std::string req = "GET /static.txt HTTP/1.1\r\n\r\n"
+        "GET /static.txt HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n"
+        "GET /static.txt HTTP/1.1\r\nRange: bytes=7-\r\n\r\n";
+
+    ASSERT_EQ((int)req.size(), write(fd, req.data(), req.size()));
+
+    std::string resp;
+    ASSERT_TRUE(ReadUntil(fd, "static content", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+
+    resp.clear();
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\n", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 304 Not Modified\r\n"));
+
+    resp.clear();
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\ncontent", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 206 Partial Content\r\n"));
+    EXPECT_NE(std::string::npos, resp.find("Content-Range: bytes 7-13/14\r\n"));
+
+    // path is matched once decoded and normalized, query is not part of it.
+    const char dotted[] = "GET /x/..//static%2etxt?v=1 HTTP/1.1\r\n\r\n";
+    ASSERT_EQ((int)sizeof(dotted) - 1, write(fd, dotted, sizeof(dotted) - 1));
+
+    resp.clear();
+    ASSERT_TRUE(ReadUntil(fd, "static content", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+
+    // other paths still go to handler.
+    const char other[] = "GET /none HTTP/1.1\r\n\r\n";
+    ASSERT_EQ((int)sizeof(other) - 1, write(fd, other, sizeof(other) - 1));
+
+    resp.clear();
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\n", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 404 Not Found\r\n"));
+
+    close(fd);
+
+    thread.Stop();
+
+    EXPECT_EQ(1, gs_handlerCalls);
+}
+
+struct Http2Frame
+{
+    int type_;
+    int flags_;
+    uint32_t id_;
+    std::string payload_;
+};
+
+static std::string MakeHttp2Frame(int type, int flags, uint32_t id, const std::string& payload)
+{
+    unsigned char head[9] = {
+        (unsigned char)(payload.size() >> 16), (unsigned char)(payload.size() >> 8), (unsigned char)payload.size(),
+        (unsigned char)type, (unsigned char)flags,
+        (unsigned char)(id >> 24), (unsigned char)(id >> 16), (unsigned char)(id >> 8), (unsigned char)id,
+    };
+
+    return std::string((const char*)head, sizeof(head)) + payload;
+}
+
+static bool ReadFull(int fd, char* buf, int len)
+{
+    int got = 0;
+    while (got < len)
+    {
+        int n = read(fd, buf + got, len - got);
+        if (n <= 0) return false;
+
+        got += n;
+    }
+
+    return true;
+}
+
+static bool ReadHttp2Frame(int fd, Http2Frame* frame)
+{
+    unsigned char head[9];
+    if (!ReadFull(fd, (char*)head, sizeof(head))) return false;
+
+    frame->type_ = head[3];
+    frame->flags_ = head[4];
+    frame->id_ = (uint32_t)head[5] << 24 | head[6] << 16 | head[7] << 8 | head[8];
+    frame->payload_.resize(head[0] << 16 | head[1] << 8 | head[2]);
+
+    return frame->payload_.empty() || ReadFull(fd, &frame->payload_[0], frame->payload_.size());
+}
+
+static void CollectHttp2Header(void* arg, const std::string& name, const std::string& value)
+{
+    std::string* out = (std::string*)arg;
+
+    *out += name + ": " + value + "\n";
+}
+
+// read frames until every stream asked for ends, headers and body of each are collected.
+static bool ReadHttp2Responses(int fd, HpackDecoder& decoder, std::map<uint32_t, std::string>* headers,
+        std::map<uint32_t, std::string>* bodies, size_t streams)
+{
+    size_t ended = 0;
+
+    while (ended < streams)
+    {
+        Http2Frame frame;
+        if (!ReadHttp2Frame(fd, &frame)) return false;
+
+        if (frame.type_ == Http2Session::H2F_HEADERS)
+        {
+            if (!decoder.Decode(frame.payload_.data(), frame.payload_.size(), &CollectHttp2Header, &(*headers)[frame.id_])) return false;
+        }
+        else if (frame.type_ == Http2Session::H2F_DATA)
+        {
+            (*bodies)[frame.id_] += frame.payload_;
+        }
+        else
+        {
+            continue;
+        }
+
+        if (frame.flags_ & Http2Session::H2FL_END_STREAM) ++ended;
+    }
+
+    return true;
+}
+
+static const char HTTP2_CLIENT_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+TEST(HttpServerTest, Http2Test)
+{
+    HttpServer server;
+    server.SetHttpHandler(&StreamRequestHandler);
+    server.SetHeartbeat(20000);
+    server.AddEntity("/static.txt", new HttpEntity("static content", 14, "text/plain", 784111777));
+
+    HttpServerThread thread(server);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    // prior knowledge, two streams in one write.
+    HpackEncoder encoder;
+    std::string one, two;
+
+    encoder.Encode(":method", "GET", &one);
+    encoder.Encode(":scheme", "http", &one);
+    encoder.Encode(":path", "/static.txt", &one);
+    encoder.Encode(":authority", "localhost", &one);
+
+    encoder.Encode(":method", "GET", &two);
+    encoder.Encode(":scheme", "http", &two);
+    encoder.Encode(":path", "/none", &two);
+    encoder.Encode(":authority", "localhost", &two);
+
+    const int flags = Http2Session::H2FL_END_HEADERS | Http2Session::H2FL_END_STREAM;
+
+    std::string req = std::string(HTTP2_CLIENT_PREFACE) + MakeHttp2Frame(Http2Session::H2F_SETTINGS, 0, 0, "")
+        + MakeHttp2Frame(Http2Session::H2F_HEADERS, flags, 1, one)
+        + MakeHttp2Frame(Http2Session::H2F_HEADERS, flags, 3, two);
+
+    ASSERT_EQ((int)req.size(), write(fd, req.data(), req.size()));
+
+    Http2Frame frame;
+    ASSERT_TRUE(ReadHttp2Frame(fd, &frame));
+    EXPECT_EQ(Http2Session::H2F_SETTINGS, frame.type_);
+
+    HpackDecoder decoder;
+    std::map<uint32_t, std::string> headers;
+    std::map<uint32_t, std::string> bodies;
+
+    ASSERT_TRUE(ReadHttp2Responses(fd, decoder, &headers, &bodies, 2));
+
+    EXPECT_EQ(0u, headers[1].find(":status: 200\n"));
+    EXPECT_NE(std::string::npos, headers[1].find("content-length: 14\n"));
+    EXPECT_EQ("static content", bodies[1]);
+
+    EXPECT_EQ(0u, headers[3].find(":status: 404\n"));
+    EXPECT_EQ("", bodies[3]);
+
+    // peer going away closes the connection.
+    std::string bye = MakeHttp2Frame(Http2Session::H2F_GOAWAY, 0, 0, std::string(8, '\0'));
+    ASSERT_EQ((int)bye.size(), write(fd, bye.data(), bye.size()));
+
+    while (ReadHttp2Frame(fd, &frame)) {}
+
+    close(fd);
+
+    thread.Stop();
+}
+
+TEST(HttpServerTest, Http2UpgradeTest)
+{
+    HttpServer server;
+    server.SetHttpHandler(&StreamRequestHandler);
+    server.SetHeartbeat(20000);
+    server.AddEntity("/static.txt", new HttpEntity("static content", 14, "text/plain", 784111777));
+
+    HttpServerThread thread(server);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    // upgrade headers not listed in Connection may come from a proxy, http/1 answers.
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    const char unlisted[] = "GET /static.txt HTTP/1.1\r\nHost: localhost\r\n"
+        "Connection: Upgrade\r\nUpgrade: h2c\r\nHTTP2-Settings: AAMAAABkAARAAAAA\r\n\r\n";
+
+    ASSERT_EQ((int)sizeof(unlisted) - 1, write(fd, unlisted, sizeof(unlisted) - 1));
+
+    std::string plain;
+    ASSERT_TRUE(ReadUntil(fd, "static content", &plain));
+    EXPECT_EQ(0u, plain.find("HTTP/1.1 200 OK\r\n"));
+
+    close(fd);
+
+    fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    const char upgrade[] = "GET /static.txt HTTP/1.1\r\nHost: localhost\r\n"
+        "Connection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\nHTTP2-Settings: AAMAAABkAARAAAAA\r\n\r\n";
+
+    ASSERT_EQ((int)sizeof(upgrade) - 1, write(fd, upgrade, sizeof(upgrade) - 1));
+
+    std::string resp;
+    ASSERT_TRUE(ReadUntil(fd, "\r\n\r\n", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 101 Switching Protocols\r\n"));
+
+    std::string req = std::string(HTTP2_CLIENT_PREFACE) + MakeHttp2Frame(Http2Session::H2F_SETTINGS, 0, 0, "");
+    ASSERT_EQ((int)req.size(), write(fd, req.data(), req.size()));
+
+    // request of upgrade is answered on stream 1.
+    HpackDecoder decoder;
+    std::map<uint32_t, std::string> headers;
+    std::map<uint32_t, std::string> bodies;
+
+    ASSERT_TRUE(ReadHttp2Responses(fd, decoder, &headers, &bodies, 1));
+
+    EXPECT_EQ(0u, headers[1].find(":status: 200\n"));
+    EXPECT_EQ("static content", bodies[1]);
+
+    close(fd);
+
+    thread.Stop();
+}
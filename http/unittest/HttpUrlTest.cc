@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include "http/HttpUrl.h"
+#include "http/HttpArena.h"
+#include "http/HttpRequest.h"
+
+#include <string>
+#include <string.h>
+
+static std::string Str(const HttpStrRef& ref)
+{
+    return ref.ToString();
+}
+
+TEST(HttpUrlTest, ParseTest)
+{
+    HttpUrl url;
+
+    // long enough for the vector loops, separators at various offsets.
+    std::string target = "/static/images/2024/a-very-long-file-name.png?w=100&h=20&fit=crop#top";
+    ASSERT_TRUE(url.Parse(target.data(), target.size()));
+
+    EXPECT_EQ("/static/images/2024/a-very-long-file-name.png", Str(url.GetPath()));
+    EXPECT_EQ("w=100&h=20&fit=crop", Str(url.GetQuery()));
+    EXPECT_EQ("top", Str(url.GetFragment()));
+
+    // view of the target, nothing copied.
+    EXPECT_EQ(target.data(), url.GetPath().data_);
+    EXPECT_EQ(target.data() + target.find('?') + 1, url.GetQuery().data_);
+
+    ASSERT_TRUE(url.Parse("/a?b?c=d", 8));
+    EXPECT_EQ("/a", Str(url.GetPath()));
+    EXPECT_EQ("b?c=d", Str(url.GetQuery()));
+
+    ASSERT_TRUE(url.Parse("http://example.com:8080/x/y?z", 29));
+    EXPECT_EQ("/x/y", Str(url.GetPath()));
+    EXPECT_EQ("z", Str(url.GetQuery()));
+
+    ASSERT_TRUE(url.Parse("http://example.com", 18));
+    EXPECT_EQ("/", Str(url.GetPath()));
+
+    ASSERT_TRUE(url.Parse("*", 1));
+    EXPECT_EQ("*", Str(url.GetPath()));
+
+    // bytes above 0x7f are let through.
+    ASSERT_TRUE(url.Parse("/caf\xc3\xa9", 6));
+
+    const char* bad[] = { "", "/a b", "/abcdefghijklmnopqrstuvwxyz\x01", "/a?b\tc", "/a#b\x7f", "relative/path" };
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); ++i)
+    {
+        EXPECT_FALSE(url.Parse(bad[i], strlen(bad[i]))) << i;
+        EXPECT_FALSE(url.IsSet());
+    }
+}
+
+TEST(HttpUrlTest, QueryTest)
+{
+    HttpUrl url;
+
+    const char target[] = "/s?q=a%20b+c&&flag&empty=&q=second&k=v=w";
+    ASSERT_TRUE(url.Parse(target, sizeof(target) - 1));
+
+    const char* keys[] = { "q", "flag", "empty", "q", "k" };
+    const char* values[] = { "a%20b+c", "", "", "second", "v=w" };
+
+    HttpStrRef key, value;
+    HttpQueryIterator it = url.GetQueryIterator();
+
+    int num = 0;
+    while (it.Next(&key, &value))
+    {
+        ASSERT_LT(num, 5);
+        EXPECT_EQ(keys[num], Str(key));
+        EXPECT_EQ(values[num], Str(value));
+        ++num;
+    }
+
+    EXPECT_EQ(5, num);
+
+    EXPECT_TRUE(url.FindParam("q", &value));
+    EXPECT_EQ("a%20b+c", Str(value));
+    EXPECT_FALSE(url.FindParam("none", &value));
+
+    HttpArena arena;
+    HttpRequest req;
+    req.SetArena(&arena);
+    ASSERT_TRUE(req.SetTarget(target, sizeof(target) - 1));
+
+    ASSERT_TRUE(req.GetQueryParam("q", &value));
+    EXPECT_EQ("a b c", Str(value));
+
+    // nothing to decode, raw bytes are returned.
+    size_t used = arena.GetUsed();
+    ASSERT_TRUE(req.GetQueryParam("k", &value));
+    EXPECT_EQ("v=w", Str(value));
+    EXPECT_EQ(used, arena.GetUsed());
+
+    // old accessors still work.
+    EXPECT_EQ("/s", req.GetUrl());
+    EXPECT_EQ(target + 3, req.GetUrlData());
+}
+
+TEST(HttpUrlTest, DecodeTest)
+{
+    char buf[64];
+
+    const char src[] = "%41%62c+d%2fe%2F0123456789abcdef";
+    EXPECT_EQ(24, HttpUrl::Decode(src, sizeof(src) - 1, buf, true));
+    EXPECT_EQ(0, memcmp(buf, "Abc d/e/0123456789abcdef", 24));
+
+    EXPECT_EQ(4, HttpUrl::Decode("a+b%7e", 6, buf, false));
+    EXPECT_EQ(0, memcmp(buf, "a+b~", 4));
+
+    // decoded in place.
+    char inplace[] = "x%25y";
+    EXPECT_EQ(3, HttpUrl::Decode(inplace, 5, inplace, false));
+    EXPECT_EQ(0, memcmp(inplace, "x%y", 3));
+
+    const char* bad[] = { "%", "ab%4", "%zz", "%00", "%0g" };
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); ++i)
+    {
+        EXPECT_EQ(-1, HttpUrl::Decode(bad[i], strlen(bad[i]), buf, true)) << bad[i];
+    }
+
+    // no arena to decode into.
+    HttpStrRef out;
+    EXPECT_TRUE(HttpUrl::Decode(NULL, HttpStrRef("abc", 3), true, &out));
+    EXPECT_FALSE(HttpUrl::Decode(NULL, HttpStrRef("a%20", 4), true, &out));
+}
+
+TEST(HttpUrlTest, NormalizeTest)
+{
+    struct
+    {
+        const char* path;
+        const char* expect;
+    } cases[] = {
+        { "/", "/" },
+        { "/a/b", "/a/b" },
+        { "//a///b//", "/a/b/" },
+        { "/a/./b/.", "/a/b/" },
+        { "/a/b/../c", "/a/c" },
+        { "/a/b/..", "/a/" },
+        { "/a/..", "/" },
+        { "/a/.../b", "/a/.../b" },
+        { "/.hidden/..x", "/.hidden/..x" },
+        { "/a/b/c/d/e/f/g/h/../../../../../../../x", "/a/x" },
+        { "/..", NULL },
+        { "/a/../..", NULL },
+    };
+
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); ++i)
+    {
+        char buf[64];
+        strcpy(buf, cases[i].path);
+
+        // in place, as the result is never longer.
+        int len = HttpUrl::NormalizePath(buf, strlen(buf), buf);
+
+        if (cases[i].expect == NULL)
+        {
+            EXPECT_EQ(-1, len) << cases[i].path;
+            continue;
+        }
+
+        ASSERT_LE(0, len) << cases[i].path;
+        EXPECT_EQ(cases[i].expect, std::string(buf, len)) << cases[i].path;
+    }
+
+    HttpArena arena;
+    HttpUrl url;
+    HttpStrRef path;
+
+    // clean path is returned as it is.
+    ASSERT_TRUE(url.Parse("/a/b.html?x", 11));
+    ASSERT_TRUE(url.GetNormalizedPath(&arena, &path));
+    EXPECT_EQ(url.GetPath().data_, path.data_);
+    EXPECT_EQ(0u, arena.GetUsed());
+
+    // encoded dots are decoded before normalizing, raw target is left alone.
+    const char target[] = "/a/%2e%2E/b//c";
+    ASSERT_TRUE(url.Parse(target, sizeof(target) - 1));
+    ASSERT_TRUE(url.GetNormalizedPath(&arena, &path));
+    EXPECT_EQ("/b/c", Str(path));
+    EXPECT_EQ("/a/%2e%2E/b//c", Str(url.GetPath()));
+
+    ASSERT_TRUE(url.Parse("/x/%2e%2e/..", 12));
+    EXPECT_FALSE(url.GetNormalizedPath(&arena, &path));
+}
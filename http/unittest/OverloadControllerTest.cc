@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "http/OverloadController.h"
+
+static OverloadController::Config MakeConfig()
+{
+    OverloadController::Config config;
+
+    config.maxLoopLag = 1000;
+    config.maxPendingWrite = 1024;
+    config.maxHandlerLatency = 1000;
+    config.maxConnection = 100;
+    config.shedRange = 1.0;
+
+    return config;
+}
+
+static int AdmitNum(OverloadController& ctrl, int num)
+{
+    int admitted = 0;
+    for (int i = 0; i < num; ++i)
+    {
+        if (ctrl.Admit() == OverloadController::OD_ADMIT) ++admitted;
+    }
+
+    return admitted;
+}
+
+TEST(OverloadControllerTest, IdleTest)
+{
+    OverloadController ctrl(MakeConfig());
+
+    EXPECT_DOUBLE_EQ(0, ctrl.GetPressure());
+    EXPECT_DOUBLE_EQ(1.0, ctrl.GetAdmitRatio());
+    EXPECT_FALSE(ctrl.ShouldPauseAccept());
+
+    EXPECT_EQ(100, AdmitNum(ctrl, 100));
+    EXPECT_EQ(100, ctrl.GetAdmitted());
+    EXPECT_EQ(0, ctrl.GetShed());
+}
+
+TEST(OverloadControllerTest, GradualShedTest)
+{
+    OverloadController ctrl(MakeConfig());
+
+    // half way into shed range.
+    ctrl.AddPendingWrite(1536);
+
+    EXPECT_DOUBLE_EQ(1.5, ctrl.GetPressure());
+    EXPECT_DOUBLE_EQ(0.5, ctrl.GetAdmitRatio());
+    EXPECT_FALSE(ctrl.ShouldPauseAccept());
+
+    EXPECT_EQ(50, AdmitNum(ctrl, 100));
+    EXPECT_EQ(50, ctrl.GetShed());
+
+    // shed connections are answered with 503 by default.
+    ctrl.AddPendingWrite(1024);
+    EXPECT_DOUBLE_EQ(0, ctrl.GetAdmitRatio());
+    EXPECT_TRUE(ctrl.ShouldPauseAccept());
+    EXPECT_EQ(OverloadController::OD_REJECT, ctrl.Admit());
+
+    ctrl.AddPendingWrite(-2560);
+    EXPECT_EQ(0, ctrl.GetPendingWrite());
+    EXPECT_DOUBLE_EQ(1.0, ctrl.GetAdmitRatio());
+
+    OverloadController::Config config = MakeConfig();
+    config.reject503 = false;
+    config.allowPause = false;
+
+    ctrl.SetConfig(config);
+    ctrl.SetConnection(300);
+
+    EXPECT_FALSE(ctrl.ShouldPauseAccept());
+    EXPECT_EQ(OverloadController::OD_DROP, ctrl.Admit());
+}
+
+TEST(OverloadControllerTest, LatencyDecayTest)
+{
+    OverloadController ctrl(MakeConfig());
+
+    for (int i = 0; i < 100; ++i)
+    {
+        ctrl.RecordLoopLag(3000);
+        ctrl.RecordHandlerLatency(2500);
+    }
+
+    EXPECT_NEAR(3.0, ctrl.GetPressure(), 0.01);
+    EXPECT_TRUE(ctrl.ShouldPauseAccept());
+
+    // loop goes idle, old samples fade out.
+    for (int i = 0; i < 100; ++i) ctrl.Tick();
+
+    EXPECT_DOUBLE_EQ(0, ctrl.GetPressure());
+    EXPECT_FALSE(ctrl.ShouldPauseAccept());
+}
@@ -0,0 +1,260 @@
+#include <gtest/gtest.h>
+
+#include "http/RpcChannel.h"
+
+#include <string>
+#include <vector>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+TEST(RpcChannelTest, VarintTest)
+{
+    const uint64_t vals[] = { 0, 1, 127, 128, 300, 16383, 16384, 0xffffffffull, 0xffffffffffffffffull };
+    const int lens[] = { 1, 1, 1, 2, 2, 2, 3, 5, 10 };
+
+    for (size_t i = 0; i < sizeof(vals)/sizeof(vals[0]); ++i)
+    {
+        char buf[10];
+        ASSERT_EQ(lens[i], RpcChannel::EncodeVarint(vals[i], buf));
+
+        uint64_t val = 0;
+        EXPECT_EQ(lens[i], RpcChannel::DecodeVarint(buf, lens[i], &val));
+        EXPECT_EQ(vals[i], val);
+
+        // short of the last byte.
+        EXPECT_EQ(0, RpcChannel::DecodeVarint(buf, lens[i] - 1, &val));
+    }
+
+    uint64_t val = 0;
+    EXPECT_EQ(2, RpcChannel::DecodeVarint("\xac\x02\x7f", 3, &val));
+    EXPECT_EQ(300u, val);
+
+    // longer than 10 bytes, and beyond 64 bits.
+    EXPECT_EQ(-1, RpcChannel::DecodeVarint("\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 11, &val));
+    EXPECT_EQ(-1, RpcChannel::DecodeVarint("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x02", 10, &val));
+}
+
+// echo "re:" + payload, fail "fail", close on "close".
+static void EchoHandler(void* arg, RpcChannel* channel, const RpcMessage& msg)
+{
+    int* notified = (int*)arg;
+    std::string data(msg.data_, msg.size_);
+
+    if (msg.type_ == RMT_NOTIFY)
+    {
+        ++*notified;
+        return;
+    }
+
+    if (data == "fail") channel->ReplyError(msg.id_, "failed", 6);
+    else if (data == "close") channel->Close();
+    else channel->Reply(msg.id_, ("re:" + data).data(), data.size() + 3);
+}
+
+struct CallResult
+{
+    CallResult(): status(-1), id(0) {}
+
+    int status;
+    uint64_t id;
+    std::string data;
+};
+
+static void CollectReply(void* arg, int status, const RpcMessage& reply)
+{
+    CallResult* result = (CallResult*)arg;
+
+    result->status = status;
+    result->id = reply.id_;
+    if (reply.data_) result->data.assign(reply.data_, reply.size_);
+}
+
+struct RpcPair
+{
+    RpcPair(): client(NULL), server(NULL), connected(false), closed(false) {}
+
+    SocketConnection* client;
+    SocketConnection* server;
+
+    RpcChannel clientChannel;
+    RpcChannel serverChannel;
+
+    bool connected;
+    bool closed;
+};
+
+static void PollPair(SocketServer& server, RpcPair& pair)
+{
+    SocketEvent evt;
+    server.RunPoll(&evt);
+
+    if (evt.code == SC_ACCEPTED)
+    {
+        pair.server = evt.conn;
+        pair.serverChannel.ResetChannel(evt.conn);
+    }
+    else if (evt.code == SC_CONNECTED && evt.conn == pair.client)
+    {
+        pair.connected = true;
+    }
+    else if (evt.code == SC_READ || evt.code == SC_WRITE)
+    {
+        RpcChannel* channel = evt.conn == pair.client? &pair.clientChannel : &pair.serverChannel;
+
+        if (channel->ProcessEvent(evt) < 0 && channel == &pair.clientChannel) pair.closed = true;
+    }
+}
+
+static bool SetupPair(SocketServer& server, RpcPair& pair)
+{
+    server.SetWatchAcceptedSock(true);
+
+    int listen_fd = ListenTo("127.0.0.1", 0);
+    if (listen_fd < 0) return false;
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(listen_fd, (struct sockaddr*)&addr, &len) != 0) return false;
+    if (!server.WatchRawSocket(listen_fd, true)) return false;
+
+    pair.client = server.ConnectTo("127.0.0.1", ntohs(addr.sin_port));
+    if (pair.client == NULL) return false;
+
+    pair.connected = pair.client->IsConnected();
+    pair.clientChannel.ResetChannel(pair.client);
+
+    while (!pair.connected || pair.server == NULL) PollPair(server, pair);
+
+    return true;
+}
+
+TEST(RpcChannelTest, CallTest)
+{
+    SocketServer server;
+    RpcPair pair;
+    ASSERT_TRUE(SetupPair(server, pair));
+
+    int notified = 0;
+    pair.serverChannel.SetRequestHandler(&EchoHandler, &notified);
+
+    // calls queued are flushed by one write, replies of them too.
+    const int num = 200;
+    std::vector<CallResult> results(num + 2);
+
+    for (int i = 0; i < num; ++i)
+    {
+        char data[32];
+        int len = snprintf(data, sizeof(data), "call %d", i);
+
+        ASSERT_EQ((uint64_t)i + 1, pair.clientChannel.Call(data, len, &CollectReply, &results[i]));
+    }
+
+    ASSERT_TRUE(pair.clientChannel.Notify("ping", 4));
+    ASSERT_NE(0u, pair.clientChannel.Call("fail", 4, &CollectReply, &results[num]));
+
+    // larger than read buffer, which grows to hold it.
+    std::string large(1024*1024, 'x');
+    for (size_t i = 0; i < large.size(); i += 1000) large[i] = (char)('a' + i % 26);
+
+    ASSERT_NE(0u, pair.clientChannel.Call(large.data(), large.size(), &CollectReply, &results[num + 1]));
+
+    EXPECT_EQ(num + 2, pair.clientChannel.GetPendingCalls());
+    ASSERT_LT(0, pair.clientChannel.Flush());
+
+    while (pair.clientChannel.GetPendingCalls() > 0) PollPair(server, pair);
+
+    for (int i = 0; i < num; ++i)
+    {
+        char data[32];
+        snprintf(data, sizeof(data), "re:call %d", i);
+
+        EXPECT_EQ(RS_OK, results[i].status);
+        EXPECT_EQ((uint64_t)i + 1, results[i].id);
+        EXPECT_EQ(data, results[i].data);
+    }
+
+    EXPECT_EQ(RS_ERROR, results[num].status);
+    EXPECT_EQ("failed", results[num].data);
+
+    EXPECT_EQ(RS_OK, results[num + 1].status);
+    EXPECT_TRUE(results[num + 1].data == "re:" + large);
+
+    EXPECT_EQ(1, notified);
+
+    const RpcStats& stats = pair.clientChannel.GetStats();
+    EXPECT_EQ(num + 3, stats.sent);
+    EXPECT_EQ(num + 2, stats.received);
+
+    // frames of a flush share syscalls, rather than a write each.
+    EXPECT_GT(stats.sent / 4, stats.writes);
+    EXPECT_GT(pair.serverChannel.GetStats().sent / 4, pair.serverChannel.GetStats().writes);
+
+    EXPECT_EQ(0, pair.clientChannel.GetPendingWriteSize());
+    EXPECT_EQ(0, pair.serverChannel.GetPendingWriteSize());
+}
+
+TEST(RpcChannelTest, CloseTest)
+{
+    SocketServer server;
+    RpcPair pair;
+    ASSERT_TRUE(SetupPair(server, pair));
+
+    int notified = 0;
+    pair.serverChannel.SetRequestHandler(&EchoHandler, &notified);
+
+    // server closes the connection while request is being handled, calls fail.
+    CallResult first, second;
+    ASSERT_NE(0u, pair.clientChannel.Call("close", 5, &CollectReply, &first));
+    ASSERT_NE(0u, pair.clientChannel.Call("never", 5, &CollectReply, &second));
+    ASSERT_LT(0, pair.clientChannel.Flush());
+
+    while (!pair.closed) PollPair(server, pair);
+
+    EXPECT_TRUE(pair.serverChannel.IsClosed());
+    EXPECT_TRUE(pair.clientChannel.IsClosed());
+
+    EXPECT_EQ(RS_CLOSED, first.status);
+    EXPECT_EQ(RS_CLOSED, second.status);
+    EXPECT_EQ(0, pair.clientChannel.GetPendingCalls());
+
+    EXPECT_EQ(0u, pair.clientChannel.Call("late", 4, &CollectReply, &first));
+    EXPECT_FALSE(pair.clientChannel.Notify("late", 4));
+}
+
+TEST(RpcChannelTest, MalformedTest)
+{
+    SocketServer server;
+    RpcPair pair;
+    ASSERT_TRUE(SetupPair(server, pair));
+
+    pair.clientChannel.SetMaxFrameSize(1024);
+    pair.serverChannel.SetMaxFrameSize(1024);
+
+    // frame beyond the limit is refused by sender, and closes the connection on receiver.
+    std::string large(2048, 'x');
+    EXPECT_EQ(0u, pair.clientChannel.Call(large.data(), large.size(), &CollectReply, NULL));
+
+    // request without handler is answered by an error.
+    CallResult result;
+    ASSERT_NE(0u, pair.clientChannel.Call("before", 6, &CollectReply, &result));
+    ASSERT_LT(0, pair.clientChannel.Flush());
+
+    while (result.status < 0) PollPair(server, pair);
+
+    EXPECT_EQ(RS_ERROR, result.status);
+    EXPECT_EQ("no handler", result.data);
+
+    char head[10];
+    int len = RpcChannel::EncodeVarint(large.size(), head);
+
+    ASSERT_EQ(len, pair.client->SendBuffer(head, len));
+    ASSERT_EQ((int)large.size(), pair.client->SendBuffer(large.data(), large.size()));
+
+    while (!pair.closed) PollPair(server, pair);
+
+    EXPECT_TRUE(pair.serverChannel.IsClosed());
+}
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <semaphore.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -254,3 +255,47 @@ TEST(TestWrite, SocketPollTest)
 }
 
 
+
+TEST(SocketPollTest, BusyPollTest)
+{
+    SocketPoll poll;
+    poll.SetBusyPoll(50*1000);
+
+    int fd[2];
+    ASSERT_EQ(0, pipe(fd));
+
+    TestData data;
+    data.fd = fd[0];
+    ASSERT_TRUE(poll.AddSocket(fd[0], &data));
+    ASSERT_EQ(1, write(fd[1], "b", 1));
+
+    // no budget yet, blocks and returns at once, budget grows.
+    PollEvent events[4];
+    ASSERT_EQ(1, poll.WaitAll(events, 4));
+    EXPECT_EQ(0u, poll.GetPollStats().spinHits);
+    EXPECT_EQ(1u, poll.GetPollStats().sleeps);
+    EXPECT_LT(0, poll.GetPollStats().budget);
+
+    // caught by spinning.
+    ASSERT_TRUE(poll.ModifySocket(fd[0], &data));
+    ASSERT_EQ(1, poll.WaitAll(events, 4));
+    EXPECT_EQ(1u, poll.GetPollStats().spinHits);
+    EXPECT_EQ(1u, poll.GetPollStats().sleeps);
+
+    // idle longer than max spin, budget shrinks to nothing.
+    char c;
+    ASSERT_EQ(1, read(fd[0], &c, 1));
+    ASSERT_TRUE(poll.ModifySocket(fd[0], &data));
+    EXPECT_EQ(0, poll.WaitAll(events, 4, 100));
+    EXPECT_LE(2u, poll.GetPollStats().sleeps);
+    EXPECT_EQ(0, poll.GetPollStats().budget);
+    EXPECT_LE(1000 * 100 - 1000 - poll.GetPollStats().spinTime, poll.GetPollStats().sleepTime);
+
+    // no spinning with timeout of 0.
+    uint64_t sleeps = poll.GetPollStats().sleeps;
+    EXPECT_EQ(0, poll.WaitAll(events, 4, 0));
+    EXPECT_EQ(sleeps, poll.GetPollStats().sleeps);
+
+    close(fd[0]);
+    close(fd[1]);
+}
@@ -0,0 +1,423 @@
+#include <gtest/gtest.h>
+
+#include "thread/Thread.h"
+#include "http/HttpServer.h"
+#include "http/SocketTls.h"
+
+#include <string>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+// files of its own for each run, removed at exit.
+static char TLS_CERT_FILE[] = "/tmp/socket_tls_test_cert_XXXXXX";
+static char TLS_KEY_FILE[] = "/tmp/socket_tls_test_key_XXXXXX";
+
+static void RemoveCertificate()
+{
+    unlink(TLS_CERT_FILE);
+    unlink(TLS_KEY_FILE);
+}
+
+static FILE* CreateTempFile(char* path)
+{
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+
+    FILE* file = fdopen(fd, "w");
+    if (file == NULL) close(fd);
+
+    return file;
+}
+
+// self signed certificate of localhost, written once per run.
+static bool MakeCertificate()
+{
+    static int done = 0;
+    if (done) return done > 0;
+
+    done = -1;
+
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    if (key == NULL || cert == NULL) return false;
+
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    FILE* cf = CreateTempFile(TLS_CERT_FILE);
+    FILE* kf = CreateTempFile(TLS_KEY_FILE);
+
+    atexit(&RemoveCertificate);
+
+    if (X509_sign(cert, key, EVP_sha256()) > 0 && cf && kf
+            && PEM_write_X509(cf, cert) == 1 && PEM_write_PrivateKey(kf, key, NULL, NULL, 0, NULL, NULL) == 1)
+    {
+        done = 1;
+    }
+
+    if (cf) fclose(cf);
+    if (kf) fclose(kf);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    return done > 0;
+}
+
+class HttpsServerThread: public ThreadBase
+{
+    public:
+
+        HttpsServerThread(HttpServer& server, TlsContext& ctx)
+            :m_server(server), m_port(-1)
+        {
+            int fd = ListenTo("127.0.0.1", 0);
+
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            if (getsockname(fd, (struct sockaddr*)&addr, &len) == 0) m_port = ntohs(addr.sin_port);
+
+            m_server.SetTlsContext(&ctx);
+            m_server.SetListenSock(fd);
+        }
+
+        int GetPort() const { return m_port; }
+
+        // heartbeat timer wakes up the poller.
+        void Stop()
+        {
+            m_server.SetStop();
+            Join();
+        }
+
+        virtual void Run()
+        {
+            m_server.RunServer();
+        }
+
+    private:
+
+        HttpServer& m_server;
+        int m_port;
+};
+
+static int ConnectServer(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct timeval tv = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// blocking client connection, session is resumed if given.
+static SSL* ConnectTls(SSL_CTX* ctx, int port, SSL_SESSION* session = NULL)
+{
+    int fd = ConnectServer(port);
+    if (fd < 0) return NULL;
+
+    SSL* ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    SSL_set_tlsext_host_name(ssl, "localhost");
+
+    if (session) SSL_set_session(ssl, session);
+
+    if (SSL_connect(ssl) != 1)
+    {
+        SSL_free(ssl);
+        close(fd);
+        return NULL;
+    }
+
+    return ssl;
+}
+
+static void CloseTls(SSL* ssl)
+{
+    int fd = SSL_get_fd(ssl);
+
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+}
+
+static bool WriteTls(SSL* ssl, const std::string& data)
+{
+    return SSL_write(ssl, data.data(), data.size()) == (int)data.size();
+}
+
+// read until data ends with delim, bytes read are appended to out.
+static bool ReadTlsUntil(SSL* ssl, const char* delim, std::string* out)
+{
+    size_t len = strlen(delim);
+
+    while (out->size() < len || out->compare(out->size() - len, len, delim) != 0)
+    {
+        char c;
+        int n = SSL_read(ssl, &c, 1);
+        if (n <= 0) return false;
+
+        out->push_back(c);
+    }
+
+    return true;
+}
+
+static bool ReadTlsFull(SSL* ssl, size_t len, std::string* out)
+{
+    while (out->size() < len)
+    {
+        char buf[16384];
+        int n = SSL_read(ssl, buf, std::min(sizeof(buf), len - out->size()));
+        if (n <= 0) return false;
+
+        out->append(buf, n);
+    }
+
+    return true;
+}
+
+TEST(SocketTlsTest, ContextTest)
+{
+    ASSERT_TRUE(MakeCertificate());
+
+    TlsContext ctx;
+    ASSERT_TRUE(ctx.GetContext() != NULL);
+
+    std::string none = std::string(TLS_CERT_FILE) + ".none";
+    EXPECT_FALSE(ctx.LoadCertificate(none.c_str(), TLS_KEY_FILE));
+    EXPECT_FALSE(ctx.LoadCertificate(TLS_KEY_FILE, TLS_KEY_FILE));
+    EXPECT_TRUE(ctx.LoadCertificate(TLS_CERT_FILE, TLS_KEY_FILE));
+
+    unsigned char key[80];
+    memset(key, 7, sizeof(key));
+
+    EXPECT_FALSE(ctx.SetTicketKey(key, 48));
+    EXPECT_TRUE(ctx.SetTicketKey(key, sizeof(key)));
+
+    EXPECT_TRUE(ctx.SetAlpn("h2,http/1.1"));
+    EXPECT_FALSE(ctx.SetAlpn("h2,,http/1.1"));
+    EXPECT_FALSE(ctx.SetAlpn(std::string(256, 'x').c_str()));
+    EXPECT_TRUE(ctx.SetAlpn(""));
+
+    TlsStats stats = ctx.GetStats();
+    EXPECT_EQ(0, stats.handshakes);
+    EXPECT_EQ(0, stats.failures);
+}
+
+static const char* gs_body = "static content";
+
+TEST(SocketTlsTest, HttpsTest)
+{
+    ASSERT_TRUE(MakeCertificate());
+
+    TlsContext ctx;
+    ASSERT_TRUE(ctx.LoadCertificate(TLS_CERT_FILE, TLS_KEY_FILE));
+    ASSERT_TRUE(ctx.SetAlpn("h2,http/1.1"));
+
+    // large enough to fill socket buffer, sending goes on as socket is writable.
+    std::string large(4*1024*1024, 'a');
+    for (size_t i = 0; i < large.size(); i += 4096) large[i] = (char)('a' + i % 26);
+
+    HttpServer server;
+    server.SetHeartbeat(20000);
+    server.AddEntity("/static.txt", new HttpEntity(gs_body, strlen(gs_body), "text/plain", 784111777));
+    server.AddEntity("/large.bin", new HttpEntity(large.data(), large.size(), "application/octet-stream", 784111777));
+
+    HttpsServerThread thread(server, ctx);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    SSL_CTX* client = SSL_CTX_new(TLS_client_method());
+    ASSERT_TRUE(client != NULL);
+
+    SSL_CTX_set_session_cache_mode(client, SSL_SESS_CACHE_CLIENT);
+
+    SSL* ssl = ConnectTls(client, thread.GetPort());
+    ASSERT_TRUE(ssl != NULL);
+    EXPECT_FALSE(SSL_session_reused(ssl));
+
+    // pipelined requests in one record.
+    ASSERT_TRUE(WriteTls(ssl, "GET /static.txt HTTP/1.1\r\n\r\nGET /static.txt HTTP/1.1\r\nRange: bytes=7-\r\n\r\n"));
+
+    std::string resp;
+    ASSERT_TRUE(ReadTlsUntil(ssl, "static content", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+
+    resp.clear();
+    ASSERT_TRUE(ReadTlsUntil(ssl, "\r\n\r\ncontent", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 206 Partial Content\r\n"));
+
+    ASSERT_TRUE(WriteTls(ssl, "GET /large.bin HTTP/1.1\r\n\r\n"));
+
+    resp.clear();
+    ASSERT_TRUE(ReadTlsUntil(ssl, "\r\n\r\n", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+
+    resp.clear();
+    ASSERT_TRUE(ReadTlsFull(ssl, large.size(), &resp));
+    EXPECT_TRUE(resp == large);
+
+    // tls 1.3 tickets arrive after handshake, they are read with the responses.
+    SSL_SESSION* session = SSL_get1_session(ssl);
+    ASSERT_TRUE(session != NULL);
+
+    CloseTls(ssl);
+
+    ssl = ConnectTls(client, thread.GetPort(), session);
+    ASSERT_TRUE(ssl != NULL);
+    EXPECT_TRUE(SSL_session_reused(ssl));
+
+    ASSERT_TRUE(WriteTls(ssl, "GET /static.txt HTTP/1.1\r\n\r\n"));
+
+    resp.clear();
+    ASSERT_TRUE(ReadTlsUntil(ssl, "static content", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+
+    CloseTls(ssl);
+    SSL_SESSION_free(session);
+
+    // http/2 is negotiated, server speaks first by its settings.
+    const unsigned char alpn[] = "\x02h2\x08http/1.1";
+    SSL_CTX_set_alpn_protos(client, alpn, sizeof(alpn) - 1);
+
+    ssl = ConnectTls(client, thread.GetPort());
+    ASSERT_TRUE(ssl != NULL);
+
+    const unsigned char* proto = NULL;
+    unsigned int protoLen = 0;
+    SSL_get0_alpn_selected(ssl, &proto, &protoLen);
+    ASSERT_EQ(2u, protoLen);
+    EXPECT_EQ(0, memcmp(proto, "h2", 2));
+
+    ASSERT_TRUE(WriteTls(ssl, std::string("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n") + std::string("\x00\x00\x00\x04\x00\x00\x00\x00\x00", 9)));
+
+    resp.clear();
+    ASSERT_TRUE(ReadTlsFull(ssl, 9, &resp));
+    EXPECT_EQ(4, resp[3]);
+    EXPECT_EQ(0, resp[4]);
+
+    CloseTls(ssl);
+
+    // plain text is not a handshake, connection is closed.
+    int fd = ConnectServer(thread.GetPort());
+    ASSERT_LE(0, fd);
+
+    const char plain[] = "GET /static.txt HTTP/1.1\r\n\r\n";
+    ASSERT_EQ((int)sizeof(plain) - 1, write(fd, plain, sizeof(plain) - 1));
+
+    // an alert may come first, unread request resets the connection.
+    char buf[256];
+    int n = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {}
+    EXPECT_TRUE(n == 0 || errno == ECONNRESET);
+
+    close(fd);
+
+    thread.Stop();
+
+    TlsStats stats = ctx.GetStats();
+    EXPECT_EQ(3, stats.handshakes);
+    EXPECT_EQ(1, stats.resumed);
+    EXPECT_EQ(1, stats.failures);
+    EXPECT_LE(0, stats.ktlsSend);
+
+    SSL_CTX_free(client);
+}
+
+TEST(SocketTlsTest, PeerGoneTest)
+{
+    ASSERT_TRUE(MakeCertificate());
+
+    struct sigaction before;
+    ASSERT_EQ(0, sigaction(SIGPIPE, NULL, &before));
+
+    TlsContext ctx;
+    ASSERT_TRUE(ctx.LoadCertificate(TLS_CERT_FILE, TLS_KEY_FILE));
+
+    // disposition of SIGPIPE is up to the application.
+    struct sigaction after;
+    ASSERT_EQ(0, sigaction(SIGPIPE, NULL, &after));
+    EXPECT_TRUE(before.sa_handler == after.sa_handler);
+
+    std::string large(4*1024*1024, 'p');
+
+    HttpServer server;
+    server.SetHeartbeat(20000);
+    server.AddEntity("/static.txt", new HttpEntity(gs_body, strlen(gs_body), "text/plain", 784111777));
+    server.AddEntity("/large.bin", new HttpEntity(large.data(), large.size(), "application/octet-stream", 784111777));
+
+    HttpsServerThread thread(server, ctx);
+    ASSERT_LT(0, thread.GetPort());
+
+    thread.Start();
+
+    SSL_CTX* client = SSL_CTX_new(TLS_client_method());
+    ASSERT_TRUE(client != NULL);
+
+    // peer leaves in the middle of a large response, server writes to a closed socket.
+    for (int i = 0; i < 3; ++i)
+    {
+        SSL* ssl = ConnectTls(client, thread.GetPort());
+        ASSERT_TRUE(ssl != NULL);
+
+        ASSERT_TRUE(WriteTls(ssl, "GET /large.bin HTTP/1.1\r\n\r\n"));
+
+        std::string resp;
+        ASSERT_TRUE(ReadTlsUntil(ssl, "\r\n\r\n", &resp));
+
+        int fd = SSL_get_fd(ssl);
+        SSL_free(ssl);
+        close(fd);
+    }
+
+    // server is still there.
+    SSL* ssl = ConnectTls(client, thread.GetPort());
+    ASSERT_TRUE(ssl != NULL);
+
+    ASSERT_TRUE(WriteTls(ssl, "GET /static.txt HTTP/1.1\r\n\r\n"));
+
+    std::string resp;
+    ASSERT_TRUE(ReadTlsUntil(ssl, "static content", &resp));
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+
+    CloseTls(ssl);
+
+    thread.Stop();
+
+    SSL_CTX_free(client);
+}
@@ -0,0 +1,45 @@
+#ifndef __HTTP_UNITTEST_TEST_UTIL_H__
+#define __HTTP_UNITTEST_TEST_UTIL_H__
+
+// helpers shared by tests that run their own stand-in peers.
+
+#include <string>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// port a tcp socket is bound to, -1 on failure.
+static inline int GetLocalPort(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr*)&addr, &len) != 0) return -1;
+
+    return ntohs(addr.sin_port);
+}
+
+// write to a blocking socket, false if it fails before all is written.
+static inline bool WriteAll(int fd, const char* data, size_t sz)
+{
+    while (sz > 0)
+    {
+        int n = write(fd, data, sz);
+        if (n <= 0) return false;
+
+        data += n;
+        sz -= n;
+    }
+
+    return true;
+}
+
+// body handler of HttpMessageParser, arg is the std::string body is appended to.
+static inline void AppendBody(void* arg, const char* data, int len)
+{
+    ((std::string*)arg)->append(data, len);
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __MISC_MPSC_QUEUE_H_
+#define __MISC_MPSC_QUEUE_H_
+
+#include <stdlib.h>
+
+#include "sys/AtomicOps.h"
+#include "misc/NonCopyable.h"
+
+/*
+ * intrusive multiple producers, single consumer queue.
+ *
+ * Push() is wait free and can be called from any thread,
+ * Pop() must only be called from the consumer thread.
+ *
+ * nodes are owned by the user, embed MpscNode into the object and
+ * use container_of(sys/Defs.h) to get the object back.
+ *
+ * note:
+ * Pop() may return NULL while a producer is in the middle of Push(),
+ * consumer should be notified by the producer after Push() returns
+ * and try again then.
+ */
+
+struct MpscNode
+{
+    MpscNode* volatile next_;
+};
+
+class MpscQueue: public noncopyable
+{
+    public:
+
+        MpscQueue()
+            :head_(&stub_)
+            ,tail_(&stub_)
+        {
+            stub_.next_ = NULL;
+        }
+
+        ~MpscQueue() {}
+
+        void Push(MpscNode* node)
+        {
+            node->next_ = NULL;
+
+            MpscNode* prev = atomic_swap(&head_, node);
+            prev->next_ = node;
+        }
+
+        MpscNode* Pop()
+        {
+            MpscNode* tail = tail_;
+            MpscNode* next = tail->next_;
+
+            if (tail == &stub_)
+            {
+                if (next == NULL) return NULL;
+
+                tail_ = next;
+                tail  = next;
+                next  = next->next_;
+            }
+
+            if (next)
+            {
+                tail_ = next;
+                return tail;
+            }
+
+            // producer is linking a new node.
+            if (tail != head_) return NULL;
+
+            Push(&stub_);
+
+            next = tail->next_;
+            if (next == NULL) return NULL;
+
+            tail_ = next;
+            return tail;
+        }
+
+        bool IsEmpty() const
+        {
+            return tail_ == &stub_ && stub_.next_ == NULL;
+        }
+
+    private:
+
+        MpscNode* volatile head_;
+        MpscNode* tail_;
+        MpscNode stub_;
+};
+
+#endif // __MISC_MPSC_QUEUE_H_
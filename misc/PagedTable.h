@@ -0,0 +1,126 @@
+#ifndef __MISC_PAGED_TABLE_H_
+#define __MISC_PAGED_TABLE_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sys/AtomicOps.h"
+#include "misc/NonCopyable.h"
+
+/*
+ * two-level table indexed by a small integer(typically a file descriptor).
+ *
+ * only the directory is sized by capacity, pages of entries are allocated
+ * on first use by Alloc(). memory therefore grows with the ids actually in use
+ * instead of with the capacity(eg, RLIMIT_NOFILE).
+ *
+ * note:
+ * a) pages are never released before the table is destroyed, pointer returned by
+ *    Get()/Alloc() stays valid for the life time of the table.
+ * b) Alloc() must be called from a single thread(the owner),
+ *    Get() is safe to be called from other threads at the same time.
+ */
+
+template<class Type>
+class PagedTable: public noncopyable
+{
+    public:
+
+        typedef void (* InitProc)(Type*, void*);
+
+        explicit PagedTable(size_t capacity, size_t pageSize = 256, InitProc init = NULL, void* arg = NULL)
+            :capacity_(capacity)
+            ,shift_(CalcShift(pageSize))
+            ,pageSize_(((size_t)1) << shift_)
+            ,pageNum_((capacity + pageSize_ - 1) >> shift_)
+            ,allocated_(0)
+            ,init_(init)
+            ,arg_(arg)
+            ,pages_((Type* volatile*)calloc(pageNum_ ? pageNum_ : 1, sizeof(Type*)))
+        {
+        }
+
+        ~PagedTable()
+        {
+            for (size_t i = 0; i < pageNum_; ++i)
+            {
+                delete[] pages_[i];
+            }
+
+            free((void*)pages_);
+        }
+
+        // return NULL if id is out of range or the page holding it is not allocated yet.
+        Type* Get(size_t id) const
+        {
+            if (id >= capacity_) return NULL;
+
+            Type* page = pages_[id >> shift_];
+            if (page == NULL) return NULL;
+
+            return page + (id & (pageSize_ - 1));
+        }
+
+        // allocate the page holding id if necessary.
+        Type* Alloc(size_t id)
+        {
+            if (id >= capacity_) return NULL;
+
+            size_t index = id >> shift_;
+            Type* page = pages_[index];
+
+            if (page == NULL)
+            {
+                page = new Type[pageSize_]();
+
+                if (init_)
+                {
+                    for (size_t i = 0; i < pageSize_; ++i) init_(&page[i], arg_);
+                }
+
+                // publish the page only after it is fully initialized.
+                atomic_barrier();
+                pages_[index] = page;
+                ++allocated_;
+            }
+
+            return page + (id & (pageSize_ - 1));
+        }
+
+        // return NULL if page is not allocated.
+        Type* GetPage(size_t index) const
+        {
+            if (index >= pageNum_) return NULL;
+
+            return pages_[index];
+        }
+
+        size_t Capacity() const { return capacity_; }
+        size_t PageSize() const { return pageSize_; }
+        size_t PageNum() const { return pageNum_; }
+        size_t AllocatedPages() const { return allocated_; }
+
+    private:
+
+        static size_t CalcShift(size_t sz)
+        {
+            size_t shift = 0;
+            while ((((size_t)1) << shift) < sz) ++shift;
+
+            return shift;
+        }
+
+        const size_t capacity_;
+        const size_t shift_;
+        const size_t pageSize_;
+        const size_t pageNum_;
+
+        size_t allocated_;
+
+        InitProc init_;
+        void* arg_;
+
+        Type* volatile* pages_;
+};
+
+#endif // __MISC_PAGED_TABLE_H_
@@ -0,0 +1,113 @@
+#ifndef __MISC_TIMER_WHEEL_H_
+#define __MISC_TIMER_WHEEL_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "misc/NonCopyable.h"
+
+/*
+ * hashed timing wheel, for large number of coarse timers(eg, heartbeats of idle connections).
+ *
+ * time is in any unit the caller likes, as long as it is monotonic, a timer is hashed to
+ * the slot of its tick, timers longer than one revolution wait in the slot for their rounds.
+ *
+ * note:
+ * a) scheduling costs O(1), advancing costs O(timers in the slots passed).
+ * b) timers can't be cancelled, caller validates the value when it expires instead,
+ *    so values are better be handles rather than pointers.
+ * c) not thread safe.
+ */
+
+template<class Type>
+class TimerWheel: public noncopyable
+{
+    public:
+
+        // slots is rounded up to power of 2.
+        TimerWheel(int64_t tick, size_t slots, int64_t now)
+            :tick_(tick > 0? tick : 1)
+            ,mask_(RoundUp(slots) - 1)
+            ,current_(now / tick_)
+            ,size_(0)
+            ,slots_(mask_ + 1)
+        {
+        }
+
+        // timer already expired fires by next Advance().
+        void Schedule(const Type& val, int64_t expire)
+        {
+            int64_t tick = expire / tick_;
+            if (tick < current_) tick = current_;
+
+            TimerEntry entry = { expire, val };
+            slots_[tick & mask_].push_back(entry);
+
+            ++size_;
+        }
+
+        // move to now, append values of timers expired to out, return number of them.
+        size_t Advance(int64_t now, std::vector<Type>* out)
+        {
+            size_t num = 0;
+            int64_t target = now / tick_;
+
+            // a whole revolution visits every slot once.
+            int64_t first = current_;
+            if (target - first > (int64_t)mask_) first = target - mask_;
+
+            for (int64_t t = first; t <= target; ++t)
+            {
+                std::vector<TimerEntry>& slot = slots_[t & mask_];
+
+                size_t kept = 0;
+                for (size_t i = 0; i < slot.size(); ++i)
+                {
+                    if (slot[i].expire_ > now)
+                    {
+                        slot[kept++] = slot[i];
+                        continue;
+                    }
+
+                    out->push_back(slot[i].val_);
+                    ++num;
+                }
+
+                slot.resize(kept);
+            }
+
+            current_ = target;
+            size_ -= num;
+
+            return num;
+        }
+
+        size_t Size() const { return size_; }
+        int64_t GetTick() const { return tick_; }
+
+    private:
+
+        struct TimerEntry
+        {
+            int64_t expire_;
+            Type val_;
+        };
+
+        static size_t RoundUp(size_t sz)
+        {
+            size_t n = 1;
+            while (n < sz) n <<= 1;
+
+            return n;
+        }
+
+        const int64_t tick_;
+        const size_t mask_;
+
+        int64_t current_;
+        size_t size_;
+
+        std::vector<std::vector<TimerEntry> > slots_;
+};
+
+#endif // __MISC_TIMER_WHEEL_H_
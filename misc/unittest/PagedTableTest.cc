@@ -0,0 +1,78 @@
+#include "gtest/gtest.h"
+
+#include "PagedTable.h"
+
+struct PagedTableTestItem
+{
+    int id;
+    void* owner;
+};
+
+static void InitPagedTableTestItem(PagedTableTestItem* item, void* owner)
+{
+    item->id = -1;
+    item->owner = owner;
+}
+
+TEST(PagedTableTest, LazyAllocTest)
+{
+    int owner = 0;
+    const size_t capacity = 1024*1024;
+
+    PagedTable<PagedTableTestItem> table(capacity, 200, &InitPagedTableTestItem, &owner);
+
+    // page size is rounded up to power of 2.
+    EXPECT_EQ(256, table.PageSize());
+    EXPECT_EQ(capacity/256, table.PageNum());
+    EXPECT_EQ(0, table.AllocatedPages());
+
+    EXPECT_TRUE(table.Get(0) == NULL);
+    EXPECT_TRUE(table.Get(capacity - 1) == NULL);
+    EXPECT_TRUE(table.Get(capacity) == NULL);
+    EXPECT_TRUE(table.Alloc(capacity) == NULL);
+
+    PagedTableTestItem* item = table.Alloc(300);
+    ASSERT_TRUE(item != NULL);
+    EXPECT_EQ(1, table.AllocatedPages());
+    EXPECT_EQ(-1, item->id);
+    EXPECT_EQ(&owner, item->owner);
+
+    item->id = 300;
+
+    // same page, no more allocation.
+    EXPECT_EQ(item, table.Get(300));
+    EXPECT_EQ(item, table.Alloc(300));
+    EXPECT_TRUE(table.Get(257) != NULL);
+    EXPECT_EQ(1, table.AllocatedPages());
+
+    // other pages stay untouched.
+    EXPECT_TRUE(table.Get(255) == NULL);
+    EXPECT_TRUE(table.Get(512) == NULL);
+
+    PagedTableTestItem* last = table.Alloc(capacity - 1);
+    ASSERT_TRUE(last != NULL);
+    EXPECT_EQ(2, table.AllocatedPages());
+    EXPECT_EQ(last, table.GetPage(table.PageNum() - 1) + 255);
+
+    EXPECT_EQ(300, table.Get(300)->id);
+}
+
+TEST(PagedTableTest, PointerTableTest)
+{
+    PagedTable<int*> table(1000, 64);
+
+    EXPECT_EQ(16, table.PageNum());
+
+    int val = 0;
+    int** slot = table.Alloc(999);
+
+    ASSERT_TRUE(slot != NULL);
+    EXPECT_TRUE(*slot == NULL);
+
+    *slot = &val;
+    EXPECT_EQ(&val, *table.Get(999));
+
+    // value initialized.
+    EXPECT_TRUE(*table.Get(960) == NULL);
+    EXPECT_TRUE(table.Get(959) == NULL);
+}
@@ -0,0 +1,54 @@
+#include "gtest/gtest.h"
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+TEST(TimerWheelTest, ExpireTest)
+{
+    TimerWheel<int> wheel(10, 6, 1000);
+
+    std::vector<int> expired;
+
+    wheel.Schedule(1, 1005);
+    wheel.Schedule(2, 1025);
+    wheel.Schedule(3, 1200); // more than one revolution away.
+    wheel.Schedule(4, 500);  // expired already.
+    EXPECT_EQ(4, wheel.Size());
+
+    EXPECT_EQ(1, wheel.Advance(1000, &expired));
+    ASSERT_EQ(1, expired.size());
+    EXPECT_EQ(4, expired[0]);
+
+    expired.clear();
+    EXPECT_EQ(1, wheel.Advance(1010, &expired));
+    EXPECT_EQ(1, expired[0]);
+
+    // same slot as 3, but not its round yet.
+    expired.clear();
+    EXPECT_EQ(1, wheel.Advance(1080, &expired));
+    EXPECT_EQ(2, expired[0]);
+    EXPECT_EQ(1, wheel.Size());
+
+    expired.clear();
+    EXPECT_EQ(0, wheel.Advance(1199, &expired));
+    EXPECT_EQ(1, wheel.Advance(1200, &expired));
+    EXPECT_EQ(3, expired[0]);
+    EXPECT_EQ(0, wheel.Size());
+}
+
+TEST(TimerWheelTest, LongJumpTest)
+{
+    TimerWheel<int> wheel(1, 16, 0);
+
+    for (int i = 0; i < 100; ++i) wheel.Schedule(i, i * 7);
+
+    // jumping over many revolutions still visits every slot.
+    std::vector<int> expired;
+    EXPECT_EQ(100, wheel.Advance(10000, &expired));
+
+    std::sort(expired.begin(), expired.end());
+    for (int i = 0; i < 100; ++i) EXPECT_EQ(i, expired[i]);
+
+    EXPECT_EQ(0, wheel.Size());
+}
@@ -85,6 +85,9 @@ inline size_t atomic_decrement(volatile size_t* val)
 
 #endif // USING_CAS_TO_DO_INCREASE
 
+// store val to *ptr and return the old value.
+#define atomic_swap(ptr, val) __sync_lock_test_and_set(ptr, val)
+
 #if __GNUC__ < 4
 inline void atomic_barrier()
 {
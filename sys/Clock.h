@@ -0,0 +1,16 @@
+#ifndef __SYS_CLOCK_H__
+#define __SYS_CLOCK_H__
+
+#include <time.h>
+#include <stdint.h>
+
+// monotonic time in micro seconds, for measuring intervals.
+inline int64_t MonotonicMicroSec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif // __SYS_CLOCK_H__